@@ -0,0 +1,139 @@
+#include "AsyncGeometryBuilder.h"
+
+AsyncGeometryBuilder::AsyncGeometryBuilder(JobSystem& jobs) :
+    mJobs(jobs)
+{
+}
+
+AsyncGeometryBuilder::Request& AsyncGeometryBuilder::AddRequest(const std::string& name, Shape type)
+{
+    mRequests.emplace_back();
+    Request& r = mRequests.back();
+    r.Name = name;
+    r.Type = type;
+    return r;
+}
+
+void AsyncGeometryBuilder::AddBox(const std::string& name, float width, float height, float depth,
+    uint32 numSubdivisions)
+{
+    Request& r = AddRequest(name, Shape::Box);
+    r.Size[0] = width;
+    r.Size[1] = height;
+    r.Size[2] = depth;
+    r.Count[0] = numSubdivisions;
+}
+
+void AsyncGeometryBuilder::AddSphere(const std::string& name, float radius, uint32 sliceCount, uint32 stackCount)
+{
+    Request& r = AddRequest(name, Shape::Sphere);
+    r.Size[0] = radius;
+    r.Count[0] = sliceCount;
+    r.Count[1] = stackCount;
+}
+
+void AsyncGeometryBuilder::AddGeosphere(const std::string& name, float radius, uint32 numSubdivisions)
+{
+    Request& r = AddRequest(name, Shape::Geosphere);
+    r.Size[0] = radius;
+    r.Count[0] = numSubdivisions;
+}
+
+void AsyncGeometryBuilder::AddCylinder(const std::string& name, float bottomRadius, float topRadius, float height,
+    uint32 sliceCount, uint32 stackCount)
+{
+    Request& r = AddRequest(name, Shape::Cylinder);
+    r.Size[0] = bottomRadius;
+    r.Size[1] = topRadius;
+    r.Size[2] = height;
+    r.Count[0] = sliceCount;
+    r.Count[1] = stackCount;
+}
+
+void AsyncGeometryBuilder::AddGrid(const std::string& name, float width, float depth, uint32 m, uint32 n)
+{
+    Request& r = AddRequest(name, Shape::Grid);
+    r.Size[0] = width;
+    r.Size[1] = depth;
+    r.Count[0] = m;
+    r.Count[1] = n;
+}
+
+void AsyncGeometryBuilder::Generate(Request& r)
+{
+    GeometryGenerator geoGen;
+    switch(r.Type)
+    {
+    case Shape::Box:
+        r.MeshAoS = geoGen.CreateBox(r.Size[0], r.Size[1], r.Size[2], r.Count[0]);
+        break;
+    case Shape::Geosphere:
+        r.MeshAoS = geoGen.CreateGeosphere(r.Size[0], r.Count[0]);
+        break;
+    case Shape::Cylinder:
+        r.MeshSoA = geoGen.CreateCylinderSoA(r.Size[0], r.Size[1], r.Size[2], r.Count[0], r.Count[1]);
+        break;
+    case Shape::Sphere:
+    {
+        uint32 sliceCount = r.Count[0];
+        uint32 stackCount = r.Count[1];
+        GeometryGenerator::AllocateSphereSoA(r.MeshSoA, sliceCount, stackCount);
+        mJobs.ParallelFor(stackCount, RowsPerJob, [&r, sliceCount, stackCount](uint32 begin, uint32 end)
+        {
+            GeometryGenerator::BuildSphereRowsSoA(r.MeshSoA, r.Size[0], sliceCount, stackCount, begin, end);
+        });
+        break;
+    }
+    case Shape::Grid:
+    {
+        uint32 m = r.Count[0];
+        uint32 n = r.Count[1];
+        GeometryGenerator::AllocateGridSoA(r.MeshSoA, m, n);
+        mJobs.ParallelFor(m, RowsPerJob, [&r, m, n](uint32 begin, uint32 end)
+        {
+            GeometryGenerator::BuildGridRowsSoA(r.MeshSoA, r.Size[0], r.Size[1], m, n, begin, end);
+        });
+        break;
+    }
+    }
+}
+
+void AsyncGeometryBuilder::Build(MeshPacker& packer)
+{
+    //
+    // One job per request.  A request that splits its rows waits for them
+    // inside its job; JobSystem::Wait keeps that thread busy meanwhile.
+    //
+
+    JobCounter counter;
+    for(Request& r : mRequests)
+    {
+        mJobs.Run([this, &r]()
+        {
+            Generate(r);
+
+            // Reorder triangles for the post-transform cache and vertices for
+            // fetch locality before the meshes are concatenated.
+            if(r.Type == Shape::Box || r.Type == Shape::Geosphere)
+                r.Stats = MeshOptimizer::Optimize(r.MeshAoS);
+            else
+                r.Stats = MeshOptimizer::Optimize(r.MeshSoA);
+        }, &counter);
+    }
+    mJobs.Wait(counter);
+
+    packer.Reserve(mRequests.size());
+    for(const Request& r : mRequests)
+    {
+        if(r.Type == Shape::Box || r.Type == Shape::Geosphere)
+            packer.Add(r.Name, r.MeshAoS);
+        else
+            packer.Add(r.Name, r.MeshSoA);
+    }
+    packer.Pack(mJobs);
+}
+
+void AsyncGeometryBuilder::Clear()
+{
+    mRequests.clear();
+}
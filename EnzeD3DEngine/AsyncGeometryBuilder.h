@@ -0,0 +1,78 @@
+#pragma once
+#include <deque>
+#include <string>
+#include "GeometryGenerator.h"
+#include "JobSystem.h"
+#include "MeshOptimizer.h"
+#include "MeshPacker.h"
+
+// Queues GeometryGenerator requests and builds them on a JobSystem.  Every
+// request becomes one job; grids and spheres with many rows additionally split
+// their rows across the workers.  Each finished mesh is optimized in its own
+// job, and the packer converts the meshes in parallel once all are done.
+class AsyncGeometryBuilder
+{
+public:
+    using uint32 = GeometryGenerator::uint32;
+
+    // Rows of a grid or sphere generated by one job.  Meshes with fewer rows
+    // are built by the job of their request alone.
+    static const uint32 RowsPerJob = 32;
+
+    explicit AsyncGeometryBuilder(JobSystem& jobs);
+    AsyncGeometryBuilder(const AsyncGeometryBuilder& rhs) = delete;
+    AsyncGeometryBuilder& operator=(const AsyncGeometryBuilder& rhs) = delete;
+
+    // Same parameters as the GeometryGenerator::CreateXxx counterparts.  name
+    // becomes the DrawArgs key of the mesh.
+    void AddBox(const std::string& name, float width, float height, float depth, uint32 numSubdivisions);
+    void AddSphere(const std::string& name, float radius, uint32 sliceCount, uint32 stackCount);
+    void AddGeosphere(const std::string& name, float radius, uint32 numSubdivisions);
+    void AddCylinder(const std::string& name, float bottomRadius, float topRadius, float height,
+        uint32 sliceCount, uint32 stackCount);
+    void AddGrid(const std::string& name, float width, float depth, uint32 m, uint32 n);
+
+    // Generates and optimizes every queued mesh, then adds them to packer in
+    // request order and packs it.  The meshes stay owned by the builder, so it
+    // must outlive packer's use of them.
+    void Build(MeshPacker& packer);
+
+    size_t MeshCount()const { return mRequests.size(); }
+    const std::string& MeshName(size_t i)const { return mRequests[i].Name; }
+    const MeshOptimizer::OptimizeResult& MeshStats(size_t i)const { return mRequests[i].Stats; }
+
+    // Drops every request and its mesh.
+    void Clear();
+
+private:
+    enum class Shape
+    {
+        Box,
+        Sphere,
+        Geosphere,
+        Cylinder,
+        Grid
+    };
+
+    struct Request
+    {
+        std::string Name;
+        Shape Type = Shape::Box;
+        float Size[3] = { 0.0f, 0.0f, 0.0f };
+        uint32 Count[3] = { 0, 0, 0 };
+
+        // Box and geosphere come out of the AoS generators, everything else
+        // out of the SoA ones.
+        GeometryGenerator::MeshData MeshAoS;
+        GeometryGenerator::MeshDataSoA MeshSoA;
+        MeshOptimizer::OptimizeResult Stats;
+    };
+
+    Request& AddRequest(const std::string& name, Shape type);
+    void Generate(Request& r);
+
+    JobSystem& mJobs;
+
+    // A deque so the jobs can hold on to requests while new ones are queued.
+    std::deque<Request> mRequests;
+};
@@ -0,0 +1,191 @@
+// AsyncGeometryBuilder against building the same scene on one thread with
+// GeometryGenerator, MeshOptimizer and MeshPacker::Pack().  The packed
+// buffers of every worker count are first compared with the serial ones,
+// and the program fails on a difference; then the build is timed with
+// 1, 2, 4 and 8 workers and one per hardware thread.  --quick builds a
+// smaller scene with fewer worker counts.
+
+#include "AsyncGeometryBuilder.h"
+#include "GeometryGenerator.h"
+#include "MeshOptimizer.h"
+#include "MeshPacker.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using uint32 = GeometryGenerator::uint32;
+
+    float gSink = 0.f;
+
+    // One mesh of the scene, in the terms of both the builder and the
+    // generator.
+    struct MeshDesc
+    {
+        enum Kind { Box, Sphere, Geosphere, Cylinder, Grid } Type;
+        float Size[3];
+        uint32 Count[2];
+    };
+
+    // Many small props plus a few meshes large enough for the builder to
+    // split their rows.
+    std::vector<MeshDesc> Scene(uint32 scale)
+    {
+        std::vector<MeshDesc> scene;
+        for(uint32 i = 0; i < 16 * scale; ++i)
+        {
+            scene.push_back({ MeshDesc::Box, { 1.0f, 2.0f, 1.0f + i % 3 }, { i % 4, 0 } });
+            scene.push_back({ MeshDesc::Sphere, { 0.5f, 0, 0 }, { 24 + i % 16, 24 + i % 8 } });
+            scene.push_back({ MeshDesc::Cylinder, { 0.5f, 0.3f, 3.0f }, { 20 + i % 12, 8 } });
+        }
+        for(uint32 i = 0; i < 2 * scale; ++i)
+        {
+            scene.push_back({ MeshDesc::Geosphere, { 1.0f, 0, 0 }, { 3 + i % 2, 0 } });
+            scene.push_back({ MeshDesc::Grid, { 100.0f, 100.0f, 0 }, { 128 * scale + 1, 128 * scale } });
+            scene.push_back({ MeshDesc::Sphere, { 2.0f, 0, 0 }, { 64 * scale, 64 * scale } });
+        }
+        return scene;
+    }
+
+    void Queue(AsyncGeometryBuilder& builder, const std::vector<MeshDesc>& scene)
+    {
+        for(size_t i = 0; i < scene.size(); ++i)
+        {
+            const MeshDesc& d = scene[i];
+            std::string name = "mesh" + std::to_string(i);
+            switch(d.Type)
+            {
+            case MeshDesc::Box: builder.AddBox(name, d.Size[0], d.Size[1], d.Size[2], d.Count[0]); break;
+            case MeshDesc::Sphere: builder.AddSphere(name, d.Size[0], d.Count[0], d.Count[1]); break;
+            case MeshDesc::Geosphere: builder.AddGeosphere(name, d.Size[0], d.Count[0]); break;
+            case MeshDesc::Cylinder:
+                builder.AddCylinder(name, d.Size[0], d.Size[1], d.Size[2], d.Count[0], d.Count[1]);
+                break;
+            case MeshDesc::Grid: builder.AddGrid(name, d.Size[0], d.Size[1], d.Count[0], d.Count[1]); break;
+            }
+        }
+    }
+
+    // The single-threaded path the builder replaces.  The meshes live in
+    // the deques until the packer is done with them.
+    void BuildSerial(const std::vector<MeshDesc>& scene, std::deque<GeometryGenerator::MeshData>& aos,
+        std::deque<GeometryGenerator::MeshDataSoA>& soa, MeshPacker& packer)
+    {
+        GeometryGenerator generator;
+        packer.Reserve(scene.size());
+        for(size_t i = 0; i < scene.size(); ++i)
+        {
+            const MeshDesc& d = scene[i];
+            std::string name = "mesh" + std::to_string(i);
+            if(d.Type == MeshDesc::Box || d.Type == MeshDesc::Geosphere)
+            {
+                aos.push_back(d.Type == MeshDesc::Box ?
+                    generator.CreateBox(d.Size[0], d.Size[1], d.Size[2], d.Count[0]) :
+                    generator.CreateGeosphere(d.Size[0], d.Count[0]));
+                MeshOptimizer::Optimize(aos.back());
+                packer.Add(name, aos.back());
+                continue;
+            }
+
+            switch(d.Type)
+            {
+            case MeshDesc::Sphere: soa.push_back(generator.CreateSphereSoA(d.Size[0], d.Count[0], d.Count[1])); break;
+            case MeshDesc::Cylinder:
+                soa.push_back(generator.CreateCylinderSoA(d.Size[0], d.Size[1], d.Size[2], d.Count[0], d.Count[1]));
+                break;
+            default: soa.push_back(generator.CreateGridSoA(d.Size[0], d.Size[1], d.Count[0], d.Count[1])); break;
+            }
+            MeshOptimizer::Optimize(soa.back());
+            packer.Add(name, soa.back());
+        }
+        packer.Pack();
+    }
+
+    bool SamePacking(const MeshPacker& a, const MeshPacker& b)
+    {
+        if(a.SubmeshCount() != b.SubmeshCount() || a.Vertices().size() != b.Vertices().size() ||
+            a.IndexByteSize() != b.IndexByteSize())
+            return false;
+        for(size_t i = 0; i < a.SubmeshCount(); ++i)
+        {
+            if(a.Submesh(i).BaseVertexLocation != b.Submesh(i).BaseVertexLocation ||
+                a.Submesh(i).StartIndexLocation != b.Submesh(i).StartIndexLocation ||
+                a.Submesh(i).IndexCount != b.Submesh(i).IndexCount)
+                return false;
+        }
+        return std::memcmp(a.Vertices().data(), b.Vertices().data(), a.Vertices().size() * sizeof(Vertex)) == 0 &&
+            std::memcmp(a.IndexData(), b.IndexData(), a.IndexByteSize()) == 0;
+    }
+
+    std::vector<unsigned> WorkerCounts(bool quick)
+    {
+        std::vector<unsigned> counts = quick ? std::vector<unsigned>{ 1, 2 } : std::vector<unsigned>{ 1, 2, 4, 8 };
+        unsigned hardware = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        if(!quick && hardware > 0 && std::find(counts.begin(), counts.end(), hardware) == counts.end())
+            counts.push_back(hardware);
+        return counts;
+    }
+
+    void Run(bool quick)
+    {
+        std::vector<MeshDesc> scene = Scene(quick ? 1 : 2);
+
+        std::deque<GeometryGenerator::MeshData> aos;
+        std::deque<GeometryGenerator::MeshDataSoA> soa;
+        MeshPacker reference;
+        BuildSerial(scene, aos, soa, reference);
+        std::printf("Scene: %zu meshes, %zu vertices, %u indices, %u-bit\n\n", scene.size(),
+            reference.Vertices().size(), reference.IndexCount(), reference.IndexStride() * 8);
+
+        double serial = 1e30;
+        for(int r = 0; r < gRepetitions; ++r)
+        {
+            std::deque<GeometryGenerator::MeshData> a;
+            std::deque<GeometryGenerator::MeshDataSoA> s;
+            MeshPacker packer;
+            MyTimer timer;
+            BuildSerial(scene, a, s, packer);
+            serial = std::min(serial, (double)timer.Peek());
+            gSink += packer.Vertices().back().Pos.x;
+        }
+
+        std::printf("Build, best of %d\n", gRepetitions);
+        std::printf("  %-10s %10.3f ms\n", "serial", serial * 1e3);
+        for(unsigned workers : WorkerCounts(quick))
+        {
+            JobSystem jobs(workers);
+            double best = 1e30;
+            for(int r = 0; r < gRepetitions; ++r)
+            {
+                AsyncGeometryBuilder builder(jobs);
+                MeshPacker packer;
+                Queue(builder, scene);
+                MyTimer timer;
+                builder.Build(packer);
+                best = std::min(best, (double)timer.Peek());
+                gSink += packer.Vertices().back().Pos.x;
+
+                // Row splitting and parallel packing must not change a bit.
+                if(r == 0)
+                    Check(SamePacking(packer, reference), "the builder packs what the serial path does");
+            }
+            std::printf("  %2u workers %10.3f ms %6.2fx\n", workers, best * 1e3, serial / best);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv, 3);
+
+    std::printf("Hardware threads: %u\n", std::thread::hardware_concurrency());
+    Run(quick);
+    return Finish(gSink);
+}
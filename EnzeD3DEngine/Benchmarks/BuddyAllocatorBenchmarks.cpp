@@ -0,0 +1,306 @@
+// BuddyAllocator, which suballocates GpuBufferAllocator's pages.  Scripted
+// cases check splitting, merging back with buddies, alignment, full and
+// invalid requests and the fragmentation figures.  Random allocations and
+// frees are checked against a map of minimum blocks: blocks are disjoint,
+// sized to the next power of two and aligned to it, a request fails only
+// when no aligned run of free blocks could hold it, and the largest free
+// block is the largest such run.  Compaction plans are replayed on the map's
+// contents in order and must leave every allocation's data intact at its new
+// offset.  The program fails on a difference.  Then allocation, free and
+// compaction are timed.  --quick runs fewer operations.
+
+#include "BuddyAllocator.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+    size_t gSink = 0;
+
+    const std::uint64_t Invalid = BuddyAllocator::InvalidOffset;
+
+    void TestScripted()
+    {
+        std::printf("Scripted checks\n");
+        BuddyAllocator buddy(1024, 64);
+        Check(buddy.LargestFreeBlock() == 1024 && buddy.Fragmentation() == 0.0f, "a new allocator is one free block");
+        Check(buddy.Allocate(0) == Invalid && buddy.Allocate(1025) == Invalid && buddy.Allocate(1, 2048) == Invalid,
+            "empty, oversized and overaligned requests fail");
+
+        // 100 bytes round up to 128; splitting 1024 leaves free blocks of
+        // 128, 256 and 512 behind.
+        Check(buddy.Allocate(100) == 0 && buddy.BlockSize(0) == 128, "requests round up to a power of two");
+        Check(buddy.AllocatedBytes() == 128 && buddy.LargestFreeBlock() == 512, "splitting frees the upper halves");
+        Check(buddy.Fragmentation() == 1.0f - 512.0f / 896.0f, "fragmentation compares the largest block to all free bytes");
+        Check(buddy.Allocate(64) == 128 && buddy.BlockSize(128) == 64, "the smallest fitting free block is split");
+        Check(buddy.Allocate(64, 256) == 256 && buddy.BlockSize(256) == 256, "alignment rounds the block up");
+        Check(buddy.Allocate(64) == 192, "the other half of a split block is reused");
+        Check(buddy.AllocationCount() == 4 && buddy.FreeBytes() == 512, "allocations are counted");
+
+        buddy.Free(128);
+        buddy.Free(0);
+        Check(buddy.LargestFreeBlock() == 512, "a block does not merge while its buddy is allocated");
+        buddy.Free(192);
+        Check(buddy.LargestFreeBlock() == 512 && buddy.Allocate(256) == 0, "freed buddies merge");
+        buddy.Free(0);
+        buddy.Free(256);
+        Check(buddy.AllocationCount() == 0 && buddy.LargestFreeBlock() == 1024 && buddy.Fragmentation() == 0.0f,
+            "freeing everything merges back into one block");
+
+        // Every other minimum block allocated: half the bytes are free but
+        // nothing larger than a minimum block fits.
+        std::vector<std::uint64_t> offsets;
+        for(int i = 0; i < 16; ++i)
+            offsets.push_back(buddy.Allocate(64));
+        Check(offsets.back() == 960 && buddy.Allocate(1) == Invalid, "a full allocator fails");
+        for(int i = 0; i < 16; i += 2)
+            buddy.Free(offsets[i]);
+        Check(buddy.FreeBytes() == 512 && buddy.LargestFreeBlock() == 64 && buddy.Allocate(128) == Invalid,
+            "free space splinters");
+        Check(buddy.Fragmentation() == 1.0f - 64.0f / 512.0f, "splintered free space is fragmented");
+
+        // Compaction moves the upper allocations down into the holes until
+        // the free space is contiguous again.
+        std::vector<BuddyAllocator::Move> moves;
+        size_t moveCount = buddy.PlanCompaction(100, moves);
+        bool down = moveCount == moves.size();
+        for(const BuddyAllocator::Move& move : moves)
+            down &= move.DestOffset < move.SourceOffset && move.Size == 64;
+        Check(moveCount == 4 && down, "compaction moves blocks down");
+        Check(buddy.LargestFreeBlock() == 512 && buddy.Fragmentation() == 0.0f, "compaction leaves one free block");
+        Check(buddy.PlanCompaction(100, moves) == 0, "a compact allocator plans no moves");
+
+        buddy.Reset(4096, 256);
+        Check(buddy.Capacity() == 4096 && buddy.MinBlockSize() == 256 && buddy.AllocationCount() == 0 &&
+            buddy.Allocate(4096) == 0, "Reset starts over");
+        EndChecks();
+    }
+
+    // The allocator's state as a map of minimum blocks, each holding the id
+    // of the allocation covering it or -1.
+    struct Model
+    {
+        std::uint64_t MinBlockSize;
+        std::vector<int> Owner;
+        // Per allocation id: offset and block size, or Invalid once freed.
+        std::vector<std::uint64_t> Offsets;
+        std::vector<std::uint64_t> Sizes;
+
+        Model(std::uint64_t capacity, std::uint64_t minBlockSize) :
+            MinBlockSize(minBlockSize), Owner((size_t)(capacity / minBlockSize), -1)
+        {
+        }
+
+        static std::uint64_t RoundUp(std::uint64_t size)
+        {
+            std::uint64_t rounded = 1;
+            while(rounded < size)
+                rounded <<= 1;
+            return rounded;
+        }
+
+        // Whether an aligned run of free blocks of size bytes exists.
+        bool HasFreeRun(std::uint64_t size)const
+        {
+            size_t run = (size_t)std::max<std::uint64_t>(size / MinBlockSize, 1);
+            for(size_t start = 0; start + run <= Owner.size(); start += run)
+            {
+                bool free = true;
+                for(size_t b = start; b < start + run && free; ++b)
+                    free = Owner[b] < 0;
+                if(free)
+                    return true;
+            }
+            return false;
+        }
+
+        std::uint64_t LargestFreeRun()const
+        {
+            std::uint64_t largest = 0;
+            for(std::uint64_t size = MinBlockSize; size <= Owner.size() * MinBlockSize; size <<= 1)
+            {
+                if(HasFreeRun(size))
+                    largest = size;
+            }
+            return largest;
+        }
+
+        bool Take(int id, std::uint64_t offset, std::uint64_t size)
+        {
+            bool free = true;
+            for(size_t b = (size_t)(offset / MinBlockSize); b < (offset + size) / MinBlockSize; ++b)
+            {
+                free &= Owner[b] < 0;
+                Owner[b] = id;
+            }
+            return free;
+        }
+
+        void Release(int id)
+        {
+            for(size_t b = (size_t)(Offsets[id] / MinBlockSize); b < (Offsets[id] + Sizes[id]) / MinBlockSize; ++b)
+                Owner[b] = -1;
+            Offsets[id] = Invalid;
+        }
+    };
+
+    void TestRandom(int operations)
+    {
+        std::printf("Random allocations\n");
+        const std::uint64_t capacity = 1 << 20, minBlockSize = 256;
+        BuddyAllocator buddy(capacity, minBlockSize);
+        Model model(capacity, minBlockSize);
+        std::mt19937 rng(5);
+        std::uniform_int_distribution<int> sizeLog(0, 16), alignmentLog(0, 12);
+
+        bool placed = true, sized = true, aligned = true, failsOnlyWhenFull = true, counted = true, largest = true;
+        size_t failures = 0, compactions = 0;
+        std::vector<int> live;
+        for(int op = 0; op < operations; ++op)
+        {
+            if(!live.empty() && rng() % 100 < 45)
+            {
+                size_t i = rng() % live.size();
+                buddy.Free(model.Offsets[live[i]]);
+                model.Release(live[i]);
+                live[i] = live.back();
+                live.pop_back();
+            }
+            else
+            {
+                std::uint64_t size = 1 + rng() % (1u << sizeLog(rng));
+                std::uint64_t alignment = 1ull << alignmentLog(rng);
+                std::uint64_t block = std::max(Model::RoundUp(std::max(size, alignment)), minBlockSize);
+                std::uint64_t offset = buddy.Allocate(size, alignment);
+                if(offset == Invalid)
+                {
+                    failsOnlyWhenFull &= !model.HasFreeRun(block);
+                    ++failures;
+                }
+                else
+                {
+                    int id = (int)model.Offsets.size();
+                    model.Offsets.push_back(offset);
+                    model.Sizes.push_back(block);
+                    placed &= offset + block <= capacity && model.Take(id, offset, block);
+                    sized &= buddy.BlockSize(offset) == block;
+                    aligned &= offset % block == 0 && offset % alignment == 0;
+                    live.push_back(id);
+                }
+            }
+
+            if(op % 64 == 0)
+            {
+                std::uint64_t bytes = 0;
+                for(int id : live)
+                    bytes += model.Sizes[id];
+                counted &= buddy.AllocatedBytes() == bytes && buddy.AllocationCount() == live.size();
+                largest &= buddy.LargestFreeBlock() == model.LargestFreeRun();
+            }
+
+            // Now and then compact a little and replay the moves on the
+            // map's contents.
+            if(op % 500 == 499)
+            {
+                std::vector<BuddyAllocator::Move> moves;
+                buddy.PlanCompaction(8, moves);
+                compactions += moves.size();
+                std::vector<int> contents = model.Owner;
+                for(const BuddyAllocator::Move& move : moves)
+                {
+                    std::copy_n(contents.begin() + (size_t)(move.SourceOffset / minBlockSize),
+                        (size_t)(move.Size / minBlockSize), contents.begin() + (size_t)(move.DestOffset / minBlockSize));
+                    int id = model.Owner[(size_t)(move.SourceOffset / minBlockSize)];
+                    placed &= id >= 0 && model.Offsets[id] == move.SourceOffset && model.Sizes[id] == move.Size;
+                    if(id < 0)
+                        continue;
+                    model.Release(id);
+                    model.Offsets[id] = move.DestOffset;
+                    placed &= model.Take(id, move.DestOffset, move.Size) && move.DestOffset < move.SourceOffset;
+                }
+                // Every allocation finds its own data at its new offset.
+                for(int id : live)
+                    placed &= contents[(size_t)(model.Offsets[id] / minBlockSize)] == id &&
+                        buddy.BlockSize(model.Offsets[id]) == model.Sizes[id];
+            }
+        }
+
+        for(int id : live)
+            buddy.Free(model.Offsets[id]);
+        Check(placed, "allocations are disjoint, also after compaction");
+        Check(sized, "blocks are the request rounded up to a power of two");
+        Check(aligned, "blocks are aligned to their size and the request");
+        Check(failsOnlyWhenFull, "requests fail only when no aligned free run fits");
+        Check(counted, "allocated bytes and count match");
+        Check(largest, "the largest free block is the largest free run");
+        Check(failures > 0 && compactions > 0, "the allocator filled up and compacted");
+        Check(buddy.AllocationCount() == 0 && buddy.LargestFreeBlock() == capacity, "freeing everything merges back");
+        std::printf("  %zu failed requests, %zu moves\n", failures, compactions);
+        EndChecks();
+    }
+
+    void Benchmark(int operations)
+    {
+        // A 64MB page of mesh buffers between 256 bytes and 64KB.
+        const std::uint64_t capacity = 64ull << 20;
+        std::printf("%d allocate/free pairs on a %llu MB page, best of %d\n", operations,
+            (unsigned long long)(capacity >> 20), gRepetitions);
+        std::mt19937 rng(9);
+        std::vector<std::uint64_t> sizes(operations);
+        for(std::uint64_t& size : sizes)
+            size = 256 + rng() % (64 * 1024);
+
+        BuddyAllocator buddy;
+        std::vector<std::uint64_t> live;
+        float fragmentation = 0.0f;
+        double churn = Time([&]()
+        {
+            buddy.Reset(capacity, 256);
+            live.clear();
+            for(int i = 0; i < operations; ++i)
+            {
+                // Keep about half the page allocated.
+                if(buddy.FreeBytes() < capacity / 2 && !live.empty())
+                {
+                    size_t victim = (size_t)(sizes[i] % live.size());
+                    buddy.Free(live[victim]);
+                    live[victim] = live.back();
+                    live.pop_back();
+                }
+                std::uint64_t offset = buddy.Allocate(sizes[i], 256);
+                if(offset != Invalid)
+                    live.push_back(offset);
+            }
+            fragmentation = buddy.Fragmentation();
+            gSink += live.size();
+        });
+
+        std::vector<BuddyAllocator::Move> moves;
+        BuddyAllocator compacted;
+        double compaction = Time([&]()
+        {
+            compacted = buddy;
+            moves.clear();
+            compacted.PlanCompaction(256, moves);
+            gSink += moves.size();
+        });
+        std::printf("  %-14s %9.3f ms %7.2f ns/op, %zu live, fragmentation %.2f\n", "Allocate+Free", churn * 1e3,
+            churn * 1e9 / operations, live.size(), fragmentation);
+        std::printf("  %-14s %9.3f ms for %zu moves, fragmentation %.2f\n", "PlanCompaction", compaction * 1e3,
+            moves.size(), compacted.Fragmentation());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestScripted();
+    TestRandom(quick ? 5000 : 50000);
+    Benchmark(quick ? 20000 : 200000);
+    return Finish(gSink);
+}
@@ -0,0 +1,471 @@
+// The render item BVH as RenderItemStore keeps it, against linear scans.
+// Items are added, removed and moved through the store in random rounds;
+// after each round the BVH's frustum, box, sphere and ray queries are
+// compared with brute force over the live items, both before the moves are
+// refitted (inserted items and tombstones) and after, and the program fails
+// on a difference or on a key that is not a live slot.  Items attached to a
+// TransformHierarchy are moved the way EnzeApp::UpdateTransforms moves them
+// and must be found at their new place only.  Then frustum culling
+// and picking through the BVH are timed against FrustumCuller::Cull and a
+// linear ray scan at several scene sizes.  --quick skips the largest sizes.
+
+#include "BoundingVolumeHierarchy.h"
+#include "FrustumCuller.h"
+#include "MyTimer.h"
+#include "RenderItemStore.h"
+#include "TestHarness.h"
+#include "TransformHierarchy.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    size_t gSink = 0;
+
+    XMMATRIX ViewProj()
+    {
+        XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(30.0f, 20.0f, -40.0f, 1.0f),
+            XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.0f / 9.0f, 1.0f, 300.0f);
+        return XMMatrixMultiply(view, proj);
+    }
+
+    // Render items with unit boxes, scaled and placed at random within
+    // [-halfSize, halfSize] on every axis.
+    struct Scene
+    {
+        std::mt19937 Rng{ 11 };
+        float HalfSize;
+        RenderItemStore Items;
+        std::vector<RenderItemHandle> Handles;
+
+        explicit Scene(float halfSize) : HalfSize(halfSize) {}
+
+        XMFLOAT4X4 RandomWorld()
+        {
+            std::uniform_real_distribution<float> position(-HalfSize, HalfSize);
+            std::uniform_real_distribution<float> scale(0.2f, 3.0f);
+            XMFLOAT4X4 world;
+            XMStoreFloat4x4(&world, XMMatrixMultiply(XMMatrixScaling(scale(Rng), scale(Rng), scale(Rng)),
+                XMMatrixTranslation(position(Rng), position(Rng), position(Rng))));
+            return world;
+        }
+
+        void Add()
+        {
+            RenderItemDesc desc;
+            desc.World = RandomWorld();
+            desc.DrawArgs.IndexCount = 36;
+            desc.DrawArgs.Bounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+            Handles.push_back(Items.Add(desc));
+        }
+
+        void RemoveRandom()
+        {
+            size_t i = std::uniform_int_distribution<size_t>(0, Handles.size() - 1)(Rng);
+            Items.Remove(Handles[i]);
+            Handles[i] = Handles.back();
+            Handles.pop_back();
+        }
+
+        void MoveRandom()
+        {
+            size_t i = std::uniform_int_distribution<size_t>(0, Handles.size() - 1)(Rng);
+            Items.SetWorld(Handles[i], RandomWorld());
+        }
+    };
+
+    // Bounds of dense item i as the BVH stores them.
+    void ItemBounds(const AabbSoA& b, size_t i, XMFLOAT3& mn, XMFLOAT3& mx)
+    {
+        BoundingBox box(XMFLOAT3(b.CenterX[i], b.CenterY[i], b.CenterZ[i]),
+            XMFLOAT3(b.ExtentX[i], b.ExtentY[i], b.ExtentZ[i]));
+        XMStoreFloat3(&mn, XMVectorSubtract(XMLoadFloat3(&box.Center), XMLoadFloat3(&box.Extents)));
+        XMStoreFloat3(&mx, XMVectorAdd(XMLoadFloat3(&box.Center), XMLoadFloat3(&box.Extents)));
+    }
+
+    bool IsLiveSlot(const Scene& scene, std::uint32_t key)
+    {
+        return std::any_of(scene.Handles.begin(), scene.Handles.end(),
+            [key](const RenderItemHandle& h) { return h.Slot == key; });
+    }
+
+    // Every key must name a live item, once.  Returns the keys as a sorted
+    // list of dense indices.
+    std::vector<std::uint32_t> ToDense(const Scene& scene, const std::vector<std::uint32_t>& keys, bool& valid)
+    {
+        std::vector<std::uint32_t> dense;
+        for(std::uint32_t key : keys)
+        {
+            if(!IsLiveSlot(scene, key) || scene.Items.DenseIndexOfSlot(key) == ~0u)
+            {
+                valid = false;
+                continue;
+            }
+            dense.push_back(scene.Items.DenseIndexOfSlot(key));
+        }
+        std::sort(dense.begin(), dense.end());
+        valid &= std::adjacent_find(dense.begin(), dense.end()) == dense.end();
+        return dense;
+    }
+
+    void CheckQueries(const Scene& scene, const char* when)
+    {
+        const RenderItemStore& items = scene.Items;
+        const BoundingVolumeHierarchy& bvh = items.Bvh();
+        const AabbSoA& bounds = items.WorldBounds();
+        size_t count = items.Size();
+        char what[128];
+        bool valid = true;
+
+        std::snprintf(what, sizeof(what), "%s: the BVH holds every item", when);
+        Check(bvh.ItemCount() == count, what);
+
+        // Frustum.  Boxes within a small margin of a plane may go either way.
+        FrustumCuller::Planes planes = FrustumCuller::ExtractPlanes(ViewProj());
+        std::vector<std::uint32_t> keys;
+        bvh.QueryFrustum(planes, keys);
+        std::vector<std::uint32_t> visible = ToDense(scene, keys, valid);
+        bool frustum = true;
+        for(size_t i = 0; i < count; ++i)
+        {
+            double worst = 1e30;
+            for(const XMFLOAT4& n : planes.Plane)
+            {
+                double dist = (double)n.x*bounds.CenterX[i] + (double)n.y*bounds.CenterY[i] + (double)n.z*bounds.CenterZ[i] + n.w;
+                double radius = std::fabs((double)n.x)*bounds.ExtentX[i] + std::fabs((double)n.y)*bounds.ExtentY[i] +
+                    std::fabs((double)n.z)*bounds.ExtentZ[i];
+                worst = std::min(worst, dist + radius);
+            }
+            bool found = std::binary_search(visible.begin(), visible.end(), (std::uint32_t)i);
+            if((worst > 1e-3 && !found) || (worst < -1e-3 && found))
+                frustum = false;
+        }
+        std::snprintf(what, sizeof(what), "%s: QueryFrustum matches a linear scan", when);
+        Check(frustum, what);
+
+        // Box and sphere, with the BVH's own float arithmetic.
+        std::uniform_real_distribution<float> position(-scene.HalfSize, scene.HalfSize);
+        std::mt19937 rng(5);
+        bool box = true, sphere = true;
+        for(int q = 0; q < 16; ++q)
+        {
+            BoundingBox query(XMFLOAT3(position(rng), position(rng), position(rng)),
+                XMFLOAT3(scene.HalfSize * 0.1f, scene.HalfSize * 0.05f, scene.HalfSize * 0.2f));
+            XMFLOAT3 qMin, qMax;
+            XMStoreFloat3(&qMin, XMVectorSubtract(XMLoadFloat3(&query.Center), XMLoadFloat3(&query.Extents)));
+            XMStoreFloat3(&qMax, XMVectorAdd(XMLoadFloat3(&query.Center), XMLoadFloat3(&query.Extents)));
+            BoundingSphere ball(query.Center, scene.HalfSize * 0.15f);
+
+            std::vector<std::uint32_t> expectBox, expectSphere;
+            for(size_t i = 0; i < count; ++i)
+            {
+                XMFLOAT3 mn, mx;
+                ItemBounds(bounds, i, mn, mx);
+                if(mn.x <= qMax.x && mx.x >= qMin.x && mn.y <= qMax.y && mx.y >= qMin.y && mn.z <= qMax.z && mx.z >= qMin.z)
+                    expectBox.push_back((std::uint32_t)i);
+
+                float dx = std::max(std::max(mn.x - ball.Center.x, 0.0f), ball.Center.x - mx.x);
+                float dy = std::max(std::max(mn.y - ball.Center.y, 0.0f), ball.Center.y - mx.y);
+                float dz = std::max(std::max(mn.z - ball.Center.z, 0.0f), ball.Center.z - mx.z);
+                if(dx*dx + dy*dy + dz*dz <= ball.Radius*ball.Radius)
+                    expectSphere.push_back((std::uint32_t)i);
+            }
+
+            keys.clear();
+            bvh.QueryBox(query, keys);
+            box &= ToDense(scene, keys, valid) == expectBox;
+            keys.clear();
+            bvh.QuerySphere(ball, keys);
+            sphere &= ToDense(scene, keys, valid) == expectSphere;
+        }
+        std::snprintf(what, sizeof(what), "%s: QueryBox matches a linear scan", when);
+        Check(box, what);
+        std::snprintf(what, sizeof(what), "%s: QuerySphere matches a linear scan", when);
+        Check(sphere, what);
+
+        // Rays from outside the scene towards random points in it, as picking
+        // casts them; the nearest box must be found at the same distance.
+        bool rays = true;
+        for(int q = 0; q < 64; ++q)
+        {
+            XMFLOAT3 from(position(rng) * 2.0f, scene.HalfSize * 1.5f, position(rng) * 2.0f);
+            XMFLOAT3 to(position(rng), position(rng), position(rng));
+            XMVECTOR dir = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&to), XMLoadFloat3(&from)));
+            XMFLOAT3 d;
+            XMStoreFloat3(&d, dir);
+
+            double nearest = 1e30;
+            for(size_t i = 0; i < count; ++i)
+            {
+                XMFLOAT3 mn, mx;
+                ItemBounds(bounds, i, mn, mx);
+                double t0 = 0.0, t1 = 1e4;
+                const float o[3] = { from.x, from.y, from.z }, v[3] = { d.x, d.y, d.z };
+                const float lo[3] = { mn.x, mn.y, mn.z }, hi[3] = { mx.x, mx.y, mx.z };
+                for(int a = 0; a < 3; ++a)
+                {
+                    double ta = (lo[a] - (double)o[a]) / v[a], tb = (hi[a] - (double)o[a]) / v[a];
+                    t0 = std::max(t0, std::min(ta, tb));
+                    t1 = std::min(t1, std::max(ta, tb));
+                }
+                if(t0 <= t1)
+                    nearest = std::min(nearest, t0);
+            }
+
+            std::uint32_t key = ~0u;
+            float distance = 1e4f;
+            bool hit = bvh.Raycast(XMLoadFloat3(&from), dir, key, distance);
+            if(hit != (nearest < 1e30) || (hit && std::fabs(distance - nearest) > 1e-3 * std::max(1.0, nearest)))
+                rays = false;
+            if(hit && (!IsLiveSlot(scene, key) || items.DenseIndexOfSlot(key) == ~0u))
+                valid = false;
+        }
+        std::snprintf(what, sizeof(what), "%s: Raycast finds the nearest box", when);
+        Check(rays, what);
+        std::snprintf(what, sizeof(what), "%s: every key is a live slot, once", when);
+        Check(valid, what);
+    }
+
+    void TestChurn()
+    {
+        std::printf("Queries after adds, removes and moves\n");
+        Scene scene(60.0f);
+        for(int i = 0; i < 3000; ++i)
+            scene.Add();
+        scene.Items.RefitBvh();
+        CheckQueries(scene, "built");
+
+        std::uniform_int_distribution<int> count(0, 120);
+        for(int round = 0; round < 12; ++round)
+        {
+            // Inserts and tombstones are visible before any refit.
+            int removes = count(scene.Rng), adds = count(scene.Rng);
+            for(int i = 0; i < removes; ++i)
+                scene.RemoveRandom();
+            for(int i = 0; i < adds; ++i)
+                scene.Add();
+            CheckQueries(scene, "added and removed");
+
+            // Moves show once refitted, including moves of inserted items.
+            int moves = count(scene.Rng) * 4;
+            for(int i = 0; i < moves; ++i)
+                scene.MoveRandom();
+            scene.Items.RefitBvh();
+            CheckQueries(scene, "moved");
+        }
+
+        // Enough changes for Refit to rebuild rather than carry them along.
+        for(int i = 0; i < 1000; ++i)
+            scene.RemoveRandom();
+        for(int i = 0; i < 800; ++i)
+            scene.Add();
+        scene.Items.RefitBvh();
+        const BoundingVolumeHierarchy& bvh = scene.Items.Bvh();
+        Check(bvh.LooseCount() == 0 && bvh.DeadCount() == 0, "Refit rebuilds after many changes");
+        CheckQueries(scene, "rebuilt");
+
+        // Down to nothing and back up, all through inserts.
+        while(!scene.Handles.empty())
+            scene.RemoveRandom();
+        scene.Items.RefitBvh();
+        CheckQueries(scene, "emptied");
+        for(int i = 0; i < 200; ++i)
+            scene.Add();
+        CheckQueries(scene, "refilled");
+        scene.Items.RefitBvh();
+        CheckQueries(scene, "refilled and refitted");
+        EndChecks();
+    }
+
+    // What EnzeApp::UpdateTransforms does: the items of the nodes the last
+    // Update() recomputed take their new world matrices.
+    void PassOnWorlds(const TransformHierarchy& transforms, const std::vector<RenderItemHandle>& nodeItems,
+        RenderItemStore& items)
+    {
+        const std::vector<Math::Float4x4>& worlds = transforms.Worlds();
+        const std::vector<std::uint32_t>& slots = transforms.DenseSlots();
+        for(std::uint32_t node : transforms.ChangedNodes())
+        {
+            std::uint32_t slot = slots[node];
+            if(slot < nodeItems.size() && items.IsAlive(nodeItems[slot]))
+                items.SetWorld(nodeItems[slot], *MathHelper::AsXMFLOAT4X4(&worlds[node]));
+        }
+    }
+
+    // Nearest item a vertical ray through (x, z) hits, or ~0u.
+    std::uint32_t PickDown(const RenderItemStore& items, float x, float z)
+    {
+        std::uint32_t key = ~0u;
+        float distance = 1e4f;
+        items.Bvh().Raycast(XMVectorSet(x, 500.0f, z, 1.0f), XMVectorSet(0.0f, -1.0f, 0.0f, 0.0f), key, distance);
+        return key;
+    }
+
+    void TestTransforms()
+    {
+        std::printf("Items moved by a transform hierarchy\n");
+        Scene scene(60.0f);
+        for(int i = 0; i < 2000; ++i)
+            scene.Add();
+
+        // A root with a ring of children, one item each, in the middle of
+        // the scattered items.
+        TransformHierarchy transforms;
+        std::vector<RenderItemHandle> nodeItems;
+        LocalTransform rootLocal;
+        rootLocal.Translation = { 200.0f, 0.0f, 0.0f };
+        TransformHandle root = transforms.Add(rootLocal);
+        std::vector<TransformHandle> children;
+        for(int i = 0; i < 16; ++i)
+        {
+            LocalTransform local;
+            local.Translation = { 3.0f * std::cos(i * XM_2PI / 16), 0.0f, 3.0f * std::sin(i * XM_2PI / 16) };
+            children.push_back(transforms.Add(local, root));
+
+            RenderItemDesc desc;
+            desc.DrawArgs.Bounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+            RenderItemHandle item = scene.Items.Add(desc);
+            scene.Handles.push_back(item);
+            if(nodeItems.size() <= children.back().Slot)
+                nodeItems.resize(children.back().Slot + 1);
+            nodeItems[children.back().Slot] = item;
+        }
+        transforms.Update();
+        PassOnWorlds(transforms, nodeItems, scene.Items);
+        scene.Items.RefitBvh();
+        CheckQueries(scene, "attached");
+        Check(PickDown(scene.Items, 203.0f, 0.0f) == nodeItems[children[0].Slot].Slot,
+            "picking finds an attached item");
+
+        // Moving the root moves every child's item, through SetWorld only.
+        for(int step = 0; step < 8; ++step)
+        {
+            rootLocal.Translation = { 200.0f, 0.0f, 40.0f * (step + 1) };
+            transforms.SetLocal(root, rootLocal);
+            transforms.Update();
+            PassOnWorlds(transforms, nodeItems, scene.Items);
+            scene.Items.RefitBvh();
+            CheckQueries(scene, "root moved");
+        }
+        Check(PickDown(scene.Items, 203.0f, 320.0f) == nodeItems[children[0].Slot].Slot,
+            "picking finds the item where its node went");
+        Check(PickDown(scene.Items, 203.0f, 0.0f) == ~0u, "and not where it was");
+
+        // One child moved on its own, and one removed with its item.
+        LocalTransform local = transforms.Local(children[4]);
+        local.Translation.y = -100.0f;
+        transforms.SetLocal(children[4], local);
+        scene.Items.Remove(nodeItems[children[8].Slot]);
+        scene.Handles.erase(std::find_if(scene.Handles.begin(), scene.Handles.end(),
+            [&](const RenderItemHandle& h) { return h.Slot == nodeItems[children[8].Slot].Slot; }));
+        transforms.Remove(children[8]);
+        transforms.Update();
+        PassOnWorlds(transforms, nodeItems, scene.Items);
+        scene.Items.RefitBvh();
+        CheckQueries(scene, "child moved");
+        EndChecks();
+    }
+
+    void Benchmark(bool quick)
+    {
+        std::printf("BVH against linear scans, best of %d\n", gRepetitions);
+        std::printf("  %8s %8s %11s %11s %7s %11s %11s %7s\n", "items", "visible",
+            "cull bvh", "cull scan", "ratio", "ray bvh", "ray scan", "ratio");
+
+        FrustumCuller::Planes planes = FrustumCuller::ExtractPlanes(ViewProj());
+        for(size_t itemCount : { 1024u, 4096u, 16384u, 65536u, 262144u })
+        {
+            if(quick && itemCount > 16384)
+                continue;
+
+            // Constant density, so the frustum sees a shrinking share.
+            Scene scene(4.0f * std::cbrt((float)itemCount));
+            scene.Items.Reserve(itemCount);
+            for(size_t i = 0; i < itemCount; ++i)
+                scene.Add();
+            scene.Items.RefitBvh();
+            const RenderItemStore& items = scene.Items;
+
+            // As EnzeApp::CullRenderItems does it: keys, then dense indices.
+            std::vector<std::uint32_t> keys, visible(itemCount);
+            size_t visibleCount = 0;
+            double bvhCull = Time([&]()
+            {
+                keys.clear();
+                items.Bvh().QueryFrustum(planes, keys);
+                for(size_t i = 0; i < keys.size(); ++i)
+                    visible[i] = items.DenseIndexOfSlot(keys[i]);
+                visibleCount = keys.size();
+                gSink += visibleCount;
+            });
+            double scanCull = Time([&]()
+            {
+                gSink += FrustumCuller::Cull(planes, items.WorldBounds(), 0, itemCount, visible.data());
+            });
+
+            // Picking rays from the camera into the scene.
+            const int rayCount = 256;
+            std::vector<XMFLOAT3> directions(rayCount);
+            std::uniform_real_distribution<float> spread(-0.3f, 0.3f);
+            for(XMFLOAT3& d : directions)
+                XMStoreFloat3(&d, XMVector3Normalize(XMVectorSet(-0.6f + spread(scene.Rng), -0.4f + spread(scene.Rng),
+                    0.8f + spread(scene.Rng), 0.0f)));
+            XMVECTOR origin = XMVectorSet(30.0f, 20.0f, -40.0f, 1.0f);
+            double bvhRay = Time([&]()
+            {
+                for(const XMFLOAT3& d : directions)
+                {
+                    std::uint32_t key = 0;
+                    float distance = 1e4f;
+                    gSink += items.Bvh().Raycast(origin, XMLoadFloat3(&d), key, distance) ? key : 0;
+                }
+            });
+            double scanRay = Time([&]()
+            {
+                const AabbSoA& b = items.WorldBounds();
+                for(const XMFLOAT3& d : directions)
+                {
+                    XMFLOAT3 o, inv(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+                    XMStoreFloat3(&o, origin);
+                    float best = 1e4f;
+                    std::uint32_t nearest = 0;
+                    for(size_t i = 0; i < itemCount; ++i)
+                    {
+                        float tx0 = (b.CenterX[i] - b.ExtentX[i] - o.x)*inv.x, tx1 = (b.CenterX[i] + b.ExtentX[i] - o.x)*inv.x;
+                        float ty0 = (b.CenterY[i] - b.ExtentY[i] - o.y)*inv.y, ty1 = (b.CenterY[i] + b.ExtentY[i] - o.y)*inv.y;
+                        float tz0 = (b.CenterZ[i] - b.ExtentZ[i] - o.z)*inv.z, tz1 = (b.CenterZ[i] + b.ExtentZ[i] - o.z)*inv.z;
+                        float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+                        float tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), best));
+                        if(tNear <= tFar)
+                        {
+                            best = tNear;
+                            nearest = (std::uint32_t)i;
+                        }
+                    }
+                    gSink += nearest;
+                }
+            });
+
+            std::printf("  %8zu %8zu %8.3f ms %8.3f ms %6.2fx %8.3f us %8.3f us %6.1fx\n", itemCount, visibleCount,
+                bvhCull * 1e3, scanCull * 1e3, scanCull / bvhCull,
+                bvhRay * 1e6 / rayCount, scanRay * 1e6 / rayCount, scanRay / bvhRay);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestChurn();
+    TestTransforms();
+    Benchmark(quick);
+    return Finish(gSink);
+}
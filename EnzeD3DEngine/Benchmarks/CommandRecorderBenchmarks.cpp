@@ -0,0 +1,360 @@
+// BasicCommandRecorder over a mock command list that logs every call it
+// receives.  A scripted sequence of binds, with redundant ones mixed in, must
+// reach the mock exactly as the recorder's rules say: repeats dropped, root
+// arguments forgotten on a new root signature or Reset(), parameters past
+// MaxRootParameters and topology 0 never filtered, and draws always
+// forwarded; the statistics must count the same.  The same calls recorded
+// into a RenderCommandStream must decode to the mock's log, and DrawSortKey
+// must order by its fields.  Then recording a frame through the recorder is
+// timed against recording it straight into a stream.  --quick records fewer
+// draws.
+
+#include "CommandRecorder.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    size_t gSink = 0;
+
+    // One call as the command list saw it: its type and arguments widened
+    // to 64 bits.
+    struct Call
+    {
+        RenderCommandType Type;
+        std::uint64_t Args[5];
+
+        bool operator==(const Call& rhs)const
+        {
+            return Type == rhs.Type && std::memcmp(Args, rhs.Args, sizeof(Args)) == 0;
+        }
+    };
+
+    Call MakeCall(RenderCommandType type, std::uint64_t a = 0, std::uint64_t b = 0, std::uint64_t c = 0,
+        std::uint64_t d = 0, std::uint64_t e = 0)
+    {
+        return Call{ type, { a, b, c, d, e } };
+    }
+
+    std::uint64_t Pointer(void* p)
+    {
+        return (std::uint64_t)(std::uintptr_t)p;
+    }
+
+    // Logs the calls BasicCommandRecorder forwards.
+    struct MockCommandList
+    {
+        std::vector<Call> Log;
+
+        void SetPipelineState(void* p) { Log.push_back(MakeCall(RenderCommandType::SetPipelineState, Pointer(p))); }
+        void SetGraphicsRootSignature(void* p) { Log.push_back(MakeCall(RenderCommandType::SetRootSignature, Pointer(p))); }
+        void SetVertexBuffer(const RenderVertexBufferView& v)
+        {
+            Log.push_back(MakeCall(RenderCommandType::SetVertexBuffer, v.BufferLocation, v.SizeInBytes, v.StrideInBytes));
+        }
+        void SetIndexBuffer(const RenderIndexBufferView& v)
+        {
+            Log.push_back(MakeCall(RenderCommandType::SetIndexBuffer, v.BufferLocation, v.SizeInBytes, v.Format));
+        }
+        void SetPrimitiveTopology(std::uint32_t t) { Log.push_back(MakeCall(RenderCommandType::SetPrimitiveTopology, t)); }
+        void SetGraphicsRootConstantBufferView(std::uint32_t p, RenderGpuAddress a)
+        {
+            Log.push_back(MakeCall(RenderCommandType::SetRootConstantBufferView, p, a));
+        }
+        void SetGraphicsRootShaderResourceView(std::uint32_t p, RenderGpuAddress a)
+        {
+            Log.push_back(MakeCall(RenderCommandType::SetRootShaderResourceView, p, a));
+        }
+        void SetGraphicsRoot32BitConstant(std::uint32_t p, std::uint32_t v, std::uint32_t o)
+        {
+            Log.push_back(MakeCall(RenderCommandType::SetRoot32BitConstant, p, v, o));
+        }
+        void DrawIndexedInstanced(std::uint32_t count, std::uint32_t instances, std::uint32_t start,
+            std::int32_t base, std::uint32_t startInstance)
+        {
+            Log.push_back(MakeCall(RenderCommandType::DrawIndexedInstanced, count, instances, start,
+                (std::uint64_t)(std::int64_t)base, startInstance));
+        }
+    };
+
+    // The stream's commands in the mock's terms.
+    std::vector<Call> Decode(const RenderCommandStream& stream)
+    {
+        std::vector<Call> calls;
+        for(auto c = stream.Begin(); c != stream.End(); c = RenderCommandStream::Next(c))
+        {
+            switch(c->Type)
+            {
+            case RenderCommandType::SetPipelineState:
+                calls.push_back(MakeCall(c->Type, Pointer(reinterpret_cast<const RenderCommand::SetPipelineState*>(c)->PipelineState)));
+                break;
+            case RenderCommandType::SetRootSignature:
+                calls.push_back(MakeCall(c->Type, Pointer(reinterpret_cast<const RenderCommand::SetRootSignature*>(c)->RootSignature)));
+                break;
+            case RenderCommandType::SetVertexBuffer:
+            {
+                const RenderVertexBufferView& v = reinterpret_cast<const RenderCommand::SetVertexBuffer*>(c)->View;
+                calls.push_back(MakeCall(c->Type, v.BufferLocation, v.SizeInBytes, v.StrideInBytes));
+                break;
+            }
+            case RenderCommandType::SetIndexBuffer:
+            {
+                const RenderIndexBufferView& v = reinterpret_cast<const RenderCommand::SetIndexBuffer*>(c)->View;
+                calls.push_back(MakeCall(c->Type, v.BufferLocation, v.SizeInBytes, v.Format));
+                break;
+            }
+            case RenderCommandType::SetPrimitiveTopology:
+                calls.push_back(MakeCall(c->Type, reinterpret_cast<const RenderCommand::SetPrimitiveTopology*>(c)->Topology));
+                break;
+            case RenderCommandType::SetRootConstantBufferView:
+            case RenderCommandType::SetRootShaderResourceView:
+            {
+                const RenderCommand::SetRootView* v = reinterpret_cast<const RenderCommand::SetRootView*>(c);
+                calls.push_back(MakeCall(c->Type, v->RootParameter, v->Address));
+                break;
+            }
+            case RenderCommandType::SetRoot32BitConstant:
+            {
+                const RenderCommand::SetRoot32BitConstant* v = reinterpret_cast<const RenderCommand::SetRoot32BitConstant*>(c);
+                calls.push_back(MakeCall(c->Type, v->RootParameter, v->Value, v->DestOffset));
+                break;
+            }
+            case RenderCommandType::DrawIndexedInstanced:
+            {
+                const RenderCommand::DrawIndexedInstanced* d = reinterpret_cast<const RenderCommand::DrawIndexedInstanced*>(c);
+                calls.push_back(MakeCall(c->Type, d->IndexCountPerInstance, d->InstanceCount, d->StartIndexLocation,
+                    (std::uint64_t)(std::int64_t)d->BaseVertexLocation, d->StartInstanceLocation));
+                break;
+            }
+            default:
+                calls.push_back(MakeCall(c->Type));
+                break;
+            }
+        }
+        return calls;
+    }
+
+    int gPipelines[2], gSignatures[2];
+
+    // Issues a fixed sequence of calls and appends to expected the ones the
+    // recorder must forward.  Returns the number it must drop.
+    template<typename CommandList>
+    std::uint32_t Script(BasicCommandRecorder<CommandList>& recorder, std::vector<Call>& expected)
+    {
+        std::uint32_t dropped = 0;
+        auto forwarded = [&expected](const Call& call) { expected.push_back(call); };
+        RenderVertexBufferView vb;
+        vb.BufferLocation = 0x10000;
+        vb.SizeInBytes = 4096;
+        vb.StrideInBytes = 24;
+        RenderIndexBufferView ib;
+        ib.BufferLocation = 0x20000;
+        ib.SizeInBytes = 1024;
+        ib.Format = 57;
+
+        recorder.SetGraphicsRootSignature(&gSignatures[0]);
+        forwarded(MakeCall(RenderCommandType::SetRootSignature, Pointer(&gSignatures[0])));
+        recorder.SetGraphicsRootSignature(&gSignatures[0]);
+        ++dropped;
+        recorder.SetPipelineState(&gPipelines[0]);
+        forwarded(MakeCall(RenderCommandType::SetPipelineState, Pointer(&gPipelines[0])));
+        recorder.SetPipelineState(&gPipelines[0]);
+        ++dropped;
+
+        recorder.SetVertexBuffer(vb);
+        forwarded(MakeCall(RenderCommandType::SetVertexBuffer, vb.BufferLocation, vb.SizeInBytes, vb.StrideInBytes));
+        recorder.SetVertexBuffer(vb);
+        ++dropped;
+        recorder.SetIndexBuffer(ib);
+        forwarded(MakeCall(RenderCommandType::SetIndexBuffer, ib.BufferLocation, ib.SizeInBytes, ib.Format));
+        recorder.SetIndexBuffer(ib);
+        ++dropped;
+        // A view that differs in one field is a new view.
+        ib.Format = 42;
+        recorder.SetIndexBuffer(ib);
+        forwarded(MakeCall(RenderCommandType::SetIndexBuffer, ib.BufferLocation, ib.SizeInBytes, ib.Format));
+
+        recorder.SetPrimitiveTopology(4);
+        forwarded(MakeCall(RenderCommandType::SetPrimitiveTopology, 4));
+        recorder.SetPrimitiveTopology(4);
+        ++dropped;
+        recorder.SetPrimitiveTopology(0);
+        forwarded(MakeCall(RenderCommandType::SetPrimitiveTopology, 0));
+        recorder.SetPrimitiveTopology(0);
+        forwarded(MakeCall(RenderCommandType::SetPrimitiveTopology, 0));
+
+        // Root arguments: per parameter, kind and value.
+        recorder.SetGraphicsRootConstantBufferView(1, 0x3000);
+        forwarded(MakeCall(RenderCommandType::SetRootConstantBufferView, 1, 0x3000));
+        recorder.SetGraphicsRootConstantBufferView(1, 0x3000);
+        ++dropped;
+        recorder.SetGraphicsRootShaderResourceView(1, 0x3000);
+        forwarded(MakeCall(RenderCommandType::SetRootShaderResourceView, 1, 0x3000));
+        recorder.SetGraphicsRootShaderResourceView(2, 0x3000);
+        forwarded(MakeCall(RenderCommandType::SetRootShaderResourceView, 2, 0x3000));
+        recorder.SetGraphicsRoot32BitConstant(0, 7, 0);
+        forwarded(MakeCall(RenderCommandType::SetRoot32BitConstant, 0, 7, 0));
+        recorder.SetGraphicsRoot32BitConstant(0, 7, 0);
+        ++dropped;
+        recorder.SetGraphicsRoot32BitConstant(0, 7, 1);
+        forwarded(MakeCall(RenderCommandType::SetRoot32BitConstant, 0, 7, 1));
+        recorder.SetGraphicsRoot32BitConstant(0, 7, 0);
+        forwarded(MakeCall(RenderCommandType::SetRoot32BitConstant, 0, 7, 0));
+
+        // Past the cached parameters everything goes through.
+        std::uint32_t high = BasicCommandRecorder<CommandList>::MaxRootParameters;
+        recorder.SetGraphicsRootConstantBufferView(high, 0x5000);
+        forwarded(MakeCall(RenderCommandType::SetRootConstantBufferView, high, 0x5000));
+        recorder.SetGraphicsRootConstantBufferView(high, 0x5000);
+        forwarded(MakeCall(RenderCommandType::SetRootConstantBufferView, high, 0x5000));
+
+        // Draws are never filtered.
+        for(int i = 0; i < 2; ++i)
+        {
+            recorder.DrawIndexedInstanced(36, 5, 12, -4, 100);
+            forwarded(MakeCall(RenderCommandType::DrawIndexedInstanced, 36, 5, 12, (std::uint64_t)(std::int64_t)-4, 100));
+        }
+
+        // The same signature keeps the root arguments; another one drops
+        // them, so the same CBV is bound again.
+        recorder.SetGraphicsRootSignature(&gSignatures[0]);
+        ++dropped;
+        recorder.SetGraphicsRootConstantBufferView(1, 0x3000);
+        forwarded(MakeCall(RenderCommandType::SetRootConstantBufferView, 1, 0x3000));
+        recorder.SetGraphicsRootShaderResourceView(2, 0x3000);
+        ++dropped;
+        recorder.SetGraphicsRootSignature(&gSignatures[1]);
+        forwarded(MakeCall(RenderCommandType::SetRootSignature, Pointer(&gSignatures[1])));
+        recorder.SetGraphicsRootShaderResourceView(2, 0x3000);
+        forwarded(MakeCall(RenderCommandType::SetRootShaderResourceView, 2, 0x3000));
+
+        // Other state survives a new root signature.
+        recorder.SetPipelineState(&gPipelines[0]);
+        ++dropped;
+        recorder.SetVertexBuffer(vb);
+        ++dropped;
+        recorder.SetPipelineState(&gPipelines[1]);
+        forwarded(MakeCall(RenderCommandType::SetPipelineState, Pointer(&gPipelines[1])));
+        recorder.DrawIndexedInstanced(6, 1, 0, 0, 0);
+        forwarded(MakeCall(RenderCommandType::DrawIndexedInstanced, 6, 1, 0, 0, 0));
+        return dropped;
+    }
+
+    void TestRecorder()
+    {
+        std::printf("Recorder checks\n");
+        MockCommandList mock;
+        BasicCommandRecorder<MockCommandList> recorder(&mock);
+        std::vector<Call> expected;
+        std::uint32_t dropped = Script(recorder, expected);
+        Check(mock.Log == expected, "the mock receives exactly the calls that change state, and draws");
+        Check(recorder.GetStats().Calls == expected.size(), "Calls counts forwarded calls");
+        Check(recorder.GetStats().RedundantCalls == dropped, "RedundantCalls counts dropped calls");
+        Check(recorder.GetStats().Draws == 3 && recorder.GetStats().Instances == 11, "draws and instances");
+
+        // Reset forgets the cache, so the whole script forwards as before;
+        // the stats keep adding up until ResetStats().
+        MockCommandList second;
+        recorder.Reset(&second);
+        Check(recorder.Get() == &second, "Reset switches the command list");
+        std::vector<Call> again;
+        Script(recorder, again);
+        Check(second.Log == expected && again == expected, "Reset forgets all bound state");
+        Check(recorder.GetStats().Calls == 2 * expected.size(), "stats accumulate across Reset");
+        recorder.ResetStats();
+        Check(recorder.GetStats().Calls == 0 && recorder.GetStats().Draws == 0, "ResetStats clears them");
+
+        // A stream records what the mock saw.
+        RenderCommandStream stream;
+        CommandRecorder streamRecorder(&stream);
+        std::vector<Call> unused;
+        Script(streamRecorder, unused);
+        Check(stream.CommandCount() == expected.size() && Decode(stream) == expected,
+            "a RenderCommandStream records the same calls");
+        Check(stream.ByteSize() % 8 == 0, "the stream is whole words");
+        stream.Clear();
+        Check(stream.CommandCount() == 0 && stream.Begin() == stream.End(), "Clear empties the stream");
+
+        // Sort keys order by pipeline, geometry, material, then depth.
+        bool keys = DrawSortKey::Make(0, 9, 9, 1e6f) < DrawSortKey::Make(1, 0, 0, 0.0f) &&
+            DrawSortKey::Make(2, 0, 9, 1e6f) < DrawSortKey::Make(2, 1, 0, 0.0f) &&
+            DrawSortKey::Make(2, 3, 0, 1e6f) < DrawSortKey::Make(2, 3, 1, 0.0f) &&
+            DrawSortKey::Make(2, 3, 4, 0.5f) < DrawSortKey::Make(2, 3, 4, 0.75f) &&
+            DrawSortKey::Make(2, 3, 4, -5.0f) == DrawSortKey::Make(2, 3, 4, 0.0f);
+        Check(keys, "DrawSortKey orders by pipeline, geometry, material, depth");
+        bool monotonic = true;
+        float previous = 0.0f;
+        for(float depth = 1e-3f; depth < 1e5f; depth *= 1.01f)
+        {
+            monotonic &= DrawSortKey::QuantizeDepth(depth) >= DrawSortKey::QuantizeDepth(previous);
+            previous = depth;
+        }
+        Check(monotonic, "QuantizeDepth keeps depth order");
+        EndChecks();
+    }
+
+    // A frame as EnzeApp records it: each draw binds its geometry's buffers
+    // and its batch's instance offset, so most binds repeat.
+    template<typename Sink>
+    void RecordFrame(Sink& sink, std::uint32_t drawCount)
+    {
+        sink.SetGraphicsRootSignature(&gSignatures[0]);
+        sink.SetPipelineState(&gPipelines[0]);
+        sink.SetGraphicsRootShaderResourceView(2, 0x8000);
+        sink.SetGraphicsRootConstantBufferView(3, 0x9000);
+        for(std::uint32_t i = 0; i < drawCount; ++i)
+        {
+            std::uint32_t geometry = i / 64;
+            RenderVertexBufferView vb;
+            vb.BufferLocation = 0x100000 + geometry * 0x1000;
+            vb.SizeInBytes = 0x1000;
+            vb.StrideInBytes = 24;
+            RenderIndexBufferView ib;
+            ib.BufferLocation = 0x800000 + geometry * 0x400;
+            ib.SizeInBytes = 0x400;
+            ib.Format = 57;
+            sink.SetVertexBuffer(vb);
+            sink.SetIndexBuffer(ib);
+            sink.SetPrimitiveTopology(4);
+            sink.SetGraphicsRootShaderResourceView(2, 0x8000);
+            sink.SetGraphicsRoot32BitConstant(0, i, 0);
+            sink.DrawIndexedInstanced(36, 4, (i % 64) * 36, 0, i * 4);
+        }
+    }
+
+    void Benchmark(std::uint32_t drawCount)
+    {
+        std::printf("Recording %u draws, best of %d\n", drawCount, gRepetitions);
+        RenderCommandStream direct, filtered;
+        double directTime = Time([&]()
+        {
+            direct.Clear();
+            RecordFrame(direct, drawCount);
+            gSink += direct.CommandCount();
+        });
+        CommandRecorder recorder;
+        double filteredTime = Time([&]()
+        {
+            filtered.Clear();
+            recorder.Reset(&filtered);
+            RecordFrame(recorder, drawCount);
+            gSink += filtered.CommandCount();
+        });
+        std::printf("  %-10s %9.3f ms %8zu commands %9zu bytes\n", "stream", directTime * 1e3,
+            direct.CommandCount(), direct.ByteSize());
+        std::printf("  %-10s %9.3f ms %8zu commands %9zu bytes\n", "recorder", filteredTime * 1e3,
+            filtered.CommandCount(), filtered.ByteSize());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestRecorder();
+    Benchmark(quick ? 10000 : 100000);
+    return Finish(gSink);
+}
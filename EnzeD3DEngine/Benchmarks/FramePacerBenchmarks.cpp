@@ -0,0 +1,230 @@
+// FramePacer against SimulatedGpuTimeline, the virtual GPU clock that lets
+// frame pacing be measured without a GPU.  The timeline's completion times,
+// waits and vsync rounding are checked by hand; then simulated frame loops
+// check that the pacer never lets more than FramesInFlight() frames queue,
+// that a GPU-bound loop runs at the GPU's rate with FramesInFlight() frames
+// of latency, that a CPU-bound one never stalls, and that changing the
+// number of frames in flight drains the GPU first.  The program fails on a
+// difference.  Then a table of simulated frame times and latencies is
+// printed and the pacer's own overhead is timed.  --quick simulates fewer
+// frames.
+
+#include "FramePacer.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+    size_t gSink = 0;
+
+    bool Near(double a, double b)
+    {
+        return std::fabs(a - b) < 1e-6;
+    }
+
+    void TestTimeline()
+    {
+        std::printf("Simulated timeline checks\n");
+        SimulatedGpuTimeline gpu(10.0);
+        gpu.Signal(1);
+        gpu.AdvanceCpu(5.0);
+        gpu.Signal(2);
+        Check(Near(gpu.CompletionTimeMs(1), 10.0) && Near(gpu.CompletionTimeMs(2), 20.0),
+            "frames run back to back on the GPU");
+        Check(gpu.CompletedValue() == 0, "nothing completes before its time");
+        gpu.WaitForValue(1);
+        Check(Near(gpu.NowMs(), 10.0) && gpu.CompletedValue() == 1, "a wait jumps to the completion");
+        gpu.WaitForValue(1);
+        Check(Near(gpu.NowMs(), 10.0), "waiting for completed work costs nothing");
+        Check(gpu.CompletionTimeMs(3) < 0.0, "unsignaled values never complete");
+
+        // An idle GPU starts a frame when it is submitted.
+        gpu.AdvanceCpu(30.0);
+        Check(gpu.CompletedValue() == 2, "later frames complete as the clock moves");
+        gpu.Signal(5);
+        Check(Near(gpu.CompletionTimeMs(5), 50.0), "an idle GPU starts on submission");
+        Check(Near(gpu.CompletionTimeMs(4), 50.0), "a value between signals completes with the later one");
+        gpu.SetGpuFrameMs(1.0);
+        gpu.Signal(6);
+        Check(Near(gpu.CompletionTimeMs(6), 51.0), "the GPU frame time can change");
+
+        // With vsync a frame completes on the next interval boundary.
+        SimulatedGpuTimeline vsync(5.0, 16.0);
+        vsync.Signal(1);
+        vsync.Signal(2);
+        vsync.AdvanceCpu(40.0);
+        vsync.Signal(3);
+        Check(Near(vsync.CompletionTimeMs(1), 16.0) && Near(vsync.CompletionTimeMs(2), 32.0) &&
+            Near(vsync.CompletionTimeMs(3), 48.0), "vsync rounds completions up to the present interval");
+        EndChecks();
+    }
+
+    struct Run
+    {
+        // Steady state averages, after the first frames in flight.
+        double FrameMs = 0.0;
+        double LatencyMs = 0.0;
+        double WaitMs = 0.0;
+        std::uint64_t MaxQueued = 0;
+        std::uint64_t StalledFrames = 0;
+        bool Idle = false;
+    };
+
+    // A loop of frames taking cpuMs on the CPU and gpuMs on the GPU.
+    // Latency runs from when BeginFrame() lets the frame's CPU work start to
+    // the frame's completion on the GPU.
+    Run Simulate(std::uint32_t framesInFlight, double cpuMs, double gpuMs, double presentMs, int frameCount)
+    {
+        SimulatedGpuTimeline gpu(gpuMs, presentMs);
+        FramePacer pacer(gpu, framesInFlight);
+        const int warmup = 8;
+
+        Run run;
+        double firstBeginMs = 0.0, lastBeginMs = 0.0;
+        for(int f = 0; f < frameCount; ++f)
+        {
+            if(f == warmup)
+                pacer.ResetTelemetry();
+            pacer.BeginFrame();
+            double beginMs = gpu.NowMs();
+            gpu.AdvanceCpu(cpuMs);
+            std::uint64_t fence = pacer.EndFrame();
+            run.MaxQueued = std::max(run.MaxQueued, pacer.LastSignaledValue() - gpu.CompletedValue());
+
+            if(f == warmup)
+                firstBeginMs = beginMs;
+            if(f >= warmup)
+            {
+                lastBeginMs = beginMs;
+                run.LatencyMs += gpu.CompletionTimeMs(fence) - beginMs;
+            }
+        }
+        const int measured = frameCount - warmup;
+        run.FrameMs = (lastBeginMs - firstBeginMs) / (measured - 1);
+        run.LatencyMs /= measured;
+        run.WaitMs = pacer.GetTelemetry().TotalWaitMs / pacer.GetTelemetry().Frames;
+        run.StalledFrames = pacer.GetTelemetry().StalledFrames;
+
+        pacer.WaitForIdle();
+        run.Idle = gpu.CompletedValue() == pacer.LastSignaledValue();
+        return run;
+    }
+
+    void TestPacing(int frameCount)
+    {
+        std::printf("Pacing checks\n");
+        bool bounded = true, idle = true;
+        for(std::uint32_t n = 1; n <= 4; ++n)
+        {
+            for(double cpuMs : { 2.0, 10.0 })
+            {
+                Run run = Simulate(n, cpuMs, 12.0 - cpuMs, 0.0, frameCount);
+                bounded &= run.MaxQueued <= n;
+                idle &= run.Idle;
+            }
+        }
+        Check(bounded, "no more than FramesInFlight() frames are queued");
+        Check(idle, "WaitForIdle drains the GPU");
+
+        // GPU-bound: with one frame in flight CPU and GPU take turns; with
+        // more the GPU never idles and each frame waits for the GPU to
+        // finish the frames ahead of it.
+        Run serial = Simulate(1, 2.0, 10.0, 0.0, frameCount);
+        Check(Near(serial.FrameMs, 12.0) && Near(serial.LatencyMs, 12.0), "one frame in flight serializes CPU and GPU");
+        bool gpuRate = true;
+        for(std::uint32_t n = 2; n <= 4; ++n)
+        {
+            Run run = Simulate(n, 2.0, 10.0, 0.0, frameCount);
+            gpuRate &= Near(run.FrameMs, 10.0) && Near(run.LatencyMs, 10.0 * n) &&
+                run.StalledFrames == (std::uint64_t)(frameCount - 8);
+        }
+        Check(gpuRate, "GPU-bound loops run at the GPU's rate with a frame of latency per frame in flight");
+
+        // CPU-bound: the GPU is always done before the CPU comes back.
+        Run cpuBound = Simulate(2, 10.0, 2.0, 0.0, frameCount);
+        Check(Near(cpuBound.FrameMs, 10.0) && Near(cpuBound.LatencyMs, 12.0) && cpuBound.StalledFrames == 0 &&
+            Near(cpuBound.WaitMs, 0.0), "CPU-bound loops never wait");
+
+        // Vsync: frames come at the present interval.
+        Run vsync = Simulate(2, 2.0, 5.0, 16.0, frameCount);
+        Check(Near(vsync.FrameMs, 16.0), "vsync paces frames at the present interval");
+
+        // Changing the number of frames in flight waits for the GPU, so the
+        // next frame finds every slot free.
+        SimulatedGpuTimeline gpu(10.0);
+        FramePacer pacer(gpu, 2);
+        for(int f = 0; f < 5; ++f)
+        {
+            pacer.BeginFrame();
+            gpu.AdvanceCpu(1.0);
+            pacer.EndFrame();
+        }
+        pacer.SetFramesInFlight(3);
+        Check(pacer.FramesInFlight() == 3 && pacer.CurrentSlot() == 0 &&
+            gpu.CompletedValue() == pacer.LastSignaledValue(), "SetFramesInFlight drains the GPU");
+        pacer.ResetTelemetry();
+        for(int f = 0; f < 3; ++f)
+        {
+            Check(pacer.BeginFrame() == (std::uint32_t)f, "slots are handed out in turn");
+            pacer.EndFrame();
+        }
+        Check(pacer.GetTelemetry().StalledFrames == 0, "fresh slots do not wait");
+        pacer.BeginFrame();
+        pacer.EndFrame();
+        Check(pacer.GetTelemetry().StalledFrames == 1 && pacer.FrameHistory().back().FramesQueued == 3,
+            "the fourth frame waits for the first");
+        pacer.SetFramesInFlight(0);
+        Check(pacer.FramesInFlight() == 1, "at least one frame is in flight");
+
+        // Work fenced outside frames takes the next fence value.
+        std::uint64_t signaled = pacer.Signal();
+        pacer.BeginFrame();
+        Check(pacer.EndFrame() == signaled + 1 && pacer.FrameCount() == 10, "frames and signals share one fence");
+        EndChecks();
+    }
+
+    void Benchmark(int frameCount)
+    {
+        std::printf("Simulated frame loops by CPU, GPU and present interval (ms)\n");
+        std::printf("  %-16s %8s %10s %10s %10s\n", "cpu/gpu/vsync", "in flight", "frame", "latency", "wait");
+        struct Case { double Cpu, Gpu, Present; };
+        for(const Case& c : { Case{ 4.0, 12.0, 0.0 }, Case{ 12.0, 4.0, 0.0 }, Case{ 4.0, 12.0, 16.7 } })
+        {
+            for(std::uint32_t n = 1; n <= 4; ++n)
+            {
+                Run run = Simulate(n, c.Cpu, c.Gpu, c.Present, frameCount);
+                char name[32];
+                std::snprintf(name, sizeof(name), "%.0f/%.0f/%.1f", c.Cpu, c.Gpu, c.Present);
+                std::printf("  %-16s %8u %10.2f %10.2f %10.2f\n", name, n, run.FrameMs, run.LatencyMs, run.WaitMs);
+            }
+        }
+
+        // The pacer's own cost per frame, on a timeline that never blocks.
+        std::printf("\nPacer overhead, %d frames, best of %d\n", frameCount, gRepetitions);
+        double seconds = Time([&]()
+        {
+            SimulatedGpuTimeline gpu(0.0);
+            FramePacer pacer(gpu, 3);
+            for(int f = 0; f < frameCount; ++f)
+            {
+                gSink += pacer.BeginFrame();
+                gSink += (size_t)pacer.EndFrame();
+            }
+        });
+        std::printf("  %-12s %9.3f ms %7.2f ns/frame\n", "Begin+End", seconds * 1e3, seconds * 1e9 / frameCount);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestTimeline();
+    TestPacing(quick ? 200 : 2000);
+    Benchmark(quick ? 2000 : 100000);
+    return Finish(gSink);
+}
@@ -0,0 +1,508 @@
+// The CPU side of a frame, without a GPU: render items are culled, batched
+// by InstanceBatcher, recorded into a RenderCommandStream the way
+// EnzeApp::RecordChunk and RenderGroupItems record them, and submitted to a
+// NullRenderBackend.  The backend's counts and its copy of the stream are
+// checked against the batches: one draw per batch with the batch's instance
+// range, binds only where the geometry changes, and the frame's barriers and
+// clears once each.  The same frame is recorded in chunks by a
+// ParallelCommandRecorder and its streams, replayed in chunk order as if
+// each were a fresh command list, must draw the same draws with the same
+// bound state in the same order as the serial stream; the program fails on a
+// difference.  Then the stages of a frame are timed at several scene sizes,
+// and chunked recording against serial.  --quick skips the largest.
+
+#include "CommandRecorder.h"
+#include "FrustumCuller.h"
+#include "InstanceBatcher.h"
+#include "JobSystem.h"
+#include "MyTimer.h"
+#include "ParallelCommandRecorder.h"
+#include "RenderBackend.h"
+#include "RenderItemStore.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    size_t gSink = 0;
+
+    // Stand-ins for the D3D12 objects the stream only carries as opaque
+    // values.
+    int gPipeline, gRootSignature, gBackBuffer;
+    const int GeometryCount = 6;
+    std::uint64_t gGeometryStorage[GeometryCount];
+    const RenderGpuAddress PassAddress = 0x7000, MaterialAddress = 0x8000, ObjectAddress = 0x9000,
+        InstanceAddress = 0xa000;
+    const RenderDescriptor RenderTarget = 0x100, DepthStencil = 0x200;
+
+    RenderVertexBufferView VertexView(std::uint32_t geometryId)
+    {
+        RenderVertexBufferView view;
+        view.BufferLocation = 0x100000 * (geometryId + 1);
+        view.SizeInBytes = 0x80000;
+        view.StrideInBytes = 24;
+        return view;
+    }
+
+    RenderIndexBufferView IndexView(std::uint32_t geometryId)
+    {
+        RenderIndexBufferView view;
+        view.BufferLocation = 0x100000 * (geometryId + 1) + 0x80000;
+        view.SizeInBytes = 0x20000;
+        view.Format = 57;
+        return view;
+    }
+
+    // A scene and what one frame derives from it, with EnzeApp's stages.
+    struct Frame
+    {
+        std::mt19937 Rng{ 17 };
+        std::vector<Material> Materials;
+        RenderItemStore Items;
+        FrustumCuller::Planes Planes;
+        XMFLOAT4X4 View;
+        std::vector<std::uint32_t> Visible;
+        std::vector<float> VisibleDepths;
+        InstanceBatcher Batcher;
+
+        // Items spread over GeometryCount geometries of submeshCount
+        // submeshes each, so up to GeometryCount * submeshCount draw states.
+        explicit Frame(size_t itemCount, int submeshCount = 8) : Materials(4)
+        {
+            for(size_t m = 0; m < Materials.size(); ++m)
+                Materials[m].MatCBIndex = (int)m;
+
+            XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(30.0f, 20.0f, -40.0f, 1.0f),
+                XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+            XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.0f / 9.0f, 1.0f, 300.0f);
+            XMStoreFloat4x4(&View, view);
+            Planes = FrustumCuller::ExtractPlanes(XMMatrixMultiply(view, proj));
+
+            float halfSize = 4.0f * std::cbrt((float)itemCount);
+            std::uniform_real_distribution<float> position(-halfSize, halfSize);
+            std::uniform_int_distribution<int> geometry(0, GeometryCount - 1), submesh(0, submeshCount - 1), material(0, 3);
+            Items.Reserve(itemCount);
+            for(size_t i = 0; i < itemCount; ++i)
+            {
+                RenderItemDesc desc;
+                XMStoreFloat4x4(&desc.World, XMMatrixTranslation(position(Rng), position(Rng), position(Rng)));
+                int g = geometry(Rng), s = submesh(Rng);
+                desc.Geo = reinterpret_cast<MeshGeometry*>(&gGeometryStorage[g]);
+                desc.Mat = &Materials[material(Rng)];
+                desc.DrawArgs.IndexCount = 36 + 6 * s;
+                desc.DrawArgs.StartIndexLocation = 1000 * s;
+                desc.DrawArgs.BaseVertexLocation = 24 * g;
+                desc.DrawArgs.Bounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+                Items.Add(desc);
+            }
+        }
+
+        // EnzeApp::CullRenderItems, below the BVH threshold.
+        void Cull()
+        {
+            const AabbSoA& bounds = Items.WorldBounds();
+            Visible.resize(bounds.Size());
+            Visible.resize(FrustumCuller::Cull(Planes, bounds, 0, bounds.Size(), Visible.data()));
+        }
+
+        // EnzeApp::BatchVisibleItems, without the upload.
+        void Batch()
+        {
+            const AabbSoA& bounds = Items.WorldBounds();
+            VisibleDepths.resize(Visible.size());
+            for(size_t i = 0; i < Visible.size(); ++i)
+            {
+                std::uint32_t item = Visible[i];
+                VisibleDepths[i] = bounds.CenterX[item] * View._13 + bounds.CenterY[item] * View._23 +
+                    bounds.CenterZ[item] * View._33 + View._43;
+            }
+            Batcher.Build(Items, Visible.data(), Visible.size(), VisibleDepths.data());
+            Batcher.SortBatches(Items);
+        }
+
+        // EnzeApp::RecordChunk and RenderGroupItems for batches [begin, end)
+        // as chunk of chunkCount.
+        void Record(std::uint32_t chunk, std::uint32_t chunkCount, std::uint32_t begin, std::uint32_t end,
+            RenderCommandStream& stream, CommandRecorder& recorder)const
+        {
+            recorder.SetPipelineState(&gPipeline);
+            RenderViewport viewport;
+            viewport.Width = 1280.0f;
+            viewport.Height = 720.0f;
+            RenderRect rect;
+            rect.Right = 1280;
+            rect.Bottom = 720;
+            stream.SetViewport(viewport);
+            stream.SetScissorRect(rect);
+            if(chunk == 0)
+            {
+                const float color[4] = { 0.69f, 0.77f, 0.87f, 1.0f };
+                stream.ResourceBarrier(&gBackBuffer, RenderResourceState::Present, RenderResourceState::RenderTarget);
+                stream.ClearRenderTarget(RenderTarget, color);
+                stream.ClearDepthStencil(DepthStencil, 1.0f, 0);
+            }
+            stream.SetRenderTargets(RenderTarget, DepthStencil);
+            recorder.SetGraphicsRootSignature(&gRootSignature);
+            recorder.SetGraphicsRootConstantBufferView(1, PassAddress);
+
+            recorder.SetGraphicsRootShaderResourceView(2, MaterialAddress);
+            recorder.SetGraphicsRootShaderResourceView(3, ObjectAddress);
+            recorder.SetGraphicsRootShaderResourceView(4, InstanceAddress);
+            const std::vector<DrawState>& states = Items.DrawStates();
+            const std::vector<InstanceBatch>& batches = Batcher.Batches();
+            for(std::uint32_t i = begin; i < end; ++i)
+            {
+                const InstanceBatch& batch = batches[i];
+                const DrawState& state = states[batch.DrawState];
+                recorder.SetVertexBuffer(VertexView(state.GeometryId));
+                recorder.SetIndexBuffer(IndexView(state.GeometryId));
+                recorder.SetPrimitiveTopology(state.PrimitiveType);
+                recorder.SetGraphicsRoot32BitConstant(0, batch.InstanceOffset, 0);
+                recorder.DrawIndexedInstanced(state.IndexCount, batch.InstanceCount,
+                    state.StartIndexLocation, state.BaseVertexLocation, 0);
+            }
+
+            if(chunk + 1 == chunkCount)
+                stream.ResourceBarrier(&gBackBuffer, RenderResourceState::RenderTarget, RenderResourceState::Present);
+        }
+    };
+
+    bool SameStream(const RenderCommandStream& a, const RenderCommandStream& b)
+    {
+        size_t bytes = (const std::uint8_t*)a.End() - (const std::uint8_t*)a.Begin();
+        return a.CommandCount() == b.CommandCount() &&
+            bytes == (size_t)((const std::uint8_t*)b.End() - (const std::uint8_t*)b.Begin()) &&
+            (bytes == 0 || std::memcmp(a.Begin(), b.Begin(), bytes) == 0);
+    }
+
+    // What a draw sees on the GPU: the draw and the state bound when it is
+    // issued.
+    struct BoundDraw
+    {
+        const void* PipelineState = nullptr;
+        const void* RootSignature = nullptr;
+        RenderDescriptor RenderTarget = 0;
+        RenderGpuAddress VertexBuffer = 0;
+        RenderGpuAddress IndexBuffer = 0;
+        std::uint32_t Topology = 0;
+        RenderGpuAddress RootViews[5] = {};
+        std::uint32_t InstanceOffset = ~0u;
+        std::uint32_t IndexCount = 0;
+        std::uint32_t InstanceCount = 0;
+        std::uint32_t StartIndex = 0;
+        std::int32_t BaseVertex = 0;
+
+        bool operator==(const BoundDraw& rhs)const
+        {
+            return PipelineState == rhs.PipelineState && RootSignature == rhs.RootSignature &&
+                RenderTarget == rhs.RenderTarget && VertexBuffer == rhs.VertexBuffer &&
+                IndexBuffer == rhs.IndexBuffer && Topology == rhs.Topology &&
+                std::equal(RootViews, RootViews + 5, rhs.RootViews) && InstanceOffset == rhs.InstanceOffset &&
+                IndexCount == rhs.IndexCount && InstanceCount == rhs.InstanceCount &&
+                StartIndex == rhs.StartIndex && BaseVertex == rhs.BaseVertex;
+        }
+    };
+
+    // Replays stream as one new command list, which starts with nothing
+    // bound, appending its draws.  Counts clears and barriers into events.
+    void Replay(const RenderCommandStream& stream, std::vector<BoundDraw>& draws, size_t events[2])
+    {
+        BoundDraw bound;
+        for(auto c = stream.Begin(); c != stream.End(); c = RenderCommandStream::Next(c))
+        {
+            switch(c->Type)
+            {
+            case RenderCommandType::SetPipelineState:
+                bound.PipelineState = reinterpret_cast<const RenderCommand::SetPipelineState*>(c)->PipelineState;
+                break;
+            case RenderCommandType::SetRootSignature:
+                // Root arguments do not survive a root signature change.
+                bound.RootSignature = reinterpret_cast<const RenderCommand::SetRootSignature*>(c)->RootSignature;
+                std::fill(bound.RootViews, bound.RootViews + 5, 0);
+                bound.InstanceOffset = ~0u;
+                break;
+            case RenderCommandType::SetRenderTargets:
+                bound.RenderTarget = reinterpret_cast<const RenderCommand::SetRenderTargets*>(c)->RenderTarget;
+                break;
+            case RenderCommandType::ClearRenderTarget:
+            case RenderCommandType::ClearDepthStencil:
+                ++events[0];
+                break;
+            case RenderCommandType::ResourceBarrier:
+                ++events[1];
+                break;
+            case RenderCommandType::SetVertexBuffer:
+                bound.VertexBuffer = reinterpret_cast<const RenderCommand::SetVertexBuffer*>(c)->View.BufferLocation;
+                break;
+            case RenderCommandType::SetIndexBuffer:
+                bound.IndexBuffer = reinterpret_cast<const RenderCommand::SetIndexBuffer*>(c)->View.BufferLocation;
+                break;
+            case RenderCommandType::SetPrimitiveTopology:
+                bound.Topology = reinterpret_cast<const RenderCommand::SetPrimitiveTopology*>(c)->Topology;
+                break;
+            case RenderCommandType::SetRootConstantBufferView:
+            case RenderCommandType::SetRootShaderResourceView:
+            {
+                const RenderCommand::SetRootView* view = reinterpret_cast<const RenderCommand::SetRootView*>(c);
+                if(view->RootParameter < 5)
+                    bound.RootViews[view->RootParameter] = view->Address;
+                break;
+            }
+            case RenderCommandType::SetRoot32BitConstant:
+                bound.InstanceOffset = reinterpret_cast<const RenderCommand::SetRoot32BitConstant*>(c)->Value;
+                break;
+            case RenderCommandType::DrawIndexedInstanced:
+            {
+                const RenderCommand::DrawIndexedInstanced* draw =
+                    reinterpret_cast<const RenderCommand::DrawIndexedInstanced*>(c);
+                BoundDraw d = bound;
+                d.IndexCount = draw->IndexCountPerInstance;
+                d.InstanceCount = draw->InstanceCount;
+                d.StartIndex = draw->StartIndexLocation;
+                d.BaseVertex = draw->BaseVertexLocation;
+                draws.push_back(d);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    void TestFrame()
+    {
+        std::printf("Frame checks\n");
+        Frame frame(20000);
+        frame.Cull();
+        frame.Batch();
+        const std::vector<InstanceBatch>& batches = frame.Batcher.Batches();
+        Check(!batches.empty() && frame.Visible.size() < frame.Items.Size(), "some items are culled, some drawn");
+
+        RenderCommandStream stream;
+        CommandRecorder recorder(&stream);
+        frame.Record(0, 1, 0, (std::uint32_t)batches.size(), stream, recorder);
+        NullRenderBackend backend(true);
+        backend.Submit(stream);
+
+        const NullRenderBackend::Stats& stats = backend.GetStats();
+        auto count = [&stats](RenderCommandType type) { return stats.CommandsOfType[(size_t)type]; };
+        Check(stats.Submits == 1 && stats.Commands == stream.CommandCount() && stats.Bytes == stream.ByteSize(),
+            "the backend sees the whole stream");
+        Check(SameStream(backend.LastStream(), stream), "the backend keeps an identical copy");
+        Check(count(RenderCommandType::DrawIndexedInstanced) == batches.size(), "one draw per batch");
+        Check(stats.Instances == frame.Visible.size(), "one instance per visible item");
+        Check(count(RenderCommandType::ResourceBarrier) == 2 && count(RenderCommandType::ClearRenderTarget) == 1 &&
+            count(RenderCommandType::ClearDepthStencil) == 1 && count(RenderCommandType::SetRenderTargets) == 1,
+            "the back buffer is transitioned, cleared and bound once");
+        Check(count(RenderCommandType::SetPipelineState) == 1 && count(RenderCommandType::SetRootSignature) == 1 &&
+            count(RenderCommandType::SetPrimitiveTopology) == 1, "frame-wide state is bound once");
+
+        // Batches are sorted by geometry, so each geometry's buffers are
+        // bound once.
+        std::vector<std::uint32_t> geometries;
+        for(const InstanceBatch& batch : batches)
+            geometries.push_back(frame.Items.DrawStates()[batch.DrawState].GeometryId);
+        size_t geometryChanges = std::unique(geometries.begin(), geometries.end()) - geometries.begin();
+        Check(count(RenderCommandType::SetVertexBuffer) == geometryChanges &&
+            count(RenderCommandType::SetIndexBuffer) == geometryChanges, "buffers bound once per geometry");
+
+        // Each draw carries its batch's arguments, with the batch's instance
+        // offset in root constant 0 ahead of it.
+        bool draws = true;
+        size_t drawIndex = 0;
+        std::uint32_t instanceOffset = ~0u;
+        const RenderCommandHeader* first = backend.LastStream().Begin();
+        bool framed = first != backend.LastStream().End() && first->Type == RenderCommandType::SetPipelineState;
+        const RenderCommandHeader* last = nullptr;
+        for(auto c = backend.LastStream().Begin(); c != backend.LastStream().End(); c = RenderCommandStream::Next(c))
+        {
+            last = c;
+            if(c->Type == RenderCommandType::SetRoot32BitConstant)
+                instanceOffset = reinterpret_cast<const RenderCommand::SetRoot32BitConstant*>(c)->Value;
+            if(c->Type != RenderCommandType::DrawIndexedInstanced)
+                continue;
+            const RenderCommand::DrawIndexedInstanced* draw = reinterpret_cast<const RenderCommand::DrawIndexedInstanced*>(c);
+            if(drawIndex >= batches.size())
+            {
+                draws = false;
+                break;
+            }
+            const InstanceBatch& batch = batches[drawIndex++];
+            const DrawState& state = frame.Items.DrawStates()[batch.DrawState];
+            draws &= draw->IndexCountPerInstance == state.IndexCount && draw->InstanceCount == batch.InstanceCount &&
+                draw->StartIndexLocation == state.StartIndexLocation &&
+                draw->BaseVertexLocation == state.BaseVertexLocation && instanceOffset == batch.InstanceOffset;
+        }
+        Check(draws && drawIndex == batches.size(), "draws carry their batch's arguments, in batch order");
+        framed &= last != nullptr && last->Type == RenderCommandType::ResourceBarrier &&
+            reinterpret_cast<const RenderCommand::ResourceBarrier*>(last)->After == RenderResourceState::Present;
+        Check(framed, "the frame starts with the pipeline and ends presentable");
+
+        // A second submit adds up; ResetStats starts over.
+        backend.Submit(stream);
+        Check(backend.GetStats().Submits == 2 && backend.GetStats().Commands == 2 * stream.CommandCount(),
+            "stats accumulate over submits");
+        backend.ResetStats();
+        Check(backend.GetStats().Submits == 0 && backend.GetStats().Instances == 0, "ResetStats clears them");
+
+        // With nothing visible the frame still clears and presents.
+        frame.Visible.clear();
+        frame.Batcher.Build(frame.Items, nullptr, 0);
+        stream.Clear();
+        recorder.Reset(&stream);
+        frame.Record(0, 1, 0, 0, stream, recorder);
+        backend.Submit(stream);
+        Check(backend.GetStats().CommandsOfType[(size_t)RenderCommandType::DrawIndexedInstanced] == 0 &&
+            backend.GetStats().CommandsOfType[(size_t)RenderCommandType::ResourceBarrier] == 2,
+            "an empty frame clears and presents");
+        EndChecks();
+    }
+
+    void TestChunkedRecording()
+    {
+        std::printf("Chunked recording checks\n");
+        Frame frame(20000);
+        frame.Cull();
+        frame.Batch();
+        const std::uint32_t batchCount = (std::uint32_t)frame.Batcher.Batches().size();
+
+        RenderCommandStream serial;
+        CommandRecorder serialRecorder(&serial);
+        frame.Record(0, 1, 0, batchCount, serial, serialRecorder);
+        std::vector<BoundDraw> expected;
+        size_t expectedEvents[2] = {};
+        Replay(serial, expected, expectedEvents);
+        Check(expected.size() == batchCount, "the serial frame draws every batch");
+
+        JobSystem jobs(3);
+        ParallelCommandRecorder parallel;
+        bool chunkCounts = true, ranges = true, sameDraws = true, sameEvents = true, pipelineFirst = true, stats = true;
+        struct Split { std::uint32_t Items, MaxChunks, MinItems; };
+        const Split splits[] = { { batchCount, 1, 1 }, { batchCount, 2, 1 }, { batchCount, 5, 4 },
+            { batchCount, 8, 16 }, { batchCount, 64, 1 }, { 3, 8, 1 }, { 0, 4, 1 } };
+        for(const Split& split : splits)
+        {
+            std::vector<std::uint32_t> begins(split.MaxChunks, ~0u), ends(split.MaxChunks, ~0u);
+            std::uint32_t chunkCount = parallel.Record(jobs, split.Items, split.MaxChunks, split.MinItems,
+                [&](std::uint32_t chunk, std::uint32_t begin, std::uint32_t end,
+                    RenderCommandStream& stream, CommandRecorder& recorder)
+            {
+                begins[chunk] = begin;
+                ends[chunk] = end;
+                frame.Record(chunk, parallel.ChunkCount(), begin, end, stream, recorder);
+            });
+            chunkCounts &= chunkCount >= 1 && chunkCount <= split.MaxChunks && chunkCount == parallel.ChunkCount() &&
+                (chunkCount == 1 || split.Items / chunkCount >= split.MinItems);
+
+            // Contiguous chunks, in order, differing in size by at most one.
+            std::uint32_t next = 0, smallest = ~0u, largest = 0;
+            for(std::uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+            {
+                ranges &= begins[chunk] == next && ends[chunk] >= begins[chunk];
+                next = ends[chunk];
+                smallest = std::min(smallest, ends[chunk] - begins[chunk]);
+                largest = std::max(largest, ends[chunk] - begins[chunk]);
+            }
+            ranges &= next == split.Items && largest - smallest <= 1;
+
+            std::vector<BoundDraw> draws;
+            size_t events[2] = {};
+            for(std::uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+            {
+                const RenderCommandStream& stream = parallel.Stream(chunk);
+                Replay(stream, draws, events);
+                pipelineFirst &= stream.Begin() != stream.End() && stream.Begin()->Type == RenderCommandType::SetPipelineState;
+            }
+            std::vector<BoundDraw> expectedPrefix(expected.begin(), expected.begin() + split.Items);
+            sameDraws &= draws == expectedPrefix;
+            sameEvents &= events[0] == expectedEvents[0] && events[1] == expectedEvents[1];
+            stats &= parallel.GetStats().Draws == split.Items;
+        }
+        Check(chunkCounts, "chunk counts respect maxChunks and minItemsPerChunk");
+        Check(ranges, "chunks cover the items in order, evenly");
+        Check(sameDraws, "chunks replayed in order draw what the serial stream draws, with the same state");
+        Check(sameEvents, "the chunks clear and transition the back buffer once between them");
+        Check(pipelineFirst, "every chunk binds its pipeline first");
+        Check(stats, "recorder stats sum over the chunks");
+        EndChecks();
+    }
+
+    void Benchmark(bool quick)
+    {
+        std::printf("One frame, best of %d (ms)\n", gRepetitions);
+        std::printf("  %8s %8s %8s %9s %9s %9s %9s %11s\n", "items", "visible", "batches",
+            "cull", "batch", "record", "submit", "commands");
+        for(size_t itemCount : { 1000u, 10000u, 100000u, 1000000u })
+        {
+            if(quick && itemCount > 10000)
+                continue;
+
+            Frame frame(itemCount);
+            RenderCommandStream stream;
+            CommandRecorder recorder;
+            NullRenderBackend backend;
+            double cull = Time([&]() { frame.Cull(); gSink += frame.Visible.size(); });
+            double batch = Time([&]() { frame.Batch(); gSink += frame.Batcher.Batches().size(); });
+            double record = Time([&]()
+            {
+                stream.Clear();
+                recorder.Reset(&stream);
+                frame.Record(0, 1, 0, (std::uint32_t)frame.Batcher.Batches().size(), stream, recorder);
+                gSink += stream.CommandCount();
+            });
+            double submit = Time([&]() { backend.Submit(stream); });
+            gSink += (size_t)backend.GetStats().Instances;
+
+            std::printf("  %8zu %8zu %8zu %9.3f %9.3f %9.3f %9.3f %11zu\n", itemCount, frame.Visible.size(),
+                frame.Batcher.Batches().size(), cull * 1e3, batch * 1e3, record * 1e3, submit * 1e3,
+                stream.CommandCount());
+        }
+
+        // Chunks pay for binding their own state; recording only spreads
+        // over the workers with enough batches, so this scene has many
+        // submeshes and hence many draw states.
+        Frame frame(quick ? 20000 : 200000, 4096);
+        frame.Cull();
+        frame.Batch();
+        const std::uint32_t batchCount = (std::uint32_t)frame.Batcher.Batches().size();
+        std::printf("\nRecording %u batches in chunks, best of %d (ms)\n", batchCount, gRepetitions);
+        std::printf("  %8s %9s %11s\n", "chunks", "record", "commands");
+        JobSystem jobs;
+        ParallelCommandRecorder parallel;
+        for(std::uint32_t maxChunks : { 1u, 2u, 4u, 8u })
+        {
+            size_t commands = 0;
+            double record = Time([&]()
+            {
+                std::uint32_t chunkCount = parallel.Record(jobs, batchCount, maxChunks, 256,
+                    [&](std::uint32_t chunk, std::uint32_t begin, std::uint32_t end,
+                        RenderCommandStream& stream, CommandRecorder& recorder)
+                {
+                    frame.Record(chunk, parallel.ChunkCount(), begin, end, stream, recorder);
+                });
+                commands = 0;
+                for(std::uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+                    commands += parallel.Stream(chunk).CommandCount();
+            });
+            gSink += commands;
+            std::printf("  %8u %9.3f %11zu\n", maxChunks, record * 1e3, commands);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestFrame();
+    TestChunkedRecording();
+    Benchmark(quick);
+    return Finish(gSink);
+}
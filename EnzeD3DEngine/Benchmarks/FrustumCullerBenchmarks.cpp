@@ -0,0 +1,254 @@
+// FrustumCuller::Cull on a million boxes against a scalar loop.  Cull's
+// output is first compared with a double precision reference of the same
+// plane test, over the whole array and over ranges with unaligned ends, and
+// checked to keep every box with a corner inside the view volume; the
+// program fails on a difference.  Then the SIMD path, the scalar loop and
+// Cull split across a JobSystem are timed.  --quick culls fewer boxes.
+
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    size_t gSink = 0;
+
+    XMMATRIX ViewProj()
+    {
+        XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(30.0f, 20.0f, -40.0f, 1.0f),
+            XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.0f / 9.0f, 1.0f, 300.0f);
+        return XMMatrixMultiply(view, proj);
+    }
+
+    // Boxes of mixed sizes scattered around the camera, so that a good share
+    // of them straddles a plane.
+    AabbSoA RandomBoxes(size_t count, std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> position(-400.0f, 400.0f);
+        std::uniform_real_distribution<float> logExtent(-3.0f, 3.0f);
+        AabbSoA boxes;
+        boxes.Reserve(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            BoundingBox box;
+            box.Center = XMFLOAT3(position(rng), position(rng) * 0.25f, position(rng));
+            box.Extents = XMFLOAT3(std::exp(logExtent(rng)), std::exp(logExtent(rng)), std::exp(logExtent(rng)));
+            boxes.PushBack(box);
+        }
+        return boxes;
+    }
+
+    // The plane test in double precision: the margin by which the box is
+    // inside the worst plane, negative when it is culled.
+    double Margin(const FrustumCuller::Planes& planes, const AabbSoA& boxes, size_t i)
+    {
+        double margin = 1e300;
+        for(const XMFLOAT4& n : planes.Plane)
+        {
+            double dist = (double)n.x * boxes.CenterX[i] + (double)n.y * boxes.CenterY[i] +
+                (double)n.z * boxes.CenterZ[i] + n.w;
+            double radius = std::fabs((double)n.x) * boxes.ExtentX[i] + std::fabs((double)n.y) * boxes.ExtentY[i] +
+                std::fabs((double)n.z) * boxes.ExtentZ[i];
+            margin = std::min(margin, dist + radius);
+        }
+        return margin;
+    }
+
+    // Whether a corner of box i lands inside D3D's clip volume.
+    bool CornerInside(FXMMATRIX viewProj, const AabbSoA& boxes, size_t i)
+    {
+        for(int c = 0; c < 8; ++c)
+        {
+            XMVECTOR corner = XMVectorSet(boxes.CenterX[i] + (c & 1 ? boxes.ExtentX[i] : -boxes.ExtentX[i]),
+                boxes.CenterY[i] + (c & 2 ? boxes.ExtentY[i] : -boxes.ExtentY[i]),
+                boxes.CenterZ[i] + (c & 4 ? boxes.ExtentZ[i] : -boxes.ExtentZ[i]), 1.0f);
+            XMFLOAT4 clip;
+            XMStoreFloat4(&clip, XMVector4Transform(corner, viewProj));
+            const float e = 1e-4f * std::fabs(clip.w);
+            if(clip.w > 0.0f && std::fabs(clip.x) <= clip.w - e && std::fabs(clip.y) <= clip.w - e &&
+                clip.z >= e && clip.z <= clip.w - e)
+                return true;
+        }
+        return false;
+    }
+
+    // Compares Cull over [begin, end) with the reference; boxes within
+    // rounding of a plane may go either way.
+    void CheckRange(const FrustumCuller::Planes& planes, const AabbSoA& boxes, size_t begin, size_t end)
+    {
+        // Guard entries after the end catch writes past end - begin.
+        const std::uint32_t guard = 0xdeadbeefu;
+        std::vector<std::uint32_t> visible(end - begin + 16, guard);
+        size_t count = FrustumCuller::Cull(planes, boxes, begin, end, visible.data());
+
+        bool increasing = true, inRange = true, agrees = true;
+        size_t next = 0;
+        for(size_t i = begin; i < end; ++i)
+        {
+            bool kept = next < count && visible[next] == i;
+            if(kept)
+                ++next;
+            double margin = Margin(planes, boxes, i);
+            if(std::fabs(margin) > 1e-3)
+                agrees &= kept == (margin >= 0.0);
+        }
+        for(size_t k = 0; k < count; ++k)
+        {
+            increasing &= k == 0 || visible[k] > visible[k - 1];
+            inRange &= visible[k] >= begin && visible[k] < end;
+        }
+        Check(count <= end - begin && next == count, "every written index is a box of the range");
+        Check(increasing && inRange, "indices are increasing and within the range");
+        Check(agrees, "Cull agrees with the reference plane test");
+        Check(std::all_of(visible.begin() + (end - begin), visible.end(),
+            [guard](std::uint32_t v) { return v == guard; }), "nothing is written past end - begin");
+    }
+
+    void Test(const FrustumCuller::Planes& planes, FXMMATRIX viewProj, const AabbSoA& boxes)
+    {
+        std::printf("Cull against the reference\n");
+        CheckRange(planes, boxes, 0, boxes.Size());
+        // Ends that are not multiples of the vector width, and tiny ranges
+        // handled by the scalar tail alone.
+        for(size_t begin : { (size_t)0, (size_t)1, (size_t)3, (size_t)7, (size_t)13 })
+            for(size_t length : { (size_t)0, (size_t)1, (size_t)5, (size_t)8, (size_t)9, (size_t)1001 })
+                CheckRange(planes, boxes, begin, begin + length);
+
+        // Conservative: a box with a corner inside the volume is never
+        // culled, whatever the rounding.
+        std::vector<std::uint32_t> visible(boxes.Size());
+        size_t count = FrustumCuller::Cull(planes, boxes, 0, boxes.Size(), visible.data());
+        std::vector<bool> kept(boxes.Size(), false);
+        for(size_t k = 0; k < count; ++k)
+            kept[visible[k]] = true;
+        bool conservative = true;
+        for(size_t i = 0; i < boxes.Size(); i += 7)
+            conservative &= kept[i] || !CornerInside(viewProj, boxes, i);
+        Check(conservative, "boxes with a corner inside the frustum are kept");
+
+        // TransformBox against the box around the eight transformed corners.
+        std::mt19937 rng(4);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        float error = 0.0f;
+        for(int t = 0; t < 1000; ++t)
+        {
+            XMMATRIX world = XMMatrixMultiply(XMMatrixScaling(1.0f + unit(rng), 2.0f, 0.5f),
+                XMMatrixMultiply(XMMatrixRotationY(3.0f * unit(rng)),
+                    XMMatrixTranslation(10.0f * unit(rng), unit(rng), 5.0f)));
+            BoundingBox box(XMFLOAT3(unit(rng), unit(rng), unit(rng)), XMFLOAT3(1.0f, 0.5f + unit(rng) * 0.4f, 2.0f));
+            BoundingBox transformed = FrustumCuller::TransformBox(box, world);
+
+            float mn[3] = { 1e30f, 1e30f, 1e30f }, mx[3] = { -1e30f, -1e30f, -1e30f };
+            for(int c = 0; c < 8; ++c)
+            {
+                XMFLOAT3 p;
+                XMStoreFloat3(&p, XMVector3Transform(XMVectorSet(
+                    box.Center.x + (c & 1 ? box.Extents.x : -box.Extents.x),
+                    box.Center.y + (c & 2 ? box.Extents.y : -box.Extents.y),
+                    box.Center.z + (c & 4 ? box.Extents.z : -box.Extents.z), 1.0f), world));
+                const float v[3] = { p.x, p.y, p.z };
+                for(int a = 0; a < 3; ++a)
+                {
+                    mn[a] = std::min(mn[a], v[a]);
+                    mx[a] = std::max(mx[a], v[a]);
+                }
+            }
+            const float center[3] = { transformed.Center.x, transformed.Center.y, transformed.Center.z };
+            const float extents[3] = { transformed.Extents.x, transformed.Extents.y, transformed.Extents.z };
+            for(int a = 0; a < 3; ++a)
+            {
+                error = std::max(error, std::fabs(center[a] - extents[a] - mn[a]));
+                error = std::max(error, std::fabs(center[a] + extents[a] - mx[a]));
+            }
+        }
+        Check(error <= 1e-4f, "TransformBox is the box around the transformed corners");
+        EndChecks();
+    }
+
+    // Cull's scalar tail on its own, as a compiler would write the loop.
+    size_t CullScalar(const FrustumCuller::Planes& planes, const AabbSoA& boxes, std::uint32_t* visible)
+    {
+        size_t count = 0;
+        for(size_t i = 0; i < boxes.Size(); ++i)
+        {
+            bool outside = false;
+            for(const XMFLOAT4& n : planes.Plane)
+            {
+                float dist = n.x * boxes.CenterX[i] + n.y * boxes.CenterY[i] + n.z * boxes.CenterZ[i] + n.w;
+                float radius = std::fabs(n.x) * boxes.ExtentX[i] + std::fabs(n.y) * boxes.ExtentY[i] +
+                    std::fabs(n.z) * boxes.ExtentZ[i];
+                outside = outside || dist + radius < 0.0f;
+            }
+            if(!outside)
+                visible[count++] = (std::uint32_t)i;
+        }
+        return count;
+    }
+
+    void Benchmark(const FrustumCuller::Planes& planes, const AabbSoA& boxes)
+    {
+        const size_t n = boxes.Size();
+        std::vector<std::uint32_t> visible(n);
+        size_t visibleCount = 0;
+        std::printf("Culling %zu boxes, best of %d\n", n, gRepetitions);
+
+        double scalar = Time([&]() { visibleCount = CullScalar(planes, boxes, visible.data()); gSink += visibleCount; });
+        double simd = Time([&]() { gSink += FrustumCuller::Cull(planes, boxes, 0, n, visible.data()); });
+        std::printf("  %-12s %9.3f ms %7.2f ns/box\n", "scalar", scalar * 1e3, scalar * 1e9 / n);
+        std::printf("  %-12s %9.3f ms %7.2f ns/box %6.2fx\n", "Cull", simd * 1e3, simd * 1e9 / n, scalar / simd);
+
+        // Chunks culled into their own part of the output, then compacted,
+        // as a caller spreading the scan over workers would.
+        JobSystem jobs;
+        const std::uint32_t chunkSize = 16384;
+        std::uint32_t chunkCount = (std::uint32_t)((n + chunkSize - 1) / chunkSize);
+        std::vector<size_t> chunkCounts(chunkCount);
+        double parallel = Time([&]()
+        {
+            jobs.ParallelFor(chunkCount, 1, [&](std::uint32_t begin, std::uint32_t end)
+            {
+                for(std::uint32_t c = begin; c < end; ++c)
+                {
+                    size_t first = (size_t)c * chunkSize;
+                    chunkCounts[c] = FrustumCuller::Cull(planes, boxes, first, std::min(n, first + chunkSize),
+                        visible.data() + first);
+                }
+            });
+            size_t total = chunkCounts[0];
+            for(std::uint32_t c = 1; c < chunkCount; ++c)
+            {
+                std::memmove(visible.data() + total, visible.data() + (size_t)c * chunkSize,
+                    chunkCounts[c] * sizeof(std::uint32_t));
+                total += chunkCounts[c];
+            }
+            gSink += total;
+        });
+        std::printf("  %-12s %9.3f ms %7.2f ns/box %6.2fx  (%u workers)\n", "Cull, jobs", parallel * 1e3,
+            parallel * 1e9 / n, scalar / parallel, jobs.WorkerCount());
+        std::printf("  %zu visible (%.1f%%)\n", visibleCount, 100.0 * visibleCount / n);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    std::mt19937 rng(1);
+    AabbSoA boxes = RandomBoxes(quick ? 100000 : 1000000, rng);
+    XMMATRIX viewProj = ViewProj();
+    FrustumCuller::Planes planes = FrustumCuller::ExtractPlanes(viewProj);
+
+    Test(planes, viewProj, boxes);
+    Benchmark(planes, boxes);
+    return Finish(gSink);
+}
@@ -0,0 +1,243 @@
+// GeometryGenerator's scalar builders against their SoA/SIMD counterparts.
+// Every SoA mesh is first compared with the scalar one, vertex by vertex
+// and index by index, and the program fails on a mismatch; then both are
+// timed at several tessellations.  The geosphere's welded subdivision is
+// checked for the topology of a closed sphere.  --quick runs the smaller
+// sizes only.
+
+#include "GeometryGenerator.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    using uint32 = GeometryGenerator::uint32;
+
+    float gSink = 0.f;
+
+    // The SoA builders evaluate sin/cos four lanes at a time, which may
+    // differ from the scalar calls in the last bits.
+    const float Tolerance = 1e-5f;
+
+    // Largest difference between any vertex component of the two meshes,
+    // or infinity when their sizes differ.
+    float MaxVertexError(const GeometryGenerator::MeshData& aos, const GeometryGenerator::MeshDataSoA& soa)
+    {
+        if(aos.Vertices.size() != soa.VertexCount())
+            return INFINITY;
+
+        float error = 0.f;
+        auto compare = [&error](float a, float b) { error = std::max(error, std::fabs(a - b)); };
+        for(size_t i = 0; i < aos.Vertices.size(); ++i)
+        {
+            const GeometryGenerator::Vertex& v = aos.Vertices[i];
+            compare(v.Position.x, soa.PosX[i]);
+            compare(v.Position.y, soa.PosY[i]);
+            compare(v.Position.z, soa.PosZ[i]);
+            compare(v.Normal.x, soa.NormalX[i]);
+            compare(v.Normal.y, soa.NormalY[i]);
+            compare(v.Normal.z, soa.NormalZ[i]);
+            compare(v.TangentU.x, soa.TangentX[i]);
+            compare(v.TangentU.y, soa.TangentY[i]);
+            compare(v.TangentU.z, soa.TangentZ[i]);
+            compare(v.TexC.x, soa.TexU[i]);
+            compare(v.TexC.y, soa.TexV[i]);
+        }
+        return error;
+    }
+
+    struct Shape
+    {
+        const char* Name;
+        uint32 Sizes[3];
+        std::function<GeometryGenerator::MeshData(GeometryGenerator&, uint32)> Scalar;
+        std::function<GeometryGenerator::MeshDataSoA(GeometryGenerator&, uint32)> SoA;
+    };
+
+    std::vector<Shape> Shapes()
+    {
+        return
+        {
+            { "sphere", { 20, 256, 1024 },
+                [](GeometryGenerator& g, uint32 n) { return g.CreateSphere(0.5f, n, n); },
+                [](GeometryGenerator& g, uint32 n) { return g.CreateSphereSoA(0.5f, n, n); } },
+            { "cylinder", { 20, 256, 1024 },
+                [](GeometryGenerator& g, uint32 n) { return g.CreateCylinder(0.5f, 0.3f, 3.0f, n, n); },
+                [](GeometryGenerator& g, uint32 n) { return g.CreateCylinderSoA(0.5f, 0.3f, 3.0f, n, n); } },
+            // Odd column counts exercise the partial vector at the end of a row.
+            { "grid", { 41, 257, 1025 },
+                [](GeometryGenerator& g, uint32 n) { return g.CreateGrid(20.0f, 30.0f, n, n); },
+                [](GeometryGenerator& g, uint32 n) { return g.CreateGridSoA(20.0f, 30.0f, n, n); } },
+        };
+    }
+
+    void TestMatchesScalar()
+    {
+        std::printf("SoA output against the scalar builders\n");
+        GeometryGenerator generator;
+        for(const Shape& shape : Shapes())
+        {
+            // Small and awkward tessellations, plus the benchmark sizes.
+            for(uint32 n : { 3u, 4u, 5u, 7u, shape.Sizes[0], shape.Sizes[1] })
+            {
+                GeometryGenerator::MeshData aos = shape.Scalar(generator, n);
+                GeometryGenerator::MeshDataSoA soa = shape.SoA(generator, n);
+                float error = MaxVertexError(aos, soa);
+                bool sameIndices = aos.Indices32 == soa.Indices32;
+                std::printf("  %-8s %5u: %8zu vertices, max error %.3g, indices %s\n", shape.Name, n,
+                    soa.VertexCount(), error, sameIndices ? "identical" : "DIFFER");
+                Check(error <= Tolerance, "vertices match the scalar builder");
+                Check(sameIndices, "indices match the scalar builder");
+            }
+        }
+
+        // The packed {Pos, Normal} layout takes the transposing path, any
+        // other stride the per-vertex one; both must write the same floats.
+        GeometryGenerator::MeshDataSoA sphere = generator.CreateSphereSoA(0.5f, 17, 9);
+        std::vector<float> packed(sphere.VertexCount() * 6), strided(sphere.VertexCount() * 8);
+        GeometryGenerator::InterleavePositionNormal(sphere, packed.data(), 6 * sizeof(float));
+        GeometryGenerator::InterleavePositionNormal(sphere, strided.data(), 8 * sizeof(float));
+        bool interleaved = true;
+        for(size_t i = 0; i < sphere.VertexCount(); ++i)
+        {
+            interleaved &= std::memcmp(&packed[i * 6], &strided[i * 8], 6 * sizeof(float)) == 0;
+            interleaved &= packed[i * 6] == sphere.PosX[i] && packed[i * 6 + 5] == sphere.NormalZ[i];
+        }
+        Check(interleaved, "InterleavePositionNormal writes every vertex");
+        std::printf("\n");
+    }
+
+    // Subdivide welds: each edge of level k gets one midpoint shared by both
+    // of its triangles, so the geosphere stays a closed mesh with the
+    // icosahedron's counts times 4^k: V = 10 * 4^k + 2, E = 30 * 4^k and
+    // F = 20 * 4^k.
+    void TestGeosphereWeld()
+    {
+        std::printf("Geosphere subdivision\n");
+        GeometryGenerator generator;
+        for(uint32 level = 0; level <= 6; ++level)
+        {
+            GeometryGenerator::MeshData mesh = generator.CreateGeosphere(1.0f, level);
+            size_t scale = (size_t)1 << (2 * level);
+            size_t triangleCount = mesh.Indices32.size() / 3;
+
+            // Each undirected edge must be used once in each direction: by
+            // exactly two triangles, wound consistently.
+            std::map<std::pair<uint32, uint32>, int> directedEdges;
+            bool outward = true;
+            for(size_t t = 0; t < triangleCount; ++t)
+            {
+                const uint32* tri = &mesh.Indices32[t * 3];
+                for(int e = 0; e < 3; ++e)
+                    ++directedEdges[{ tri[e], tri[(e + 1) % 3] }];
+
+                // Clockwise seen from outside, as D3D's front faces are, which
+                // makes (p1 - p0) x (p2 - p0) point away from the center.
+                DirectX::XMFLOAT3 p[3] = { mesh.Vertices[tri[0]].Position,
+                    mesh.Vertices[tri[1]].Position, mesh.Vertices[tri[2]].Position };
+                float ax = p[1].x - p[0].x, ay = p[1].y - p[0].y, az = p[1].z - p[0].z;
+                float bx = p[2].x - p[0].x, by = p[2].y - p[0].y, bz = p[2].z - p[0].z;
+                float nx = ay * bz - az * by, ny = az * bx - ax * bz, nz = ax * by - ay * bx;
+                outward &= nx * (p[0].x + p[1].x + p[2].x) + ny * (p[0].y + p[1].y + p[2].y) +
+                    nz * (p[0].z + p[1].z + p[2].z) > 0.f;
+            }
+
+            bool paired = true;
+            for(const auto& edge : directedEdges)
+            {
+                auto reverse = directedEdges.find({ edge.first.second, edge.first.first });
+                paired &= edge.second == 1 && reverse != directedEdges.end() && reverse->second == 1;
+            }
+
+            // An unshared midpoint would show up as two vertices at one
+            // position.
+            std::map<std::tuple<float, float, float>, int> positions;
+            for(const GeometryGenerator::Vertex& v : mesh.Vertices)
+                ++positions[std::make_tuple(v.Position.x, v.Position.y, v.Position.z)];
+
+            size_t edgeCount = directedEdges.size() / 2;
+            std::printf("  level %u: V %6zu, E %6zu, F %6zu, distinct positions %6zu\n", level,
+                mesh.Vertices.size(), edgeCount, triangleCount, positions.size());
+            Check(mesh.Vertices.size() == 10 * scale + 2, "vertex count is 10 * 4^k + 2");
+            Check(edgeCount == 30 * scale, "edge count is 30 * 4^k");
+            Check(triangleCount == 20 * scale, "face count is 20 * 4^k");
+            Check(paired, "every edge is shared by two consistently wound triangles");
+            Check(positions.size() == mesh.Vertices.size(), "no two vertices share a position");
+            Check(outward, "triangles face outward");
+        }
+        std::printf("\n");
+    }
+
+    void Benchmark(bool quick)
+    {
+        std::printf("Build times, best of %d\n", gRepetitions);
+        std::printf("  %-8s %6s %10s %12s %12s %8s\n", "", "size", "vertices", "scalar ms", "SoA ms", "speedup");
+        GeometryGenerator generator;
+        for(const Shape& shape : Shapes())
+        {
+            for(uint32 n : shape.Sizes)
+            {
+                if(quick && n > 256)
+                    continue;
+
+                size_t vertexCount = 0;
+                double scalar = Time([&]()
+                {
+                    GeometryGenerator::MeshData mesh = shape.Scalar(generator, n);
+                    gSink += mesh.Vertices.back().Position.x;
+                });
+                double soa = Time([&]()
+                {
+                    GeometryGenerator::MeshDataSoA mesh = shape.SoA(generator, n);
+                    vertexCount = mesh.VertexCount();
+                    gSink += mesh.PosX.back();
+                });
+                std::printf("  %-8s %6u %10zu %12.3f %12.3f %7.2fx\n", shape.Name, n, vertexCount,
+                    scalar * 1e3, soa * 1e3, scalar / soa);
+            }
+        }
+
+        // Conversion to the packed vertex buffer layout, which the scalar
+        // path does with one Vertex at a time.
+        uint32 n = quick ? 256 : 1024;
+        GeometryGenerator::MeshData aos = generator.CreateGrid(20.0f, 30.0f, n, n);
+        GeometryGenerator::MeshDataSoA soa = generator.CreateGridSoA(20.0f, 30.0f, n, n);
+        std::vector<float> packed(soa.VertexCount() * 6);
+        double scalar = Time([&]()
+        {
+            float* out = packed.data();
+            for(const GeometryGenerator::Vertex& v : aos.Vertices)
+            {
+                *out++ = v.Position.x; *out++ = v.Position.y; *out++ = v.Position.z;
+                *out++ = v.Normal.x; *out++ = v.Normal.y; *out++ = v.Normal.z;
+            }
+            gSink += packed[0];
+        });
+        double interleave = Time([&]()
+        {
+            GeometryGenerator::InterleavePositionNormal(soa, packed.data(), 6 * sizeof(float));
+            gSink += packed[0];
+        });
+        std::printf("  %-8s %6u %10zu %12.3f %12.3f %7.2fx  (to {Pos, Normal})\n", "pack", n,
+            soa.VertexCount(), scalar * 1e3, interleave * 1e3, scalar / interleave);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestMatchesScalar();
+    TestGeosphereWeld();
+    Benchmark(quick);
+    return Finish(gSink);
+}
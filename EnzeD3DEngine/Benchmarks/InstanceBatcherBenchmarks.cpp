@@ -0,0 +1,254 @@
+// InstanceBatcher on a store of render items sharing a few dozen draw
+// states.  The batches built from random visible sets are compared with a
+// plain grouping of the same items: batch and instance counts, instance
+// ranges, the instance data and its order inside a batch, batch depths, and
+// after SortBatches() the DrawSortKey order; the program fails on a
+// difference.  Then Build() and SortBatches() are timed.  --quick batches
+// fewer items.
+
+#include "CommandRecorder.h"
+#include "InstanceBatcher.h"
+#include "MyTimer.h"
+#include "RenderItemStore.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    size_t gSink = 0;
+
+    // The batcher only compares geometry pointers, so any distinct
+    // addresses will do.
+    const int GeometryCount = 6;
+    std::uint64_t gGeometryStorage[GeometryCount];
+
+    MeshGeometry* Geometry(int g)
+    {
+        return reinterpret_cast<MeshGeometry*>(&gGeometryStorage[g]);
+    }
+
+    // Items spread over GeometryCount geometries with several submeshes
+    // each, and a handful of materials that do not split batches.
+    struct Scene
+    {
+        std::mt19937 Rng{ 3 };
+        std::vector<Material> Materials;
+        RenderItemStore Items;
+        std::vector<RenderItemHandle> Handles;
+
+        explicit Scene(size_t itemCount) : Materials(5)
+        {
+            for(size_t m = 0; m < Materials.size(); ++m)
+                Materials[m].MatCBIndex = (int)(m * 3 + 1);
+
+            Items.Reserve(itemCount);
+            for(size_t i = 0; i < itemCount; ++i)
+                Add();
+        }
+
+        void Add()
+        {
+            std::uniform_int_distribution<int> geometry(0, GeometryCount - 1), submesh(0, 7), material(0, 4);
+            RenderItemDesc desc;
+            int g = geometry(Rng), s = submesh(Rng);
+            desc.Geo = Geometry(g);
+            desc.Mat = &Materials[material(Rng)];
+            desc.DrawArgs.IndexCount = 36 + 6 * s;
+            desc.DrawArgs.StartIndexLocation = 1000 * s;
+            desc.DrawArgs.BaseVertexLocation = 24 * g;
+            Handles.push_back(Items.Add(desc));
+        }
+
+        // Dense indices of a random share of the items, in random order,
+        // with a view depth for each.
+        void RandomVisible(double share, std::vector<std::uint32_t>& visible, std::vector<float>& depths)
+        {
+            visible.clear();
+            std::uniform_real_distribution<double> pick(0.0, 1.0);
+            for(std::uint32_t i = 0; i < (std::uint32_t)Items.Size(); ++i)
+            {
+                if(pick(Rng) < share)
+                    visible.push_back(i);
+            }
+            std::shuffle(visible.begin(), visible.end(), Rng);
+
+            std::uniform_real_distribution<float> depth(-1.0f, 300.0f);
+            depths.resize(visible.size());
+            for(float& d : depths)
+                d = depth(Rng);
+        }
+    };
+
+    void CheckBatches(const InstanceBatcher& batcher, const RenderItemStore& items,
+        const std::vector<std::uint32_t>& visible, const float* depths, bool sorted)
+    {
+        // The plain grouping: states in order of first appearance, and the
+        // visible positions of each state's items in visible order.
+        std::vector<std::uint32_t> firstSeen;
+        std::vector<std::vector<size_t>> members(items.DrawStates().size());
+        for(size_t i = 0; i < visible.size(); ++i)
+        {
+            std::uint32_t state = items.DrawStateIds()[visible[i]];
+            if(members[state].empty())
+                firstSeen.push_back(state);
+            members[state].push_back(i);
+        }
+
+        const std::vector<InstanceBatch>& batches = batcher.Batches();
+        const std::vector<InstanceData>& instances = batcher.Instances();
+        Check(batches.size() == firstSeen.size(), "one batch per visible draw state");
+        Check(instances.size() == visible.size(), "one instance per visible item");
+        Check(batcher.GetStats().Items == visible.size() && batcher.GetStats().Batches == batches.size(),
+            "stats count items and batches");
+
+        size_t largest = 0;
+        bool order = true, ranges = true, data = true, depth = true, states = true;
+        std::vector<std::uint8_t> covered(instances.size(), 0);
+        for(size_t b = 0; b < batches.size(); ++b)
+        {
+            const InstanceBatch& batch = batches[b];
+            if(!sorted)
+                order &= b < firstSeen.size() && batch.DrawState == firstSeen[b];
+            if(batch.DrawState >= members.size() || members[batch.DrawState].size() != batch.InstanceCount)
+            {
+                states = false;
+                continue;
+            }
+            largest = std::max<size_t>(largest, batch.InstanceCount);
+
+            // Instances of one batch are contiguous and in visible order.
+            float nearest = 0.0f;
+            for(std::uint32_t k = 0; k < batch.InstanceCount; ++k)
+            {
+                std::uint32_t slot = batch.InstanceOffset + k;
+                if(slot >= instances.size() || covered[slot]++)
+                {
+                    ranges = false;
+                    continue;
+                }
+                size_t position = members[batch.DrawState][k];
+                std::uint32_t item = visible[position];
+                data &= instances[slot].ObjectIndex == items.ObjCBIndices()[item] &&
+                    instances[slot].MaterialIndex == (std::uint32_t)items.Materials()[item]->MatCBIndex;
+                if(depths)
+                    nearest = k == 0 ? depths[position] : std::min(nearest, depths[position]);
+            }
+            depth &= batch.Depth == nearest;
+        }
+        ranges &= std::all_of(covered.begin(), covered.end(), [](std::uint8_t c) { return c == 1; });
+
+        if(!sorted)
+        {
+            // Build() lays the ranges out in batch order.
+            std::uint32_t offset = 0;
+            for(const InstanceBatch& batch : batches)
+            {
+                ranges &= batch.InstanceOffset == offset;
+                offset += batch.InstanceCount;
+            }
+        }
+
+        Check(order, "batches in order of first appearance");
+        Check(states, "each batch holds every visible item of its state");
+        Check(ranges, "instance ranges cover the instances once");
+        Check(data, "instances carry the item's object and material index");
+        Check(depth, "batch depth is its nearest instance's");
+        Check(batcher.GetStats().LargestBatch == largest, "stats find the largest batch");
+    }
+
+    void CheckSorted(const InstanceBatcher& batcher, const RenderItemStore& items)
+    {
+        bool sorted = true;
+        const std::vector<InstanceBatch>& batches = batcher.Batches();
+        for(size_t b = 1; b < batches.size(); ++b)
+        {
+            const InstanceBatch& p = batches[b - 1];
+            const InstanceBatch& c = batches[b];
+            sorted &= DrawSortKey::Make(0, items.DrawStates()[p.DrawState].GeometryId, 0, p.Depth) <=
+                DrawSortKey::Make(0, items.DrawStates()[c.DrawState].GeometryId, 0, c.Depth);
+        }
+        Check(sorted, "SortBatches orders by geometry, then front to back");
+    }
+
+    void TestBatches()
+    {
+        std::printf("Batching checks\n");
+        Scene scene(5000);
+        InstanceBatcher batcher;
+        std::vector<std::uint32_t> visible;
+        std::vector<float> depths;
+        Check(scene.Items.DrawStates().size() == GeometryCount * 8, "materials do not split draw states");
+
+        for(double share : { 1.0, 0.5, 0.02, 0.0 })
+        {
+            scene.RandomVisible(share, visible, depths);
+            batcher.Build(scene.Items, visible.data(), visible.size(), depths.data());
+            CheckBatches(batcher, scene.Items, visible, depths.data(), false);
+            batcher.SortBatches(scene.Items);
+            CheckBatches(batcher, scene.Items, visible, depths.data(), true);
+            CheckSorted(batcher, scene.Items);
+
+            batcher.Build(scene.Items, visible.data(), visible.size());
+            CheckBatches(batcher, scene.Items, visible, nullptr, false);
+        }
+
+        // Removing items moves others in the dense arrays; the batcher sees
+        // the store as it is now.
+        for(int i = 0; i < 1500; ++i)
+        {
+            size_t h = std::uniform_int_distribution<size_t>(0, scene.Handles.size() - 1)(scene.Rng);
+            scene.Items.Remove(scene.Handles[h]);
+            scene.Handles[h] = scene.Handles.back();
+            scene.Handles.pop_back();
+        }
+        for(int i = 0; i < 200; ++i)
+            scene.Add();
+        scene.RandomVisible(0.7, visible, depths);
+        batcher.Build(scene.Items, visible.data(), visible.size(), depths.data());
+        CheckBatches(batcher, scene.Items, visible, depths.data(), false);
+        batcher.SortBatches(scene.Items);
+        CheckBatches(batcher, scene.Items, visible, depths.data(), true);
+        CheckSorted(batcher, scene.Items);
+        EndChecks();
+    }
+
+    void Benchmark(size_t itemCount)
+    {
+        Scene scene(itemCount);
+        InstanceBatcher batcher;
+        std::vector<std::uint32_t> visible;
+        std::vector<float> depths;
+        scene.RandomVisible(0.5, visible, depths);
+        std::printf("Batching %zu of %zu items, %zu draw states, best of %d\n", visible.size(), itemCount,
+            scene.Items.DrawStates().size(), gRepetitions);
+
+        double build = Time([&]()
+        {
+            batcher.Build(scene.Items, visible.data(), visible.size(), depths.data());
+            gSink += batcher.Batches().size();
+        });
+        double sort = Time([&]()
+        {
+            batcher.Build(scene.Items, visible.data(), visible.size(), depths.data());
+            batcher.SortBatches(scene.Items);
+            gSink += batcher.Batches().front().InstanceOffset;
+        }) - build;
+        std::printf("  %-12s %9.3f ms %7.2f ns/item\n", "Build", build * 1e3, build * 1e9 / visible.size());
+        std::printf("  %-12s %9.3f ms %7.2f ns/batch\n", "SortBatches", sort * 1e3,
+            sort * 1e9 / batcher.Batches().size());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestBatches();
+    Benchmark(quick ? 20000 : 200000);
+    return Finish(gSink);
+}
@@ -0,0 +1,275 @@
+// Stress tests of JobSystem, then its throughput.  The tests run many tiny
+// jobs, recursive fork-join from inside jobs, RunAfter chains, submission
+// from outside threads and several systems used from one thread, and fail
+// when a job is lost, run twice or runs before its dependency.  The
+// benchmark reports jobs per second for Run/Wait from the creating thread,
+// for jobs spawned by jobs and for ParallelFor, at several worker counts.
+// --quick runs fewer jobs.
+
+#include "JobSystem.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    std::uint32_t gScale = 16;
+    std::atomic<std::uint64_t> gSink{ 0 };
+
+    void TestManyJobs(JobSystem& jobs)
+    {
+        std::uint32_t count = 16384 * gScale;
+        std::vector<std::atomic<std::uint8_t>> ran(count);
+        JobCounter counter;
+        for(std::uint32_t i = 0; i < count; ++i)
+            jobs.Run([&ran, i]() { ran[i].fetch_add(1, std::memory_order_relaxed); }, &counter);
+        jobs.Wait(counter);
+
+        bool once = true;
+        for(auto& r : ran)
+            once &= r.load() == 1;
+        Check(once, "every job runs exactly once");
+        Check(counter.Pending.load() == 0, "the counter drains");
+    }
+
+    // Binary fork-join from inside jobs; each level waits on its children,
+    // so Wait must keep running other jobs rather than block a worker.
+    std::uint64_t Tree(JobSystem& jobs, std::uint32_t depth)
+    {
+        if(depth == 0)
+            return 1;
+
+        std::uint64_t left = 0, right = 0;
+        JobCounter counter;
+        jobs.Run([&jobs, &left, depth]() { left = Tree(jobs, depth - 1); }, &counter);
+        jobs.Run([&jobs, &right, depth]() { right = Tree(jobs, depth - 1); }, &counter);
+        jobs.Wait(counter);
+        return left + right;
+    }
+
+    void TestNested(JobSystem& jobs)
+    {
+        std::uint32_t depth = gScale >= 16 ? 16 : 12;
+        Check(Tree(jobs, depth) == (std::uint64_t)1 << depth, "nested fork-join counts every leaf");
+    }
+
+    void TestParallelFor(JobSystem& jobs)
+    {
+        for(std::uint32_t grain : { 1u, 7u, 64u, 100000u })
+        {
+            std::uint32_t count = 1000 * gScale + 3;
+            std::vector<std::uint8_t> hits(count, 0);
+            jobs.ParallelFor(count, grain, [&hits](std::uint32_t begin, std::uint32_t end)
+            {
+                for(std::uint32_t i = begin; i < end; ++i)
+                    ++hits[i];
+            });
+            Check(std::all_of(hits.begin(), hits.end(), [](std::uint8_t h) { return h == 1; }),
+                "ParallelFor covers every index once");
+        }
+    }
+
+    // Long chains and a wide fan-in: every job must see the value its
+    // dependency wrote.
+    void TestRunAfter(JobSystem& jobs)
+    {
+        const std::uint32_t chainLength = 64;
+        const std::uint32_t chains = 8 * gScale;
+        std::vector<std::uint32_t> values(chains * chainLength, 0);
+        std::vector<std::unique_ptr<JobCounter>> counters;
+        counters.reserve(values.size());
+        JobCounter all;
+        for(std::uint32_t c = 0; c < chains; ++c)
+        {
+            std::uint32_t* chain = &values[c * chainLength];
+            counters.emplace_back(new JobCounter());
+            jobs.Run([chain]() { chain[0] = 1; }, counters.back().get());
+            for(std::uint32_t i = 1; i < chainLength; ++i)
+            {
+                JobCounter& previous = *counters.back();
+                counters.emplace_back(new JobCounter());
+                jobs.RunAfter(previous, [chain, i]() { chain[i] = chain[i - 1] + 1; }, counters.back().get());
+            }
+            jobs.RunAfter(*counters.back(), []() {}, &all);
+        }
+        jobs.Wait(all);
+
+        bool ordered = true;
+        for(std::uint32_t c = 0; c < chains; ++c)
+            ordered &= values[c * chainLength + chainLength - 1] == chainLength;
+        Check(ordered, "RunAfter chains run in dependency order");
+    }
+
+    // Threads the system does not know submit and wait through the locked
+    // queue, concurrently with each other and with the workers.
+    void TestOutsideThreads(JobSystem& jobs)
+    {
+        std::atomic<std::uint64_t> total{ 0 };
+        std::vector<std::thread> threads;
+        for(int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&jobs, &total]()
+            {
+                for(int round = 0; round < 16; ++round)
+                {
+                    JobCounter counter;
+                    for(std::uint32_t i = 0; i < 64 * gScale; ++i)
+                        jobs.Run([&total]() { total.fetch_add(1, std::memory_order_relaxed); }, &counter);
+                    jobs.Wait(counter);
+                }
+            });
+        }
+        for(std::thread& t : threads)
+            t.join();
+        Check(total.load() == 4ull * 16 * 64 * gScale, "jobs from outside threads all run");
+    }
+
+    // One thread creating several systems owns deque 0 of each; jobs of one
+    // system submit to the other from its workers, which are outside threads
+    // there.
+    void TestSeveralSystems()
+    {
+        JobSystem a(2);
+        JobSystem b(3);
+        std::atomic<std::uint64_t> total{ 0 };
+        JobCounter outer;
+        for(int i = 0; i < 64; ++i)
+        {
+            a.Run([&b, &total]()
+            {
+                b.ParallelFor(256, 16, [&total](std::uint32_t begin, std::uint32_t end)
+                {
+                    total.fetch_add(end - begin, std::memory_order_relaxed);
+                });
+            }, &outer);
+        }
+        JobCounter inner;
+        for(int i = 0; i < 1024; ++i)
+            b.Run([&total]() { total.fetch_add(1, std::memory_order_relaxed); }, &inner);
+        a.Wait(outer);
+        b.Wait(inner);
+        Check(total.load() == 64 * 256 + 1024, "two systems created on one thread");
+
+        // This thread creates a system that another thread destroys and
+        // replaces; the replacement often lands at the same address.  Its
+        // deque 0 belongs to the other thread alone, so this thread must
+        // submit through the locked queue while both push at once.
+        for(int round = 0; round < 16; ++round)
+        {
+            std::unique_ptr<JobSystem> system(new JobSystem(2));
+            std::atomic<std::uint32_t> count{ 0 };
+            std::atomic<bool> replaced{ false };
+            std::thread owner([&system, &count, &replaced]()
+            {
+                system.reset();
+                system.reset(new JobSystem(2));
+                replaced.store(true);
+                JobCounter counter;
+                for(int i = 0; i < 4096; ++i)
+                    system->Run([&count]() { count.fetch_add(1, std::memory_order_relaxed); }, &counter);
+                system->Wait(counter);
+            });
+            while(!replaced.load())
+                std::this_thread::yield();
+            JobCounter counter;
+            for(int i = 0; i < 4096; ++i)
+                system->Run([&count]() { count.fetch_add(1, std::memory_order_relaxed); }, &counter);
+            system->Wait(counter);
+            owner.join();
+            Check(count.load() == 8192, "a system replaced by another thread");
+        }
+    }
+
+    void RunTests()
+    {
+        std::printf("Stress tests\n");
+        for(unsigned workers : { 1u, 3u, 8u })
+        {
+            JobSystem jobs(workers);
+            TestManyJobs(jobs);
+            TestNested(jobs);
+            TestParallelFor(jobs);
+            TestRunAfter(jobs);
+            TestOutsideThreads(jobs);
+            std::printf("  %u workers: %s\n", workers, gFailures ? "failed" : "ok");
+        }
+        TestSeveralSystems();
+        std::printf("  several systems: %s\n\n", gFailures ? "failed" : "ok");
+    }
+
+    void Benchmark(bool quick)
+    {
+        std::uint32_t count = 16384 * gScale;
+        std::printf("Throughput, %u empty jobs, best of %d (Mjobs/s)\n", count, gRepetitions);
+        std::printf("  %8s %12s %12s %12s %10s\n", "workers", "Run/Wait", "spawned", "ParallelFor", "steals");
+
+        std::vector<unsigned> workerCounts = { 1, 2, 4, 8 };
+        unsigned hardware = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        if(hardware > 0 && std::find(workerCounts.begin(), workerCounts.end(), hardware) == workerCounts.end())
+            workerCounts.push_back(hardware);
+        if(quick)
+            workerCounts.resize(2);
+
+        for(unsigned workers : workerCounts)
+        {
+            JobSystem jobs(workers);
+            double submitted = Time([&]()
+            {
+                JobCounter counter;
+                for(std::uint32_t i = 0; i < count; ++i)
+                    jobs.Run([]() { gSink.fetch_add(1, std::memory_order_relaxed); }, &counter);
+                jobs.Wait(counter);
+            });
+
+            // Jobs pushed from workers onto their own deques, the case the
+            // work-stealing queues are built for.
+            jobs.ResetStats();
+            std::uint32_t spawners = 64;
+            double spawned = Time([&]()
+            {
+                JobCounter counter;
+                for(std::uint32_t s = 0; s < spawners; ++s)
+                {
+                    jobs.Run([&jobs, count, spawners]()
+                    {
+                        JobCounter children;
+                        for(std::uint32_t i = 0; i < count / spawners; ++i)
+                            jobs.Run([]() { gSink.fetch_add(1, std::memory_order_relaxed); }, &children);
+                        jobs.Wait(children);
+                    }, &counter);
+                }
+                jobs.Wait(counter);
+            });
+            JobSystem::Stats stats = jobs.GetStats();
+
+            double parallelFor = Time([&]()
+            {
+                jobs.ParallelFor(count, 1, [](std::uint32_t begin, std::uint32_t end)
+                {
+                    gSink.fetch_add(end - begin, std::memory_order_relaxed);
+                });
+            });
+
+            std::printf("  %8u %12.2f %12.2f %12.2f %10llu\n", workers, count / submitted * 1e-6,
+                count / spawned * 1e-6, count / parallelFor * 1e-6, (unsigned long long)stats.Steals);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv, 5);
+    if(quick)
+        gScale = 2;
+
+    std::printf("Hardware threads: %u\n\n", std::thread::hardware_concurrency());
+    RunTests();
+    Benchmark(quick);
+    return Finish((size_t)gSink.load());
+}
@@ -0,0 +1,272 @@
+// MaterialRegistry::Load, the parser for materials.txt.  Scripted cases
+// check well-formed input, comments and defaults, reloading a material by
+// name, and that each kind of malformed line is reported with its line
+// number and leaves the registry exactly as it was; the shipped
+// materials.txt must load.  Random files mixing good and bad lines are
+// checked the same way.  The program fails on a difference.  Then loading
+// thousands of materials is timed.  --quick loads fewer random files and
+// materials.
+
+#include "MaterialRegistry.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    size_t gSink = 0;
+
+    bool Load(MaterialRegistry& registry, const std::string& text, std::string* error = nullptr)
+    {
+        std::istringstream in(text);
+        return registry.Load(in, "test", error);
+    }
+
+    bool SameMaterial(const Material& a, const Material& b)
+    {
+        return a.Name == b.Name && a.MatCBIndex == b.MatCBIndex && a.DiffuseSrvHeapIndex == b.DiffuseSrvHeapIndex &&
+            a.NormalSrvHeapIndex == b.NormalSrvHeapIndex && a.ChangeGeneration == b.ChangeGeneration &&
+            std::memcmp(&a.DiffuseAlbedo, &b.DiffuseAlbedo, sizeof(a.DiffuseAlbedo)) == 0 &&
+            std::memcmp(&a.FresnelR0, &b.FresnelR0, sizeof(a.FresnelR0)) == 0 && a.Roughness == b.Roughness &&
+            std::memcmp(&a.MatTransform, &b.MatTransform, sizeof(a.MatTransform)) == 0;
+    }
+
+    // Everything Load may change.
+    struct Snapshot
+    {
+        std::vector<Material> Materials;
+        std::uint64_t Generation;
+        std::vector<std::uint32_t> Dirty;
+
+        explicit Snapshot(const MaterialRegistry& registry)
+            : Generation(registry.Generation()), Dirty(registry.DirtyMaterials())
+        {
+            for(std::uint32_t id = 0; id < (std::uint32_t)registry.Count(); ++id)
+                Materials.push_back(*registry.Get(id));
+        }
+
+        bool Matches(const MaterialRegistry& registry)const
+        {
+            if(registry.Count() != Materials.size() || registry.Generation() != Generation ||
+                registry.DirtyMaterials() != Dirty)
+                return false;
+            for(std::uint32_t id = 0; id < (std::uint32_t)Materials.size(); ++id)
+            {
+                if(!SameMaterial(*registry.Get(id), Materials[id]) || registry.Find(Materials[id].Name) != registry.Get(id))
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    void TestScripted()
+    {
+        std::printf("Scripted checks\n");
+        MaterialRegistry registry;
+        std::string error;
+        Check(Load(registry, "", &error) && registry.Count() == 0 && registry.Generation() == 0,
+            "empty input loads nothing");
+        Check(Load(registry,
+            "# a comment\n"
+            "\n"
+            "material grass   # trailing comment\n"
+            "    DiffuseAlbedo 0.25 0.5 0.75 1\n"
+            "\tFresnelR0 0.02 0.03 0.04\n"
+            "    Roughness 0.125\n"
+            "    MatTransform 2 0 0 0  0 2 0 0  0 0 1 0  0.5 0 0 1\n"
+            "    DiffuseSrvHeapIndex 4\n"
+            "    NormalSrvHeapIndex 5\n"
+            "material plain\n", &error), "well-formed input loads");
+
+        Material* grass = registry.Find("grass");
+        Material* plain = registry.Find("plain");
+        Check(grass != nullptr && plain != nullptr, "materials are found by name");
+        if(grass == nullptr || plain == nullptr)
+        {
+            EndChecks();
+            return;
+        }
+        Material defaults;
+        Check(registry.Count() == 2 && grass == registry.Get(0) && plain == registry.Get(1) &&
+            grass->MatCBIndex == 0 && plain->MatCBIndex == 1, "ids follow the order of the file");
+        Check(grass->DiffuseAlbedo.x == 0.25f && grass->DiffuseAlbedo.y == 0.5f && grass->DiffuseAlbedo.z == 0.75f &&
+            grass->DiffuseAlbedo.w == 1.0f && grass->FresnelR0.x == 0.02f && grass->FresnelR0.y == 0.03f &&
+            grass->FresnelR0.z == 0.04f && grass->Roughness == 0.125f, "colors and roughness are read");
+        Check(grass->MatTransform._11 == 2.0f && grass->MatTransform._22 == 2.0f && grass->MatTransform._33 == 1.0f &&
+            grass->MatTransform._41 == 0.5f && grass->MatTransform._14 == 0.0f, "MatTransform is read row by row");
+        Check(grass->DiffuseSrvHeapIndex == 4 && grass->NormalSrvHeapIndex == 5, "heap indices are read");
+        defaults.Name = "plain";
+        defaults.MatCBIndex = 1;
+        defaults.ChangeGeneration = plain->ChangeGeneration;
+        Check(SameMaterial(*plain, defaults), "fields left out keep the defaults");
+        Check(registry.Generation() == 2 && grass->ChangeGeneration == 1 && plain->ChangeGeneration == 2 &&
+            registry.DirtyMaterials() == std::vector<std::uint32_t>({ 0, 1 }), "loaded materials are marked changed");
+
+        // Loading a name again updates that material and keeps its id.
+        registry.RetireDirty(registry.Generation());
+        Check(Load(registry, "material moss\nmaterial plain\nRoughness 0.5\n", &error), "a second file loads");
+        Check(registry.Count() == 3 && registry.Find("plain") == plain && plain->MatCBIndex == 1 &&
+            plain->Roughness == 0.5f && registry.Find("moss") != nullptr &&
+            registry.Find("moss")->MatCBIndex == 2, "reloading a name keeps its id");
+        Check(registry.DirtyMaterials() == std::vector<std::uint32_t>({ 2, 1 }) && plain->ChangeGeneration == 4,
+            "only the loaded materials become dirty");
+
+        // Each malformed file: the message, and nothing changed.
+        struct Bad { const char* Text; const char* Error; const char* What; };
+        const Bad bad[] =
+        {
+            { "Roughness 0.5\nmaterial late\n", "test:1: 'Roughness' before the first material",
+                "a field before the first material fails" },
+            { "# header\n\n  DiffuseSrvHeapIndex 1\n", "test:3: 'DiffuseSrvHeapIndex' before the first material",
+                "comments and blank lines do not start a material" },
+            { "material a\nShininess 3\n", "test:2: unknown field 'Shininess'", "unknown fields fail" },
+            { "material a\nroughness 0.5\n", "test:2: unknown field 'roughness'", "field names are case sensitive" },
+            { "material a\nFresnelR0 0.1 0.2\n", "test:2: bad value for 'FresnelR0'", "too few values fail" },
+            { "material a\nRoughness 0.1 0.2\n", "test:2: bad value for 'Roughness'", "too many values fail" },
+            { "material a\nRoughness rough\n", "test:2: bad value for 'Roughness'", "values that are not numbers fail" },
+            { "material a\nDiffuseSrvHeapIndex 1.5\n", "test:2: bad value for 'DiffuseSrvHeapIndex'",
+                "heap indices must be integers" },
+            { "material a\nMatTransform 1 0 0 0 0 1 0 0 0 0 1 0 0 0 0\n", "test:2: bad value for 'MatTransform'",
+                "MatTransform needs sixteen values" },
+            { "material\n", "test:1: expected 'material <name>'", "a material needs a name" },
+            { "material a b\n", "test:1: expected 'material <name>'", "material names are one word" },
+            { "material grass\nRoughness 0.9\nmaterial b\n\nDiffuseAlbedo 1 1 1\n", "test:5: bad value for 'DiffuseAlbedo'",
+                "an error late in the file fails the whole file" },
+        };
+        bool unchanged = true;
+        for(const Bad& b : bad)
+        {
+            Snapshot before(registry);
+            error.clear();
+            bool loaded = Load(registry, b.Text, &error);
+            Check(!loaded && error == b.Error, b.What);
+            if(loaded || error != b.Error)
+                std::printf("    got \"%s\"\n", error.c_str());
+            unchanged &= before.Matches(registry);
+        }
+        Check(unchanged, "a malformed file changes nothing");
+        Snapshot before(registry);
+        Check(!Load(registry, "material a\nShininess 3\n") && before.Matches(registry), "errors need no message");
+
+        // The shipped definitions, the way EnzeApp::BuildMaterials loads them.
+        MaterialRegistry shipped;
+        Check(shipped.LoadFile(L"" ENZE_ASSET_DIR "/materials.txt", &error) && shipped.Count() == 4 &&
+            shipped.Find("skullMat") != nullptr && shipped.Find("skullMat")->MatCBIndex == 3 &&
+            shipped.Find("skullMat")->DiffuseSrvHeapIndex == 3, "materials.txt loads");
+        Check(!shipped.LoadFile(L"missing/materials.txt", &error) && error == "missing/materials.txt: cannot open" &&
+            shipped.Count() == 4, "a missing file fails");
+        EndChecks();
+    }
+
+    // Random files of lines that are each good or bad on their own; a file
+    // loads if no line is bad and no field comes before the first material.
+    void TestRandomFiles(int fileCount)
+    {
+        std::printf("Random files\n");
+        enum Kind { Blank, Material, Field };
+        struct Line { const char* Text; bool Good; Kind Type; };
+        const Line lines[] =
+        {
+            { "material a", true, Material }, { "material b  # b", true, Material }, { "material c", true, Material },
+            { "", true, Blank }, { "   # comment", true, Blank },
+            { "DiffuseAlbedo 0.1 0.2 0.3 1", true, Field }, { "FresnelR0 0.5 0.5 0.5", true, Field },
+            { "Roughness 0.75", true, Field }, { "NormalSrvHeapIndex -1", true, Field },
+            { "MatTransform 1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1", true, Field },
+            { "Roughness", false, Field }, { "DiffuseAlbedo 1 1 1 1 1", false, Field },
+            { "Albedo 1 1 1 1", false, Field }, { "material", false, Material }, { "DiffuseSrvHeapIndex x", false, Field },
+        };
+        const int lineCount = (int)(sizeof(lines) / sizeof(lines[0]));
+        std::mt19937 rng(25);
+        MaterialRegistry registry;
+        bool predicted = true, unchanged = true, numbered = true, known = true;
+        size_t loaded = 0;
+        for(int f = 0; f < fileCount; ++f)
+        {
+            std::string text, expected;
+            bool seenMaterial = false;
+            int length = std::uniform_int_distribution<int>(1, 12)(rng);
+            for(int i = 0; i < length; ++i)
+            {
+                // Bad lines are rare enough that some files load.
+                int pick = std::uniform_int_distribution<int>(0, lineCount - 1)(rng);
+                if(!lines[pick].Good && rng() % 4 != 0)
+                    pick = 0;
+                const Line& line = lines[pick];
+                text += line.Text;
+                text += '\n';
+                bool bad = !line.Good || (!seenMaterial && line.Type == Field);
+                if(bad && expected.empty())
+                    expected = "test:" + std::to_string(i + 1) + ":";
+                seenMaterial |= line.Good && line.Type == Material;
+            }
+
+            Snapshot before(registry);
+            std::string error;
+            bool ok = Load(registry, text, &error);
+            predicted &= ok == expected.empty();
+            if(ok)
+            {
+                ++loaded;
+                known &= registry.Count() <= 3;
+            }
+            else
+            {
+                unchanged &= before.Matches(registry);
+                numbered &= error.compare(0, expected.size(), expected) == 0;
+            }
+            registry.RetireDirty(registry.Generation());
+        }
+        Check(predicted, "files load exactly when every line is good");
+        Check(numbered, "errors name the first bad line");
+        Check(unchanged, "failed loads change nothing");
+        Check(known, "reloaded names keep their ids");
+        Check(loaded > 0 && loaded < (size_t)fileCount, "some files loaded and some failed");
+        std::printf("  %zu of %d files loaded\n", loaded, fileCount);
+        EndChecks();
+    }
+
+    void Benchmark(int materialCount)
+    {
+        std::printf("Loading %d materials, best of %d\n", materialCount, gRepetitions);
+        std::string text;
+        for(int i = 0; i < materialCount; ++i)
+        {
+            text += "material mat" + std::to_string(i) + "\n";
+            text += "    DiffuseAlbedo 0.5 0.25 0.125 1    # color\n";
+            text += "    FresnelR0 0.02 0.02 0.02\n";
+            text += "    Roughness 0.3\n";
+            text += "    DiffuseSrvHeapIndex " + std::to_string(i % 64) + "\n";
+        }
+
+        double fresh = Time([&]()
+        {
+            MaterialRegistry registry;
+            Load(registry, text);
+            gSink += registry.Count();
+        });
+        MaterialRegistry registry;
+        Load(registry, text);
+        double reload = Time([&]()
+        {
+            Load(registry, text);
+            gSink += registry.DirtyMaterials().size();
+            registry.RetireDirty(registry.Generation());
+        });
+        std::printf("  %-12s %9.3f ms %7.2f us/material\n", "new", fresh * 1e3, fresh * 1e6 / materialCount);
+        std::printf("  %-12s %9.3f ms %7.2f us/material\n", "reload", reload * 1e3, reload * 1e6 / materialCount);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestScripted();
+    TestRandomFiles(quick ? 2000 : 20000);
+    Benchmark(quick ? 2000 : 20000);
+    return Finish(gSink);
+}
@@ -0,0 +1,1036 @@
+// The Math backend MathHelper was built with, checked against a
+// double-precision reference: matrix products, inverses, look-at and
+// perspective matrices, the quaternion functions and the batched kernels,
+// each within a few float roundings; with DirectXMath, also that Float4x4
+// and XMFLOAT4X4 share their layout and the matrices agree with
+// DirectXMath's.  The inverses for rigid, affine and perspective matrices
+// are checked against MatInverse, and TransposeMatricesStrided against a
+// scalar transpose.  The program fails on a difference.  CMakeLists.txt builds
+// it once per backend the compiler can target.  Then the per-frame math cost
+// of EnzeApp::UpdateMainPass and EnzeApp::UpdateObjectConstants is timed
+// without a device.  --quick times fewer passes and objects.
+
+#include "MathHelper.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+using namespace Math;
+
+namespace
+{
+    // Fraction of the objects changed in a frame for the dirty-list case.
+    const size_t DirtyDivisor = 10;
+
+    // Exit code telling ctest the program was skipped.
+    const int SkipExitCode = 77;
+
+    // The matrices of PassConstants, in upload order.
+    struct PassMatrices
+    {
+        Float4x4 View, InvView, Proj, InvProj, ViewProj, InvViewProj;
+    };
+
+    float gSink = 0.f;
+
+    template<typename F>
+    void Run(const char* name, size_t itemCount, F&& body)
+    {
+        double best = Time(body);
+        std::printf("%-48s %10.3f ms %10.2f ns/item\n", name, best * 1e3, best * 1e9 / itemCount);
+    }
+
+    const char* BackendName()
+    {
+#if defined(MATH_HELPER_AVX2)
+        return "AVX2";
+#elif defined(MATH_HELPER_SSE41)
+        return "SSE4.1";
+#elif defined(MATH_HELPER_SSE2)
+        return "SSE2";
+#elif defined(MATH_HELPER_NEON)
+        return "NEON";
+#else
+        return "scalar";
+#endif
+    }
+
+    // Whether this CPU runs the instructions the backend was built with.
+    bool BackendSupported()
+    {
+#if defined(MATH_HELPER_SSE41) && (defined(__GNUC__) || defined(__clang__))
+        bool supported = __builtin_cpu_supports("sse4.1");
+#if defined(MATH_HELPER_FMA)
+        supported = supported && __builtin_cpu_supports("fma");
+#endif
+#if defined(MATH_HELPER_AVX2)
+        supported = supported && __builtin_cpu_supports("avx2");
+#endif
+        return supported;
+#elif defined(MATH_HELPER_SSE41) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool supported = (info[2] >> 19) & 1;
+#if defined(MATH_HELPER_FMA)
+        supported = supported && ((info[2] >> 12) & 1);
+#endif
+#if defined(MATH_HELPER_AVX2)
+        __cpuidex(info, 7, 0);
+        supported = supported && ((info[1] >> 5) & 1);
+#endif
+        return supported;
+#else
+        return true;
+#endif
+    }
+
+    //
+    // Double-precision reference.
+    //
+
+    struct DMat
+    {
+        double m[4][4];
+    };
+
+    struct DQuat
+    {
+        double x, y, z, w;
+    };
+
+    DMat ToDouble(const Float4x4& f)
+    {
+        DMat d;
+        for(int r = 0; r < 4; ++r)
+            for(int c = 0; c < 4; ++c)
+                d.m[r][c] = f.m[r][c];
+        return d;
+    }
+
+    DQuat ToDouble(Vec4 v)
+    {
+        Float4 f = StoreFloat4(v);
+        return { f.x, f.y, f.z, f.w };
+    }
+
+    DMat Multiply(const DMat& a, const DMat& b)
+    {
+        DMat r;
+        for(int i = 0; i < 4; ++i)
+        {
+            for(int j = 0; j < 4; ++j)
+            {
+                r.m[i][j] = 0.0;
+                for(int k = 0; k < 4; ++k)
+                    r.m[i][j] += a.m[i][k] * b.m[k][j];
+            }
+        }
+        return r;
+    }
+
+    // |a| * |b|: how large the terms summed into each element of a * b are,
+    // which bounds the rounding error of the float product.
+    DMat MultiplyAbs(const DMat& a, const DMat& b)
+    {
+        DMat r;
+        for(int i = 0; i < 4; ++i)
+        {
+            for(int j = 0; j < 4; ++j)
+            {
+                r.m[i][j] = 0.0;
+                for(int k = 0; k < 4; ++k)
+                    r.m[i][j] += std::fabs(a.m[i][k] * b.m[k][j]);
+            }
+        }
+        return r;
+    }
+
+    // The largest row sum of absolute values.
+    double Norm(const DMat& a)
+    {
+        double norm = 0.0;
+        for(int r = 0; r < 4; ++r)
+            norm = std::max(norm, std::fabs(a.m[r][0]) + std::fabs(a.m[r][1]) + std::fabs(a.m[r][2]) + std::fabs(a.m[r][3]));
+        return norm;
+    }
+
+    // Gauss-Jordan elimination with partial pivoting.
+    DMat Inverse(DMat a, double* determinant)
+    {
+        DMat r = {};
+        for(int i = 0; i < 4; ++i)
+            r.m[i][i] = 1.0;
+
+        double det = 1.0;
+        for(int c = 0; c < 4; ++c)
+        {
+            int pivot = c;
+            for(int i = c + 1; i < 4; ++i)
+            {
+                if(std::fabs(a.m[i][c]) > std::fabs(a.m[pivot][c]))
+                    pivot = i;
+            }
+            if(pivot != c)
+            {
+                std::swap(a.m[pivot], a.m[c]);
+                std::swap(r.m[pivot], r.m[c]);
+                det = -det;
+            }
+
+            double p = a.m[c][c];
+            det *= p;
+            for(int j = 0; j < 4; ++j)
+            {
+                a.m[c][j] /= p;
+                r.m[c][j] /= p;
+            }
+            for(int i = 0; i < 4; ++i)
+            {
+                if(i == c)
+                    continue;
+                double f = a.m[i][c];
+                for(int j = 0; j < 4; ++j)
+                {
+                    a.m[i][j] -= f * a.m[c][j];
+                    r.m[i][j] -= f * r.m[c][j];
+                }
+            }
+        }
+        *determinant = det;
+        return r;
+    }
+
+    // The Hamilton product a * b.
+    DQuat Multiply(const DQuat& a, const DQuat& b)
+    {
+        return
+        {
+            a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+        };
+    }
+
+    // q * (v, 0) * conj(q) for a unit q.
+    DQuat Rotate(const DQuat& q, double x, double y, double z)
+    {
+        DQuat conjugate = { -q.x, -q.y, -q.z, q.w };
+        return Multiply(Multiply(q, { x, y, z, 0.0 }), conjugate);
+    }
+
+    // Row i is the rotation of the i-th axis, as row vectors are
+    // transformed by v * M.
+    DMat RotationMatrix(const DQuat& q)
+    {
+        DMat r = {};
+        for(int i = 0; i < 3; ++i)
+        {
+            DQuat axis = Rotate(q, i == 0, i == 1, i == 2);
+            r.m[i][0] = axis.x;
+            r.m[i][1] = axis.y;
+            r.m[i][2] = axis.z;
+        }
+        r.m[3][3] = 1.0;
+        return r;
+    }
+
+    DQuat Normalize(const DQuat& q)
+    {
+        double length = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+        return { q.x / length, q.y / length, q.z / length, q.w / length };
+    }
+
+    // Along the shorter arc, between q0 and q1 normalized in double so a
+    // float rounding of their length does not move the angle.
+    DQuat Slerp(DQuat q0, DQuat q1, double t)
+    {
+        q0 = Normalize(q0);
+        q1 = Normalize(q1);
+        double cosOmega = q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w;
+        if(cosOmega < 0.0)
+        {
+            q1 = { -q1.x, -q1.y, -q1.z, -q1.w };
+            cosOmega = -cosOmega;
+        }
+        double omega = std::acos(std::min(cosOmega, 1.0));
+        if(omega < 1e-9)
+            return q0;
+        double s0 = std::sin((1.0 - t) * omega) / std::sin(omega);
+        double s1 = std::sin(t * omega) / std::sin(omega);
+        return { s0 * q0.x + s1 * q1.x, s0 * q0.y + s1 * q1.y, s0 * q0.z + s1 * q1.z, s0 * q0.w + s1 * q1.w };
+    }
+
+    struct DVec3
+    {
+        double x, y, z;
+    };
+
+    DVec3 Sub(const DVec3& a, const DVec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    double Dot(const DVec3& a, const DVec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    DVec3 Cross(const DVec3& a, const DVec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    DVec3 Normalize(const DVec3& v)
+    {
+        double length = std::sqrt(Dot(v, v));
+        return { v.x / length, v.y / length, v.z / length };
+    }
+
+    DMat LookAtLH(const DVec3& eye, const DVec3& target, const DVec3& up)
+    {
+        DVec3 z = Normalize(Sub(target, eye));
+        DVec3 x = Normalize(Cross(up, z));
+        DVec3 y = Cross(z, x);
+        return
+        { {
+            { x.x, y.x, z.x, 0.0 },
+            { x.y, y.y, z.y, 0.0 },
+            { x.z, y.z, z.z, 0.0 },
+            { -Dot(x, eye), -Dot(y, eye), -Dot(z, eye), 1.0 }
+        } };
+    }
+
+    DMat PerspectiveFovLH(double fovAngleY, double aspectRatio, double nearZ, double farZ)
+    {
+        double height = 1.0 / std::tan(0.5 * fovAngleY);
+        double range = farZ / (farZ - nearZ);
+        return
+        { {
+            { height / aspectRatio, 0.0, 0.0, 0.0 },
+            { 0.0, height, 0.0, 0.0 },
+            { 0.0, 0.0, range, 1.0 },
+            { 0.0, 0.0, -range * nearZ, 0.0 }
+        } };
+    }
+
+    //
+    // Errors against the reference.  Each records the largest error seen
+    // under its name so the report shows how close the backend came.
+    //
+
+    struct ErrorStat
+    {
+        const char* Name;
+        double Tolerance;
+        double Max = 0.0;
+        bool NaN = false;
+
+        ErrorStat(const char* name, double tolerance) : Name(name), Tolerance(tolerance) {}
+
+        void Add(double error)
+        {
+            NaN |= error != error;
+            Max = std::max(Max, error);
+        }
+
+        void Report()
+        {
+            std::printf("  %-40s max error %.2e (tolerance %.0e)\n", Name, Max, Tolerance);
+            Check(!NaN && Max <= Tolerance, Name);
+        }
+    };
+
+    // Largest element difference relative to the largest reference element,
+    // or to 1 for small matrices.
+    double MatrixError(const Float4x4& got, const DMat& want)
+    {
+        double scale = 1.0;
+        for(int r = 0; r < 4; ++r)
+            for(int c = 0; c < 4; ++c)
+                scale = std::max(scale, std::fabs(want.m[r][c]));
+        double error = 0.0;
+        for(int r = 0; r < 4; ++r)
+            for(int c = 0; c < 4; ++c)
+                error = std::max(error, std::fabs(got.m[r][c] - want.m[r][c]) / scale);
+        return error;
+    }
+
+    double MatrixError(const Mat4& got, const DMat& want)
+    {
+        return MatrixError(StoreFloat4x4(got), want);
+    }
+
+    // Largest element difference from a * b relative to the terms summed
+    // into the element.
+    double ProductError(const Float4x4& got, const Float4x4& a, const Float4x4& b)
+    {
+        DMat want = Multiply(ToDouble(a), ToDouble(b));
+        DMat terms = MultiplyAbs(ToDouble(a), ToDouble(b));
+        double error = 0.0;
+        for(int r = 0; r < 4; ++r)
+        {
+            for(int c = 0; c < 4; ++c)
+                error = std::max(error, std::fabs(got.m[r][c] - want.m[r][c]) / std::max(terms.m[r][c], DBL_MIN));
+        }
+        return error;
+    }
+
+    double QuatError(Vec4 got, const DQuat& want)
+    {
+        DQuat g = ToDouble(got);
+        return std::max(std::max(std::fabs(g.x - want.x), std::fabs(g.y - want.y)),
+            std::max(std::fabs(g.z - want.z), std::fabs(g.w - want.w)));
+    }
+
+    // (x, y, z, 1) * m with the w dropped, relative to the terms summed.
+    double PointError(float x, float y, float z, float gotX, float gotY, float gotZ, const Float4x4& m)
+    {
+        const float got[3] = { gotX, gotY, gotZ };
+        double error = 0.0;
+        for(int c = 0; c < 3; ++c)
+        {
+            double want = (double)x * m.m[0][c] + (double)y * m.m[1][c] + (double)z * m.m[2][c] + m.m[3][c];
+            double terms = std::fabs((double)x * m.m[0][c]) + std::fabs((double)y * m.m[1][c]) +
+                std::fabs((double)z * m.m[2][c]) + std::fabs(m.m[3][c]);
+            error = std::max(error, std::fabs(got[c] - want) / std::max(terms, DBL_MIN));
+        }
+        return error;
+    }
+
+    //
+    // Inputs.
+    //
+
+    Vec4 RandomUnitQuat(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        return QuatNormalize(VecSet(unit(rng), unit(rng), unit(rng), unit(rng)));
+    }
+
+    Float4x4 RandomWorld(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        Vec4 axis = VecNormalize3(VecSet(unit(rng), unit(rng), unit(rng), 0.f));
+        Vec4 rotation = QuatRotationAxis(axis, 3.14159f * unit(rng));
+        Vec4 scale = VecReplicate(1.5f + unit(rng));
+        Vec4 translation = VecSet(100.f * unit(rng), 100.f * unit(rng), 100.f * unit(rng), 0.f);
+        return StoreFloat4x4(MatAffineTransformation(scale, rotation, translation));
+    }
+
+    // Random entries around a dominant diagonal, so the matrix is well
+    // conditioned and its float inverse close to the exact one.
+    Float4x4 RandomGeneral(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        Float4x4 m;
+        for(int r = 0; r < 4; ++r)
+            for(int c = 0; c < 4; ++c)
+                m.m[r][c] = unit(rng) + (r == c ? 4.f * (unit(rng) < 0.f ? -1.f : 1.f) : 0.f);
+        return m;
+    }
+
+    Float4x4 RandomView(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        Vec4 eye = VecSet(50.f * unit(rng), 50.f * unit(rng), 50.f * unit(rng), 1.f);
+        Vec4 target = VecSet(10.f * unit(rng), 10.f * unit(rng), 10.f * unit(rng), 1.f);
+        return StoreFloat4x4(MatLookAtLH(eye, target, VecSet(0.f, 1.f, 0.f, 0.f)));
+    }
+
+    // Scaled differently along each axis, unlike RandomWorld.
+    Float4x4 RandomAffine(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        Vec4 scale = VecSet(1.5f + unit(rng), 1.5f + unit(rng), 1.5f + unit(rng), 0.f);
+        Vec4 translation = VecSet(100.f * unit(rng), 100.f * unit(rng), 100.f * unit(rng), 0.f);
+        return StoreFloat4x4(MatAffineTransformation(scale, RandomUnitQuat(rng), translation));
+    }
+
+    Float4x4 RandomPerspective(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        return StoreFloat4x4(MatPerspectiveFovLH(0.3f + 1.5f * unit(rng), 0.5f + 2.f * unit(rng),
+            0.05f + unit(rng), 100.f + 5000.f * unit(rng)));
+    }
+
+    void TestLayout(std::mt19937& rng)
+    {
+        std::printf("Layout checks\n");
+        std::uniform_real_distribution<float> unit(-100.f, 100.f);
+        Float4x4 f;
+        for(int i = 0; i < 16; ++i)
+            (&f._11)[i] = unit(rng);
+        f._23 = -0.f;
+
+        bool named = true;
+        for(int r = 0; r < 4; ++r)
+            for(int c = 0; c < 4; ++c)
+                named &= &f.m[r][c] == &f._11 + r * 4 + c;
+        Check(named, "_RC names m[R-1][C-1], row-major");
+
+        Float4x4 stored = StoreFloat4x4(Load(f));
+        Check(std::memcmp(&stored, &f, sizeof(f)) == 0, "Load and Store keep every bit");
+        Float4x4 transposed = StoreFloat4x4(MatTranspose(Load(f)));
+        bool exact = true;
+        for(int r = 0; r < 4; ++r)
+            for(int c = 0; c < 4; ++c)
+                exact &= std::memcmp(&transposed.m[r][c], &f.m[c][r], sizeof(float)) == 0;
+        Check(exact, "MatTranspose moves elements exactly");
+
+        Float3 p3 = StoreFloat3(Load(Float3(1.f, 2.f, 3.f), 7.f));
+        Float4 p4 = StoreFloat4(Load(Float3(1.f, 2.f, 3.f), 7.f));
+        Check(p3.x == 1.f && p3.y == 2.f && p3.z == 3.f && p4.w == 7.f, "Float3 loads with the given w");
+
+#if defined(MATH_HELPER_DIRECTXMATH)
+        // Float4x4 and XMFLOAT4X4 are interchangeable through AsFloat4x4,
+        // Load and Store.
+        DirectX::XMFLOAT4X4 xm(
+            f._11, f._12, f._13, f._14, f._21, f._22, f._23, f._24,
+            f._31, f._32, f._33, f._34, f._41, f._42, f._43, f._44);
+        Check(std::memcmp(MathHelper::AsFloat4x4(&xm), &f, sizeof(f)) == 0 &&
+            MathHelper::AsFloat4x4(&xm)->_32 == xm._32 && MathHelper::AsFloat4x4(&xm)->m[3][1] == xm(3, 1),
+            "AsFloat4x4 views an XMFLOAT4X4 element for element");
+        Check(MathHelper::AsXMFLOAT4X4(&f)->_41 == f._41 && MathHelper::AsXMFLOAT4X4(&f)->_14 == f._14,
+            "AsXMFLOAT4X4 views a Float4x4 element for element");
+
+        DirectX::XMFLOAT4X4 roundTrip;
+        Store(&roundTrip, Load(xm));
+        Check(std::memcmp(&roundTrip, &xm, sizeof(xm)) == 0, "Load and Store of an XMFLOAT4X4 keep every bit");
+        DirectX::XMFLOAT4X4 fromDirectX;
+        DirectX::XMStoreFloat4x4(&fromDirectX, DirectX::XMLoadFloat4x4(&xm));
+        Check(std::memcmp(&fromDirectX, MathHelper::AsXMFLOAT4X4(&stored), sizeof(xm)) == 0,
+            "DirectXMath reads and writes the same bytes");
+        DirectX::XMFLOAT4X4 identity = MathHelper::Identity4X4();
+        Float4x4 mathIdentity = Float4x4::Identity();
+        Check(std::memcmp(&identity, &mathIdentity, sizeof(identity)) == 0, "Identity4X4 is Float4x4::Identity");
+#endif
+        EndChecks();
+    }
+
+    void TestMatrices(std::mt19937& rng, int count)
+    {
+        std::printf("Matrix checks against doubles\n");
+        const double Rounding = FLT_EPSILON;
+        ErrorStat product("MatMultiply", 4 * Rounding);
+        ErrorStat inverse("MatInverse", 4 * Rounding);
+        ErrorStat determinant("MatInverse determinant", 4 * Rounding);
+        ErrorStat lookAt("MatLookAtLH", 8 * Rounding);
+        ErrorStat perspective("MatPerspectiveFovLH", 8 * Rounding);
+        ErrorStat affine("MatAffineTransformation", 8 * Rounding);
+
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        for(int i = 0; i < count; ++i)
+        {
+            Float4x4 a = RandomGeneral(rng), b = RandomWorld(rng);
+            product.Add(ProductError(StoreFloat4x4(MatMultiply(Load(a), Load(b))), a, b));
+            product.Add(ProductError(StoreFloat4x4(MatMultiply(Load(b), Load(a))), b, a));
+
+            // Perspective with the ranges a camera uses.
+            float fov = 0.3f + 1.5f * (0.5f + 0.5f * unit(rng));
+            float aspect = 1.f + unit(rng) * 0.8f;
+            float nearZ = 0.1f + 0.5f * (unit(rng) + 1.f);
+            float farZ = 100.f + 500.f * (unit(rng) + 1.f);
+            Float4x4 proj = StoreFloat4x4(MatPerspectiveFovLH(fov, aspect, nearZ, farZ));
+            perspective.Add(MatrixError(proj, PerspectiveFovLH(fov, aspect, nearZ, farZ)));
+
+            DVec3 eye = { 50.0 * unit(rng), 50.0 * unit(rng), 50.0 * unit(rng) };
+            DVec3 target = { 10.0 * unit(rng), 10.0 * unit(rng), 10.0 * unit(rng) };
+            DVec3 up = { 0.2 * unit(rng), 1.0, 0.2 * unit(rng) };
+            Float4x4 view = StoreFloat4x4(MatLookAtLH(
+                VecSet((float)eye.x, (float)eye.y, (float)eye.z, 1.f),
+                VecSet((float)target.x, (float)target.y, (float)target.z, 1.f),
+                VecSet((float)up.x, (float)up.y, (float)up.z, 0.f)));
+            lookAt.Add(MatrixError(view, LookAtLH(eye, target, up)));
+
+            // Scale, then rotate, then translate.
+            Vec4 q = RandomUnitQuat(rng);
+            float sx = 0.5f + unit(rng) * 0.4f, sy = 1.f + unit(rng) * 0.4f, sz = 2.f + unit(rng);
+            DMat scaling = {};
+            scaling.m[0][0] = sx;
+            scaling.m[1][1] = sy;
+            scaling.m[2][2] = sz;
+            scaling.m[3][3] = 1.0;
+            DMat want = Multiply(scaling, RotationMatrix(ToDouble(q)));
+            want.m[3][0] = 10.0;
+            want.m[3][1] = -20.0;
+            want.m[3][2] = 30.0;
+            affine.Add(MatrixError(MatAffineTransformation(VecSet(sx, sy, sz, 0.f), q,
+                VecSet(10.f, -20.f, 30.f, 0.f)), want));
+
+            // Inverses of every kind of matrix a frame inverts.
+            Float4x4 viewProj = StoreFloat4x4(MatMultiply(Load(view), Load(proj)));
+            // A projection's inverse is only as accurate as its condition
+            // number allows, so errors are measured per unit of it.
+            for(const Float4x4& m : { a, b, view, proj, viewProj })
+            {
+                double wantDeterminant;
+                DMat wantInverse = Inverse(ToDouble(m), &wantDeterminant);
+                double condition = Norm(ToDouble(m)) * Norm(wantInverse);
+                float gotDeterminant;
+                inverse.Add(MatrixError(MatInverse(Load(m), &gotDeterminant), wantInverse) / condition);
+                determinant.Add(std::fabs(gotDeterminant - wantDeterminant) / std::fabs(wantDeterminant) / condition);
+            }
+        }
+
+#if defined(MATH_HELPER_DIRECTXMATH)
+        // The matrices DirectXMath builds from the same inputs.
+        ErrorStat directXProduct("XMMatrixMultiply", 4 * Rounding);
+        ErrorStat directXLookAt("XMMatrixLookAtLH", 8 * Rounding);
+        ErrorStat directXPerspective("XMMatrixPerspectiveFovLH", 8 * Rounding);
+        for(int i = 0; i < count; ++i)
+        {
+            Float4x4 a = RandomGeneral(rng), b = RandomWorld(rng);
+            DirectX::XMFLOAT4X4 xm;
+            DirectX::XMStoreFloat4x4(&xm, DirectX::XMMatrixMultiply(
+                DirectX::XMLoadFloat4x4(MathHelper::AsXMFLOAT4X4(&a)), DirectX::XMLoadFloat4x4(MathHelper::AsXMFLOAT4X4(&b))));
+            directXProduct.Add(MatrixError(*MathHelper::AsFloat4x4(&xm), ToDouble(StoreFloat4x4(MatMultiply(Load(a), Load(b))))));
+
+            float eye[3] = { 50.f * unit(rng), 50.f * unit(rng), 50.f * unit(rng) };
+            DirectX::XMStoreFloat4x4(&xm, DirectX::XMMatrixLookAtLH(DirectX::XMVectorSet(eye[0], eye[1], eye[2], 1.f),
+                DirectX::XMVectorSet(0.f, 0.f, 0.f, 1.f), DirectX::XMVectorSet(0.f, 1.f, 0.f, 0.f)));
+            directXLookAt.Add(MatrixError(*MathHelper::AsFloat4x4(&xm), ToDouble(StoreFloat4x4(MatLookAtLH(
+                VecSet(eye[0], eye[1], eye[2], 1.f), VecSet(0.f, 0.f, 0.f, 1.f), VecSet(0.f, 1.f, 0.f, 0.f))))));
+
+            float fov = 0.5f + unit(rng) * 0.3f;
+            DirectX::XMStoreFloat4x4(&xm, DirectX::XMMatrixPerspectiveFovLH(fov, 16.f / 9.f, 1.f, 1000.f));
+            directXPerspective.Add(MatrixError(*MathHelper::AsFloat4x4(&xm),
+                ToDouble(StoreFloat4x4(MatPerspectiveFovLH(fov, 16.f / 9.f, 1.f, 1000.f)))));
+        }
+        directXProduct.Report();
+        directXLookAt.Report();
+        directXPerspective.Report();
+#endif
+
+        product.Report();
+        inverse.Report();
+        determinant.Report();
+        lookAt.Report();
+        perspective.Report();
+        affine.Report();
+        EndChecks();
+    }
+
+    void TestQuaternions(std::mt19937& rng, int count)
+    {
+        std::printf("Quaternion checks against doubles\n");
+        const double Rounding = FLT_EPSILON;
+        ErrorStat axisAngle("QuatRotationAxis", 4 * Rounding);
+        ErrorStat normalize("QuatNormalize", 4 * Rounding);
+        ErrorStat multiply("QuatMultiply", 8 * Rounding);
+        ErrorStat rotate("QuatRotate", 8 * Rounding);
+        ErrorStat matrix("MatRotationQuaternion", 8 * Rounding);
+        ErrorStat slerp("QuatSlerp", 8 * Rounding);
+
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        for(int i = 0; i < count; ++i)
+        {
+            float x = unit(rng), y = unit(rng), z = unit(rng), angle = 3.14159f * unit(rng);
+            Vec4 axis = VecNormalize3(VecSet(x, y, z, 0.f));
+            DQuat a = ToDouble(axis);
+            double s = std::sin(0.5 * angle), c = std::cos(0.5 * angle);
+            axisAngle.Add(QuatError(QuatRotationAxis(axis, angle), { a.x * s, a.y * s, a.z * s, c }));
+
+            Vec4 raw = VecSet(x, y, z, unit(rng));
+            normalize.Add(QuatError(QuatNormalize(raw), Normalize(ToDouble(raw))));
+
+            Vec4 q1 = RandomUnitQuat(rng), q2 = RandomUnitQuat(rng);
+            DQuat d1 = ToDouble(q1), d2 = ToDouble(q2);
+            multiply.Add(QuatError(QuatMultiply(q1, q2), Multiply(d2, d1)));
+            DQuat conjugate = ToDouble(QuatConjugate(q1));
+            multiply.Add(QuatError(QuatMultiply(q1, QuatConjugate(q1)), Multiply(conjugate, d1)));
+
+            // Rotating by q1 then q2 is rotating by QuatMultiply(q1, q2),
+            // and the matrices agree with the quaternions.
+            Vec4 v = VecSet(10.f * x, 10.f * y, 10.f * z, 0.f);
+            DQuat dv = ToDouble(v);
+            DQuat want = Rotate(d1, dv.x, dv.y, dv.z);
+            want.w = 0.0;
+            Vec4 rotated = VecSelectW(QuatRotate(v, q1), VecZero());
+            rotate.Add(QuatError(rotated, want) / 10.0);
+            DQuat twice = Rotate(d2, want.x, want.y, want.z);
+            twice.w = 0.0;
+            rotate.Add(QuatError(VecSelectW(QuatRotate(v, QuatMultiply(q1, q2)), VecZero()), twice) / 10.0);
+            matrix.Add(MatrixError(MatRotationQuaternion(q1), RotationMatrix(d1)));
+
+            // Random pairs, pairs on opposite hemispheres, and pairs close
+            // enough for the normalized lerp.
+            float t = 0.5f + 0.5f * unit(rng);
+            Vec4 near = QuatNormalize(VecAdd(q1, VecMul(VecSet(x, y, z, 1.f), VecReplicate(1e-3f))));
+            for(Vec4 end : { q2, VecNegate(q2), near })
+            {
+                DQuat wantSlerp = Slerp(d1, ToDouble(end), t);
+                slerp.Add(QuatError(QuatSlerp(q1, end, t), wantSlerp));
+            }
+            slerp.Add(QuatError(QuatSlerp(q1, q2, 0.f), d1));
+        }
+
+        axisAngle.Report();
+        normalize.Report();
+        multiply.Report();
+        rotate.Report();
+        matrix.Report();
+        slerp.Report();
+        EndChecks();
+    }
+
+    // The batched kernels, at every count up to a few AVX2 blocks so each
+    // loop's tail is run.
+    void TestKernels(std::mt19937& rng)
+    {
+        std::printf("Batched kernel checks against doubles\n");
+        const double Rounding = FLT_EPSILON;
+        ErrorStat pairwise("MultiplyMatrices, pairwise", 4 * Rounding);
+        ErrorStat shared("MultiplyMatrices, shared", 4 * Rounding);
+        ErrorStat points("TransformPoints", 4 * Rounding);
+        ErrorStat soa("TransformPointsSoA", 4 * Rounding);
+        bool aliased = true, bounded = true;
+
+        std::uniform_real_distribution<float> unit(-100.f, 100.f);
+        const float Guard = 12345.f;
+        for(size_t count = 0; count <= 20; ++count)
+        {
+            std::vector<Float4x4> a(count), b(count), dst(count + 1);
+            for(size_t i = 0; i < count; ++i)
+            {
+                a[i] = RandomWorld(rng);
+                b[i] = RandomGeneral(rng);
+            }
+            Float4x4 m = RandomWorld(rng);
+
+            dst[count]._11 = Guard;
+            MathHelper::MultiplyMatrices(a.data(), b.data(), dst.data(), count);
+            for(size_t i = 0; i < count; ++i)
+                pairwise.Add(ProductError(dst[i], a[i], b[i]));
+            std::vector<Float4x4> inPlace = a;
+            MathHelper::MultiplyMatrices(inPlace.data(), b.data(), inPlace.data(), count);
+            aliased &= count == 0 || std::memcmp(inPlace.data(), dst.data(), count * sizeof(Float4x4)) == 0;
+
+            MathHelper::MultiplyMatrices(a.data(), m, dst.data(), count);
+            for(size_t i = 0; i < count; ++i)
+                shared.Add(ProductError(dst[i], a[i], m));
+            inPlace = a;
+            MathHelper::MultiplyMatrices(inPlace.data(), m, inPlace.data(), count);
+            aliased &= count == 0 || std::memcmp(inPlace.data(), dst.data(), count * sizeof(Float4x4)) == 0;
+            bounded &= dst[count]._11 == Guard;
+
+            // One point past the end of each output is a guard.
+            std::vector<Float3> src(count), out(count + 1);
+            std::vector<float> x(count), y(count), z(count);
+            std::vector<float> outX(count + 1, Guard), outY(count + 1, Guard), outZ(count + 1, Guard);
+            for(size_t i = 0; i < count; ++i)
+            {
+                src[i] = Float3(unit(rng), unit(rng), unit(rng));
+                x[i] = src[i].x;
+                y[i] = src[i].y;
+                z[i] = src[i].z;
+            }
+            out[count] = Float3(Guard, Guard, Guard);
+            MathHelper::TransformPoints(m, src.data(), out.data(), count);
+            MathHelper::TransformPointsSoA(m, x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), count);
+            for(size_t i = 0; i < count; ++i)
+            {
+                points.Add(PointError(x[i], y[i], z[i], out[i].x, out[i].y, out[i].z, m));
+                soa.Add(PointError(x[i], y[i], z[i], outX[i], outY[i], outZ[i], m));
+            }
+            bounded &= out[count].x == Guard && out[count].y == Guard && out[count].z == Guard;
+            bounded &= outX[count] == Guard && outY[count] == Guard && outZ[count] == Guard;
+
+            std::vector<Float3> transformed = src;
+            MathHelper::TransformPoints(m, transformed.data(), transformed.data(), count);
+            aliased &= count == 0 || std::memcmp(transformed.data(), out.data(), count * sizeof(Float3)) == 0;
+        }
+
+        pairwise.Report();
+        shared.Report();
+        points.Report();
+        soa.Report();
+        Check(aliased, "kernels give the same results in place");
+        Check(bounded, "kernels write nothing past count");
+        EndChecks();
+    }
+
+    // The inverses for matrices of a known kind, against the general
+    // inverse and against m * inverse = identity, both per unit of the
+    // condition number as for MatInverse.
+    void TestFastInverses(std::mt19937& rng, int count)
+    {
+        std::printf("Fast inverse checks\n");
+        const double Rounding = FLT_EPSILON;
+        ErrorStat rigid("MatInverseRigid vs MatInverse", 4 * Rounding);
+        ErrorStat rigidIdentity("MatInverseRigid, m * inverse", 4 * Rounding);
+        ErrorStat affine("MatInverseAffine vs MatInverse", 4 * Rounding);
+        ErrorStat affineIdentity("MatInverseAffine, m * inverse", 4 * Rounding);
+        ErrorStat perspective("MatInversePerspectiveLH vs MatInverse", 4 * Rounding);
+        ErrorStat perspectiveIdentity("MatInversePerspectiveLH, m * inverse", 4 * Rounding);
+
+        DMat identity = {};
+        for(int i = 0; i < 4; ++i)
+            identity.m[i][i] = 1.0;
+
+        auto measure = [&](const Float4x4& m, const Mat4& fast, ErrorStat& general, ErrorStat& product)
+        {
+            double determinant;
+            double condition = Norm(ToDouble(m)) * Norm(Inverse(ToDouble(m), &determinant));
+            general.Add(MatrixError(fast, ToDouble(StoreFloat4x4(MatInverse(Load(m))))) / condition);
+            product.Add(MatrixError(MatMultiply(Load(m), fast), identity) / condition);
+        };
+
+        for(int i = 0; i < count; ++i)
+        {
+            Float4x4 view = RandomView(rng), world = RandomWorld(rng), scaled = RandomAffine(rng);
+            Float4x4 proj = RandomPerspective(rng);
+            measure(view, MatInverseRigid(Load(view)), rigid, rigidIdentity);
+            measure(world, MatInverseAffine(Load(world)), affine, affineIdentity);
+            measure(scaled, MatInverseAffine(Load(scaled)), affine, affineIdentity);
+            measure(view, MatInverseAffine(Load(view)), affine, affineIdentity);
+            measure(proj, MatInversePerspectiveLH(Load(proj)), perspective, perspectiveIdentity);
+        }
+
+        rigid.Report();
+        rigidIdentity.Report();
+        affine.Report();
+        affineIdentity.Report();
+        perspective.Report();
+        perspectiveIdentity.Report();
+        EndChecks();
+    }
+
+    // TransposeMatricesStrided against a scalar transpose, for every
+    // combination of an item list, a transform, packed and padded strides,
+    // and counts around the AVX2 block sizes.  Slots it should not write and
+    // the padding of the slots it does write must keep their bytes.
+    void TestTransposeStrided(std::mt19937& rng)
+    {
+        std::printf("TransposeMatricesStrided checks\n");
+        const double Rounding = FLT_EPSILON;
+        ErrorStat transformed("TransposeMatricesStrided, transform", 4 * Rounding);
+        bool exact = true, bounded = true;
+
+        const size_t sourceCount = 48;
+        std::vector<Float4x4> src(sourceCount);
+        for(auto& m : src)
+            m = RandomGeneral(rng);
+        Float4x4 transform = RandomWorld(rng);
+
+        std::vector<std::uint32_t> slots(sourceCount);
+        for(size_t i = 0; i < sourceCount; ++i)
+            slots[i] = (std::uint32_t)i;
+        std::shuffle(slots.begin(), slots.end(), rng);
+
+        const unsigned char Untouched = 0xAB;
+        for(size_t stride : { sizeof(Float4x4), (size_t)96, (size_t)256 })
+        {
+            for(size_t count : { 0, 1, 7, 8, 9, 13, 16, 21 })
+            {
+                for(bool withItems : { false, true })
+                {
+                    for(bool withTransform : { false, true })
+                    {
+                        // Every other item in reverse, or the first count.
+                        std::vector<std::uint32_t> items(count);
+                        for(size_t k = 0; k < count; ++k)
+                            items[k] = (std::uint32_t)(withItems ? sourceCount - 1 - 2 * k : k);
+
+                        std::vector<unsigned char> dst(sourceCount * stride, Untouched);
+                        MathHelper::TransposeMatricesStrided(src.data(), withItems ? items.data() : nullptr, count,
+                            slots.data(), dst.data(), stride, withTransform ? &transform : nullptr);
+
+                        std::vector<bool> written(sourceCount, false);
+                        for(std::uint32_t item : items)
+                        {
+                            written[item] = true;
+                            Float4x4 got;
+                            std::memcpy(&got, &dst[slots[item] * stride], sizeof(got));
+                            Float4x4 back = StoreFloat4x4(MatTranspose(Load(got)));
+                            if(withTransform)
+                            {
+                                transformed.Add(ProductError(back, src[item], transform));
+                            }
+                            else
+                            {
+                                exact &= std::memcmp(&back, &src[item], sizeof(back)) == 0;
+                            }
+                            for(size_t b = sizeof(Float4x4); b < stride; ++b)
+                                bounded &= dst[slots[item] * stride + b] == Untouched;
+                        }
+                        for(size_t i = 0; i < sourceCount; ++i)
+                        {
+                            if(written[i])
+                                continue;
+                            for(size_t b = 0; b < stride; ++b)
+                                bounded &= dst[slots[i] * stride + b] == Untouched;
+                        }
+                    }
+                }
+            }
+        }
+
+        transformed.Report();
+        Check(exact, "TransposeMatricesStrided without a transform transposes exactly");
+        Check(bounded, "TransposeMatricesStrided writes only the listed slots' matrices");
+        EndChecks();
+    }
+
+    void BenchmarkPass(size_t passIterations)
+    {
+        // Orbiting views as UpdateCamera builds them, so nothing can be
+        // hoisted out of the loop.
+        const size_t viewCount = 1024;
+        std::vector<Float4x4> views(viewCount);
+        for(size_t i = 0; i < viewCount; ++i)
+        {
+            float theta = 6.2831853f * i / viewCount;
+            Vec4 eye = VecSet(5.f * std::cos(theta), 3.f, 5.f * std::sin(theta), 1.f);
+            views[i] = StoreFloat4x4(MatLookAtLH(eye, VecZero(), VecSet(0.f, 1.f, 0.f, 0.f)));
+        }
+        Mat4 proj = MatPerspectiveFovLH(0.25f * 3.14159265f, 16.f / 9.f, 1.f, 1000.f);
+        Float4x4 projF = StoreFloat4x4(proj);
+        Float4x4 invProjF = StoreFloat4x4(MatInversePerspectiveLH(proj));
+        PassMatrices pass;
+
+        std::printf("UpdateMainPass, %zu passes, best of %d\n", passIterations, gRepetitions);
+
+        Run("  general inverses (view, proj, viewProj)", passIterations, [&]()
+        {
+            for(size_t i = 0; i < passIterations; ++i)
+            {
+                Mat4 view = Load(views[i & (viewCount - 1)]);
+                Mat4 proj = Load(projF);
+                Mat4 viewProj = MatMultiply(view, proj);
+                Store(&pass.View, MatTranspose(view));
+                Store(&pass.InvView, MatTranspose(MatInverse(view)));
+                Store(&pass.Proj, MatTranspose(proj));
+                Store(&pass.InvProj, MatTranspose(MatInverse(proj)));
+                Store(&pass.ViewProj, MatTranspose(viewProj));
+                Store(&pass.InvViewProj, MatTranspose(MatInverse(viewProj)));
+                gSink += pass.InvViewProj._11;
+            }
+        });
+
+        Run("  rigid view, cached inverse proj", passIterations, [&]()
+        {
+            for(size_t i = 0; i < passIterations; ++i)
+            {
+                Mat4 view = Load(views[i & (viewCount - 1)]);
+                Mat4 proj = Load(projF);
+                Mat4 invView = MatInverseRigid(view);
+                Mat4 invProj = Load(invProjF);
+                Mat4 viewProj = MatMultiply(view, proj);
+                Store(&pass.View, MatTranspose(view));
+                Store(&pass.InvView, MatTranspose(invView));
+                Store(&pass.Proj, MatTranspose(proj));
+                Store(&pass.InvProj, MatTranspose(invProj));
+                Store(&pass.ViewProj, MatTranspose(viewProj));
+                Store(&pass.InvViewProj, MatTranspose(MatMultiply(invProj, invView)));
+                gSink += pass.InvViewProj._11;
+            }
+        });
+    }
+
+    void BenchmarkObjects(size_t objectCount)
+    {
+        std::mt19937 rng(7);
+        std::vector<Float4x4> worlds(objectCount);
+        for(auto& world : worlds)
+            world = RandomWorld(rng);
+
+        // ObjCBIndex of each item; shuffled like a store after many
+        // removals and insertions.
+        std::vector<std::uint32_t> slots(objectCount);
+        for(size_t i = 0; i < objectCount; ++i)
+            slots[i] = (std::uint32_t)i;
+        std::shuffle(slots.begin(), slots.end(), rng);
+
+        std::vector<std::uint32_t> dirty;
+        for(size_t i = 0; i < objectCount; i += DirtyDivisor)
+            dirty.push_back((std::uint32_t)i);
+
+        Float4x4 viewProj = StoreFloat4x4(MatMultiply(
+            MatLookAtLH(VecSet(0.f, 3.f, -5.f, 1.f), VecZero(), VecSet(0.f, 1.f, 0.f, 0.f)),
+            MatPerspectiveFovLH(0.25f * 3.14159265f, 16.f / 9.f, 1.f, 1000.f)));
+
+        // Object constants are packed 64-byte elements of a structured buffer.
+        const size_t stride = sizeof(Float4x4);
+        std::vector<Float4x4> objectBuffer(objectCount);
+        std::vector<Float4x4> products(objectCount);
+
+        std::printf("UpdateObjectConstants, %zu objects, best of %d\n", objectCount, gRepetitions);
+
+        Run("  scalar transpose per object", objectCount, [&]()
+        {
+            for(size_t i = 0; i < objectCount; ++i)
+            {
+                Float4x4& dst = objectBuffer[slots[i]];
+                for(int r = 0; r < 4; ++r)
+                    for(int c = 0; c < 4; ++c)
+                        dst.m[c][r] = worlds[i].m[r][c];
+            }
+            gSink += objectBuffer[0]._11;
+        });
+
+        Run("  TransposeMatricesStrided, all", objectCount, [&]()
+        {
+            MathHelper::TransposeMatricesStrided(worlds.data(), nullptr, objectCount,
+                slots.data(), objectBuffer.data(), stride);
+            gSink += objectBuffer[0]._11;
+        });
+
+        Run("  TransposeMatricesStrided, dirty list", dirty.size(), [&]()
+        {
+            MathHelper::TransposeMatricesStrided(worlds.data(), dirty.data(), dirty.size(),
+                slots.data(), objectBuffer.data(), stride);
+            gSink += objectBuffer[0]._11;
+        });
+
+        Run("  TransposeMatricesStrided, world * viewProj", objectCount, [&]()
+        {
+            MathHelper::TransposeMatricesStrided(worlds.data(), nullptr, objectCount,
+                slots.data(), objectBuffer.data(), stride, &viewProj);
+            gSink += objectBuffer[0]._11;
+        });
+
+        Run("  MultiplyMatrices, world * viewProj", objectCount, [&]()
+        {
+            MathHelper::MultiplyMatrices(worlds.data(), viewProj, products.data(), objectCount);
+            gSink += products[0]._11;
+        });
+
+        Run("  MatInverseAffine per object", objectCount, [&]()
+        {
+            for(size_t i = 0; i < objectCount; ++i)
+                Store(&products[i], MatInverseAffine(Load(worlds[i])));
+            gSink += products[0]._11;
+        });
+
+        Run("  MatInverse per object", objectCount, [&]()
+        {
+            for(size_t i = 0; i < objectCount; ++i)
+                Store(&products[i], MatInverse(Load(worlds[i])));
+            gSink += products[0]._11;
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+    std::printf("MathHelper backend: %s\n\n", BackendName());
+    if(!BackendSupported())
+    {
+        std::printf("This CPU cannot run the %s backend; skipped.\n", BackendName());
+        return SkipExitCode;
+    }
+
+    std::mt19937 rng(21);
+    TestLayout(rng);
+    TestMatrices(rng, quick ? 2000 : 20000);
+    TestQuaternions(rng, quick ? 2000 : 20000);
+    TestKernels(rng);
+    TestFastInverses(rng, quick ? 2000 : 20000);
+    TestTransposeStrided(rng);
+
+    BenchmarkPass(quick ? 100000 : 1000000);
+    std::printf("\n");
+    BenchmarkObjects(quick ? 10000 : 100000);
+    return Finish(gSink);
+}
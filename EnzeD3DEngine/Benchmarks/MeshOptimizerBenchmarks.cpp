@@ -0,0 +1,177 @@
+// Vertex cache statistics of the GeometryGenerator meshes before and after
+// MeshOptimizer, printed so they show up without a debugger attached.  The
+// program fails when optimizing makes a mesh worse, changes its triangles,
+// leaves vertices out of first-use order, or leaves 16-bit indices narrowed
+// beforehand stale; then Optimize is timed on large meshes.  --quick skips
+// the largest sizes.
+
+#include "GeometryGenerator.h"
+#include "MeshOptimizer.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace
+{
+    using uint32 = MeshOptimizer::uint32;
+
+    float gSink = 0.f;
+
+    // A triangle by the positions of its corners, rotated so the smallest
+    // corner comes first; winding is kept.
+    using Triangle = std::array<float, 9>;
+
+    std::vector<Triangle> Triangles(const GeometryGenerator::MeshData& mesh)
+    {
+        std::vector<Triangle> triangles;
+        for(size_t t = 0; t + 2 < mesh.Indices32.size(); t += 3)
+        {
+            std::array<Triangle, 3> rotations;
+            for(int r = 0; r < 3; ++r)
+            {
+                for(int c = 0; c < 3; ++c)
+                {
+                    const DirectX::XMFLOAT3& p = mesh.Vertices[mesh.Indices32[t + (r + c) % 3]].Position;
+                    rotations[r][c * 3 + 0] = p.x;
+                    rotations[r][c * 3 + 1] = p.y;
+                    rotations[r][c * 3 + 2] = p.z;
+                }
+            }
+            triangles.push_back(*std::min_element(rotations.begin(), rotations.end()));
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    // OptimizeVertexFetchRemap numbers vertices in the order the indices
+    // first reference them.
+    bool InFirstUseOrder(const std::vector<uint32>& indices, size_t vertexCount)
+    {
+        uint32 next = 0;
+        for(uint32 index : indices)
+        {
+            if(index > next)
+                return false;
+            if(index == next)
+                ++next;
+        }
+        return next == vertexCount;
+    }
+
+    // The triangles in random order, as from an exporter that does not care
+    // about the cache.
+    GeometryGenerator::MeshData Shuffled(GeometryGenerator::MeshData mesh)
+    {
+        std::vector<std::array<uint32, 3>> triangles(mesh.Indices32.size() / 3);
+        std::memcpy(triangles.data(), mesh.Indices32.data(), mesh.Indices32.size() * sizeof(uint32));
+        std::shuffle(triangles.begin(), triangles.end(), std::mt19937(5));
+        std::memcpy(mesh.Indices32.data(), triangles.data(), mesh.Indices32.size() * sizeof(uint32));
+        return mesh;
+    }
+
+    void Report(const char* name, const GeometryGenerator::MeshData& original)
+    {
+        GeometryGenerator::MeshData mesh = original;
+        bool narrow = mesh.Vertices.size() <= 0x10000;
+        if(narrow)
+            mesh.GetIndices16();
+        MeshOptimizer::OptimizeResult result = MeshOptimizer::Optimize(mesh);
+        std::printf("  %-22s %8zu tris  ACMR %.3f -> %.3f  ATVR %.3f -> %.3f\n", name,
+            mesh.Indices32.size() / 3, result.Before.ACMR, result.After.ACMR,
+            result.Before.ATVR, result.After.ATVR);
+
+        // Forsyth's ordering is a heuristic; allow for ties going the other
+        // way on meshes that were already in good order.
+        Check(result.After.ACMR <= result.Before.ACMR * 1.02f, "ACMR does not get worse");
+        Check(result.After.ATVR <= result.Before.ATVR * 1.02f, "ATVR does not get worse");
+        Check(result.After.ATVR >= 1.0f, "every vertex is transformed at least once");
+        Check(result.After.ACMR >= 0.5f - 1e-6f || mesh.Indices32.size() < 3 * 64,
+            "ACMR is at least the 0.5 of a closed or large mesh");
+        Check(mesh.Indices32.size() == original.Indices32.size(), "index count is kept");
+        Check(Triangles(mesh) == Triangles(original), "the same triangles, with the same winding");
+        Check(InFirstUseOrder(mesh.Indices32, mesh.Vertices.size()), "vertices are in first-use order");
+        Check(!narrow || std::equal(mesh.Indices32.begin(), mesh.Indices32.end(), mesh.GetIndices16().begin(),
+            mesh.GetIndices16().end()), "16-bit indices narrowed before optimizing follow the new order");
+
+        MeshOptimizer::CacheStats recomputed = MeshOptimizer::AnalyzeVertexCache(mesh.Indices32.data(),
+            mesh.Indices32.size(), mesh.Vertices.size());
+        Check(recomputed.ACMR == result.After.ACMR && recomputed.ATVR == result.After.ATVR,
+            "reported stats match a fresh analysis");
+    }
+
+    void TestMeshes()
+    {
+        GeometryGenerator generator;
+        std::printf("Vertex cache stats, %u-entry FIFO\n", MeshOptimizer::DefaultCacheSize);
+
+        // The meshes BuildCommonGeoMetry uses, then larger ones.
+        Report("box 3", generator.CreateBox(1.5f, 0.5f, 1.5f, 3));
+        Report("grid 60x40", generator.CreateGrid(20.0f, 30.0f, 60, 40));
+        Report("sphere 20x20", generator.CreateSphere(0.5f, 20, 20));
+        Report("cylinder 20x20", generator.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20));
+        Report("geosphere 3", generator.CreateGeosphere(0.5f, 3));
+        Report("grid 256x256", generator.CreateGrid(20.0f, 30.0f, 256, 256));
+        Report("sphere 128x128", generator.CreateSphere(0.5f, 128, 128));
+
+        // Random triangle order is the worst case and must improve a lot.
+        GeometryGenerator::MeshData shuffled = Shuffled(generator.CreateGrid(20.0f, 30.0f, 128, 128));
+        Report("grid 128x128 shuffled", shuffled);
+        GeometryGenerator::MeshData optimized = shuffled;
+        MeshOptimizer::OptimizeResult result = MeshOptimizer::Optimize(optimized);
+        Check(result.After.ACMR < 0.5f * result.Before.ACMR, "shuffled grid: ACMR at least halves");
+
+        // The SoA overload reorders the same way as the AoS one.
+        GeometryGenerator::MeshData aos = generator.CreateSphere(0.5f, 40, 40);
+        GeometryGenerator::MeshDataSoA soa = generator.CreateSphereSoA(0.5f, 40, 40);
+        MeshOptimizer::OptimizeResult aosResult = MeshOptimizer::Optimize(aos);
+        MeshOptimizer::OptimizeResult soaResult = MeshOptimizer::Optimize(soa);
+        bool same = aos.Indices32 == soa.Indices32 && aos.Vertices.size() == soa.VertexCount() &&
+            aosResult.After.ACMR == soaResult.After.ACMR;
+        for(size_t i = 0; same && i < aos.Vertices.size(); ++i)
+            same = std::fabs(aos.Vertices[i].Position.x - soa.PosX[i]) <= 1e-5f &&
+                std::fabs(aos.Vertices[i].Normal.z - soa.NormalZ[i]) <= 1e-5f;
+        Check(same, "the SoA overload matches the AoS one");
+        std::printf("\n");
+    }
+
+    void Benchmark(bool quick)
+    {
+        std::printf("Optimize, best of %d\n", gRepetitions);
+        GeometryGenerator generator;
+        for(uint32 n : { 64u, 256u, 1024u })
+        {
+            if(quick && n > 256)
+                continue;
+
+            GeometryGenerator::MeshData grid = Shuffled(generator.CreateGrid(20.0f, 30.0f, n, n));
+            double best = 1e30;
+            for(int r = 0; r < gRepetitions; ++r)
+            {
+                GeometryGenerator::MeshData mesh = grid;
+                MyTimer timer;
+                MeshOptimizer::Optimize(mesh);
+                best = std::min(best, (double)timer.Peek());
+                gSink += mesh.Vertices[0].Position.x;
+            }
+            size_t triangleCount = grid.Indices32.size() / 3;
+            std::printf("  shuffled grid %4ux%-4u %8zu tris %9.3f ms %7.1f ns/tri\n", n, n, triangleCount,
+                best * 1e3, best * 1e9 / triangleCount);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv, 5);
+
+    TestMeshes();
+    Benchmark(quick);
+    return Finish(gSink);
+}
@@ -0,0 +1,240 @@
+// MeshPacker on 10k small meshes, the case of a scene assembled from many
+// props.  The packed buffers are first checked against the source meshes:
+// submesh offsets, vertices, indices, bounds and the 16/32-bit index choice,
+// for Pack() and Pack(JobSystem&) alike; then both are timed.  --quick packs
+// fewer meshes.
+
+#include "GeometryGenerator.h"
+#include "JobSystem.h"
+#include "MeshPacker.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using uint32 = GeometryGenerator::uint32;
+
+    float gSink = 0.f;
+
+    // A mix of the generators' AoS and SoA meshes; deques so the packer's
+    // references stay valid while meshes are added.
+    struct MeshSet
+    {
+        std::deque<GeometryGenerator::MeshData> AoS;
+        std::deque<GeometryGenerator::MeshDataSoA> SoA;
+        std::vector<std::string> Names;
+
+        explicit MeshSet(size_t count)
+        {
+            GeometryGenerator generator;
+            for(size_t i = 0; i < count; ++i)
+            {
+                uint32 detail = 4 + (uint32)(i % 7);
+                switch(i % 4)
+                {
+                case 0: AoS.push_back(generator.CreateBox(1.0f, 2.0f, 3.0f, detail % 3)); break;
+                case 1: SoA.push_back(generator.CreateSphereSoA(0.5f + i % 3, detail, detail)); break;
+                case 2: SoA.push_back(generator.CreateGridSoA(4.0f, 2.0f, detail, detail + 1)); break;
+                default: SoA.push_back(generator.CreateCylinderSoA(0.5f, 0.25f, 2.0f, detail, 2)); break;
+                }
+                Names.push_back("mesh" + std::to_string(i));
+            }
+        }
+
+        void AddTo(MeshPacker& packer)const
+        {
+            packer.Reserve(Names.size());
+            size_t aos = 0, soa = 0;
+            for(size_t i = 0; i < Names.size(); ++i)
+            {
+                if(i % 4 == 0)
+                    packer.Add(Names[i], AoS[aos++]);
+                else
+                    packer.Add(Names[i], SoA[soa++]);
+            }
+        }
+
+        size_t VertexCount()const
+        {
+            size_t count = 0;
+            for(const auto& m : AoS)
+                count += m.Vertices.size();
+            for(const auto& m : SoA)
+                count += m.VertexCount();
+            return count;
+        }
+    };
+
+    struct Source
+    {
+        size_t VertexCount;
+        const std::vector<uint32>* Indices;
+        DirectX::XMFLOAT3 Position(size_t i)const
+        {
+            return AoS ? AoS->Vertices[i].Position : DirectX::XMFLOAT3(SoA->PosX[i], SoA->PosY[i], SoA->PosZ[i]);
+        }
+        DirectX::XMFLOAT3 Normal(size_t i)const
+        {
+            return AoS ? AoS->Vertices[i].Normal : DirectX::XMFLOAT3(SoA->NormalX[i], SoA->NormalY[i], SoA->NormalZ[i]);
+        }
+        const GeometryGenerator::MeshData* AoS;
+        const GeometryGenerator::MeshDataSoA* SoA;
+    };
+
+    std::vector<Source> Sources(const MeshSet& set)
+    {
+        std::vector<Source> sources;
+        size_t aos = 0, soa = 0;
+        for(size_t i = 0; i < set.Names.size(); ++i)
+        {
+            if(i % 4 == 0)
+            {
+                const auto& m = set.AoS[aos++];
+                sources.push_back({ m.Vertices.size(), &m.Indices32, &m, nullptr });
+            }
+            else
+            {
+                const auto& m = set.SoA[soa++];
+                sources.push_back({ m.VertexCount(), &m.Indices32, nullptr, &m });
+            }
+        }
+        return sources;
+    }
+
+    bool Equal(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+
+    // Compares everything the packer produced with the meshes it was given.
+    void Verify(const MeshPacker& packer, const std::vector<Source>& sources, uint32 expectedStride)
+    {
+        Check(packer.SubmeshCount() == sources.size(), "one submesh per mesh");
+        Check(packer.IndexStride() == expectedStride, "index stride");
+
+        std::uint32_t baseVertex = 0, startIndex = 0;
+        bool offsets = true, vertices = true, indices = true, bounds = true;
+        for(size_t s = 0; s < sources.size() && s < packer.SubmeshCount(); ++s)
+        {
+            const Source& src = sources[s];
+            const SubmeshGeometry& sub = packer.Submesh(s);
+            offsets &= sub.BaseVertexLocation == (std::int32_t)baseVertex && sub.StartIndexLocation == startIndex &&
+                sub.IndexCount == src.Indices->size();
+
+            DirectX::XMFLOAT3 mn(1e30f, 1e30f, 1e30f), mx(-1e30f, -1e30f, -1e30f);
+            for(size_t v = 0; v < src.VertexCount; ++v)
+            {
+                const Vertex& packed = packer.Vertices()[baseVertex + v];
+                DirectX::XMFLOAT3 p = src.Position(v);
+                vertices &= Equal(packed.Pos, p) && Equal(packed.Normal, src.Normal(v));
+                mn = DirectX::XMFLOAT3(std::min(mn.x, p.x), std::min(mn.y, p.y), std::min(mn.z, p.z));
+                mx = DirectX::XMFLOAT3(std::max(mx.x, p.x), std::max(mx.y, p.y), std::max(mx.z, p.z));
+            }
+            const DirectX::BoundingBox& b = sub.Bounds;
+            bounds &= std::fabs(b.Center.x - b.Extents.x - mn.x) <= 1e-5f && std::fabs(b.Center.x + b.Extents.x - mx.x) <= 1e-5f &&
+                std::fabs(b.Center.y - b.Extents.y - mn.y) <= 1e-5f && std::fabs(b.Center.y + b.Extents.y - mx.y) <= 1e-5f &&
+                std::fabs(b.Center.z - b.Extents.z - mn.z) <= 1e-5f && std::fabs(b.Center.z + b.Extents.z - mx.z) <= 1e-5f;
+
+            // Indices stay relative to the submesh's BaseVertexLocation.
+            for(size_t i = 0; i < src.Indices->size(); ++i)
+            {
+                std::uint32_t index = expectedStride == 2 ?
+                    static_cast<const std::uint16_t*>(packer.IndexData())[startIndex + i] :
+                    static_cast<const std::uint32_t*>(packer.IndexData())[startIndex + i];
+                indices &= index == (*src.Indices)[i];
+            }
+
+            baseVertex += (std::uint32_t)src.VertexCount;
+            startIndex += (std::uint32_t)src.Indices->size();
+        }
+
+        Check(offsets, "submeshes are laid out back to back");
+        Check(vertices, "vertices are copied unchanged");
+        Check(indices, "indices are copied unchanged");
+        Check(bounds, "bounds enclose exactly the submesh's positions");
+        Check(packer.Vertices().size() == baseVertex, "vertex count is the sum of the meshes'");
+        Check(packer.IndexCount() == startIndex && packer.IndexByteSize() == startIndex * expectedStride,
+            "index count and byte size");
+    }
+
+    void TestPacking(JobSystem& jobs)
+    {
+        std::printf("Packing checks\n");
+        MeshSet set(1000);
+        std::vector<Source> sources = Sources(set);
+
+        MeshPacker serial;
+        set.AddTo(serial);
+        serial.Pack();
+        Verify(serial, sources, 2);
+
+        MeshPacker parallel;
+        set.AddTo(parallel);
+        parallel.Pack(jobs);
+        Verify(parallel, sources, 2);
+        Check(std::memcmp(serial.Vertices().data(), parallel.Vertices().data(),
+            serial.Vertices().size() * sizeof(Vertex)) == 0, "Pack(jobs) matches Pack()");
+
+        // One mesh with more than 65536 vertices forces 32-bit indices for
+        // the whole buffer.
+        GeometryGenerator generator;
+        GeometryGenerator::MeshDataSoA big = generator.CreateGridSoA(10.0f, 10.0f, 300, 300);
+        MeshPacker wide;
+        set.AddTo(wide);
+        wide.Add("big", big);
+        wide.Pack(jobs);
+        sources.push_back({ big.VertexCount(), &big.Indices32, nullptr, &big });
+        Verify(wide, sources, 4);
+
+        // Clear keeps nothing but storage.
+        wide.Clear();
+        Check(wide.SubmeshCount() == 0 && wide.Vertices().empty() && wide.IndexCount() == 0 &&
+            wide.IndexStride() == 2, "Clear resets the packer");
+        EndChecks();
+    }
+
+    void Benchmark(JobSystem& jobs, size_t meshCount)
+    {
+        MeshSet set(meshCount);
+        size_t vertexCount = set.VertexCount();
+        std::printf("Packing %zu meshes, %zu vertices, best of %d\n", meshCount, vertexCount, gRepetitions);
+
+        MeshPacker packer;
+        for(JobSystem* j : { (JobSystem*)nullptr, &jobs })
+        {
+            double best = 1e30;
+            for(int r = 0; r < gRepetitions; ++r)
+            {
+                MyTimer timer;
+                packer.Clear();
+                set.AddTo(packer);
+                if(j)
+                    packer.Pack(*j);
+                else
+                    packer.Pack();
+                best = std::min(best, (double)timer.Peek());
+                gSink += packer.Vertices().back().Pos.x;
+            }
+            std::printf("  %-8s %9.3f ms %8.1f ns/mesh %6.2f ns/vertex\n", j ? "jobs" : "serial",
+                best * 1e3, best * 1e9 / meshCount, best * 1e9 / vertexCount);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    JobSystem jobs;
+    std::printf("JobSystem workers: %u\n\n", jobs.WorkerCount());
+    TestPacking(jobs);
+    Benchmark(jobs, quick ? 1000 : 10000);
+    return Finish(gSink);
+}
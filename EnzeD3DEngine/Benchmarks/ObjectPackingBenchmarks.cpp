@@ -0,0 +1,378 @@
+// Precision and cost of the ObjectFormat layouts.  Every format is packed
+// and decoded with the shader's decode; the errors are checked against the
+// bounds below and the program fails if one is exceeded, so it doubles as
+// the test of the packing code.  Packing 100k objects is then timed like
+// EnzeApp::UpdateObjectConstants uploads them, as is the update of a
+// scattered dirty list with and without SortIntoRanges.  --quick times
+// fewer repetitions.
+
+#include "JobSystem.h"
+#include "ObjectPacking.h"
+#include "MyTimer.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace Math;
+
+namespace
+{
+    const size_t ObjectCount = 100000;
+    const size_t PrecisionSamples = 200000;
+
+    // Largest error of a decoded 3x3 element relative to the largest scale
+    // factor of the world, and of a decoded translation relative to its
+    // length.
+    struct Bounds
+    {
+        float Linear;
+        float Translation;
+    };
+
+    Bounds FormatBounds(ObjectFormat format)
+    {
+        switch(format)
+        {
+        // Half rounding: 2^-11 of the element.
+        case ObjectFormat::Affine3x4Half: return { 1.f / 2048.f, 0.f };
+        // Half scale plus the snorm16 quaternion, whose components are off
+        // by at most 2^-16 each.
+        case ObjectFormat::QuatTranslationScale: return { 1.f / 2048.f + 2e-4f, 0.f };
+        // Float copies, exact.
+        default: return { 0.f, 0.f };
+        }
+    }
+
+    float gSink = 0.f;
+
+    // Scale, then rotate, then translate, as TransformHierarchy builds
+    // worlds.  Some worlds mirror.
+    Float4x4 RandomWorld(std::mt19937& rng, bool uniformScale)
+    {
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        std::uniform_real_distribution<float> logScale(-2.3f, 2.3f);
+        Vec4 axis = VecNormalize3(VecSet(unit(rng), unit(rng), unit(rng), 0.f));
+        Vec4 rotation = QuatRotationAxis(axis, 3.14159f * unit(rng));
+        float sx = std::exp(logScale(rng));
+        float sy = uniformScale ? sx : std::exp(logScale(rng));
+        float sz = uniformScale ? sx : std::exp(logScale(rng));
+        if(unit(rng) < -0.8f)
+            sx = -sx;
+        Vec4 translation = VecSet(1000.f * unit(rng), 1000.f * unit(rng), 1000.f * unit(rng), 0.f);
+        return StoreFloat4x4(MatAffineTransformation(VecSet(sx, sy, sz, 0.f), rotation, translation));
+    }
+
+    // A non-uniformly scaled parent with a rotated child: has shear, which
+    // QuatTranslationScale cannot represent.
+    Float4x4 ShearedWorld(std::mt19937& rng)
+    {
+        Float4x4 child = RandomWorld(rng, true);
+        Float4x4 parent = StoreFloat4x4(MatScaling(1.f, 4.f, 0.5f));
+        return StoreFloat4x4(MatMultiply(Load(child), Load(parent)));
+    }
+
+    struct Errors
+    {
+        float Linear = 0.f;
+        float Translation = 0.f;
+    };
+
+    Errors Measure(ObjectFormat format, const std::vector<Float4x4>& worlds)
+    {
+        Errors errors;
+        std::vector<std::uint8_t> element(ObjectPacking::ElementByteSize(format));
+        const std::uint32_t slot = 0;
+        for(const Float4x4& world : worlds)
+        {
+            ObjectPacking::PackObjects(format, &world, nullptr, 1, &slot, element.data(), element.size());
+            Float4x4 decoded = ObjectPacking::UnpackObject(format, element.data());
+
+            float maxScale = 0.f;
+            for(int i = 0; i < 3; ++i)
+                maxScale = std::max(maxScale, std::sqrt(world.m[i][0] * world.m[i][0] +
+                    world.m[i][1] * world.m[i][1] + world.m[i][2] * world.m[i][2]));
+            for(int i = 0; i < 3; ++i)
+                for(int j = 0; j < 3; ++j)
+                    errors.Linear = std::max(errors.Linear, std::fabs(decoded.m[i][j] - world.m[i][j]) / maxScale);
+
+            float length = std::sqrt(world._41 * world._41 + world._42 * world._42 + world._43 * world._43);
+            for(int j = 0; j < 3; ++j)
+                errors.Translation = std::max(errors.Translation, std::fabs(decoded.m[3][j] - world.m[3][j]) / length);
+
+            Check(decoded._14 == 0.f && decoded._24 == 0.f && decoded._34 == 0.f && decoded._44 == 1.f,
+                "last column is (0, 0, 0, 1)");
+        }
+        return errors;
+    }
+
+    void TestHalves()
+    {
+        std::printf("Half conversion\n");
+
+        // Every finite half survives a round trip.
+        bool roundTrips = true;
+        for(std::uint32_t h = 0; h < 0x10000u; ++h)
+        {
+            if((h & 0x7c00u) == 0x7c00u)
+                continue;
+            roundTrips &= ObjectPacking::FloatToHalf(ObjectPacking::HalfToFloat((std::uint16_t)h)) == h;
+        }
+        Check(roundTrips, "finite halves round-trip");
+
+        // Floats round to the nearer of the halves around them, and ties to
+        // the even one.
+        std::mt19937 rng(3);
+        std::uniform_int_distribution<std::uint32_t> bits(0, 0x477fefffu);
+        bool nearest = true;
+        for(size_t i = 0; i < PrecisionSamples; ++i)
+        {
+            std::uint32_t b = bits(rng);
+            float f;
+            std::memcpy(&f, &b, sizeof(f));
+            std::uint16_t h = ObjectPacking::FloatToHalf(f);
+            float error = std::fabs(ObjectPacking::HalfToFloat(h) - f);
+            float below = std::fabs(ObjectPacking::HalfToFloat((std::uint16_t)(h - (h ? 1 : 0))) - f);
+            float above = std::fabs(ObjectPacking::HalfToFloat((std::uint16_t)(h + 1)) - f);
+            nearest &= error < below || (error == below && (h & 1) == 0) || h == 0;
+            nearest &= error < above || (error == above && (h & 1) == 0);
+        }
+        Check(nearest, "floats round to the nearest half");
+        Check(ObjectPacking::FloatToHalf(65520.f) == 0x7c00u, "65520 rounds to infinity");
+        Check(ObjectPacking::FloatToHalf(-1e-9f) == 0x8000u, "tiny negatives round to -0");
+        Check(ObjectPacking::FloatToHalf(std::ldexp(1.f, -24)) == 0x0001u, "smallest denormal");
+        EndChecks();
+    }
+
+    void TestPrecision()
+    {
+        std::mt19937 rng(11);
+        std::vector<Float4x4> general(PrecisionSamples), uniform(PrecisionSamples), sheared(PrecisionSamples / 10);
+        for(auto& world : general)
+            world = RandomWorld(rng, false);
+        for(auto& world : uniform)
+            world = RandomWorld(rng, true);
+        for(auto& world : sheared)
+            world = ShearedWorld(rng);
+
+        std::printf("Precision, max error relative to scale / translation length\n");
+        std::printf("  %-32s %12s %12s %12s %12s\n", "", "non-uniform", "translation", "uniform", "sheared");
+        for(std::uint32_t f = 0; f < (std::uint32_t)ObjectFormat::Count; ++f)
+        {
+            ObjectFormat format = (ObjectFormat)f;
+            Bounds bounds = FormatBounds(format);
+            Errors g = Measure(format, general);
+            Errors u = Measure(format, uniform);
+            Errors s = Measure(format, sheared);
+            std::printf("  %-32s %12.3g %12.3g %12.3g %12.3g\n", ObjectPacking::Name(format),
+                g.Linear, g.Translation, u.Linear, s.Linear);
+
+            Check(g.Linear <= bounds.Linear && u.Linear <= bounds.Linear, "3x3 part within bounds");
+            Check(g.Translation <= bounds.Translation && u.Translation <= bounds.Translation, "translation within bounds");
+            // Shear is only lost by QuatTranslationScale.
+            if(format != ObjectFormat::QuatTranslationScale)
+                Check(s.Linear <= bounds.Linear, "sheared 3x3 part within bounds");
+        }
+        std::printf("\n");
+    }
+
+    // n distinct slots in random order, as ObjCBIndices after churn.
+    std::vector<std::uint32_t> ShuffledSlots(size_t n, std::mt19937& rng)
+    {
+        std::vector<std::uint32_t> slots(n);
+        for(size_t i = 0; i < n; ++i)
+            slots[i] = (std::uint32_t)i;
+        std::shuffle(slots.begin(), slots.end(), rng);
+        return slots;
+    }
+
+    // count distinct items in random order, as a dirty list.
+    std::vector<std::uint32_t> RandomItems(size_t n, size_t count, std::mt19937& rng)
+    {
+        std::vector<std::uint32_t> items = ShuffledSlots(n, rng);
+        items.resize(count);
+        return items;
+    }
+
+    // Jobs over the ranges SortIntoRanges made, as UpdateObjectConstants
+    // runs them.
+    void PackRanges(JobSystem& jobs, ObjectFormat format, const std::vector<Float4x4>& worlds,
+        const std::vector<std::uint32_t>& items, const std::vector<std::uint32_t>& ranges,
+        const std::vector<std::uint32_t>& slots, std::vector<std::uint8_t>& buffer, size_t stride)
+    {
+        jobs.ParallelFor((std::uint32_t)ranges.size() - 1, 1, [&](std::uint32_t begin, std::uint32_t end)
+        {
+            for(std::uint32_t r = begin; r < end; ++r)
+                ObjectPacking::PackObjects(format, worlds.data(), items.data() + ranges[r],
+                    ranges[r + 1] - ranges[r], slots.data(), buffer.data(), stride);
+        });
+    }
+
+    void TestRanges(JobSystem& jobs)
+    {
+        std::printf("SortIntoRanges\n");
+        const size_t n = 10000;
+        std::mt19937 rng(5);
+        std::vector<Float4x4> worlds(n);
+        for(auto& world : worlds)
+            world = RandomWorld(rng, false);
+        std::vector<std::uint32_t> slots = ShuffledSlots(n, rng);
+
+        std::vector<std::uint32_t> ranges;
+        std::vector<std::uint64_t> keys;
+        for(size_t count : { (size_t)0, (size_t)1, (size_t)5, (size_t)1000, n })
+        {
+            for(std::uint32_t f = 0; f < (std::uint32_t)ObjectFormat::Count; ++f)
+            {
+                ObjectFormat format = (ObjectFormat)f;
+                size_t stride = ObjectPacking::ElementByteSize(format);
+                for(size_t grain : { (size_t)1, (size_t)7, (size_t)512 })
+                {
+                    std::vector<std::uint32_t> dirty = RandomItems(n, count, rng);
+                    std::vector<std::uint32_t> items = dirty;
+                    ObjectPacking::SortIntoRanges(items, slots.data(), stride, grain, ranges, keys);
+
+                    std::vector<std::uint32_t> a = dirty, b = items;
+                    std::sort(a.begin(), a.end());
+                    std::sort(b.begin(), b.end());
+                    Check(a == b, "the same items come out");
+                    bool sorted = true;
+                    for(size_t i = 1; i < items.size(); ++i)
+                        sorted &= slots[items[i - 1]] < slots[items[i]];
+                    Check(sorted, "items are in slot order");
+
+                    bool bounded = ranges.size() >= 2 && ranges.front() == 0 && ranges.back() == items.size();
+                    bool lines = true;
+                    for(size_t r = 1; bounded && r < ranges.size(); ++r)
+                    {
+                        bounded &= ranges[r] > ranges[r - 1] || items.empty();
+                        // All but the last range hold at least grain items.
+                        bounded &= r + 1 == ranges.size() || ranges[r] - ranges[r - 1] >= grain;
+                        if(r + 1 < ranges.size())
+                        {
+                            size_t lastLine = ((size_t)slots[items[ranges[r] - 1]] * stride + stride - 1) / 64;
+                            lines &= (size_t)slots[items[ranges[r]]] * stride / 64 > lastLine;
+                        }
+                    }
+                    Check(bounded, "ranges cover the items in order");
+                    Check(lines, "no two ranges write the same cache line");
+
+                    // The jobs write exactly what one serial pass does.
+                    std::vector<std::uint8_t> expected(stride * n, 0), packed(stride * n, 0);
+                    ObjectPacking::PackObjects(format, worlds.data(), dirty.data(), dirty.size(),
+                        slots.data(), expected.data(), stride);
+                    PackRanges(jobs, format, worlds, items, ranges, slots, packed, stride);
+                    Check(packed == expected, "ranges pack what the dirty list does");
+                }
+            }
+        }
+        EndChecks();
+    }
+
+    void BenchmarkPacking()
+    {
+        std::mt19937 rng(7);
+        std::vector<Float4x4> worlds(ObjectCount);
+        for(auto& world : worlds)
+            world = RandomWorld(rng, false);
+
+        // ObjCBIndex of each item, shuffled as in a store after churn.
+        std::vector<std::uint32_t> slots(ObjectCount);
+        for(size_t i = 0; i < ObjectCount; ++i)
+            slots[i] = (std::uint32_t)i;
+        std::shuffle(slots.begin(), slots.end(), rng);
+
+        std::printf("Packing %zu objects\n", ObjectCount);
+        for(std::uint32_t f = 0; f < (std::uint32_t)ObjectFormat::Count; ++f)
+        {
+            ObjectFormat format = (ObjectFormat)f;
+            size_t stride = ObjectPacking::ElementByteSize(format);
+            std::vector<std::uint8_t> buffer(stride * ObjectCount);
+            double seconds = Time([&]()
+            {
+                ObjectPacking::PackObjects(format, worlds.data(), nullptr, ObjectCount,
+                    slots.data(), buffer.data(), stride);
+                gSink += buffer[0];
+            });
+            // Against the 256-byte constant buffer elements objects used to
+            // take.
+            std::printf("  %-32s %3zu bytes %6.2f MB/frame %5.1fx smaller %8.3f ms %6.2f ns/object\n",
+                ObjectPacking::Name(format), stride, stride * ObjectCount / 1e6, 256.0 / stride,
+                seconds * 1e3, seconds * 1e9 / ObjectCount);
+        }
+    }
+
+    // UpdateObjectConstants on a frame resource that is behind: a dirty
+    // list in change order over shuffled slots, packed by jobs that gather
+    // it in batches as it comes, against sorting it into line-aligned
+    // ranges first.  The sort is part of the sorted timing.  The buffer here
+    // is ordinary cached memory, so the table shows what the sort costs;
+    // the gain is on the mapped upload heap, which is write-combined and
+    // flushes a partly written line as separate bus writes.
+    void BenchmarkDirtyUpdate(JobSystem& jobs)
+    {
+        const std::uint32_t grain = 512;
+        const size_t batchSize = 64;
+        const ObjectFormat format = ObjectFormat::Affine3x4;
+        const size_t stride = ObjectPacking::ElementByteSize(format);
+
+        std::mt19937 rng(9);
+        std::vector<Float4x4> worlds(ObjectCount);
+        for(auto& world : worlds)
+            world = RandomWorld(rng, false);
+        std::vector<std::uint32_t> slots = ShuffledSlots(ObjectCount, rng);
+        std::vector<std::uint8_t> buffer(stride * ObjectCount);
+
+        std::printf("\nDirty update of %zu objects, %s, %u workers, best of %d\n", ObjectCount,
+            ObjectPacking::Name(format), jobs.WorkerCount(), gRepetitions);
+        std::printf("  %8s %14s %14s %8s\n", "dirty", "scattered ms", "sorted ms", "speedup");
+        for(double fraction : { 0.01, 0.1, 0.5, 1.0 })
+        {
+            std::vector<std::uint32_t> dirty = RandomItems(ObjectCount, (size_t)(ObjectCount * fraction), rng);
+            double scattered = Time([&]()
+            {
+                jobs.ParallelFor((std::uint32_t)dirty.size(), grain, [&](std::uint32_t begin, std::uint32_t end)
+                {
+                    for(std::uint32_t i = begin; i < end; i += (std::uint32_t)batchSize)
+                    {
+                        std::uint32_t items[batchSize];
+                        size_t count = std::min<size_t>(batchSize, end - i);
+                        std::memcpy(items, &dirty[i], count * sizeof(std::uint32_t));
+                        ObjectPacking::PackObjects(format, worlds.data(), items, count, slots.data(),
+                            buffer.data(), stride);
+                    }
+                });
+                gSink += buffer[0];
+            });
+
+            std::vector<std::uint32_t> items, ranges;
+            std::vector<std::uint64_t> keys;
+            double sorted = Time([&]()
+            {
+                items = dirty;
+                ObjectPacking::SortIntoRanges(items, slots.data(), stride, grain, ranges, keys);
+                PackRanges(jobs, format, worlds, items, ranges, slots, buffer, stride);
+                gSink += buffer[0];
+            });
+            std::printf("  %7.0f%% %14.3f %14.3f %7.2fx\n", fraction * 100, scattered * 1e3, sorted * 1e3,
+                scattered / sorted);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    ParseQuick(argc, argv);
+
+    JobSystem jobs;
+    TestHalves();
+    TestPrecision();
+    TestRanges(jobs);
+    BenchmarkPacking();
+    BenchmarkDirtyUpdate(jobs);
+    return Finish(gSink);
+}
@@ -0,0 +1,242 @@
+// The generation catch-up of RenderItemStore: a ring of frame resources,
+// each with its own copy of the object constants, is updated the way
+// EnzeApp::UpdateObjectConstants does it while items move, are added and are
+// removed, and the ring changes size.  After each update the frame
+// resource's copy must match the store for every live item, the items it
+// rewrote must be exactly those changed since it was last written, and the
+// dirty list must empty once every frame resource has caught up.  The
+// program fails on a difference.  Then catch-up updates are timed against
+// rewriting every item.  --quick runs fewer frames on fewer items.
+
+#include "MyTimer.h"
+#include "RenderItemStore.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    size_t gSink = 0;
+
+    std::uint64_t gGeometryStorage;
+
+    // A frame resource's object buffer, indexed by ObjCBIndex.
+    struct FrameCopy
+    {
+        std::uint64_t Generation = 0;
+        std::vector<XMFLOAT4X4> Objects;
+    };
+
+    // EnzeApp::UpdateObjectConstants on a FrameCopy: every item when the copy
+    // was never written, else the items changed since; then the dirty list
+    // is retired up to the copy furthest behind.  Returns the items written.
+    size_t UpdateCopy(RenderItemStore& items, FrameCopy& copy, const std::vector<std::unique_ptr<FrameCopy>>& ring,
+        std::vector<std::uint32_t>& changed)
+    {
+        copy.Objects.resize(items.ObjectCBCapacity());
+        changed.clear();
+        if(copy.Generation == 0)
+        {
+            for(std::uint32_t i = 0; i < (std::uint32_t)items.Size(); ++i)
+                changed.push_back(i);
+        }
+        else
+        {
+            items.CollectChangedSince(copy.Generation, changed);
+        }
+        for(std::uint32_t item : changed)
+            copy.Objects[items.ObjCBIndices()[item]] = items.Worlds()[item];
+
+        copy.Generation = items.Generation();
+        std::uint64_t oldest = copy.Generation;
+        for(const auto& frame : ring)
+            oldest = std::min(oldest, frame->Generation);
+        items.RetireDirty(oldest);
+        return changed.size();
+    }
+
+    struct Scene
+    {
+        std::mt19937 Rng{ 23 };
+        Material Mat;
+        RenderItemStore Items;
+        std::vector<RenderItemHandle> Handles;
+        float NextX = 0.0f;
+
+        void Add()
+        {
+            RenderItemDesc desc;
+            XMStoreFloat4x4(&desc.World, XMMatrixTranslation(NextX, 0.0f, 0.0f));
+            NextX += 1.0f;
+            desc.Geo = reinterpret_cast<MeshGeometry*>(&gGeometryStorage);
+            desc.Mat = &Mat;
+            desc.DrawArgs.IndexCount = 36;
+            Handles.push_back(Items.Add(desc));
+        }
+
+        RenderItemHandle& Any()
+        {
+            return Handles[std::uniform_int_distribution<size_t>(0, Handles.size() - 1)(Rng)];
+        }
+
+        void Move(RenderItemHandle handle)
+        {
+            XMFLOAT4X4 world = Items.World(handle);
+            world._42 += 1.0f;
+            Items.SetWorld(handle, world);
+        }
+
+        void RemoveAny()
+        {
+            RenderItemHandle& handle = Any();
+            Items.Remove(handle);
+            handle = Handles.back();
+            Handles.pop_back();
+        }
+    };
+
+    void TestCatchUp(int frameCount)
+    {
+        std::printf("Generation catch-up checks\n");
+        Scene scene;
+        for(int i = 0; i < 2000; ++i)
+            scene.Add();
+
+        // Ring sizes as SetFramesInFlight would set them: shrinking keeps
+        // the first frame resources, growing adds unwritten ones.
+        const std::uint32_t ringSizes[] = { 3, 1, 4, 2, 3 };
+        std::vector<std::unique_ptr<FrameCopy>> ring;
+        std::vector<std::uint32_t> changed, expected;
+        bool current = true, exact = true, bounded = true;
+        size_t written = 0, catchUps = 0;
+        std::uint32_t slot = 0;
+        for(int frame = 0; frame < frameCount; ++frame)
+        {
+            if(frame % (frameCount / 5) == 0)
+            {
+                std::uint32_t size = ringSizes[frame / (frameCount / 5) % 5];
+                ring.resize(std::min<size_t>(ring.size(), size));
+                while(ring.size() < size)
+                    ring.push_back(std::make_unique<FrameCopy>());
+                slot = 0;
+            }
+
+            // A few items move, some of them more than once, some are
+            // marked dirty, and a few come and go.
+            int moves = std::uniform_int_distribution<int>(0, 30)(scene.Rng);
+            for(int m = 0; m < moves; ++m)
+                scene.Move(scene.Any());
+            if(frame % 3 == 0)
+                scene.Items.MarkDirty(scene.Any());
+            if(frame % 4 == 0)
+            {
+                scene.RemoveAny();
+                scene.Add();
+            }
+
+            FrameCopy& copy = *ring[slot];
+            slot = (slot + 1) % (std::uint32_t)ring.size();
+
+            // What the copy lacks, by brute force over every item.
+            expected.clear();
+            for(std::uint32_t i = 0; i < (std::uint32_t)scene.Items.Size(); ++i)
+            {
+                if(copy.Generation == 0 || scene.Items.ChangeGenerations()[i] > copy.Generation)
+                    expected.push_back(i);
+            }
+            catchUps += copy.Generation != 0;
+            written += UpdateCopy(scene.Items, copy, ring, changed);
+            std::sort(changed.begin(), changed.end());
+            exact &= changed == expected;
+
+            for(std::uint32_t i = 0; i < (std::uint32_t)scene.Items.Size(); ++i)
+            {
+                current &= std::memcmp(&copy.Objects[scene.Items.ObjCBIndices()[i]], &scene.Items.Worlds()[i],
+                    sizeof(XMFLOAT4X4)) == 0;
+            }
+            // Only the items some frame resource still lacks stay dirty.
+            for(std::uint32_t item : scene.Items.DirtyItems())
+            {
+                bool lacked = false;
+                for(const auto& frame : ring)
+                    lacked |= scene.Items.ChangeGenerations()[item] > frame->Generation;
+                bounded &= lacked;
+            }
+        }
+        Check(exact, "each frame resource rewrites exactly the items changed since it was written");
+        Check(current, "the frame resource written matches the store");
+        Check(bounded, "the dirty list holds only items some frame resource lacks");
+
+        // Once every frame resource has caught up nothing is dirty.
+        for(size_t i = 0; i < ring.size(); ++i)
+        {
+            UpdateCopy(scene.Items, *ring[slot], ring, changed);
+            slot = (slot + 1) % (std::uint32_t)ring.size();
+        }
+        Check(scene.Items.DirtyItems().empty(), "the dirty list empties when every frame resource catches up");
+        std::printf("  %zu items written over %d frames, %zu catch-ups\n", written, frameCount, catchUps);
+        EndChecks();
+    }
+
+    void Benchmark(size_t itemCount, int frameCount)
+    {
+        const size_t movesPerFrame = itemCount / 100;
+        std::printf("%zu items, %zu moving per frame, 3 frame resources, best of %d\n", itemCount, movesPerFrame,
+            gRepetitions);
+        Scene scene;
+        scene.Items.Reserve(itemCount);
+        for(size_t i = 0; i < itemCount; ++i)
+            scene.Add();
+
+        std::vector<std::unique_ptr<FrameCopy>> ring;
+        for(int i = 0; i < 3; ++i)
+            ring.push_back(std::make_unique<FrameCopy>());
+        std::vector<std::uint32_t> changed;
+        for(auto& frame : ring)
+            UpdateCopy(scene.Items, *frame, ring, changed);
+
+        size_t written = 0;
+        std::uint32_t slot = 0;
+        double catchUp = Time([&]()
+        {
+            written = 0;
+            for(int f = 0; f < frameCount; ++f)
+            {
+                for(size_t m = 0; m < movesPerFrame; ++m)
+                    scene.Items.MarkDirty(scene.Handles[(f * 7919 + m * 104729) % scene.Handles.size()]);
+                written += UpdateCopy(scene.Items, *ring[slot], ring, changed);
+                slot = (slot + 1) % 3;
+            }
+        });
+        double rewrite = Time([&]()
+        {
+            for(int f = 0; f < frameCount; ++f)
+            {
+                FrameCopy& copy = *ring[f % 3];
+                for(std::uint32_t i = 0; i < (std::uint32_t)scene.Items.Size(); ++i)
+                    copy.Objects[scene.Items.ObjCBIndices()[i]] = scene.Items.Worlds()[i];
+                gSink += copy.Objects.size();
+            }
+        });
+        gSink += written;
+        std::printf("  %-12s %9.3f ms/frame %9zu items/frame\n", "catch-up", catchUp * 1e3 / frameCount,
+            written / frameCount);
+        std::printf("  %-12s %9.3f ms/frame %9zu items/frame\n", "rewrite all", rewrite * 1e3 / frameCount,
+            scene.Items.Size());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestCatchUp(quick ? 200 : 1000);
+    Benchmark(quick ? 20000 : 200000, 30);
+    return Finish(gSink);
+}
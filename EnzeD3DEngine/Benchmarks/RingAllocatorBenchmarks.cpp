@@ -0,0 +1,180 @@
+// RingAllocator, the offset bookkeeping behind UploadRingBuffer.  Scripted
+// cases check wraparound at the end of the ring, the skipped bytes staying
+// with their frame, alignment, full and oversized requests, and that frames
+// only give their bytes back once their fence has completed.  Random frames
+// of random allocations with a few frames in flight are checked against the
+// live allocations: aligned, inside the ring and never overlapping one that
+// has not retired.  The program fails on a difference.  Then allocation is
+// timed.  --quick runs fewer frames.
+
+#include "MyTimer.h"
+#include "RingAllocator.h"
+#include "TestHarness.h"
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace
+{
+    size_t gSink = 0;
+
+    const std::uint64_t Invalid = RingAllocator::InvalidOffset;
+
+    void TestScripted()
+    {
+        std::printf("Scripted checks\n");
+        RingAllocator ring(1024);
+        Check(ring.Allocate(0, 1) == Invalid, "empty requests fail");
+        Check(ring.Allocate(1025, 1) == Invalid, "requests larger than the ring fail");
+        Check(ring.UsedBytes() == 0, "failed requests take nothing");
+
+        // Frame 1 takes [0, 600), frame 2 [600, 900).
+        Check(ring.Allocate(600, 1) == 0, "the first allocation starts the ring");
+        ring.FinishFrame(1);
+        Check(ring.Allocate(300, 1) == 600, "allocations follow each other");
+        ring.FinishFrame(2);
+        Check(ring.Allocate(200, 1) == Invalid, "no room while both frames are live");
+
+        ring.Retire(0);
+        Check(ring.UsedBytes() == 900, "frames stay until their fence completes");
+        ring.Retire(1);
+        Check(ring.UsedBytes() == 300, "a completed frame gives its bytes back");
+
+        // 500 bytes do not fit in [900, 1024), so frame 3 skips the end of
+        // the ring and starts again at 0, in front of frame 2.
+        Check(ring.Allocate(500, 1) == 0, "allocations wrap around instead of straddling the end");
+        Check(ring.UsedBytes() == 300 + 124 + 500, "the skipped end is held by the wrapping frame");
+        Check(ring.Allocate(200, 1) == Invalid, "a wrapped head stops at the oldest live frame");
+        Check(ring.Allocate(100, 1) == 500, "what fits in front of the oldest frame is handed out");
+        ring.FinishFrame(3);
+        ring.Retire(2);
+        Check(ring.UsedBytes() == 724, "retiring the oldest frame keeps the wrapped one");
+        Check(ring.Allocate(300, 1) == 600, "the retired frame's bytes are reused");
+        ring.FinishFrame(4);
+        Check(ring.Allocate(1, 1) == Invalid, "a full ring fails");
+        ring.Retire(4);
+        Check(ring.UsedBytes() == 0, "retiring several frames at once frees all of them");
+
+        // With nothing live the ring restarts at the front, so a request of
+        // the whole ring succeeds wherever the head was.
+        Check(ring.Allocate(1024, 1) == 0, "an empty ring serves its whole capacity");
+        ring.FinishFrame(5);
+        ring.Retire(5);
+
+        Check(ring.Allocate(1, 1) == 0 && ring.Allocate(10, 256) == 256, "allocations are aligned");
+        Check(ring.UsedBytes() == 266, "alignment padding is counted as used");
+        Check(ring.Allocate(600, 256) == Invalid, "padding counts against the free space");
+        ring.FinishFrame(6);
+        ring.Retire(6);
+
+        // An empty frame retires without disturbing the ring.
+        Check(ring.Allocate(100, 1) == 0, "the ring restarts after the last frame retires");
+        ring.FinishFrame(7);
+        ring.FinishFrame(8);
+        ring.Retire(8);
+        Check(ring.UsedBytes() == 0, "empty frames retire");
+
+        ring.Reset(64);
+        Check(ring.Capacity() == 64 && ring.UsedBytes() == 0 && ring.Allocate(64, 64) == 0,
+            "Reset starts over with the new capacity");
+        EndChecks();
+    }
+
+    struct Allocation
+    {
+        std::uint64_t Offset;
+        std::uint64_t Size;
+        std::uint64_t Fence;
+    };
+
+    void TestRandomFrames(int frameCount)
+    {
+        std::printf("Random frames\n");
+        const std::uint64_t capacity = 32 * 1024;
+        const std::uint64_t framesInFlight = 3;
+        RingAllocator ring(capacity);
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<int> sizeLog(0, 12), alignmentLog(0, 8), perFrame(0, 40);
+
+        std::deque<Allocation> live;
+        bool inside = true, aligned = true, disjoint = true, accounted = true;
+        size_t allocations = 0, failures = 0, wraps = 0;
+        std::uint64_t lastOffset = 0;
+        for(int frame = 1; frame <= frameCount; ++frame)
+        {
+            // The GPU is framesInFlight frames behind.
+            std::uint64_t completed = frame > (int)framesInFlight ? frame - framesInFlight : 0;
+            ring.Retire(completed);
+            while(!live.empty() && live.front().Fence <= completed)
+                live.pop_front();
+
+            int count = perFrame(rng);
+            for(int i = 0; i < count; ++i)
+            {
+                std::uint64_t size = 1 + (rng() % (1u << sizeLog(rng)));
+                std::uint64_t alignment = 1ull << alignmentLog(rng);
+                std::uint64_t offset = ring.Allocate(size, alignment);
+                if(offset == Invalid)
+                {
+                    ++failures;
+                    continue;
+                }
+                ++allocations;
+                wraps += offset < lastOffset;
+                lastOffset = offset;
+                inside &= offset + size <= capacity;
+                aligned &= offset % alignment == 0;
+                for(const Allocation& a : live)
+                    disjoint &= offset + size <= a.Offset || a.Offset + a.Size <= offset;
+                live.push_back({ offset, size, (std::uint64_t)frame });
+            }
+            ring.FinishFrame(frame);
+
+            std::uint64_t liveBytes = 0;
+            for(const Allocation& a : live)
+                liveBytes += a.Size;
+            accounted &= ring.UsedBytes() >= liveBytes && ring.UsedBytes() <= capacity;
+        }
+        ring.Retire(frameCount);
+        Check(inside, "allocations lie inside the ring");
+        Check(aligned, "allocations are aligned");
+        Check(disjoint, "allocations never overlap one that is still in flight");
+        Check(accounted, "used bytes cover the live allocations");
+        Check(ring.UsedBytes() == 0, "everything retires once the GPU catches up");
+        Check(wraps > 0 && failures > 0, "the ring wrapped and filled up");
+        std::printf("  %zu allocations, %zu wraps, %zu full\n", allocations, wraps, failures);
+        EndChecks();
+    }
+
+    void Benchmark(int frameCount)
+    {
+        const int perFrame = 1000;
+        std::printf("%d frames of %d constant buffer sized allocations, 3 in flight, best of %d\n",
+            frameCount, perFrame, gRepetitions);
+        RingAllocator ring(16 * 1024 * 1024);
+        double seconds = Time([&]()
+        {
+            ring.Reset(ring.Capacity());
+            for(int frame = 1; frame <= frameCount; ++frame)
+            {
+                ring.Retire(frame > 3 ? frame - 3 : 0);
+                for(int i = 0; i < perFrame; ++i)
+                    gSink += (size_t)ring.Allocate(64 + 64 * (i & 7), 256);
+                ring.FinishFrame(frame);
+            }
+        });
+        std::printf("  %-12s %9.3f ms %7.2f ns/allocation\n", "Allocate", seconds * 1e3,
+            seconds * 1e9 / ((double)frameCount * perFrame));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    TestScripted();
+    TestRandomFrames(quick ? 2000 : 20000);
+    Benchmark(quick ? 100 : 1000);
+    return Finish(gSink);
+}
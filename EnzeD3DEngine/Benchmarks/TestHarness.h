@@ -0,0 +1,69 @@
+// What every benchmark program shares: Check() records a failure, ParseQuick()
+// reads --quick, Time() takes the best of gRepetitions runs, and main ends
+// with return Finish(checksum), which exits with 1 if any check failed.
+// ctest runs the programs registered with enze_test with --quick, which
+// keeps every check and shortens the timed part.
+
+#pragma once
+#include "MyTimer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Best-of count for Time().
+inline int gRepetitions = 7;
+
+// Checks failed so far.
+inline int gFailures = 0;
+
+inline void Check(bool ok, const char* what)
+{
+    if(!ok)
+    {
+        std::printf("  FAILED: %s\n", what);
+        ++gFailures;
+    }
+}
+
+// Ends a group of checks with whether any has failed so far.
+inline void EndChecks()
+{
+    std::printf("  %s\n\n", gFailures ? "failed" : "ok");
+}
+
+// Returns whether the program was run with --quick, which times only two
+// repetitions; otherwise Time() takes the best of repetitions.
+inline bool ParseQuick(int argc, char** argv, int repetitions = 7)
+{
+    bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+    gRepetitions = quick ? 2 : repetitions;
+    return quick;
+}
+
+// Seconds of the fastest of gRepetitions runs of body.
+template<typename F>
+double Time(F&& body)
+{
+    double best = 1e30;
+    for(int r = 0; r < gRepetitions; ++r)
+    {
+        MyTimer timer;
+        body();
+        best = std::min(best, (double)timer.Peek());
+    }
+    return best;
+}
+
+// Prints the failure count with the checksum that keeps the timed work from
+// being optimized away; main returns the result.
+inline int Finish(size_t checksum)
+{
+    std::printf("\n%d failure(s) (checksum %zu)\n", gFailures, checksum);
+    return gFailures ? 1 : 0;
+}
+
+inline int Finish(double checksum)
+{
+    std::printf("\n%d failure(s) (checksum %g)\n", gFailures, checksum);
+    return gFailures ? 1 : 0;
+}
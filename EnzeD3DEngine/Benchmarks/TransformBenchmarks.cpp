@@ -0,0 +1,507 @@
+// TransformHierarchy under random edits on deep, wide and bushy trees:
+// nodes move, are added, removed and reparented, and cycles are attempted.
+// After every Update() each live node's world matrix must match a full
+// recompute down its parent chain, ChangedNodes() must be exactly the
+// subtrees changed since the last Update(), parents before children, and
+// handles of removed subtrees must stay invalid while their slots are
+// reused.  A second hierarchy given the same edits is updated with a
+// JobSystem, on levels larger than its grain size, and must give the same
+// bits.  The program fails on a difference.  Then Update() is timed on deep
+// and wide hierarchies, on the calling thread alone and with a JobSystem.
+// --quick runs fewer rounds of edits and times fewer repetitions.
+
+#include "JobSystem.h"
+#include "MyTimer.h"
+#include "TransformHierarchy.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace Math;
+
+namespace
+{
+    const size_t NodeCount = 100000;
+
+    size_t gSink = 0;
+
+    LocalTransform RandomLocal(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        Vec4 axis = VecNormalize3(VecSet(unit(rng), unit(rng), unit(rng), 0.f));
+        LocalTransform local;
+        local.Translation = { unit(rng), unit(rng), unit(rng) };
+        local.Rotation = StoreFloat4(QuatRotationAxis(axis, 0.1f * unit(rng)));
+        local.Scale = { 1.f, 1.f, 1.f };
+        return local;
+    }
+
+    //
+    // The hierarchy as the test expects it to be: every node ever added,
+    // with its parent as an index into the same list.
+    //
+
+    struct ModelNode
+    {
+        TransformHandle Handle;
+        int Parent = -1;
+        LocalTransform Local;
+        bool Alive = true;
+    };
+
+    struct Model
+    {
+        std::vector<ModelNode> Nodes;
+        // Nodes added, moved or reparented since the last Update().
+        std::vector<std::uint8_t> Touched;
+
+        bool InSubtree(int node, int root)const
+        {
+            for(; node != -1; node = Nodes[node].Parent)
+            {
+                if(node == root)
+                    return true;
+            }
+            return false;
+        }
+
+        // Whether the node or one of its ancestors was touched.
+        bool Changed(int node)const
+        {
+            for(; node != -1; node = Nodes[node].Parent)
+            {
+                if(Touched[node])
+                    return true;
+            }
+            return false;
+        }
+
+        std::vector<int> AliveNodes()const
+        {
+            std::vector<int> alive;
+            for(int i = 0; i < (int)Nodes.size(); ++i)
+            {
+                if(Nodes[i].Alive)
+                    alive.push_back(i);
+            }
+            return alive;
+        }
+
+        // Local times parent world from the root down, as a full recompute.
+        std::vector<Float4x4> Worlds()const
+        {
+            std::vector<Float4x4> worlds(Nodes.size());
+            std::vector<std::uint8_t> done(Nodes.size(), 0);
+            std::vector<int> chain;
+            for(int i = 0; i < (int)Nodes.size(); ++i)
+            {
+                if(!Nodes[i].Alive)
+                    continue;
+                chain.clear();
+                for(int node = i; node != -1 && !done[node]; node = Nodes[node].Parent)
+                    chain.push_back(node);
+                for(auto it = chain.rbegin(); it != chain.rend(); ++it)
+                {
+                    const LocalTransform& local = Nodes[*it].Local;
+                    Mat4 world = MatAffineTransformation(Load(local.Scale), Load(local.Rotation), Load(local.Translation));
+                    if(Nodes[*it].Parent != -1)
+                        world = MatMultiply(world, Load(worlds[Nodes[*it].Parent]));
+                    Store(&worlds[*it], world);
+                    done[*it] = 1;
+                }
+            }
+            return worlds;
+        }
+    };
+
+    // Applies every edit to the serial and the parallel hierarchy alike.
+    struct Pair
+    {
+        TransformHierarchy Serial, Parallel;
+        Model Expected;
+        std::vector<TransformHandle> Removed;
+        size_t ReusedSlots = 0;
+
+        int Add(const LocalTransform& local, int parent)
+        {
+            TransformHandle parentHandle = parent == -1 ? TransformHandle() : Expected.Nodes[parent].Handle;
+            ModelNode node;
+            node.Handle = Serial.Add(local, parentHandle);
+            node.Parent = parent;
+            node.Local = local;
+            Check(Parallel.Add(local, parentHandle).Slot == node.Handle.Slot, "both hierarchies hand out the same slots");
+            for(const TransformHandle& removed : Removed)
+            {
+                if(removed.Slot == node.Handle.Slot)
+                {
+                    ++ReusedSlots;
+                    break;
+                }
+            }
+            Expected.Nodes.push_back(node);
+            Expected.Touched.push_back(1);
+            return (int)Expected.Nodes.size() - 1;
+        }
+
+        void SetLocal(int node, const LocalTransform& local)
+        {
+            Serial.SetLocal(Expected.Nodes[node].Handle, local);
+            Parallel.SetLocal(Expected.Nodes[node].Handle, local);
+            Expected.Nodes[node].Local = local;
+            Expected.Touched[node] = 1;
+        }
+
+        // Returns whether the hierarchy accepted the new parent.
+        bool SetParent(int node, int parent)
+        {
+            TransformHandle parentHandle = parent == -1 ? TransformHandle() : Expected.Nodes[parent].Handle;
+            bool accepted = Serial.SetParent(Expected.Nodes[node].Handle, parentHandle);
+            Parallel.SetParent(Expected.Nodes[node].Handle, parentHandle);
+            if(accepted && Expected.Nodes[node].Parent != parent)
+            {
+                Expected.Nodes[node].Parent = parent;
+                Expected.Touched[node] = 1;
+            }
+            return accepted;
+        }
+
+        void Remove(int root)
+        {
+            Serial.Remove(Expected.Nodes[root].Handle);
+            Parallel.Remove(Expected.Nodes[root].Handle);
+            std::vector<int> subtree;
+            for(int i = 0; i < (int)Expected.Nodes.size(); ++i)
+            {
+                if(Expected.Nodes[i].Alive && Expected.InSubtree(i, root))
+                    subtree.push_back(i);
+            }
+            // Marked dead only after the walk, which goes through parents.
+            bool invalidated = true;
+            for(int i : subtree)
+            {
+                invalidated &= !Serial.IsAlive(Expected.Nodes[i].Handle);
+                Expected.Nodes[i].Alive = false;
+                Removed.push_back(Expected.Nodes[i].Handle);
+            }
+            Check(invalidated, "Remove invalidates the handles of the whole subtree");
+        }
+
+        // Updates both hierarchies and checks them against the model.
+        void Update(JobSystem& jobSystem)
+        {
+            Serial.Update();
+            Parallel.Update(&jobSystem);
+
+            std::vector<int> alive = Expected.AliveNodes();
+            Check(Serial.Size() == alive.size(), "Size counts the live nodes");
+
+            // World matrices against a full recompute.  The hierarchy uses
+            // the same functions, so only the compiler's contractions can
+            // differ.
+            std::vector<Float4x4> worlds = Expected.Worlds();
+            bool matches = true;
+            for(int i : alive)
+            {
+                const Float4x4& got = Serial.World(Expected.Nodes[i].Handle);
+                for(int r = 0; r < 4; ++r)
+                {
+                    for(int c = 0; c < 4; ++c)
+                    {
+                        float want = worlds[i].m[r][c];
+                        matches &= std::fabs(got.m[r][c] - want) <= 1e-4f * (1.f + std::fabs(want));
+                    }
+                }
+            }
+            Check(matches, "World matches a full recompute down the parent chain");
+
+            // ChangedNodes as slots, in order.
+            const std::vector<std::uint32_t>& denseSlots = Serial.DenseSlots();
+            std::vector<int> slotToNode(denseSlots.size() + Expected.Nodes.size(), -1);
+            for(int i : alive)
+                slotToNode[Expected.Nodes[i].Handle.Slot] = i;
+            std::vector<int> position(Expected.Nodes.size(), -1);
+            bool known = true;
+            const std::vector<std::uint32_t>& changed = Serial.ChangedNodes();
+            for(size_t k = 0; k < changed.size(); ++k)
+            {
+                int node = changed[k] < denseSlots.size() ? slotToNode[denseSlots[changed[k]]] : -1;
+                if(node == -1 || position[node] != -1)
+                {
+                    known = false;
+                    continue;
+                }
+                position[node] = (int)k;
+            }
+            Check(known, "ChangedNodes lists live nodes once each");
+
+            bool exact = true, ordered = true;
+            for(int i : alive)
+            {
+                exact &= (position[i] != -1) == Expected.Changed(i);
+                int parent = Expected.Nodes[i].Parent;
+                if(position[i] != -1 && parent != -1 && position[parent] != -1)
+                    ordered &= position[parent] < position[i];
+            }
+            Check(exact, "ChangedNodes is exactly the subtrees changed since the last Update");
+            Check(ordered, "ChangedNodes lists parents before their children");
+
+            // The parallel hierarchy saw the same edits and evaluates the
+            // same nodes with the same code.
+            Check(Parallel.ChangedNodes() == changed && Parallel.DenseSlots() == denseSlots,
+                "Update with a JobSystem changes the same nodes");
+            Check(Parallel.Worlds().size() == Serial.Worlds().size() &&
+                std::memcmp(Parallel.Worlds().data(), Serial.Worlds().data(), Serial.Worlds().size() * sizeof(Float4x4)) == 0,
+                "Update with a JobSystem gives bit-identical matrices");
+
+            bool dead = true;
+            for(const TransformHandle& handle : Removed)
+                dead &= !Serial.IsAlive(handle) && !Parallel.IsAlive(handle);
+            Check(dead, "handles of removed nodes stay invalid");
+
+            std::fill(Expected.Touched.begin(), Expected.Touched.end(), 0);
+            gSink += changed.size();
+        }
+    };
+
+    struct TestShape
+    {
+        const char* Name;
+        // Adds the initial nodes; roots first.
+        std::function<void(Pair&, std::mt19937&)> Build;
+    };
+
+    void TestEdits(const TestShape& shape, JobSystem& jobSystem, int rounds)
+    {
+        std::printf("%s\n", shape.Name);
+        std::mt19937 rng(23);
+        Pair pair;
+        shape.Build(pair, rng);
+        pair.Update(jobSystem);
+
+        pair.Update(jobSystem);
+        Check(pair.Serial.ChangedNodes().empty(), "Update with nothing changed recomputes nothing");
+
+        size_t refused = 0;
+        for(int round = 0; round < rounds; ++round)
+        {
+            std::vector<int> alive = pair.Expected.AliveNodes();
+            auto any = [&]() { return alive[rng() % alive.size()]; };
+
+            // Every third round moves the roots, which changes every level
+            // in full, including those larger than the grain size.
+            if(round % 3 == 0)
+            {
+                for(int i : alive)
+                {
+                    if(pair.Expected.Nodes[i].Parent == -1)
+                        pair.SetLocal(i, RandomLocal(rng));
+                }
+            }
+            for(size_t i = 0, count = rng() % (alive.size() / 50 + 1); i < count; ++i)
+                pair.SetLocal(any(), RandomLocal(rng));
+
+            // Reparenting under the node itself or a descendant must be
+            // refused; anything else accepted.
+            for(int i = 0; i < 4; ++i)
+            {
+                int node = any(), parent = rng() % 8 == 0 ? -1 : any();
+                bool cycle = parent != -1 && pair.Expected.InSubtree(parent, node);
+                bool accepted = pair.SetParent(node, parent);
+                Check(accepted != cycle, "SetParent refuses exactly the parents that make a cycle");
+                refused += !accepted;
+            }
+
+            // Moving an ancestor under its descendant must be refused too.
+            int child = any();
+            if(pair.Expected.Nodes[child].Parent != -1)
+            {
+                int ancestor = child;
+                for(int up = rng() % 4; up >= 0 && pair.Expected.Nodes[ancestor].Parent != -1; --up)
+                    ancestor = pair.Expected.Nodes[ancestor].Parent;
+                Check(!pair.SetParent(ancestor, child), "SetParent refuses to move a node under its descendant");
+                ++refused;
+            }
+
+            // A small subtree goes, and new nodes take its slots.
+            int removed = any();
+            if(pair.Expected.Nodes[removed].Parent != -1)
+            {
+                pair.Remove(removed);
+                alive = pair.Expected.AliveNodes();
+            }
+            for(int i = 0; i < 5; ++i)
+                pair.Add(RandomLocal(rng), rng() % 4 == 0 ? -1 : any());
+
+            pair.Update(jobSystem);
+        }
+
+        // A root moved under one of its descendants is refused.
+        int root = 0, descendant = -1;
+        while(!pair.Expected.Nodes[root].Alive || pair.Expected.Nodes[root].Parent != -1)
+            ++root;
+        for(int i : pair.Expected.AliveNodes())
+        {
+            if(i != root && pair.Expected.InSubtree(i, root))
+                descendant = i;
+        }
+        Check(descendant == -1 || !pair.SetParent(root, descendant), "a root cannot move under its own descendant");
+        Check(!pair.SetParent(root, root), "a node cannot be its own parent");
+        pair.Update(jobSystem);
+        Check(pair.Serial.ChangedNodes().empty(), "a refused SetParent changes nothing");
+
+        std::printf("  %zu nodes, %zu levels, %zu cycles refused, %zu slots reused\n", pair.Serial.Size(),
+            pair.Serial.LevelCount(), refused, pair.ReusedSlots);
+        Check(pair.ReusedSlots > 0, "slots of removed nodes are reused");
+        EndChecks();
+    }
+
+    struct Scene
+    {
+        const char* Name;
+        // Builds the hierarchy and returns its nodes, parents before
+        // children, and how many of them are roots.
+        std::function<size_t(TransformHierarchy&, std::vector<TransformHandle>&, std::mt19937&)> Build;
+    };
+
+    // Runs body, then Update, gRepetitions times; body marks what changed.
+    void Run(const char* name, TransformHierarchy& hierarchy, JobSystem* jobSystem,
+        const std::function<void()>& body)
+    {
+        double best = 1e30;
+        size_t changed = 0;
+        for(int r = 0; r < gRepetitions; ++r)
+        {
+            body();
+            MyTimer timer;
+            hierarchy.Update(jobSystem);
+            best = std::min(best, (double)timer.Peek());
+            changed = hierarchy.ChangedNodes().size();
+        }
+        gSink += changed;
+        std::printf("  %-28s %-8s %9.3f ms %8zu nodes %8.2f ns/node\n", name, jobSystem ? "jobs" : "serial",
+            best * 1e3, changed, changed ? best * 1e9 / changed : 0.0);
+    }
+
+    void Benchmark(const Scene& scene, JobSystem& jobSystem)
+    {
+        std::mt19937 rng(11);
+        TransformHierarchy hierarchy;
+        std::vector<TransformHandle> nodes;
+        hierarchy.Reserve(NodeCount);
+        size_t rootCount = scene.Build(hierarchy, nodes, rng);
+
+        MyTimer layoutTimer;
+        hierarchy.Update();
+        std::printf("%s: %zu nodes, %zu levels, first Update %.3f ms\n", scene.Name, hierarchy.Size(),
+            hierarchy.LevelCount(), layoutTimer.Peek() * 1e3);
+
+        std::vector<TransformHandle> sample;
+        for(size_t i = 0; i < nodes.size() / 100; ++i)
+            sample.push_back(nodes[rng() % nodes.size()]);
+        LocalTransform moved = RandomLocal(rng);
+
+        for(JobSystem* jobs : { (JobSystem*)nullptr, &jobSystem })
+        {
+            Run("nothing changed", hierarchy, jobs, []() {});
+            Run("one leaf moved", hierarchy, jobs, [&]() { hierarchy.SetLocal(nodes.back(), moved); });
+            Run("1% of nodes moved", hierarchy, jobs, [&]()
+            {
+                for(TransformHandle node : sample)
+                    hierarchy.SetLocal(node, moved);
+            });
+            Run("roots moved (everything)", hierarchy, jobs, [&]()
+            {
+                for(size_t i = 0; i < rootCount; ++i)
+                    hierarchy.SetLocal(nodes[i], moved);
+            });
+        }
+        std::printf("\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = ParseQuick(argc, argv);
+
+    // Workers regardless of the machine, so the checked levels really are
+    // evaluated concurrently.
+    JobSystem testJobs(4);
+
+    // Each has a level of more than 1024 nodes, the grain size above which
+    // Update splits a level across the job system.
+    std::vector<TestShape> shapes =
+    {
+        { "Edits on a wide tree (1 root, 3000 children)", [](Pair& pair, std::mt19937& rng)
+        {
+            pair.Add(RandomLocal(rng), -1);
+            for(int i = 1; i < 3000; ++i)
+                pair.Add(RandomLocal(rng), 0);
+        } },
+        { "Edits on a bushy tree (fan-out 4, 7 levels)", [](Pair& pair, std::mt19937& rng)
+        {
+            pair.Add(RandomLocal(rng), -1);
+            for(int i = 1; i < 5461; ++i)
+                pair.Add(RandomLocal(rng), (i - 1) / 4);
+        } },
+        { "Edits on a deep tree (1200 chains of 5, 4 chains of 200)", [](Pair& pair, std::mt19937& rng)
+        {
+            for(int chain = 0; chain < 1200; ++chain)
+                pair.Add(RandomLocal(rng), -1);
+            for(int i = 1200; i < 6000; ++i)
+                pair.Add(RandomLocal(rng), i - 1200);
+            for(int chain = 0; chain < 4; ++chain)
+            {
+                int parent = pair.Add(RandomLocal(rng), -1);
+                for(int i = 1; i < 200; ++i)
+                    parent = pair.Add(RandomLocal(rng), parent);
+            }
+        } },
+    };
+    for(const TestShape& shape : shapes)
+        TestEdits(shape, testJobs, quick ? 12 : 60);
+
+    JobSystem jobSystem;
+    std::printf("JobSystem workers: %u\n\n", jobSystem.WorkerCount());
+
+    std::vector<Scene> scenes =
+    {
+        { "wide (1 root, 100k children)", [](TransformHierarchy& h, std::vector<TransformHandle>& nodes, std::mt19937& rng)
+        {
+            nodes.push_back(h.Add(RandomLocal(rng)));
+            for(size_t i = 1; i < NodeCount; ++i)
+                nodes.push_back(h.Add(RandomLocal(rng), nodes[0]));
+            return (size_t)1;
+        } },
+        { "bushy (fan-out 10, 5 levels)", [](TransformHierarchy& h, std::vector<TransformHandle>& nodes, std::mt19937& rng)
+        {
+            nodes.push_back(h.Add(RandomLocal(rng)));
+            for(size_t i = 1; i < NodeCount; ++i)
+                nodes.push_back(h.Add(RandomLocal(rng), nodes[(i - 1) / 10]));
+            return (size_t)1;
+        } },
+        { "deep (1000 chains of 100)", [](TransformHierarchy& h, std::vector<TransformHandle>& nodes, std::mt19937& rng)
+        {
+            for(size_t chain = 0; chain < 1000; ++chain)
+                nodes.push_back(h.Add(RandomLocal(rng)));
+            for(size_t i = 1000; i < NodeCount; ++i)
+                nodes.push_back(h.Add(RandomLocal(rng), nodes[i - 1000]));
+            return (size_t)1000;
+        } },
+        { "chain (1 chain of 100k)", [](TransformHierarchy& h, std::vector<TransformHandle>& nodes, std::mt19937& rng)
+        {
+            nodes.push_back(h.Add(RandomLocal(rng)));
+            for(size_t i = 1; i < NodeCount; ++i)
+                nodes.push_back(h.Add(RandomLocal(rng), nodes[i - 1]));
+            return (size_t)1;
+        } },
+    };
+
+    for(const Scene& scene : scenes)
+        Benchmark(scene, jobSystem);
+    return Finish(gSink);
+}
@@ -0,0 +1,756 @@
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+    using uint32 = std::uint32_t;
+
+    const uint32 InvalidIndex = ~0u;
+    const uint32 MaxLeafItems = 4;
+    const uint32 SahBinCount = 16;
+
+    // Cost of visiting a node relative to testing one item.
+    const float TraversalCost = 1.0f;
+
+    // Refit() rebuilds the tree when the items outside it plus the
+    // tombstones in it exceed this many, plus one per RebuildDivisor live
+    // items.
+    const uint32 MinRebuildChanges = 32;
+    const uint32 RebuildDivisor = 8;
+
+    struct Bounds
+    {
+        XMFLOAT3 Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+        XMFLOAT3 Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+        void Grow(const XMFLOAT3& mn, const XMFLOAT3& mx)
+        {
+            Min = XMFLOAT3(std::min(Min.x, mn.x), std::min(Min.y, mn.y), std::min(Min.z, mn.z));
+            Max = XMFLOAT3(std::max(Max.x, mx.x), std::max(Max.y, mx.y), std::max(Max.z, mx.z));
+        }
+
+        void Grow(const Bounds& b)
+        {
+            Grow(b.Min, b.Max);
+        }
+
+        // Half the surface area; the SAH only compares ratios.
+        float HalfArea()const
+        {
+            if(Max.x < Min.x)
+                return 0.0f;
+
+            float dx = Max.x - Min.x;
+            float dy = Max.y - Min.y;
+            float dz = Max.z - Min.z;
+            return dx*dy + dy*dz + dz*dx;
+        }
+    };
+
+    template<typename T>
+    Bounds BoundsOf(const T& t)
+    {
+        Bounds b;
+        b.Min = t.Min;
+        b.Max = t.Max;
+        return b;
+    }
+
+    float Component(const XMFLOAT3& v, int axis)
+    {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    bool Overlaps(const XMFLOAT3& aMin, const XMFLOAT3& aMax, const XMFLOAT3& bMin, const XMFLOAT3& bMax)
+    {
+        return aMin.x <= bMax.x && aMax.x >= bMin.x &&
+            aMin.y <= bMax.y && aMax.y >= bMin.y &&
+            aMin.z <= bMax.z && aMax.z >= bMin.z;
+    }
+
+    bool OverlapsSphere(const XMFLOAT3& mn, const XMFLOAT3& mx, const BoundingSphere& s)
+    {
+        float dx = std::max(std::max(mn.x - s.Center.x, 0.0f), s.Center.x - mx.x);
+        float dy = std::max(std::max(mn.y - s.Center.y, 0.0f), s.Center.y - mx.y);
+        float dz = std::max(std::max(mn.z - s.Center.z, 0.0f), s.Center.z - mx.z);
+        return dx*dx + dy*dy + dz*dz <= s.Radius*s.Radius;
+    }
+
+    // Slab test.  Returns the entry distance, or FLT_MAX if the ray misses
+    // the box within [0, maxDistance].  Empty boxes (min above max), as of a
+    // node whose items were all removed, are never hit.
+    float RayBox(const XMFLOAT3& origin, const XMFLOAT3& invDir, const XMFLOAT3& mn, const XMFLOAT3& mx,
+        float maxDistance)
+    {
+        if(mn.x > mx.x)
+            return FLT_MAX;
+
+        float tx0 = (mn.x - origin.x)*invDir.x, tx1 = (mx.x - origin.x)*invDir.x;
+        float ty0 = (mn.y - origin.y)*invDir.y, ty1 = (mx.y - origin.y)*invDir.y;
+        float tz0 = (mn.z - origin.z)*invDir.z, tz1 = (mx.z - origin.z)*invDir.z;
+
+        float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+        float tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), maxDistance));
+        return tNear <= tFar ? tNear : FLT_MAX;
+    }
+
+    // Frustum test of one box against the planes still in planeMask.  Clears
+    // the bits of planes the box is completely inside of.
+    bool OutsideFrustum(const FrustumCuller::Planes& planes, const XMFLOAT3& mn, const XMFLOAT3& mx,
+        uint32& planeMask)
+    {
+        if(mn.x > mx.x)
+            return true;
+
+        float cx = 0.5f*(mn.x + mx.x), cy = 0.5f*(mn.y + mx.y), cz = 0.5f*(mn.z + mx.z);
+        float ex = 0.5f*(mx.x - mn.x), ey = 0.5f*(mx.y - mn.y), ez = 0.5f*(mx.z - mn.z);
+        for(uint32 p = 0; p < 6; ++p)
+        {
+            if((planeMask & (1u << p)) == 0)
+                continue;
+
+            const XMFLOAT4& n = planes.Plane[p];
+            float dist = n.x*cx + n.y*cy + n.z*cz + n.w;
+            float radius = fabsf(n.x)*ex + fabsf(n.y)*ey + fabsf(n.z)*ez;
+            if(dist + radius < 0.0f)
+                return true;
+            if(dist - radius >= 0.0f)
+                planeMask &= ~(1u << p);
+        }
+        return false;
+    }
+
+    void SetBox(XMFLOAT3& mn, XMFLOAT3& mx, const BoundingBox& box)
+    {
+        XMStoreFloat3(&mn, XMVectorSubtract(XMLoadFloat3(&box.Center), XMLoadFloat3(&box.Extents)));
+        XMStoreFloat3(&mx, XMVectorAdd(XMLoadFloat3(&box.Center), XMLoadFloat3(&box.Extents)));
+    }
+}
+
+void BoundingVolumeHierarchy::Build(const AabbSoA& boxes, const std::uint32_t* keys)
+{
+    Clear();
+
+    uint32 itemCount = (uint32)boxes.Size();
+    if(itemCount == 0)
+        return;
+
+    mItems.resize(itemCount);
+    for(uint32 i = 0; i < itemCount; ++i)
+    {
+        Item& item = mItems[i];
+        item.Min = XMFLOAT3(boxes.CenterX[i] - boxes.ExtentX[i], boxes.CenterY[i] - boxes.ExtentY[i], boxes.CenterZ[i] - boxes.ExtentZ[i]);
+        item.Max = XMFLOAT3(boxes.CenterX[i] + boxes.ExtentX[i], boxes.CenterY[i] + boxes.ExtentY[i], boxes.CenterZ[i] + boxes.ExtentZ[i]);
+        item.Key = keys[i];
+    }
+
+    BuildTree();
+}
+
+void BoundingVolumeHierarchy::BuildTree()
+{
+    // Builds over every item in mItems, which must all be live.
+    uint32 itemCount = (uint32)mItems.size();
+    mNodes.clear();
+    mParents.clear();
+    mMovedItems.clear();
+    mTreeItemCount = itemCount;
+    mDeadCount = 0;
+
+    uint32 maxKey = 0;
+    for(const Item& item : mItems)
+        maxKey = std::max(maxKey, item.Key);
+    mKeyToItem.assign(itemCount ? maxKey + 1 : 0, InvalidIndex);
+    if(itemCount == 0)
+    {
+        mNodeDirty.clear();
+        return;
+    }
+
+    mNodes.reserve(2*itemCount);
+    mParents.reserve(2*itemCount);
+    mNodes.emplace_back();
+    mParents.push_back(InvalidIndex);
+
+    //
+    // Top-down binned SAH build with an explicit stack, since badly
+    // distributed input can make the tree deep.
+    //
+
+    struct Task
+    {
+        uint32 Node, Begin, End;
+    };
+    std::vector<Task> stack;
+    stack.push_back(Task{ 0, 0, itemCount });
+
+    while(!stack.empty())
+    {
+        Task task = stack.back();
+        stack.pop_back();
+
+        uint32 count = task.End - task.Begin;
+        Bounds bounds, centroidBounds;
+        for(uint32 i = task.Begin; i < task.End; ++i)
+        {
+            const Item& item = mItems[i];
+            bounds.Grow(item.Min, item.Max);
+            XMFLOAT3 c(0.5f*(item.Min.x + item.Max.x), 0.5f*(item.Min.y + item.Max.y), 0.5f*(item.Min.z + item.Max.z));
+            centroidBounds.Grow(c, c);
+        }
+        mNodes[task.Node].Min = bounds.Min;
+        mNodes[task.Node].Max = bounds.Max;
+
+        if(count == 1)
+        {
+            SetLeaf(task.Node, task.Begin, count);
+            continue;
+        }
+
+        // Bin the centroids along every axis and keep the cheapest split.
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        uint32 bestSplit = 0;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            float cMin = Component(centroidBounds.Min, axis);
+            float cMax = Component(centroidBounds.Max, axis);
+            if(cMax <= cMin)
+                continue;
+
+            Bounds binBounds[SahBinCount];
+            uint32 binCount[SahBinCount] = {};
+            float scale = SahBinCount / (cMax - cMin);
+            for(uint32 i = task.Begin; i < task.End; ++i)
+            {
+                const Item& item = mItems[i];
+                float c = 0.5f*(Component(item.Min, axis) + Component(item.Max, axis));
+                uint32 bin = std::min(SahBinCount - 1, (uint32)((c - cMin)*scale));
+                binBounds[bin].Grow(item.Min, item.Max);
+                ++binCount[bin];
+            }
+
+            // Sweep from the right to get the cost of every right side, then
+            // from the left to combine.
+            float rightArea[SahBinCount];
+            uint32 rightCount[SahBinCount];
+            Bounds right;
+            uint32 rightSum = 0;
+            for(uint32 b = SahBinCount - 1; b > 0; --b)
+            {
+                right.Grow(binBounds[b]);
+                rightSum += binCount[b];
+                rightArea[b] = right.HalfArea();
+                rightCount[b] = rightSum;
+            }
+
+            Bounds left;
+            uint32 leftSum = 0;
+            for(uint32 b = 1; b < SahBinCount; ++b)
+            {
+                left.Grow(binBounds[b - 1]);
+                leftSum += binCount[b - 1];
+                if(leftSum == 0 || rightCount[b] == 0)
+                    continue;
+
+                float cost = left.HalfArea()*leftSum + rightArea[b]*rightCount[b];
+                if(cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        float leafCost = (float)count;
+        float splitCost = bestAxis >= 0 ? TraversalCost + bestCost / bounds.HalfArea() : FLT_MAX;
+        if(count <= MaxLeafItems && leafCost <= splitCost)
+        {
+            SetLeaf(task.Node, task.Begin, count);
+            continue;
+        }
+
+        uint32 mid;
+        if(bestAxis >= 0)
+        {
+            float cMin = Component(centroidBounds.Min, bestAxis);
+            float scale = SahBinCount / (Component(centroidBounds.Max, bestAxis) - cMin);
+            Item* split = std::partition(mItems.data() + task.Begin, mItems.data() + task.End,
+                [bestAxis, cMin, scale, bestSplit](const Item& item)
+            {
+                float c = 0.5f*(Component(item.Min, bestAxis) + Component(item.Max, bestAxis));
+                return std::min(SahBinCount - 1, (uint32)((c - cMin)*scale)) < bestSplit;
+            });
+            mid = (uint32)(split - mItems.data());
+        }
+        else
+        {
+            // All centroids coincide; any split is as good as another.
+            mid = task.Begin + count / 2;
+        }
+
+        uint32 left = (uint32)mNodes.size();
+        mNodes.emplace_back();
+        mNodes.emplace_back();
+        mParents.push_back(task.Node);
+        mParents.push_back(task.Node);
+        mNodes[task.Node].LeftFirst = left;
+        mNodes[task.Node].Count = 0;
+
+        stack.push_back(Task{ left + 1, mid, task.End });
+        stack.push_back(Task{ left, task.Begin, mid });
+    }
+
+    for(uint32 i = 0; i < itemCount; ++i)
+        mKeyToItem[mItems[i].Key] = i;
+
+    mNodeDirty.assign(mNodes.size(), 0);
+}
+
+void BoundingVolumeHierarchy::Clear()
+{
+    mNodes.clear();
+    mParents.clear();
+    mItems.clear();
+    mKeyToItem.clear();
+    mMovedItems.clear();
+    mNodeDirty.clear();
+    mTreeItemCount = 0;
+    mDeadCount = 0;
+}
+
+void BoundingVolumeHierarchy::SetLeaf(std::uint32_t node, std::uint32_t first, std::uint32_t count)
+{
+    mNodes[node].LeftFirst = first;
+    mNodes[node].Count = count;
+    for(uint32 i = first; i < first + count; ++i)
+        mItems[i].Leaf = node;
+}
+
+std::uint32_t BoundingVolumeHierarchy::FindItem(std::uint32_t key)const
+{
+    return key < mKeyToItem.size() ? mKeyToItem[key] : InvalidIndex;
+}
+
+void BoundingVolumeHierarchy::Insert(std::uint32_t key, const BoundingBox& box)
+{
+    if(FindItem(key) != InvalidIndex)
+    {
+        Update(key, box);
+        return;
+    }
+
+    if(key >= mKeyToItem.size())
+        mKeyToItem.resize(key + 1, InvalidIndex);
+    mKeyToItem[key] = (uint32)mItems.size();
+
+    Item item;
+    SetBox(item.Min, item.Max, box);
+    item.Key = key;
+    item.Leaf = InvalidIndex;
+    mItems.push_back(item);
+}
+
+void BoundingVolumeHierarchy::Remove(std::uint32_t key)
+{
+    uint32 item = FindItem(key);
+    if(item == InvalidIndex)
+        return;
+    mKeyToItem[key] = InvalidIndex;
+
+    if(item >= mTreeItemCount)
+    {
+        // Outside the tree the order does not matter.
+        uint32 last = (uint32)mItems.size() - 1;
+        if(item != last)
+        {
+            mItems[item] = mItems[last];
+            mKeyToItem[mItems[item].Key] = item;
+        }
+        mItems.pop_back();
+        return;
+    }
+
+    // An empty box, which the leaf's refit ignores, and no key.
+    Item& dead = mItems[item];
+    dead.Key = InvalidIndex;
+    dead.Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+    dead.Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    mMovedItems.push_back(item);
+    ++mDeadCount;
+}
+
+void BoundingVolumeHierarchy::Update(std::uint32_t key, const BoundingBox& box)
+{
+    uint32 item = FindItem(key);
+    if(item == InvalidIndex)
+    {
+        Insert(key, box);
+        return;
+    }
+
+    SetBox(mItems[item].Min, mItems[item].Max, box);
+    if(item < mTreeItemCount)
+        mMovedItems.push_back(item);
+}
+
+void BoundingVolumeHierarchy::Rebuild()
+{
+    // Drop the tombstones; the tree is rebuilt over the rest, inserted
+    // items included.
+    mItems.erase(std::remove_if(mItems.begin(), mItems.end(),
+        [](const Item& item) { return item.Key == InvalidIndex; }), mItems.end());
+    BuildTree();
+}
+
+void BoundingVolumeHierarchy::Refit()
+{
+    // Inserted items are tested one by one and tombstones still take their
+    // place in the leaves, so past a point a new tree is cheaper than both.
+    if(LooseCount() + mDeadCount > MinRebuildChanges + ItemCount() / RebuildDivisor)
+    {
+        Rebuild();
+        return;
+    }
+
+    if(mMovedItems.empty())
+        return;
+
+    // Mark every node above a moved item; paths stop where they merge.
+    for(uint32 item : mMovedItems)
+    {
+        for(uint32 node = mItems[item].Leaf; node != InvalidIndex && !mNodeDirty[node]; node = mParents[node])
+            mNodeDirty[node] = 1;
+    }
+    mMovedItems.clear();
+
+    RefitNode(0);
+}
+
+void BoundingVolumeHierarchy::RefitNode(std::uint32_t root)
+{
+    //
+    // Post-order walk over the marked nodes only.  The top bit of a stack
+    // entry says the node's children are already done.
+    //
+
+    const uint32 ChildrenDone = 0x80000000u;
+    std::vector<uint32> stack;
+    stack.push_back(root);
+
+    while(!stack.empty())
+    {
+        uint32 entry = stack.back();
+        stack.pop_back();
+        uint32 index = entry & ~ChildrenDone;
+        if(!mNodeDirty[index])
+            continue;
+
+        Node& node = mNodes[index];
+        if(node.Count == 0 && (entry & ChildrenDone) == 0)
+        {
+            stack.push_back(index | ChildrenDone);
+            stack.push_back(node.LeftFirst);
+            stack.push_back(node.LeftFirst + 1);
+            continue;
+        }
+
+        Bounds bounds;
+        if(node.Count > 0)
+        {
+            for(uint32 i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+                bounds.Grow(mItems[i].Min, mItems[i].Max);
+        }
+        else
+        {
+            bounds.Grow(BoundsOf(mNodes[node.LeftFirst]));
+            bounds.Grow(BoundsOf(mNodes[node.LeftFirst + 1]));
+        }
+        node.Min = bounds.Min;
+        node.Max = bounds.Max;
+        mNodeDirty[index] = 0;
+
+        if(node.Count == 0)
+            Rotate(index);
+    }
+}
+
+void BoundingVolumeHierarchy::Rotate(std::uint32_t index)
+{
+    //
+    // Try swapping one child with a grandchild on the other side and keep the
+    // swap that shrinks the surface area of the rebuilt child the most.  The
+    // node's own bounds do not change.
+    //
+
+    uint32 l = mNodes[index].LeftFirst;
+    uint32 r = l + 1;
+
+    float bestGain = 0.0f;
+    uint32 swapA = InvalidIndex, swapB = InvalidIndex, rebuilt = InvalidIndex;
+
+    const uint32 sides[2][2] = { { l, r }, { r, l } };
+    for(const auto& side : sides)
+    {
+        uint32 child = side[0];
+        uint32 other = side[1];
+        if(mNodes[other].Count > 0)
+            continue;
+
+        float otherArea = BoundsOf(mNodes[other]).HalfArea();
+        uint32 grandchildren[2] = { mNodes[other].LeftFirst, mNodes[other].LeftFirst + 1 };
+        for(int g = 0; g < 2; ++g)
+        {
+            // child moves down next to the grandchild that stays.
+            Bounds merged = BoundsOf(mNodes[child]);
+            merged.Grow(BoundsOf(mNodes[grandchildren[1 - g]]));
+            float gain = otherArea - merged.HalfArea();
+            if(gain > bestGain)
+            {
+                bestGain = gain;
+                swapA = child;
+                swapB = grandchildren[g];
+                rebuilt = other;
+            }
+        }
+    }
+
+    if(rebuilt == InvalidIndex)
+        return;
+
+    SwapNodes(swapA, swapB);
+
+    Node& node = mNodes[rebuilt];
+    Bounds bounds = BoundsOf(mNodes[node.LeftFirst]);
+    bounds.Grow(BoundsOf(mNodes[node.LeftFirst + 1]));
+    node.Min = bounds.Min;
+    node.Max = bounds.Max;
+}
+
+void BoundingVolumeHierarchy::SwapNodes(std::uint32_t a, std::uint32_t b)
+{
+    // Slots keep their parents; what moves is the subtree stored in them.
+    std::swap(mNodes[a], mNodes[b]);
+
+    for(uint32 slot : { a, b })
+    {
+        const Node& node = mNodes[slot];
+        if(node.Count > 0)
+        {
+            for(uint32 i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+                mItems[i].Leaf = slot;
+        }
+        else
+        {
+            mParents[node.LeftFirst] = slot;
+            mParents[node.LeftFirst + 1] = slot;
+        }
+    }
+}
+
+void BoundingVolumeHierarchy::QueryFrustum(const FrustumCuller::Planes& planes, std::vector<std::uint32_t>& keys)const
+{
+    for(uint32 i = mTreeItemCount; i < (uint32)mItems.size(); ++i)
+    {
+        uint32 planeMask = 0x3f;
+        if(!OutsideFrustum(planes, mItems[i].Min, mItems[i].Max, planeMask))
+            keys.push_back(mItems[i].Key);
+    }
+    if(mNodes.empty())
+        return;
+
+    // Each entry carries the planes its box still straddles; below a node
+    // that is completely inside, nothing is tested against a plane again.
+    struct Entry
+    {
+        uint32 Node, PlaneMask;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+    stack.push_back(Entry{ 0, 0x3f });
+
+    while(!stack.empty())
+    {
+        Entry entry = stack.back();
+        stack.pop_back();
+
+        const Node& node = mNodes[entry.Node];
+        if(OutsideFrustum(planes, node.Min, node.Max, entry.PlaneMask))
+            continue;
+
+        if(node.Count > 0)
+        {
+            // With no planes left to test only tombstones are rejected.
+            for(uint32 i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+            {
+                uint32 planeMask = entry.PlaneMask;
+                if(!OutsideFrustum(planes, mItems[i].Min, mItems[i].Max, planeMask))
+                    keys.push_back(mItems[i].Key);
+            }
+        }
+        else
+        {
+            stack.push_back(Entry{ node.LeftFirst + 1, entry.PlaneMask });
+            stack.push_back(Entry{ node.LeftFirst, entry.PlaneMask });
+        }
+    }
+}
+
+void BoundingVolumeHierarchy::QueryBox(const BoundingBox& box, std::vector<std::uint32_t>& keys)const
+{
+    XMFLOAT3 mn, mx;
+    XMStoreFloat3(&mn, XMVectorSubtract(XMLoadFloat3(&box.Center), XMLoadFloat3(&box.Extents)));
+    XMStoreFloat3(&mx, XMVectorAdd(XMLoadFloat3(&box.Center), XMLoadFloat3(&box.Extents)));
+
+    for(uint32 i = mTreeItemCount; i < (uint32)mItems.size(); ++i)
+    {
+        if(Overlaps(mItems[i].Min, mItems[i].Max, mn, mx))
+            keys.push_back(mItems[i].Key);
+    }
+    if(mNodes.empty())
+        return;
+
+    std::vector<uint32> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while(!stack.empty())
+    {
+        const Node& node = mNodes[stack.back()];
+        stack.pop_back();
+        if(!Overlaps(node.Min, node.Max, mn, mx))
+            continue;
+
+        if(node.Count > 0)
+        {
+            for(uint32 i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+            {
+                if(Overlaps(mItems[i].Min, mItems[i].Max, mn, mx))
+                    keys.push_back(mItems[i].Key);
+            }
+        }
+        else
+        {
+            stack.push_back(node.LeftFirst + 1);
+            stack.push_back(node.LeftFirst);
+        }
+    }
+}
+
+void BoundingVolumeHierarchy::QuerySphere(const BoundingSphere& sphere, std::vector<std::uint32_t>& keys)const
+{
+    for(uint32 i = mTreeItemCount; i < (uint32)mItems.size(); ++i)
+    {
+        if(OverlapsSphere(mItems[i].Min, mItems[i].Max, sphere))
+            keys.push_back(mItems[i].Key);
+    }
+    if(mNodes.empty())
+        return;
+
+    std::vector<uint32> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while(!stack.empty())
+    {
+        const Node& node = mNodes[stack.back()];
+        stack.pop_back();
+        if(!OverlapsSphere(node.Min, node.Max, sphere))
+            continue;
+
+        if(node.Count > 0)
+        {
+            for(uint32 i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+            {
+                if(OverlapsSphere(mItems[i].Min, mItems[i].Max, sphere))
+                    keys.push_back(mItems[i].Key);
+            }
+        }
+        else
+        {
+            stack.push_back(node.LeftFirst + 1);
+            stack.push_back(node.LeftFirst);
+        }
+    }
+}
+
+bool BoundingVolumeHierarchy::Raycast(FXMVECTOR origin, FXMVECTOR direction,
+    std::uint32_t& key, float& distance)const
+{
+    XMFLOAT3 o, invDir;
+    XMStoreFloat3(&o, origin);
+    XMStoreFloat3(&invDir, XMVectorReciprocal(direction));
+
+    float best = distance;
+    bool hit = false;
+
+    // Inserted items first; a hit among them prunes the tree walk.
+    for(uint32 i = mTreeItemCount; i < (uint32)mItems.size(); ++i)
+    {
+        float t = RayBox(o, invDir, mItems[i].Min, mItems[i].Max, best);
+        if(t != FLT_MAX && t <= best)
+        {
+            best = t;
+            key = mItems[i].Key;
+            hit = true;
+        }
+    }
+
+    // Entries are (node, entry distance); the nearer child is visited first
+    // so farther subtrees are usually pruned by the closest hit so far.
+    struct Entry
+    {
+        uint32 Node;
+        float T;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+
+    float rootT = mNodes.empty() ? FLT_MAX : RayBox(o, invDir, mNodes[0].Min, mNodes[0].Max, best);
+    if(rootT != FLT_MAX)
+        stack.push_back(Entry{ 0, rootT });
+
+    while(!stack.empty())
+    {
+        Entry entry = stack.back();
+        stack.pop_back();
+        if(entry.T > best)
+            continue;
+
+        const Node& node = mNodes[entry.Node];
+        if(node.Count > 0)
+        {
+            for(uint32 i = node.LeftFirst; i < node.LeftFirst + node.Count; ++i)
+            {
+                float t = RayBox(o, invDir, mItems[i].Min, mItems[i].Max, best);
+                if(t != FLT_MAX && t <= best)
+                {
+                    best = t;
+                    key = mItems[i].Key;
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        uint32 l = node.LeftFirst;
+        float tl = RayBox(o, invDir, mNodes[l].Min, mNodes[l].Max, best);
+        float tr = RayBox(o, invDir, mNodes[l + 1].Min, mNodes[l + 1].Max, best);
+        Entry nearEntry{ l, tl }, farEntry{ l + 1, tr };
+        if(tr < tl)
+            std::swap(nearEntry, farEntry);
+
+        if(farEntry.T != FLT_MAX)
+            stack.push_back(farEntry);
+        if(nearEntry.T != FLT_MAX)
+            stack.push_back(nearEntry);
+    }
+
+    if(hit)
+        distance = best;
+
+    return hit;
+}
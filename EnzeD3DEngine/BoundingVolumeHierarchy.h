@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "FrustumCuller.h"
+
+// Bounding volume hierarchy over axis-aligned boxes, each identified by a
+// caller-chosen key (EnzeApp uses the RenderItemHandle slot).
+//
+// Build() makes a binned-SAH tree.  Nodes live in one flat array, 32 bytes
+// each, and the two children of a node are always adjacent, so a node needs
+// a single child index.  Items are stored in leaf order next to their boxes.
+//
+// Moved items are handled incrementally: Update() records the new box and
+// Refit() recomputes only the nodes above moved items, applying tree
+// rotations (Kopta et al., "Fast, Effective BVH Updates for Animated Scenes")
+// on the way up so the tree does not degrade as items drift.
+//
+// Inserted items are kept outside the tree, after its items, and the queries
+// test them one by one; removed tree items stay in their leaf as tombstones
+// the queries skip.  Refit() builds a new tree from the live items once
+// there are enough of either to slow the queries down.
+class BoundingVolumeHierarchy
+{
+public:
+    // keys[i] identifies box i of boxes.  Keys should be small integers;
+    // items are looked up through a table of size max key + 1.
+    void Build(const AabbSoA& boxes, const std::uint32_t* keys);
+    void Clear();
+
+    // Inserted and removed items take effect for queries right away, moved
+    // ones at the next Refit().  Update() of a key that is not in the
+    // hierarchy inserts it; Remove() of one does nothing.
+    void Insert(std::uint32_t key, const DirectX::BoundingBox& box);
+    void Remove(std::uint32_t key);
+    void Update(std::uint32_t key, const DirectX::BoundingBox& box);
+    void Refit();
+
+    // The query functions append the keys of the matching items to keys.
+
+    // Items whose box is at least partly inside the frustum.
+    void QueryFrustum(const FrustumCuller::Planes& planes, std::vector<std::uint32_t>& keys)const;
+    // Items whose box overlaps box.
+    void QueryBox(const DirectX::BoundingBox& box, std::vector<std::uint32_t>& keys)const;
+    // Items whose box overlaps sphere.
+    void QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<std::uint32_t>& keys)const;
+
+    // Finds the item box that the ray origin + t*direction enters first, for
+    // t in [0, distance].  On a hit, returns true and sets key and distance.
+    bool Raycast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction,
+        std::uint32_t& key, float& distance)const;
+
+    size_t ItemCount()const { return mItems.size() - mDeadCount; }
+    size_t NodeCount()const { return mNodes.size(); }
+    // Items waiting outside the tree, and tombstones in it.
+    size_t LooseCount()const { return mItems.size() - mTreeItemCount; }
+    size_t DeadCount()const { return mDeadCount; }
+
+private:
+    struct Node
+    {
+        DirectX::XMFLOAT3 Min;
+        // Internal node: index of the left child, the right one follows it.
+        // Leaf: index of the first item.
+        std::uint32_t LeftFirst = 0;
+        DirectX::XMFLOAT3 Max;
+        // Number of items, 0 for internal nodes.
+        std::uint32_t Count = 0;
+    };
+
+    struct Item
+    {
+        DirectX::XMFLOAT3 Min;
+        // ~0u for a removed item.
+        std::uint32_t Key = 0;
+        DirectX::XMFLOAT3 Max;
+        // ~0u for an item outside the tree.
+        std::uint32_t Leaf = 0;
+    };
+
+    void SetLeaf(std::uint32_t node, std::uint32_t first, std::uint32_t count);
+    void RefitNode(std::uint32_t node);
+    void Rotate(std::uint32_t node);
+    void SwapNodes(std::uint32_t a, std::uint32_t b);
+    std::uint32_t FindItem(std::uint32_t key)const;
+    void BuildTree();
+    void Rebuild();
+
+    std::vector<Node> mNodes;
+    std::vector<std::uint32_t> mParents;
+    // [0, mTreeItemCount) in leaf order, then the inserted items.
+    std::vector<Item> mItems;
+    std::vector<std::uint32_t> mKeyToItem;
+    std::uint32_t mTreeItemCount = 0;
+    std::uint32_t mDeadCount = 0;
+
+    // Items changed by Update() and the nodes Refit() must revisit.
+    std::vector<std::uint32_t> mMovedItems;
+    std::vector<std::uint8_t> mNodeDirty;
+};
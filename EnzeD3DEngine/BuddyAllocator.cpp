@@ -0,0 +1,230 @@
+#include "BuddyAllocator.h"
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    const std::uint32_t NoBlock = ~0u;
+
+    std::uint32_t Log2(std::uint64_t value)
+    {
+        std::uint32_t log = 0;
+        while(value > 1)
+        {
+            value >>= 1;
+            ++log;
+        }
+        return log;
+    }
+
+#ifndef NDEBUG
+    bool IsPowerOfTwo(std::uint64_t value)
+    {
+        return value != 0 && (value & (value - 1)) == 0;
+    }
+#endif
+}
+
+BuddyAllocator::BuddyAllocator(std::uint64_t capacity, std::uint64_t minBlockSize)
+{
+    Reset(capacity, minBlockSize);
+}
+
+void BuddyAllocator::Reset(std::uint64_t capacity, std::uint64_t minBlockSize)
+{
+    assert(IsPowerOfTwo(capacity) && IsPowerOfTwo(minBlockSize) && capacity >= minBlockSize);
+
+    mCapacity = capacity;
+    mMinBlockSize = minBlockSize;
+    mMinBlockShift = Log2(minBlockSize);
+    mMaxOrder = Log2(capacity) - mMinBlockShift;
+
+    const size_t blockCount = (size_t)(capacity >> mMinBlockShift);
+    mOrder.assign(blockCount, 0);
+    mFree.assign(blockCount, 0);
+    mNext.assign(blockCount, NoBlock);
+    mPrev.assign(blockCount, NoBlock);
+    mFreeHeads.assign(mMaxOrder + 1, NoBlock);
+
+    mAllocationCount = 0;
+    mAllocatedBytes = 0;
+
+    // One free block spanning the whole range.
+    PushFree(0, mMaxOrder);
+}
+
+std::uint32_t BuddyAllocator::OrderForSize(std::uint64_t size)const
+{
+    std::uint32_t order = 0;
+    while((mMinBlockSize << order) < size)
+        ++order;
+    return order;
+}
+
+void BuddyAllocator::PushFree(std::uint32_t block, std::uint32_t order)
+{
+    mOrder[block] = (std::uint8_t)order;
+    mFree[block] = 1;
+    mPrev[block] = NoBlock;
+    mNext[block] = mFreeHeads[order];
+    if(mFreeHeads[order] != NoBlock)
+        mPrev[mFreeHeads[order]] = block;
+    mFreeHeads[order] = block;
+}
+
+void BuddyAllocator::RemoveFree(std::uint32_t block, std::uint32_t order)
+{
+    if(mPrev[block] != NoBlock)
+        mNext[mPrev[block]] = mNext[block];
+    else
+        mFreeHeads[order] = mNext[block];
+
+    if(mNext[block] != NoBlock)
+        mPrev[mNext[block]] = mPrev[block];
+
+    mFree[block] = 0;
+    mNext[block] = NoBlock;
+    mPrev[block] = NoBlock;
+}
+
+void BuddyAllocator::Take(std::uint32_t block, std::uint32_t blockOrder, std::uint32_t order)
+{
+    RemoveFree(block, blockOrder);
+
+    // Keep the lower half and free the upper one until the block fits.
+    while(blockOrder > order)
+    {
+        --blockOrder;
+        PushFree(block + (1u << blockOrder), blockOrder);
+    }
+
+    mOrder[block] = (std::uint8_t)order;
+    ++mAllocationCount;
+    mAllocatedBytes += mMinBlockSize << order;
+}
+
+std::uint64_t BuddyAllocator::Allocate(std::uint64_t size, std::uint64_t alignment)
+{
+    if(size == 0 || size > mCapacity || alignment > mCapacity)
+        return InvalidOffset;
+
+    // Blocks are aligned to their own size, so a block at least as large as
+    // the alignment satisfies it.
+    const std::uint32_t order = OrderForSize(std::max(size, alignment));
+
+    for(std::uint32_t blockOrder = order; blockOrder <= mMaxOrder; ++blockOrder)
+    {
+        const std::uint32_t block = mFreeHeads[blockOrder];
+        if(block == NoBlock)
+            continue;
+
+        Take(block, blockOrder, order);
+        return (std::uint64_t)block << mMinBlockShift;
+    }
+
+    return InvalidOffset;
+}
+
+void BuddyAllocator::Free(std::uint64_t offset)
+{
+    std::uint32_t block = (std::uint32_t)(offset >> mMinBlockShift);
+    assert(block < mFree.size() && !mFree[block]);
+
+    std::uint32_t order = mOrder[block];
+    --mAllocationCount;
+    mAllocatedBytes -= mMinBlockSize << order;
+
+    // Merge with the buddy for as long as it is a free block of the same size.
+    while(order < mMaxOrder)
+    {
+        const std::uint32_t buddy = block ^ (1u << order);
+        if(!mFree[buddy] || mOrder[buddy] != order)
+            break;
+
+        RemoveFree(buddy, order);
+        block = std::min(block, buddy);
+        ++order;
+    }
+
+    PushFree(block, order);
+}
+
+std::uint64_t BuddyAllocator::BlockSize(std::uint64_t offset)const
+{
+    return mMinBlockSize << mOrder[(size_t)(offset >> mMinBlockShift)];
+}
+
+std::uint32_t BuddyAllocator::FindLowestFree(std::uint32_t order, std::uint32_t limit, std::uint32_t& blockOrder)const
+{
+    std::uint32_t lowest = NoBlock;
+    for(std::uint32_t o = order; o <= mMaxOrder; ++o)
+    {
+        for(std::uint32_t block = mFreeHeads[o]; block != NoBlock; block = mNext[block])
+        {
+            if(block < limit && (lowest == NoBlock || block < lowest))
+            {
+                lowest = block;
+                blockOrder = o;
+            }
+        }
+    }
+    return lowest;
+}
+
+size_t BuddyAllocator::PlanCompaction(size_t maxMoves, std::vector<Move>& moves)
+{
+    if(maxMoves == 0 || mAllocationCount == 0)
+        return 0;
+
+    // Allocated blocks, walked in address order and moved from the top down.
+    std::vector<std::uint32_t> allocated;
+    allocated.reserve(mAllocationCount);
+    for(std::uint32_t block = 0; block < mFree.size(); block += 1u << mOrder[block])
+    {
+        if(!mFree[block])
+            allocated.push_back(block);
+    }
+
+    size_t moveCount = 0;
+    for(auto it = allocated.rbegin(); it != allocated.rend() && moveCount < maxMoves; ++it)
+    {
+        const std::uint32_t source = *it;
+        const std::uint32_t order = mOrder[source];
+
+        std::uint32_t destOrder = 0;
+        const std::uint32_t dest = FindLowestFree(order, source, destOrder);
+        if(dest == NoBlock)
+            continue;
+
+        Take(dest, destOrder, order);
+        Free((std::uint64_t)source << mMinBlockShift);
+
+        Move move;
+        move.SourceOffset = (std::uint64_t)source << mMinBlockShift;
+        move.DestOffset = (std::uint64_t)dest << mMinBlockShift;
+        move.Size = mMinBlockSize << order;
+        moves.push_back(move);
+        ++moveCount;
+    }
+
+    return moveCount;
+}
+
+std::uint64_t BuddyAllocator::LargestFreeBlock()const
+{
+    for(std::uint32_t order = mMaxOrder + 1; order-- > 0;)
+    {
+        if(mFreeHeads[order] != NoBlock)
+            return mMinBlockSize << order;
+    }
+    return 0;
+}
+
+float BuddyAllocator::Fragmentation()const
+{
+    const std::uint64_t freeBytes = FreeBytes();
+    if(freeBytes == 0)
+        return 0.0f;
+
+    return 1.0f - (float)((double)LargestFreeBlock() / (double)freeBytes);
+}
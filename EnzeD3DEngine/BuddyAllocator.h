@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Binary buddy allocator over a range of capacity bytes.  It only hands out
+// offsets, so it serves GPU heaps as well as anything else.
+//
+// The range is split into blocks whose sizes are powers of two between
+// minBlockSize and capacity.  A request is rounded up to the next block size
+// and every block starts at a multiple of its size, so an allocation is also
+// aligned to anything up to its rounded size.  Freeing merges a block with its
+// buddy whenever both are free.  Allocate and Free are O(log(capacity /
+// minBlockSize)); the free blocks of each size are intrusive lists over a
+// table with one entry per minimum block.
+class BuddyAllocator
+{
+public:
+    static const std::uint64_t InvalidOffset = ~0ull;
+
+    // A block that PlanCompaction() moved from SourceOffset to DestOffset.
+    struct Move
+    {
+        std::uint64_t SourceOffset;
+        std::uint64_t DestOffset;
+        std::uint64_t Size;
+    };
+
+    BuddyAllocator() = default;
+    // capacity and minBlockSize must be powers of two, capacity >= minBlockSize.
+    BuddyAllocator(std::uint64_t capacity, std::uint64_t minBlockSize);
+
+    void Reset(std::uint64_t capacity, std::uint64_t minBlockSize);
+
+    // Returns InvalidOffset when no free block is large enough.
+    std::uint64_t Allocate(std::uint64_t size, std::uint64_t alignment = 1);
+    // offset must come from Allocate() and not have been freed yet.
+    void Free(std::uint64_t offset);
+
+    // Size of the block holding an allocation.
+    std::uint64_t BlockSize(std::uint64_t offset)const;
+
+    // Defragmentation hook.  Moves up to maxMoves allocations, highest offset
+    // first, into free blocks of the same size at lower offsets, and appends
+    // each move to moves.  The bookkeeping is updated immediately: the caller
+    // must copy the data of the moves in order, since a later move may reuse
+    // an earlier move's source, and then update whatever refers to the old
+    // offsets.  Returns the number of moves made.
+    size_t PlanCompaction(size_t maxMoves, std::vector<Move>& moves);
+
+    std::uint64_t Capacity()const { return mCapacity; }
+    std::uint64_t MinBlockSize()const { return mMinBlockSize; }
+    size_t AllocationCount()const { return mAllocationCount; }
+    // Bytes in allocated blocks, rounding included.
+    std::uint64_t AllocatedBytes()const { return mAllocatedBytes; }
+    std::uint64_t FreeBytes()const { return mCapacity - mAllocatedBytes; }
+    std::uint64_t LargestFreeBlock()const;
+    // 0 when the free space is one block, approaching 1 as it splinters.
+    float Fragmentation()const;
+
+private:
+    std::uint32_t OrderForSize(std::uint64_t size)const;
+    void PushFree(std::uint32_t block, std::uint32_t order);
+    void RemoveFree(std::uint32_t block, std::uint32_t order);
+    // Marks the free block as allocated at order, returning the halves split
+    // off a larger block to the free lists.
+    void Take(std::uint32_t block, std::uint32_t blockOrder, std::uint32_t order);
+    // Lowest free block of at least order that starts below limit.
+    std::uint32_t FindLowestFree(std::uint32_t order, std::uint32_t limit, std::uint32_t& blockOrder)const;
+
+    std::uint64_t mCapacity = 0;
+    std::uint64_t mMinBlockSize = 0;
+    std::uint32_t mMinBlockShift = 0;
+    std::uint32_t mMaxOrder = 0;
+
+    // Per minimum block, valid where a block starts: its order, whether it is
+    // free, and its free list links (~0u ends a list).
+    std::vector<std::uint8_t> mOrder;
+    std::vector<std::uint8_t> mFree;
+    std::vector<std::uint32_t> mNext;
+    std::vector<std::uint32_t> mPrev;
+    // Head of the free list of each order.
+    std::vector<std::uint32_t> mFreeHeads;
+
+    size_t mAllocationCount = 0;
+    std::uint64_t mAllocatedBytes = 0;
+};
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "RenderCommandStream.h"
+
+// 64-bit draw sort key.  Sorting ascending groups draws by pipeline state,
+// then geometry, then material, and orders draws that share all three front
+// to back, so consecutive draws change as little state as possible.
+//
+//   63        56 55           40 39           24 23          0
+//   | pipeline  |   geometry    |   material    |    depth    |
+struct DrawSortKey
+{
+    static const int PipelineBits = 8;
+    static const int GeometryBits = 16;
+    static const int MaterialBits = 16;
+    static const int DepthBits = 24;
+
+    // Ids wrap at their field width; viewDepth below zero sorts as zero.
+    static std::uint64_t Make(std::uint32_t pipeline, std::uint32_t geometry,
+        std::uint32_t material, float viewDepth)
+    {
+        std::uint64_t key = pipeline & ((1u << PipelineBits) - 1);
+        key = (key << GeometryBits) | (geometry & ((1u << GeometryBits) - 1));
+        key = (key << MaterialBits) | (material & ((1u << MaterialBits) - 1));
+        key = (key << DepthBits) | QuantizeDepth(viewDepth);
+        return key;
+    }
+
+    // Non-negative floats order the same as their bit patterns, so the top
+    // DepthBits bits below the sign keep the order without a depth range.
+    static std::uint32_t QuantizeDepth(float viewDepth)
+    {
+        if(!(viewDepth > 0.0f))
+            return 0;
+
+        std::uint32_t bits;
+        std::memcpy(&bits, &viewDepth, sizeof(bits));
+        return bits >> (31 - DepthBits);
+    }
+};
+
+// Thin wrapper over a command sink that remembers the bound state and drops
+// calls that would rebind what is already bound.  The cache only knows about
+// calls made through the recorder: call Reset() whenever the sink is cleared
+// or bound directly.
+//
+// CommandList is RenderCommandStream in the app; any type with the same
+// member functions works, such as a mock that counts calls.
+template<typename CommandList>
+class BasicCommandRecorder
+{
+public:
+    struct Stats
+    {
+        // Calls forwarded to the sink, draws included.
+        std::uint32_t Calls = 0;
+        // Bind calls dropped because the state was already bound.
+        std::uint32_t RedundantCalls = 0;
+        std::uint32_t Draws = 0;
+        std::uint32_t Instances = 0;
+    };
+
+    static const std::uint32_t MaxRootParameters = 16;
+
+    explicit BasicCommandRecorder(CommandList* cmdList = nullptr)
+    {
+        Reset(cmdList);
+    }
+
+    // Forgets all cached state and records into cmdList from now on.  The
+    // statistics keep accumulating until ResetStats().
+    void Reset(CommandList* cmdList)
+    {
+        mCmdList = cmdList;
+        mPipelineState = nullptr;
+        mRootSignature = nullptr;
+        mVertexBufferBound = false;
+        mIndexBufferBound = false;
+        mTopology = 0;
+        InvalidateRootArguments();
+    }
+
+    CommandList* Get()const { return mCmdList; }
+
+    void SetPipelineState(void* pipelineState)
+    {
+        if(Redundant(mPipelineState == pipelineState))
+            return;
+
+        mPipelineState = pipelineState;
+        Forward();
+        mCmdList->SetPipelineState(pipelineState);
+    }
+
+    // Setting a root signature invalidates every root argument, even when it
+    // is the signature already bound, so only an identical signature is
+    // skipped and the cached arguments survive only then.
+    void SetGraphicsRootSignature(void* rootSignature)
+    {
+        if(Redundant(mRootSignature == rootSignature))
+            return;
+
+        mRootSignature = rootSignature;
+        InvalidateRootArguments();
+        Forward();
+        mCmdList->SetGraphicsRootSignature(rootSignature);
+    }
+
+    void SetVertexBuffer(const RenderVertexBufferView& view)
+    {
+        if(Redundant(mVertexBufferBound &&
+            std::memcmp(&mVertexBuffer, &view, sizeof(view)) == 0))
+            return;
+
+        mVertexBuffer = view;
+        mVertexBufferBound = true;
+        Forward();
+        mCmdList->SetVertexBuffer(view);
+    }
+
+    void SetIndexBuffer(const RenderIndexBufferView& view)
+    {
+        if(Redundant(mIndexBufferBound &&
+            std::memcmp(&mIndexBuffer, &view, sizeof(view)) == 0))
+            return;
+
+        mIndexBuffer = view;
+        mIndexBufferBound = true;
+        Forward();
+        mCmdList->SetIndexBuffer(view);
+    }
+
+    // D3D_PRIMITIVE_TOPOLOGY values; 0 (undefined) is never filtered.
+    void SetPrimitiveTopology(std::uint32_t topology)
+    {
+        if(Redundant(topology != 0 && mTopology == topology))
+            return;
+
+        mTopology = topology;
+        Forward();
+        mCmdList->SetPrimitiveTopology(topology);
+    }
+
+    void SetGraphicsRootConstantBufferView(std::uint32_t rootParameter, RenderGpuAddress address)
+    {
+        if(Redundant(!UpdateRootArgument(rootParameter, RootCbv, address)))
+            return;
+
+        Forward();
+        mCmdList->SetGraphicsRootConstantBufferView(rootParameter, address);
+    }
+
+    void SetGraphicsRootShaderResourceView(std::uint32_t rootParameter, RenderGpuAddress address)
+    {
+        if(Redundant(!UpdateRootArgument(rootParameter, RootSrv, address)))
+            return;
+
+        Forward();
+        mCmdList->SetGraphicsRootShaderResourceView(rootParameter, address);
+    }
+
+    // Only the last constant written to each parameter is remembered, so
+    // parameters holding several constants are filtered per write.
+    void SetGraphicsRoot32BitConstant(std::uint32_t rootParameter, std::uint32_t value, std::uint32_t destOffsetIn32BitValues)
+    {
+        std::uint64_t argument = ((std::uint64_t)destOffsetIn32BitValues << 32) | value;
+        if(Redundant(!UpdateRootArgument(rootParameter, RootConstant, argument)))
+            return;
+
+        Forward();
+        mCmdList->SetGraphicsRoot32BitConstant(rootParameter, value, destOffsetIn32BitValues);
+    }
+
+    void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+        std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation)
+    {
+        Forward();
+        ++mStats.Draws;
+        mStats.Instances += instanceCount;
+        mCmdList->DrawIndexedInstanced(indexCountPerInstance, instanceCount,
+            startIndexLocation, baseVertexLocation, startInstanceLocation);
+    }
+
+    const Stats& GetStats()const { return mStats; }
+    void ResetStats() { mStats = Stats(); }
+
+private:
+    enum RootArgumentKind : std::uint8_t
+    {
+        RootNone,
+        RootCbv,
+        RootSrv,
+        RootConstant
+    };
+
+    bool Redundant(bool redundant)
+    {
+        if(redundant)
+            ++mStats.RedundantCalls;
+        return redundant;
+    }
+
+    void Forward()
+    {
+        ++mStats.Calls;
+    }
+
+    // Returns false when the parameter already holds this argument.
+    // Parameters past MaxRootParameters are never cached.
+    bool UpdateRootArgument(std::uint32_t rootParameter, RootArgumentKind kind, std::uint64_t argument)
+    {
+        if(rootParameter >= MaxRootParameters)
+            return true;
+
+        if(mRootKind[rootParameter] == kind && mRootArgument[rootParameter] == argument)
+            return false;
+
+        mRootKind[rootParameter] = kind;
+        mRootArgument[rootParameter] = argument;
+        return true;
+    }
+
+    void InvalidateRootArguments()
+    {
+        for(std::uint32_t i = 0; i < MaxRootParameters; ++i)
+        {
+            mRootKind[i] = RootNone;
+            mRootArgument[i] = 0;
+        }
+    }
+
+    CommandList* mCmdList = nullptr;
+
+    void* mPipelineState = nullptr;
+    void* mRootSignature = nullptr;
+    RenderVertexBufferView mVertexBuffer;
+    RenderIndexBufferView mIndexBuffer;
+    bool mVertexBufferBound = false;
+    bool mIndexBufferBound = false;
+    std::uint32_t mTopology = 0;
+
+    RootArgumentKind mRootKind[MaxRootParameters];
+    std::uint64_t mRootArgument[MaxRootParameters];
+
+    Stats mStats;
+};
+
+using CommandRecorder = BasicCommandRecorder<RenderCommandStream>;
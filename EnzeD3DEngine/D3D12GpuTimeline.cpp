@@ -0,0 +1,63 @@
+#include "D3D12GpuTimeline.h"
+#include <chrono>
+
+namespace
+{
+    // A present that takes longer than this means the swap chain is lost;
+    // the frame goes ahead rather than hanging.
+    const DWORD LatencyWaitTimeoutMs = 1000;
+}
+
+D3D12GpuTimeline::D3D12GpuTimeline(ID3D12Device* device, ID3D12CommandQueue* queue) :
+    mQueue(queue)
+{
+    ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+    mFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if(mFenceEvent == nullptr)
+        ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+}
+
+D3D12GpuTimeline::~D3D12GpuTimeline()
+{
+    SetLatencyWaitableObject(nullptr);
+    CloseHandle(mFenceEvent);
+}
+
+void D3D12GpuTimeline::SetLatencyWaitableObject(HANDLE waitableObject)
+{
+    if(mLatencyWaitableObject != nullptr)
+        CloseHandle(mLatencyWaitableObject);
+    mLatencyWaitableObject = waitableObject;
+}
+
+void D3D12GpuTimeline::Signal(std::uint64_t value)
+{
+    ThrowIfFailed(mQueue->Signal(mFence.Get(), value));
+}
+
+std::uint64_t D3D12GpuTimeline::CompletedValue()
+{
+    return mFence->GetCompletedValue();
+}
+
+void D3D12GpuTimeline::WaitForValue(std::uint64_t value)
+{
+    if(mFence->GetCompletedValue() >= value)
+        return;
+
+    ThrowIfFailed(mFence->SetEventOnCompletion(value, mFenceEvent));
+    WaitForSingleObject(mFenceEvent, INFINITE);
+}
+
+void D3D12GpuTimeline::WaitForPresentLatency()
+{
+    if(mLatencyWaitableObject != nullptr)
+        WaitForSingleObjectEx(mLatencyWaitableObject, LatencyWaitTimeoutMs, TRUE);
+}
+
+double D3D12GpuTimeline::NowMs()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
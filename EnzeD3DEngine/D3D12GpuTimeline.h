@@ -0,0 +1,34 @@
+#pragma once
+#include "d3dUtil.h"
+#include "FramePacer.h"
+
+// GpuTimeline over a command queue and a fence of its own.  When given the
+// frame latency waitable object of a swap chain created with
+// DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT, WaitForPresentLatency()
+// blocks on it so the CPU does not start a frame the swap chain cannot take
+// yet.
+class D3D12GpuTimeline : public GpuTimeline
+{
+public:
+    D3D12GpuTimeline(ID3D12Device* device, ID3D12CommandQueue* queue);
+    D3D12GpuTimeline(const D3D12GpuTimeline& rhs) = delete;
+    D3D12GpuTimeline& operator=(const D3D12GpuTimeline& rhs) = delete;
+    ~D3D12GpuTimeline();
+
+    // Takes ownership of the handle; nullptr turns latency waits off.
+    void SetLatencyWaitableObject(HANDLE waitableObject);
+
+    void Signal(std::uint64_t value) override;
+    std::uint64_t CompletedValue() override;
+    void WaitForValue(std::uint64_t value) override;
+    void WaitForPresentLatency() override;
+    double NowMs() override;
+
+    ID3D12Fence* Fence()const { return mFence.Get(); }
+
+private:
+    ID3D12CommandQueue* mQueue = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+    HANDLE mFenceEvent = nullptr;
+    HANDLE mLatencyWaitableObject = nullptr;
+};
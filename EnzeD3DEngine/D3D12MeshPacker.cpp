@@ -0,0 +1,36 @@
+// MeshPacker's D3D12 part, kept apart so MeshPacker.cpp builds without
+// Windows.
+#include "MeshPacker.h"
+#include "GpuBufferAllocator.h"
+#include "UploadManager.h"
+#include "d3dUtil.h"
+
+std::unique_ptr<MeshGeometry> MeshPacker::CreateGeometry(GpuBufferAllocator& buffers,
+    UploadManager& uploads, const std::string& name)const
+{
+    const UINT vbByteSize = (UINT)mVertices.size() * sizeof(Vertex);
+    const UINT ibByteSize = IndexByteSize();
+
+    auto geo = std::make_unique<MeshGeometry>();
+    geo->Name = name;
+
+    // Both buffers are ranges of the allocator's page buffers, filled by the
+    // copy queue.
+    GpuBufferAllocation vb = uploads.UploadToBuffer(buffers, mVertices.data(), vbByteSize);
+    GpuBufferAllocation ib = uploads.UploadToBuffer(buffers, IndexData(), ibByteSize);
+    geo->VertexBufferGPU = vb.Resource;
+    geo->VertexBufferOffset = vb.Offset;
+    geo->IndexBufferGPU = ib.Resource;
+    geo->IndexBufferOffset = ib.Offset;
+
+    geo->VertexByteStride = sizeof(Vertex);
+    geo->VertexBufferByteSize = vbByteSize;
+    geo->IndexFormat = mIndexStride == sizeof(std::uint16_t) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+    geo->IndexBufferByteSize = ibByteSize;
+
+    geo->DrawArgs.reserve(mEntries.size());
+    for(const Entry& e : mEntries)
+        geo->DrawArgs[e.Name] = e.Submesh;
+
+    return geo;
+}
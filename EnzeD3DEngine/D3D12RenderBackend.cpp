@@ -0,0 +1,173 @@
+#include "D3D12RenderBackend.h"
+
+D3D12RenderBackend::D3D12RenderBackend(ID3D12GraphicsCommandList* cmdList) :
+    mCmdList(cmdList)
+{
+}
+
+void D3D12RenderBackend::Submit(const RenderCommandStream& stream)
+{
+    for(auto c = stream.Begin(); c != stream.End(); c = RenderCommandStream::Next(c))
+    {
+        switch(c->Type)
+        {
+        case RenderCommandType::SetPipelineState:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::SetPipelineState*>(c);
+            mCmdList->SetPipelineState(static_cast<ID3D12PipelineState*>(cmd->PipelineState));
+            break;
+        }
+        case RenderCommandType::SetRootSignature:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::SetRootSignature*>(c);
+            mCmdList->SetGraphicsRootSignature(static_cast<ID3D12RootSignature*>(cmd->RootSignature));
+            break;
+        }
+        case RenderCommandType::SetViewport:
+        {
+            auto& v = reinterpret_cast<const RenderCommand::SetViewport*>(c)->Viewport;
+            D3D12_VIEWPORT viewport = { v.TopLeftX, v.TopLeftY, v.Width, v.Height, v.MinDepth, v.MaxDepth };
+            mCmdList->RSSetViewports(1, &viewport);
+            break;
+        }
+        case RenderCommandType::SetScissorRect:
+        {
+            auto& r = reinterpret_cast<const RenderCommand::SetScissorRect*>(c)->Rect;
+            D3D12_RECT rect = { r.Left, r.Top, r.Right, r.Bottom };
+            mCmdList->RSSetScissorRects(1, &rect);
+            break;
+        }
+        case RenderCommandType::SetRenderTargets:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::SetRenderTargets*>(c);
+            D3D12_CPU_DESCRIPTOR_HANDLE rtv = { (SIZE_T)cmd->RenderTarget };
+            D3D12_CPU_DESCRIPTOR_HANDLE dsv = { (SIZE_T)cmd->DepthStencil };
+            mCmdList->OMSetRenderTargets(1, &rtv, true, cmd->DepthStencil != 0 ? &dsv : nullptr);
+            break;
+        }
+        case RenderCommandType::ClearRenderTarget:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::ClearRenderTarget*>(c);
+            D3D12_CPU_DESCRIPTOR_HANDLE rtv = { (SIZE_T)cmd->RenderTarget };
+            mCmdList->ClearRenderTargetView(rtv, cmd->Color, 0, nullptr);
+            break;
+        }
+        case RenderCommandType::ClearDepthStencil:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::ClearDepthStencil*>(c);
+            D3D12_CPU_DESCRIPTOR_HANDLE dsv = { (SIZE_T)cmd->DepthStencil };
+            mCmdList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL,
+                cmd->Depth, cmd->Stencil, 0, nullptr);
+            break;
+        }
+        case RenderCommandType::ResourceBarrier:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::ResourceBarrier*>(c);
+            auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(static_cast<ID3D12Resource*>(cmd->Resource),
+                ToResourceState(cmd->Before), ToResourceState(cmd->After));
+            mCmdList->ResourceBarrier(1, &barrier);
+            break;
+        }
+        case RenderCommandType::SetVertexBuffer:
+        {
+            auto& v = reinterpret_cast<const RenderCommand::SetVertexBuffer*>(c)->View;
+            D3D12_VERTEX_BUFFER_VIEW view = { v.BufferLocation, v.SizeInBytes, v.StrideInBytes };
+            mCmdList->IASetVertexBuffers(0, 1, &view);
+            break;
+        }
+        case RenderCommandType::SetIndexBuffer:
+        {
+            auto& v = reinterpret_cast<const RenderCommand::SetIndexBuffer*>(c)->View;
+            D3D12_INDEX_BUFFER_VIEW view = { v.BufferLocation, v.SizeInBytes, (DXGI_FORMAT)v.Format };
+            mCmdList->IASetIndexBuffer(&view);
+            break;
+        }
+        case RenderCommandType::SetPrimitiveTopology:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::SetPrimitiveTopology*>(c);
+            mCmdList->IASetPrimitiveTopology((D3D12_PRIMITIVE_TOPOLOGY)cmd->Topology);
+            break;
+        }
+        case RenderCommandType::SetRootConstantBufferView:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::SetRootView*>(c);
+            mCmdList->SetGraphicsRootConstantBufferView(cmd->RootParameter, cmd->Address);
+            break;
+        }
+        case RenderCommandType::SetRootShaderResourceView:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::SetRootView*>(c);
+            mCmdList->SetGraphicsRootShaderResourceView(cmd->RootParameter, cmd->Address);
+            break;
+        }
+        case RenderCommandType::SetRoot32BitConstant:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::SetRoot32BitConstant*>(c);
+            mCmdList->SetGraphicsRoot32BitConstant(cmd->RootParameter, cmd->Value, cmd->DestOffset);
+            break;
+        }
+        case RenderCommandType::DrawIndexedInstanced:
+        {
+            auto cmd = reinterpret_cast<const RenderCommand::DrawIndexedInstanced*>(c);
+            mCmdList->DrawIndexedInstanced(cmd->IndexCountPerInstance, cmd->InstanceCount,
+                cmd->StartIndexLocation, cmd->BaseVertexLocation, cmd->StartInstanceLocation);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+RenderVertexBufferView D3D12RenderBackend::ToStreamView(const D3D12_VERTEX_BUFFER_VIEW& view)
+{
+    RenderVertexBufferView v;
+    v.BufferLocation = view.BufferLocation;
+    v.SizeInBytes = view.SizeInBytes;
+    v.StrideInBytes = view.StrideInBytes;
+    return v;
+}
+
+RenderIndexBufferView D3D12RenderBackend::ToStreamView(const D3D12_INDEX_BUFFER_VIEW& view)
+{
+    RenderIndexBufferView v;
+    v.BufferLocation = view.BufferLocation;
+    v.SizeInBytes = view.SizeInBytes;
+    v.Format = (std::uint32_t)view.Format;
+    return v;
+}
+
+RenderViewport D3D12RenderBackend::ToStreamViewport(const D3D12_VIEWPORT& viewport)
+{
+    RenderViewport v;
+    v.TopLeftX = viewport.TopLeftX;
+    v.TopLeftY = viewport.TopLeftY;
+    v.Width = viewport.Width;
+    v.Height = viewport.Height;
+    v.MinDepth = viewport.MinDepth;
+    v.MaxDepth = viewport.MaxDepth;
+    return v;
+}
+
+RenderRect D3D12RenderBackend::ToStreamRect(const D3D12_RECT& rect)
+{
+    RenderRect r;
+    r.Left = rect.left;
+    r.Top = rect.top;
+    r.Right = rect.right;
+    r.Bottom = rect.bottom;
+    return r;
+}
+
+D3D12_RESOURCE_STATES D3D12RenderBackend::ToResourceState(RenderResourceState state)
+{
+    switch(state)
+    {
+    case RenderResourceState::RenderTarget: return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    case RenderResourceState::DepthWrite: return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+    case RenderResourceState::CopyDest: return D3D12_RESOURCE_STATE_COPY_DEST;
+    case RenderResourceState::GenericRead: return D3D12_RESOURCE_STATE_GENERIC_READ;
+    case RenderResourceState::Present:
+    default: return D3D12_RESOURCE_STATE_PRESENT;
+    }
+}
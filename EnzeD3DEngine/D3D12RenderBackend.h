@@ -0,0 +1,28 @@
+#pragma once
+#include "d3dUtil.h"
+#include "RenderBackend.h"
+
+// Replays RenderCommandStreams into a D3D12 graphics command list.  The
+// opaque pointers in the stream must be ID3D12PipelineState,
+// ID3D12RootSignature and ID3D12Resource objects.
+class D3D12RenderBackend : public RenderBackend
+{
+public:
+    explicit D3D12RenderBackend(ID3D12GraphicsCommandList* cmdList = nullptr);
+
+    // The list must be open for recording when Submit() is called.
+    void SetCommandList(ID3D12GraphicsCommandList* cmdList) { mCmdList = cmdList; }
+
+    void Submit(const RenderCommandStream& stream) override;
+
+    // Conversions for recording D3D12 objects into a stream.
+    static RenderVertexBufferView ToStreamView(const D3D12_VERTEX_BUFFER_VIEW& view);
+    static RenderIndexBufferView ToStreamView(const D3D12_INDEX_BUFFER_VIEW& view);
+    static RenderViewport ToStreamViewport(const D3D12_VIEWPORT& viewport);
+    static RenderRect ToStreamRect(const D3D12_RECT& rect);
+
+private:
+    static D3D12_RESOURCE_STATES ToResourceState(RenderResourceState state);
+
+    ID3D12GraphicsCommandList* mCmdList = nullptr;
+};
@@ -18,7 +18,9 @@ DXSample::DXSample(UINT width, UINT height, std::wstring name) :
     m_width(width),
     m_height(height),
     m_title(name),
-    m_useWarpDevice(false)
+    m_useWarpDevice(false),
+    m_requestedFramesInFlight(0),
+    m_requestedObjectFormat(-1)
 {
     WCHAR assetsPath[512];
     GetAssetsPath(assetsPath, _countof(assetsPath));
@@ -124,5 +126,15 @@ void DXSample::ParseCommandLineArgs(WCHAR* argv[], int argc)
             m_useWarpDevice = true;
             m_title = m_title + L" (WARP)";
         }
+        else if ((_wcsnicmp(argv[i], L"-frames", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/frames", wcslen(argv[i])) == 0) && i + 1 < argc)
+        {
+            m_requestedFramesInFlight = static_cast<UINT>(_wtoi(argv[++i]));
+        }
+        else if ((_wcsnicmp(argv[i], L"-objects", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/objects", wcslen(argv[i])) == 0) && i + 1 < argc)
+        {
+            m_requestedObjectFormat = _wtoi(argv[++i]);
+        }
     }
 }
@@ -57,6 +57,12 @@ protected:
     // Adapter info.
     bool m_useWarpDevice;
 
+    // Frames in flight asked for with -frames N, 0 when not given.
+    UINT m_requestedFramesInFlight;
+    // Object constant layout asked for with -objects N, an ObjectFormat;
+    // -1 when not given.
+    int m_requestedObjectFormat;
+
 private:
     // Root assets path.
     std::wstring m_assetsPath;
@@ -11,9 +11,41 @@
 
 #include "stdafx.h"
 #include "EnzeApp.h"
+#include <algorithm>
 #include <iostream>
+#include "AsyncGeometryBuilder.h"
 #include "GeometryGenerator.h"
+#include "MeshOptimizer.h"
+#include "MeshPacker.h"
 
+namespace
+{
+    // Dirty render items per UpdateObjectConstants job.
+    const std::uint32_t ObjectUpdateGrainSize = 512;
+    // Below this many render items a linear SIMD scan culls faster than the
+    // BVH; BvhBenchmarks measured the scan ahead up to 256k items.
+    const size_t BvhCullThreshold = 512 * 1024;
+    // Upper bound on the command lists a frame is recorded into, and the
+    // fewest batches worth giving a list of its own.
+    const UINT MaxFrameCommandLists = 8;
+    const std::uint32_t MinBatchesPerCommandList = 64;
+    // Starting size of the per-frame upload ring; it grows when full.
+    const UINT64 UploadRingInitialSize = 256 * 1024;
+    // Default heap reserved at a time for vertex and index buffers.
+    const UINT64 GeometryPageSize = 4 * 1024 * 1024;
+    // Starting size of the staging ring for geometry uploads.
+    const UINT64 UploadStagingInitialSize = 1024 * 1024;
+    // Frames between two frame pacing summaries in the debug output.
+    const std::uint64_t FramePacingLogInterval = 600;
+
+    void LogOptimizeResult(const char* name, const MeshOptimizer::OptimizeResult& result)
+    {
+        char buffer[256];
+        sprintf_s(buffer, "%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name,
+            result.Before.ACMR, result.After.ACMR, result.Before.ATVR, result.After.ATVR);
+        ::OutputDebugStringA(buffer);
+    }
+}
 
 EnzeApp::EnzeApp(UINT width, UINT height, std::wstring name) :
     DXSample(width, height, name),
@@ -26,6 +58,12 @@ EnzeApp::EnzeApp(UINT width, UINT height, std::wstring name) :
 
 void EnzeApp::OnInit()
 {
+    m_jobSystem = std::make_unique<JobSystem>();
+    if(m_requestedFramesInFlight != 0)
+        m_FramesInFlight = std::min<UINT>(m_requestedFramesInFlight, gMaxFramesInFlight);
+    if(m_requestedObjectFormat >= 0 && m_requestedObjectFormat < (int)ObjectFormat::Count)
+        m_ObjectFormat = (ObjectFormat)m_requestedObjectFormat;
+
     CreateSwapChainAndCommandThing();
 
     // Create descriptor heaps.
@@ -42,6 +80,7 @@ void EnzeApp::OnInit()
     DefineInputLayout();
     // Create the vertex buffer.
 
+    BuildBufferAllocators();
     BuildCommonGeoMetry();
     BuildMaterials();
     BuildRenderItems();
@@ -50,10 +89,18 @@ void EnzeApp::OnInit()
     InitProjMatrix();
     BuildPSO();
     
+    // The geometry goes out on the copy queue while the direct queue runs
+    // the init work, and the direct queue waits for it before anything else.
+    m_Uploads->Submit();
+
     ThrowIfFailed(m_commandList->Close());
     ID3D12CommandList* cmdsLists[] = { m_commandList.Get() };
     m_commandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
-    WaitForPreviousFrame();
+    m_Uploads->MakeQueueWait(m_commandQueue.Get());
+
+    // Nothing waits for the init work here: the frames after it are queued
+    // behind it, and shutdown waits for everything signaled.
+    m_FramePacer->Signal();
 }
 
 void EnzeApp::CreateSwapChainAndCommandThing()
@@ -117,6 +164,7 @@ void EnzeApp::CreateSwapChainAndCommandThing()
     swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
     swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
     swapChainDesc.SampleDesc.Count = 1;
+    swapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
 
     ComPtr<IDXGISwapChain1> swapChain;
     ThrowIfFailed(factory->CreateSwapChainForHwnd(
@@ -133,6 +181,10 @@ void EnzeApp::CreateSwapChainAndCommandThing()
 
     ThrowIfFailed(swapChain.As(&m_swapChain));
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+
+    // Let the swap chain queue no more frames than the CPU runs ahead, so
+    // waiting on it at the start of a frame bounds the input latency.
+    ThrowIfFailed(m_swapChain->SetMaximumFrameLatency(m_FramesInFlight));
     // create command allocator
     ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)));
     ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get(),  nullptr, IID_PPV_ARGS(&m_commandList)));
@@ -142,15 +194,9 @@ void EnzeApp::CreateSwapChainAndCommandThing()
     ThrowIfFailed(m_commandList->Close());
 
     // creating sychronization object
-    ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
-    m_fenceValue = 1;
-
-        // Create an event handle to use for frame synchronization.
-    m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-    if (m_fenceEvent == nullptr)
-    {
-        ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
-    }
+    m_GpuTimeline = std::make_unique<D3D12GpuTimeline>(m_device.Get(), m_commandQueue.Get());
+    m_GpuTimeline->SetLatencyWaitableObject(m_swapChain->GetFrameLatencyWaitableObject());
+    m_FramePacer = std::make_unique<FramePacer>(*m_GpuTimeline, m_FramesInFlight);
 }
 
 void EnzeApp::CreateDescHeaps()
@@ -228,15 +274,27 @@ void EnzeApp::CreateDepthResources()
 void EnzeApp::InitProjMatrix()
 {
     
-    XMStoreFloat4x4(&m_Proj, XMMatrixPerspectiveFovLH(0.25f * XM_PI, (float)m_width/(float)m_height, m_NearZ, m_FarZ));
+    Math::Mat4 proj = Math::MatPerspectiveFovLH(0.25f * XM_PI, (float)m_width/(float)m_height, m_NearZ, m_FarZ);
+    Math::Store(&m_Proj, proj);
+    Math::Store(&m_InvProj, Math::MatInversePerspectiveLH(proj));
+}
+
+void EnzeApp::BuildBufferAllocators()
+{
+    m_UploadRing = std::make_unique<UploadRingBuffer>(m_device.Get(), UploadRingInitialSize);
+    m_GeometryBuffers = std::make_unique<GpuBufferAllocator>(m_device.Get(), GeometryPageSize);
+    m_Uploads = std::make_unique<UploadManager>(m_device.Get(), UploadStagingInitialSize, m_GpuTimeline->Fence());
 }
 
 void EnzeApp::BuildFrameResources()
 {
-    for(int i = 0; i < gNumFrameResources; ++i)
+    // One command list per thread that can record at the same time.
+    m_CommandListCount = std::min<UINT>(m_jobSystem->WorkerCount() + 1, MaxFrameCommandLists);
+    m_ChunkResults.resize(m_CommandListCount);
+    for(UINT i = 0; i < m_FramesInFlight; ++i)
         {
             mFrameResources.push_back(std::make_unique<FrameResource>(m_device.Get(),
-                1, (UINT)mAllRitems.size(), (UINT)m_Materials.size()));
+                m_RenderItems.ObjectCBCapacity(), m_ObjectFormat, (UINT)m_MaterialRegistry.Count(), m_CommandListCount));
         }
 }
 
@@ -267,14 +325,17 @@ void EnzeApp::BuildRootSignature()
     // 用根常量代替根表。一会直接用resource的gpuaddress去更新它
     // 一个是给pass的，另外一个是给object的
     // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[3];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 
-    // Create root CBV.
-    slotRootParameter[0].InitAsConstantBufferView(0);
+    // 0: first instance of the current batch, 1: pass, 2: material table,
+    // 3: object constants, 4: per-instance data.
+    slotRootParameter[0].InitAsConstants(1, 0);
     slotRootParameter[1].InitAsConstantBufferView(1);
-    slotRootParameter[2].InitAsConstantBufferView(2);
+    slotRootParameter[2].InitAsShaderResourceView(2);
+    slotRootParameter[3].InitAsShaderResourceView(0);
+    slotRootParameter[4].InitAsShaderResourceView(1);
     // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, slotRootParameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
     // create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
     ComPtr<ID3DBlob> serializedRootSig = nullptr;
@@ -302,17 +363,17 @@ void EnzeApp::OnUpdate()
 {
     // Convert Spherical to Cartesian coordinates.
     UpdateCamera();
-    mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+    UpdateTransforms();
+    // Blocks only when the GPU is m_FramesInFlight frames behind.
+    mCurrFrameResourceIndex = (int)m_FramePacer->BeginFrame();
     mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
-    if (mCurrFrameResource->Fence != 0 &&
-     m_fence->GetCompletedValue() < mCurrFrameResource->Fence)
-    {
-        ThrowIfFailed(m_fence->SetEventOnCompletion(mCurrFrameResource->Fence, m_fenceEvent));
-        WaitForSingleObject(m_fenceEvent, INFINITE);
-    }
+    m_UploadRing->Retire(m_FramePacer->CompletedValue());
+    GrowFrameBuffers();
     UpdateObjectConstants();
     UpdateMainPass();
-    UpdateMaterialsCB();
+    UpdateMaterialBuffer();
+    CullRenderItems();
+    BatchVisibleItems();
 
 	// Update the constant buffer with the latest worldViewProj matrix.
 }
@@ -323,16 +384,23 @@ void EnzeApp::OnRender()
     // Record all the commands we need to render the scene into the command list.
     PopulateCommandList();
 
-    // Execute the command list.
-    ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+    // Uploads queued since the last frame, such as streamed geometry, must
+    // land before the frame that may draw them.
+    m_Uploads->Submit();
+    m_Uploads->MakeQueueWait(m_commandQueue.Get());
+
+    // Execute the command lists, in recording order.
+    m_commandQueue->ExecuteCommandLists((UINT)m_SubmitLists.size(), m_SubmitLists.data());
 
     // Present the frame.
     ThrowIfFailed(m_swapChain->Present(1, 0));
     // This must be update otherwise the swapchain 会在切换一次之后锁死直接崩掉
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
-    mCurrFrameResource->Fence = ++m_fenceValue;
-    m_commandQueue->Signal(m_fence.Get(), m_fenceValue);
+    mCurrFrameResource->Fence = m_FramePacer->EndFrame();
+    // Later uploads into the geometry pages wait for this frame's reads.
+    m_GeometryBuffers->MarkRead(mCurrFrameResource->Fence);
+    m_UploadRing->FinishFrame(mCurrFrameResource->Fence);
+    LogFramePacing();
 
 }
 
@@ -340,69 +408,198 @@ void EnzeApp::OnDestroy()
 {
     // Ensure that the GPU is no longer referencing resources that are about to be
     // cleaned up by the destructor.
-    WaitForPreviousFrame();
+    m_FramePacer->WaitForIdle();
+}
+
+// Waits for the GPU to go idle, then resizes the frame resource ring.  Frame
+// resources that are kept stay current; new ones write every item and
+// material on their first frame.
+void EnzeApp::SetFramesInFlight(UINT count)
+{
+    count = std::max<UINT>(1, std::min<UINT>(count, gMaxFramesInFlight));
+    if(count == m_FramesInFlight)
+        return;
+
+    m_FramePacer->SetFramesInFlight(count);
+    ThrowIfFailed(m_swapChain->SetMaximumFrameLatency(count));
 
-    CloseHandle(m_fenceEvent);
+    mFrameResources.resize(std::min<size_t>(mFrameResources.size(), count));
+    while(mFrameResources.size() < count)
+    {
+        mFrameResources.push_back(std::make_unique<FrameResource>(m_device.Get(),
+            m_RenderItems.ObjectCBCapacity(), m_ObjectFormat, (UINT)m_MaterialRegistry.Count(), m_CommandListCount));
+    }
+    mCurrFrameResource = nullptr;
+    m_FramesInFlight = count;
 }
 
+void EnzeApp::OnKeyDown(UINT8 key)
+{
+    if(key >= '1' && key <= '4')
+        SetFramesInFlight(key - '0');
+}
 
-void EnzeApp::UpdateMaterialsCB()
+void EnzeApp::LogFramePacing()
 {
-    auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
-    for (auto &e: m_Materials)
-    {
-        Material *mat = e.second.get();
-        if(mat->NumFramesDirty > 0)
-        {
-            XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
+    if(m_FramePacer->FrameCount() % FramePacingLogInterval != 0)
+        return;
+
+    const FramePacer::Telemetry& telemetry = m_FramePacer->GetTelemetry();
+    if(telemetry.Frames == 0)
+        return;
 
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+    char buffer[256];
+    sprintf_s(buffer, "Frame pacing: %u in flight, %llu/%llu frames waited, CPU wait %.3f ms avg, %.3f ms max (%.3f ms on the swap chain)\n",
+        m_FramePacer->FramesInFlight(), telemetry.StalledFrames, telemetry.Frames,
+        telemetry.TotalWaitMs / telemetry.Frames, telemetry.MaxWaitMs,
+        telemetry.TotalLatencyWaitMs / telemetry.Frames);
+    ::OutputDebugStringA(buffer);
 
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
+    m_FramePacer->ResetTelemetry();
+}
+
+
+// Render items and materials can be added at runtime, so the current frame
+// resource's persistent buffers are grown to fit them before they are
+// written.  Its previous frame has completed, so the old buffers can go.
+void EnzeApp::GrowFrameBuffers()
+{
+    auto objectBuffer = mCurrFrameResource->ObjectBuffer.get();
+    UINT objectCount = m_RenderItems.ObjectCBCapacity();
+    if(objectBuffer->ElementCount() < objectCount)
+        objectBuffer->Resize(m_device.Get(), std::max<UINT>(objectCount, objectBuffer->ElementCount() * 2));
+
+    auto materialBuffer = mCurrFrameResource->MaterialBuffer.get();
+    UINT materialCount = (UINT)m_MaterialRegistry.Count();
+    if(materialBuffer->ElementCount() < materialCount)
+        materialBuffer->Resize(m_device.Get(), std::max<UINT>(materialCount, materialBuffer->ElementCount() * 2));
+}
+
+// Rewrites the material table entries changed since this frame resource was
+// last written: the registry's dirty list, or every material for a frame
+// resource that has never been written.
+void EnzeApp::UpdateMaterialBuffer()
+{
+    auto materialBuffer = mCurrFrameResource->MaterialBuffer.get();
+    const std::uint64_t synced = mCurrFrameResource->MaterialGeneration;
+    auto writeMaterial = [materialBuffer](const Material& mat)
+    {
+        XMMATRIX matTransform = XMLoadFloat4x4(&mat.MatTransform);
+
+        MaterialConstants matConstants;
+        matConstants.DiffuseAlbedo = mat.DiffuseAlbedo;
+        matConstants.FresnelR0 = mat.FresnelR0;
+        matConstants.Roughness = mat.Roughness;
+        XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+        materialBuffer->CopyData(mat.MatCBIndex, matConstants);
+    };
+
+    if(synced == 0)
+    {
+        for(std::uint32_t id = 0; id < (std::uint32_t)m_MaterialRegistry.Count(); ++id)
+            writeMaterial(*m_MaterialRegistry.Get(id));
+    }
+    else
+    {
+        for(std::uint32_t id : m_MaterialRegistry.DirtyMaterials())
+        {
+            const Material* mat = m_MaterialRegistry.Get(id);
+            if(mat->ChangeGeneration > synced)
+                writeMaterial(*mat);
         }
     }
 
+    // Materials stay on the dirty list until the frame resource furthest
+    // behind has them.
+    mCurrFrameResource->MaterialGeneration = m_MaterialRegistry.Generation();
+    std::uint64_t oldest = mCurrFrameResource->MaterialGeneration;
+    for(const auto& frameResource : mFrameResources)
+        oldest = std::min<std::uint64_t>(oldest, frameResource->MaterialGeneration);
+    m_MaterialRegistry.RetireDirty(oldest);
 }
 
 void EnzeApp::UpdateObjectConstants() 
 {
-    auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-    for(auto &e: mAllRitems)
+    // Only items changed since this frame resource was last written are
+    // visited: the dirty list, or every item for a frame resource that has
+    // never been written.  Each ObjCBIndex is owned by a single item, so the
+    // chunks write disjoint constant buffer elements.
+    auto currObjectCB = mCurrFrameResource->ObjectBuffer.get();
+    const std::uint64_t synced = mCurrFrameResource->ObjectGeneration;
+    const bool writeAll = synced == 0;
+    const Math::Float4x4* worlds = MathHelper::AsFloat4x4(m_RenderItems.Worlds().data());
+    const UINT* objCBIndices = m_RenderItems.ObjCBIndices().data();
+    BYTE* objectData = currObjectCB->MappedElement(0);
+    const size_t objectStride = currObjectCB->ElementByteSize();
+
+    const ObjectFormat format = m_ObjectFormat;
+
+    if(writeAll)
     {
-        if(e->NumFramesDirty > 0) {
-            XMMATRIX world = XMLoadFloat4x4(&e->World);
-            ObjectConstants objConstant;
-            XMStoreFloat4x4(&objConstant.World, XMMatrixTranspose(world));
-            currObjectCB->CopyData(e->ObjCBIndex, objConstant);
-            e->NumFramesDirty --;
-        }
+        // The elements are encoded straight into the mapped buffer.
+        m_jobSystem->ParallelFor((std::uint32_t)m_RenderItems.Size(), ObjectUpdateGrainSize,
+            [worlds, objCBIndices, objectData, objectStride, format](std::uint32_t begin, std::uint32_t end)
+        {
+            ObjectPacking::PackObjects(format, worlds + begin, nullptr, end - begin,
+                objCBIndices + begin, objectData, objectStride);
+        });
+    }
+    else
+    {
+        // The dirty list is in the order items changed, which scatters the
+        // writes over the buffer.  The items this frame resource lacks are
+        // sorted by element instead and split into line-aligned ranges, so
+        // each job streams through its own part of the mapped memory.
+        m_ObjectUpdateItems.clear();
+        m_RenderItems.CollectChangedSince(synced, m_ObjectUpdateItems);
+        ObjectPacking::SortIntoRanges(m_ObjectUpdateItems, objCBIndices, objectStride, ObjectUpdateGrainSize,
+            m_ObjectUpdateRanges, m_ObjectUpdateKeys);
+
+        const std::uint32_t* items = m_ObjectUpdateItems.data();
+        const std::uint32_t* ranges = m_ObjectUpdateRanges.data();
+        m_jobSystem->ParallelFor((std::uint32_t)m_ObjectUpdateRanges.size() - 1, 1,
+            [items, ranges, worlds, objCBIndices, objectData, objectStride, format](std::uint32_t begin, std::uint32_t end)
+        {
+            for(std::uint32_t r = begin; r < end; ++r)
+            {
+                ObjectPacking::PackObjects(format, worlds, items + ranges[r], ranges[r + 1] - ranges[r],
+                    objCBIndices, objectData, objectStride);
+            }
+        });
     }
-    
 
+    // Items stay on the dirty list until the frame resource furthest behind
+    // has them.
+    mCurrFrameResource->ObjectGeneration = m_RenderItems.Generation();
+    std::uint64_t oldest = mCurrFrameResource->ObjectGeneration;
+    for(const auto& frameResource : mFrameResources)
+        oldest = std::min<std::uint64_t>(oldest, frameResource->ObjectGeneration);
+    m_RenderItems.RetireDirty(oldest);
 }
 
 void EnzeApp::UpdateMainPass()
 {
+    // The view is a rigid transform and the projection's inverse is cached
+    // with it, so no general 4x4 inverse is needed: inv(view * proj) is
+    // inv(proj) * inv(view).
     PassConstants tempPassCB;
-    XMMATRIX view = XMLoadFloat4x4(&m_View);
-	XMMATRIX proj = XMLoadFloat4x4(&m_Proj);
-
-	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
-    XMStoreFloat4x4(&tempPassCB.ViewMatrix, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&tempPassCB.InvView, XMMatrixTranspose(invView));
-	XMStoreFloat4x4(&tempPassCB.ProjMatrix, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&tempPassCB.InvProj, XMMatrixTranspose(invProj));
-	XMStoreFloat4x4(&tempPassCB.ViewProj, XMMatrixTranspose(viewProj));
-	XMStoreFloat4x4(&tempPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+    Math::Mat4 view = Math::Load(m_View);
+    Math::Mat4 proj = Math::Load(m_Proj);
+    Math::Mat4 invView = Math::MatInverseRigid(view);
+    Math::Mat4 invProj = Math::Load(m_InvProj);
+    Math::Mat4 viewProj = Math::MatMultiply(view, proj);
+    Math::Mat4 invViewProj = Math::MatMultiply(invProj, invView);
+
+    XMFLOAT4X4 viewProjF;
+    Math::Store(&viewProjF, viewProj);
+    m_FrustumPlanes = FrustumCuller::ExtractPlanes(XMLoadFloat4x4(&viewProjF));
+
+    Math::Store(&tempPassCB.ViewMatrix, Math::MatTranspose(view));
+    Math::Store(&tempPassCB.InvView, Math::MatTranspose(invView));
+    Math::Store(&tempPassCB.ProjMatrix, Math::MatTranspose(proj));
+    Math::Store(&tempPassCB.InvProj, Math::MatTranspose(invProj));
+    Math::Store(&tempPassCB.ViewProj, Math::MatTranspose(viewProj));
+    Math::Store(&tempPassCB.InvViewProj, Math::MatTranspose(invViewProj));
     tempPassCB.EyePosW = m_EyePos;
     tempPassCB.NearZ = m_NearZ;
     tempPassCB.FarZ = m_FarZ;
@@ -416,9 +613,53 @@ void EnzeApp::UpdateMainPass()
 
 	tempPassCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
 	tempPassCB.Lights[2].Strength = { 0.15f, 0.15f, 0.15f };
-    auto currPassCB = mCurrFrameResource->PassCB.get();
-    currPassCB->CopyData(0, tempPassCB);
+    m_PassCBAddress = m_UploadRing->Upload(&tempPassCB, 1);
+
+}
+
+void EnzeApp::CullRenderItems()
+{
+    // Refit every frame, even when the linear scan culls, so the tree is
+    // current for picking and its list of moved items does not grow.
+    m_RenderItems.RefitBvh();
 
+    if(m_RenderItems.Size() >= BvhCullThreshold)
+    {
+        m_QueryKeys.clear();
+        m_RenderItems.Bvh().QueryFrustum(m_FrustumPlanes, m_QueryKeys);
+
+        m_VisibleItems.resize(m_QueryKeys.size());
+        for(size_t i = 0; i < m_QueryKeys.size(); ++i)
+            m_VisibleItems[i] = m_RenderItems.DenseIndexOfSlot(m_QueryKeys[i]);
+        return;
+    }
+
+    const AabbSoA& bounds = m_RenderItems.WorldBounds();
+    m_VisibleItems.resize(bounds.Size());
+    size_t visibleCount = FrustumCuller::Cull(m_FrustumPlanes, bounds, 0, bounds.Size(), m_VisibleItems.data());
+    m_VisibleItems.resize(visibleCount);
+}
+
+void EnzeApp::BatchVisibleItems()
+{
+    // View depth of each visible item's box center, for the front-to-back
+    // part of the batch sort key.
+    const AabbSoA& bounds = m_RenderItems.WorldBounds();
+    m_VisibleDepths.resize(m_VisibleItems.size());
+    for(size_t i = 0; i < m_VisibleItems.size(); ++i)
+    {
+        std::uint32_t item = m_VisibleItems[i];
+        m_VisibleDepths[i] = bounds.CenterX[item] * m_View._13 + bounds.CenterY[item] * m_View._23 +
+            bounds.CenterZ[item] * m_View._33 + m_View._43;
+    }
+
+    m_Batcher.Build(m_RenderItems, m_VisibleItems.data(), m_VisibleItems.size(), m_VisibleDepths.data());
+    m_Batcher.SortBatches(m_RenderItems);
+
+    const std::vector<InstanceData>& instances = m_Batcher.Instances();
+    m_InstanceAddress = 0;
+    if(!instances.empty())
+        m_InstanceAddress = m_UploadRing->Upload(instances.data(), instances.size());
 }
 
 void EnzeApp::UpdateCamera()
@@ -437,88 +678,107 @@ void EnzeApp::UpdateCamera()
 	XMStoreFloat4x4(&m_View, view);
 }
 
-// to render every single object in the group.
-void EnzeApp::RenderGroupItems() 
-{
-    UINT objCBBytesSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
-    auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-    auto matCB = mCurrFrameResource->MaterialCB->Resource();
-    for(size_t i = 0; i < mOpaqueRitems.size(); i++) {
-        auto ri = mOpaqueRitems[i];
-        m_commandList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        m_commandList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        
-        m_commandList->IASetPrimitiveTopology(ri->PrimitiveType);
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress();
-        objCBAddress += ri->ObjCBIndex * objCBBytesSize;
-        m_commandList->SetGraphicsRootConstantBufferView(0, objCBAddress);
-        D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB ->GetGPUVirtualAddress();
-        matCBAddress += ri->Mat->MatCBIndex * matCBByteSize;
-        m_commandList->SetGraphicsRootConstantBufferView(2, matCBAddress);
-        m_commandList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+// Draws batches [begin, end) with one DrawIndexedInstanced each.  The
+// batches are sorted by state and the recorder drops the binds that repeat.
+void EnzeApp::RenderGroupItems(std::uint32_t begin, std::uint32_t end, CommandRecorder& recorder)
+{
+    // Instances index the material table themselves, so it is bound once
+    // rather than per draw.
+    recorder.SetGraphicsRootShaderResourceView(2, mCurrFrameResource->MaterialBuffer->Resource()->GetGPUVirtualAddress());
+    recorder.SetGraphicsRootShaderResourceView(3, mCurrFrameResource->ObjectBuffer->Resource()->GetGPUVirtualAddress());
+    recorder.SetGraphicsRootShaderResourceView(4, m_InstanceAddress);
+
+    const auto& drawStates = m_RenderItems.DrawStates();
+    const auto& batches = m_Batcher.Batches();
+    for(std::uint32_t i = begin; i < end; ++i) {
+        const InstanceBatch& batch = batches[i];
+        const DrawState& state = drawStates[batch.DrawState];
+        recorder.SetVertexBuffer(D3D12RenderBackend::ToStreamView(state.Geo->VertexBufferView()));
+        recorder.SetIndexBuffer(D3D12RenderBackend::ToStreamView(state.Geo->IndexBufferView()));
+        recorder.SetPrimitiveTopology(state.PrimitiveType);
+        recorder.SetGraphicsRoot32BitConstant(0, batch.InstanceOffset, 0);
+        recorder.DrawIndexedInstanced(state.IndexCount, batch.InstanceCount,
+            state.StartIndexLocation, state.BaseVertexLocation, 0);
     }
 }
 
-void EnzeApp::PopulateCommandList()
+// Records one command list's share of the frame.  Every list binds its own
+// state; only the first one clears and only the last one transitions the
+// back buffer back to present.  Nothing here touches a command list, so the
+// frame can be recorded without a D3D12 device.
+void EnzeApp::RecordChunk(std::uint32_t chunk, std::uint32_t begin, std::uint32_t end,
+    RenderCommandStream& stream, CommandRecorder& recorder)
 {
-    // Command list allocators can only be reset when the associated 
-    // command lists have finished execution on the GPU; apps should use 
-    // fences to determine GPU execution progress.
-    auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
-    ThrowIfFailed(cmdListAlloc->Reset());
-
-    // However, when ExecuteCommandList() is called on a particular command 
-    // list, that command list can then be reset at any time and must be before 
-    // re-recording.
-    ThrowIfFailed(m_commandList->Reset(cmdListAlloc.Get(), m_pipelineState.Get()));
+    recorder.SetPipelineState(m_pipelineState.Get());
 
     // Set necessary state.
-    m_commandList->RSSetViewports(1, &m_viewport);
-    m_commandList->RSSetScissorRects(1, &m_scissorRect);
+    stream.SetViewport(D3D12RenderBackend::ToStreamViewport(m_viewport));
+    stream.SetScissorRect(D3D12RenderBackend::ToStreamRect(m_scissorRect));
 
-    // Indicate that the back buffer will be used as a render target.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(),
-     D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
-    // Record commands.
     CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart(), m_frameIndex, m_rtvDescriptorSize);
-    m_commandList->ClearRenderTargetView(rtvHandle, Colors::LightSteelBlue, 0, nullptr);
     CD3DX12_CPU_DESCRIPTOR_HANDLE depthStencilHandle(m_depthStencilHeap->GetCPUDescriptorHandleForHeapStart());
-    m_commandList->ClearDepthStencilView(depthStencilHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-    m_commandList->OMSetRenderTargets(1, &rtvHandle, true, &depthStencilHandle);
+    if(chunk == 0) {
+        // Indicate that the back buffer will be used as a render target.
+        stream.ResourceBarrier(m_renderTargets[m_frameIndex].Get(),
+            RenderResourceState::Present, RenderResourceState::RenderTarget);
+        stream.ClearRenderTarget(rtvHandle.ptr, Colors::LightSteelBlue);
+        stream.ClearDepthStencil(depthStencilHandle.ptr, 1.0f, 0);
+    }
+    stream.SetRenderTargets(rtvHandle.ptr, depthStencilHandle.ptr);
 
-    m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
+    recorder.SetGraphicsRootSignature(m_rootSignature.Get());
     // 把world matrix 先扔进去
-    auto passCB = mCurrFrameResource->PassCB->Resource();
-    m_commandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
-    RenderGroupItems();
+    recorder.SetGraphicsRootConstantBufferView(1, m_PassCBAddress);
+    RenderGroupItems(begin, end, recorder);
 
-    // Indicate that the back buffer will now be used to present.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
-
-    ThrowIfFailed(m_commandList->Close());
+    if(chunk + 1 == m_ParallelRecorder.ChunkCount()) {
+        // Indicate that the back buffer will now be used to present.
+        stream.ResourceBarrier(m_renderTargets[m_frameIndex].Get(),
+            RenderResourceState::RenderTarget, RenderResourceState::Present);
+    }
 }
 
-void EnzeApp::WaitForPreviousFrame()
+// Replays a recorded chunk into the frame's command list of the same index.
+// Runs on worker threads, so failures are returned instead of thrown.
+HRESULT EnzeApp::ReplayChunk(std::uint32_t chunk, const RenderCommandStream& stream)
 {
-    // WAITING FOR THE FRAME TO COMPLETE BEFORE CONTINUING IS NOT BEST PRACTICE.
-    // This is code implemented as such for simplicity. The D3D12HelloFrameBuffering
-    // sample illustrates how to use fences for efficient resource usage and to
-    // maximize GPU utilization.
-
-    // Signal and increment the fence value.
-    const UINT64 fence = m_fenceValue;
-    ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fence));
-    m_fenceValue++;
+    // Command list allocators can only be reset when the associated 
+    // command lists have finished execution on the GPU; apps should use 
+    // fences to determine GPU execution progress.
+    ID3D12CommandAllocator* cmdListAlloc = mCurrFrameResource->CmdListAllocs[chunk].Get();
+    ID3D12GraphicsCommandList* cmdList = mCurrFrameResource->CmdLists[chunk].Get();
+    HRESULT hr = cmdListAlloc->Reset();
+    if(FAILED(hr))
+        return hr;
+
+    // The pipeline state comes from the stream.
+    hr = cmdList->Reset(cmdListAlloc, nullptr);
+    if(FAILED(hr))
+        return hr;
+
+    D3D12RenderBackend backend(cmdList);
+    backend.Submit(stream);
+    return cmdList->Close();
+}
 
-    // Wait until the previous frame is finished.
-    if (m_fence->GetCompletedValue() < fence)
+// Splits the sorted batches across the frame's command lists; each job
+// records its chunk and replays it into its own list.
+void EnzeApp::PopulateCommandList()
+{
+    std::uint32_t chunkCount = m_ParallelRecorder.Record(*m_jobSystem, (std::uint32_t)m_Batcher.Batches().size(),
+        m_CommandListCount, MinBatchesPerCommandList,
+        [this](std::uint32_t chunk, std::uint32_t begin, std::uint32_t end,
+            RenderCommandStream& stream, CommandRecorder& recorder)
     {
-        ThrowIfFailed(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
-        WaitForSingleObject(m_fenceEvent, INFINITE);
+        RecordChunk(chunk, begin, end, stream, recorder);
+        m_ChunkResults[chunk] = ReplayChunk(chunk, stream);
+    });
+
+    m_SubmitLists.clear();
+    for(std::uint32_t chunk = 0; chunk < chunkCount; ++chunk) {
+        ThrowIfFailed(m_ChunkResults[chunk]);
+        m_SubmitLists.push_back(mCurrFrameResource->CmdLists[chunk].Get());
     }
-
-    m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 }
 
 void EnzeApp::DefineInputLayout()
@@ -539,219 +799,158 @@ void EnzeApp::CompileShader()
     UINT compileFlags = 0;
 #endif
 
-    ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "VSMain", "vs_5_1", compileFlags, 0, &m_vertexShader, nullptr));
-    ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "PSMain", "ps_5_1", compileFlags, 0, &m_pixelShader, nullptr));
+    // The vertex shader decodes gObjects in m_ObjectFormat.
+    char objectFormat[4];
+    sprintf_s(objectFormat, "%u", (UINT)m_ObjectFormat);
+    const D3D_SHADER_MACRO defines[] =
+    {
+        { "OBJECT_FORMAT", objectFormat },
+        { nullptr, nullptr }
+    };
+
+    ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), defines, nullptr, "VSMain", "vs_5_1", compileFlags, 0, &m_vertexShader, nullptr));
+    ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), defines, nullptr, "PSMain", "ps_5_1", compileFlags, 0, &m_pixelShader, nullptr));
 }
 
 
 
+// Material definitions are data: materials.txt sits next to shaders.hlsl
+// and the registry gives each material its id in the material table.
 void EnzeApp::BuildMaterials()
 {
-
-    auto bricks0 = std::make_unique<Material>();
-	bricks0->Name = "bricks0";
-	bricks0->MatCBIndex = 0;
-	bricks0->DiffuseSrvHeapIndex = 0;
-	bricks0->DiffuseAlbedo = XMFLOAT4(Colors::ForestGreen);
-	bricks0->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	bricks0->Roughness = 0.1f;
-
-	auto stone0 = std::make_unique<Material>();
-	stone0->Name = "stone0";
-	stone0->MatCBIndex = 1;
-	stone0->DiffuseSrvHeapIndex = 1;
-	stone0->DiffuseAlbedo = XMFLOAT4(Colors::LightSteelBlue);
-	stone0->FresnelR0 = XMFLOAT3(0.05f, 0.05f, 0.05f);
-	stone0->Roughness = 0.3f;
- 
-	auto tile0 = std::make_unique<Material>();
-	tile0->Name = "tile0";
-	tile0->MatCBIndex = 2;
-	tile0->DiffuseSrvHeapIndex = 2;
-	tile0->DiffuseAlbedo = XMFLOAT4(Colors::LightGray);
-	tile0->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	tile0->Roughness = 0.2f;
-
-	auto skullMat = std::make_unique<Material>();
-	skullMat->Name = "skullMat";
-	skullMat->MatCBIndex = 3;
-	skullMat->DiffuseSrvHeapIndex = 3;
-	skullMat->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	skullMat->FresnelR0 = XMFLOAT3(0.05f, 0.05f, 0.05);
-	skullMat->Roughness = 0.3f;
-	
-	m_Materials["bricks0"] = std::move(bricks0);
-	m_Materials["stone0"] = std::move(stone0);
-	m_Materials["tile0"] = std::move(tile0);
-	m_Materials["skullMat"] = std::move(skullMat);
+    std::string error;
+    if(!m_MaterialRegistry.LoadFile(GetAssetFullPath(L"materials.txt"), &error))
+    {
+        error += "\n";
+        ::OutputDebugStringA(error.c_str());
+        throw std::runtime_error(error);
+    }
 }
 
 void EnzeApp::BuildCommonGeoMetry()
 {
-    GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3);
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
-
 	//
-	// We are concatenating all the geometry into one big vertex/index buffer.  So
-	// define the regions in the buffer each submesh covers.
+	// Every mesh is generated and optimized as its own job; the packer then
+	// concatenates them into one big vertex/index buffer and fills DrawArgs.
 	//
 
-	// Cache the vertex offsets to each object in the concatenated vertex buffer.
-	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
-	UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-
-	// Cache the starting index for each object in the concatenated index buffer.
-	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
-	UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-
-    // Define the SubmeshGeometry that cover different 
-    // regions of the vertex/index buffers.
-
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-	gridSubmesh.StartIndexLocation = gridIndexOffset;
-	gridSubmesh.BaseVertexLocation = gridVertexOffset;
-
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
+	AsyncGeometryBuilder builder(*m_jobSystem);
+	builder.AddBox("box", 1.5f, 0.5f, 1.5f, 3);
+	builder.AddGrid("grid", 20.0f, 30.0f, 60, 40);
+	builder.AddSphere("sphere", 0.5f, 20, 20);
+	builder.AddCylinder("cylinder", 0.5f, 0.3f, 3.0f, 20, 20);
 
-	//
-	// Extract the vertex elements we are interested in and pack the
-	// vertices of all the meshes into one vertex buffer.
-	//
+	MeshPacker packer;
+	builder.Build(packer);
 
-	auto totalVertexCount =
-		box.Vertices.size() +
-		grid.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size();
-
-	std::vector<Vertex> vertices(totalVertexCount);
-
-	UINT k = 0;
-	for(size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-        vertices[k].Normal = box.Vertices[i].Normal;
-	}
-
-	for(size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-        vertices[k].Normal = grid.Vertices[i].Normal;
-	}
-
-	for(size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-        vertices[k].Normal = sphere.Vertices[i].Normal;
-	}
-
-	for(size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
-	}
-
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-    const UINT ibByteSize = (UINT)indices.size()  * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "shapeGeo";
-
-	d3dUtil::CreateDefaultBuffer(m_device.Get(),
-	m_commandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader, geo->VertexBufferGPU);
-
-    d3dUtil::CreateDefaultBuffer(m_device.Get(),
-	m_commandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader, 	geo->IndexBufferGPU);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	geo->DrawArgs["box"] = boxSubmesh;
-	geo->DrawArgs["grid"] = gridSubmesh;
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-	geo->DrawArgs["cylinder"] = cylinderSubmesh;
+	for(size_t i = 0; i < builder.MeshCount(); ++i)
+		LogOptimizeResult(builder.MeshName(i).c_str(), builder.MeshStats(i));
 
+	auto geo = packer.CreateGeometry(*m_GeometryBuffers, *m_Uploads, "shapeGeo");
 	m_Geometries[geo->Name] = std::move(geo);
 }
 
 void EnzeApp::BuildRenderItems()
 {
-    auto boxRitem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f));
-    boxRitem->ObjCBIndex = 0;
-	boxRitem->Geo = m_Geometries["shapeGeo"].get();
-	boxRitem->Mat = m_Materials["stone0"].get();
-    boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-    mAllRitems.push_back(std::move(boxRitem));
-
-    auto gridRitem = std::make_unique<RenderItem>();
-    gridRitem->World = MathHelper::Identity4X4();
-	gridRitem->ObjCBIndex = 1;
-	gridRitem->Geo = m_Geometries["shapeGeo"].get();
-	gridRitem->Mat = m_Materials["tile0"].get();
-    gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(gridRitem));
-
-    auto boxRitem1 = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&boxRitem1->World, XMMatrixScaling(2.0f, 2.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 3.f));
-    boxRitem1->ObjCBIndex = 2;
-	boxRitem1->Geo = m_Geometries["shapeGeo"].get();
-	boxRitem1->Mat = m_Materials["bricks0"].get();
-    boxRitem1->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem1->IndexCount = boxRitem1->Geo->DrawArgs["box"].IndexCount;
-	boxRitem1->StartIndexLocation = boxRitem1->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem1->BaseVertexLocation = boxRitem1->Geo->DrawArgs["box"].BaseVertexLocation;
-    mAllRitems.push_back(std::move(boxRitem1));
-    for(auto &e : mAllRitems)
-        mOpaqueRitems.push_back(e.get());
-}   
+    MeshGeometry* shapeGeo = m_Geometries["shapeGeo"].get();
+
+    // The second box rides on the first: moving the first box's node moves
+    // both.  World matrices come from the nodes, at the end of this function.
+    TransformHandle sceneRoot = m_Transforms.Add(LocalTransform());
+
+    LocalTransform boxLocal;
+    boxLocal.Scale = { 2.0f, 2.0f, 2.0f };
+    boxLocal.Translation = { 0.0f, 0.5f, 0.0f };
+    TransformHandle boxNode = m_Transforms.Add(boxLocal, sceneRoot);
+
+    RenderItemDesc box;
+	box.Geo = shapeGeo;
+	box.Mat = m_MaterialRegistry.Find("stone0");
+    box.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	box.DrawArgs = shapeGeo->DrawArgs["box"];
+    AttachRenderItem(boxNode, m_RenderItems.Add(box));
+
+    RenderItemDesc grid;
+	grid.Geo = shapeGeo;
+	grid.Mat = m_MaterialRegistry.Find("tile0");
+    grid.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    grid.DrawArgs = shapeGeo->DrawArgs["grid"];
+	AttachRenderItem(m_Transforms.Add(LocalTransform(), sceneRoot), m_RenderItems.Add(grid));
+
+    // In the first box's space, whose scale of 2 doubles the offset.
+    LocalTransform box1Local;
+    box1Local.Translation = { 0.0f, 0.0f, 1.5f };
+
+    RenderItemDesc box1;
+	box1.Geo = shapeGeo;
+	box1.Mat = m_MaterialRegistry.Find("bricks0");
+    box1.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	box1.DrawArgs = shapeGeo->DrawArgs["box"];
+    AttachRenderItem(m_Transforms.Add(box1Local, boxNode), m_RenderItems.Add(box1));
+
+    UpdateTransforms();
+}
 
+void EnzeApp::AttachRenderItem(TransformHandle node, RenderItemHandle item)
+{
+    if(m_NodeItems.size() <= node.Slot)
+        m_NodeItems.resize(node.Slot + 1);
+    m_NodeItems[node.Slot] = item;
+}
 
+// Recomputes the world matrices of the nodes that moved, with their
+// subtrees, and passes them on to the attached render items.  Only those
+// items become dirty, so only their object constants are uploaded again and
+// only their boxes are refitted in the render item BVH.
+void EnzeApp::UpdateTransforms()
+{
+    m_Transforms.Update(m_jobSystem.get());
 
+    const std::vector<Math::Float4x4>& worlds = m_Transforms.Worlds();
+    const std::vector<std::uint32_t>& slots = m_Transforms.DenseSlots();
+    for(std::uint32_t node : m_Transforms.ChangedNodes())
+    {
+        std::uint32_t slot = slots[node];
+        if(slot < m_NodeItems.size() && m_RenderItems.IsAlive(m_NodeItems[slot]))
+            m_RenderItems.SetWorld(m_NodeItems[slot], *MathHelper::AsXMFLOAT4X4(&worlds[node]));
+    }
+}
 
 void EnzeApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
     m_LastMousePos.x = x;
     m_LastMousePos.y = y;
 
+    if((btnState & MK_LBUTTON) != 0)
+        Pick(x, y);
+
     SetCapture(Win32Application::GetHwnd());
 }
 
+void EnzeApp::Pick(int sx, int sy)
+{
+    // Compute the picking ray in view space.
+    float vx = (+2.0f*sx / m_width - 1.0f) / m_Proj(0, 0);
+    float vy = (-2.0f*sy / m_height + 1.0f) / m_Proj(1, 1);
+
+    // Transform the ray to world space, where the BVH lives.
+    XMMATRIX view = XMLoadFloat4x4(&m_View);
+    XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+    XMVECTOR rayOrigin = XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), invView);
+    XMVECTOR rayDir = XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(vx, vy, 1.0f, 0.0f), invView));
+
+    // Render items are picked by their bounding boxes.
+    std::uint32_t slot = 0;
+    float distance = m_FarZ;
+    m_RenderItems.RefitBvh();
+    if(m_RenderItems.Bvh().Raycast(rayOrigin, rayDir, slot, distance))
+    {
+        char buffer[128];
+        sprintf_s(buffer, "Picked render item %u at distance %.2f\n", m_RenderItems.DenseIndexOfSlot(slot), distance);
+        ::OutputDebugStringA(buffer);
+    }
+}
+
 void EnzeApp::OnMouseUp(WPARAM btnState, int x, int y)
 {
     ReleaseCapture();
@@ -14,6 +14,18 @@
 #include "DXSample.h"
 #include "MathHelper.h"
 #include "FrameResource.h"
+#include "GpuBufferAllocator.h"
+#include "CommandRecorder.h"
+#include "D3D12GpuTimeline.h"
+#include "D3D12RenderBackend.h"
+#include "ParallelCommandRecorder.h"
+#include "InstanceBatcher.h"
+#include "JobSystem.h"
+#include "MaterialRegistry.h"
+#include "RenderItemStore.h"
+#include "TransformHierarchy.h"
+#include "UploadManager.h"
+#include "UploadRingBuffer.h"
 
 using namespace DirectX;
 
@@ -27,35 +39,6 @@ using Microsoft::WRL::ComPtr;
 // 3 frames  cpu to calculate
 
 
-struct RenderItem
-{
-	RenderItem() = default;
-
-    // World matrix of the shape that describes the object's local space
-    // relative to the world space, which defines the position, orientation,
-    // and scale of the object in the world.
-    XMFLOAT4X4 World = MathHelper::Identity4X4();
-
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
-
-    int NumFramesDirty = gNumFrameResources;
-	MeshGeometry* Geo = nullptr;
-    Material* Mat = nullptr;
-    // Primitive topology.
-    D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-    // DrawIndexedInstanced parameters.
-    UINT IndexCount = 0;
-    UINT StartIndexLocation = 0;
-    int BaseVertexLocation = 0;
-};
-
 class EnzeApp : public DXSample
 {
 public:
@@ -68,18 +51,25 @@ public:
     virtual void OnMouseDown(WPARAM btnState, int x, int y);
     virtual void OnMouseUp(WPARAM btnState, int x, int y);
     virtual void OnMouseMove(WPARAM btnState, int x, int y);
+    // Keys 1 to 4 change the number of frames in flight.
+    virtual void OnKeyDown(UINT8 key);
 private:
     POINT m_LastMousePos;
     XMFLOAT3 m_EyePos = { 0.0f, 0.0f, 0.0f };
     XMFLOAT4X4 m_View = MathHelper::Identity4X4();
     XMFLOAT4X4 m_Proj = MathHelper::Identity4X4();
+    // Only changes with m_Proj, so it is computed there instead of per frame.
+    XMFLOAT4X4 m_InvProj = MathHelper::Identity4X4();
     float m_NearZ = 1.f;
     float m_FarZ = 1000.f;
     float m_Theta = 1.5f * XM_PI;
     float m_Phi = XM_PIDIV4;
     float m_Radius = 5.0f;
     
-    static const UINT FrameCount = 2;
+    // Back buffers.  Every frame in flight may be holding one until it is
+    // presented, so there are as many as the most frames that may be in
+    // flight.
+    static const UINT FrameCount = gMaxFramesInFlight;
 
 
 //  让 render 和 geometry进行分离。因为有些物体其实
@@ -99,15 +89,48 @@ private:
     ComPtr<ID3D12DescriptorHeap> m_depthStencilHeap;
     ComPtr<ID3D12PipelineState> m_pipelineState;
     ComPtr<ID3D12GraphicsCommandList> m_commandList;
+    // The frame is recorded as up to m_CommandListCount command streams in
+    // parallel, each replayed into the current frame resource's list of the
+    // same index; m_SubmitLists holds the lists to execute, in order.
+    ParallelCommandRecorder m_ParallelRecorder;
+    UINT m_CommandListCount = 1;
+    std::vector<HRESULT> m_ChunkResults;
+    std::vector<ID3D12CommandList*> m_SubmitLists;
     UINT m_rtvDescriptorSize;
     UINT m_depthStencilDescriptorSize;
     UINT m_cbvDescriptorSize;
     DXGI_FORMAT mDepthStencilFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+    // Worker threads shared by startup and per-frame CPU work.
+    std::unique_ptr<JobSystem> m_jobSystem;
     // App resources.
     std::unique_ptr<MeshGeometry> mBoxGeo = nullptr;
+    // Default heap pages the geometry buffers are suballocated from; declared
+    // before m_Geometries so the pages outlive the geometry using them.
+    std::unique_ptr<GpuBufferAllocator> m_GeometryBuffers;
+    // Copy queue filling them; destroyed first, once its copies are done.
+    std::unique_ptr<UploadManager> m_Uploads;
     std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> m_Geometries;
-    std::vector<std::unique_ptr<RenderItem>> mAllRitems; 
-    std::vector<RenderItem *>mOpaqueRitems;
+    RenderItemStore m_RenderItems;
+    // Parent/child transforms of the scene.  A render item attached to a
+    // node takes the node's world matrix whenever it is recomputed;
+    // m_NodeItems holds the attached item of each node, by node slot.
+    TransformHierarchy m_Transforms;
+    std::vector<RenderItemHandle> m_NodeItems;
+    // World-space frustum of the current frame and the dense indices of the
+    // render items that survived culling against it.
+    FrustumCuller::Planes m_FrustumPlanes;
+    std::vector<std::uint32_t> m_VisibleItems;
+    // Handle slots the render item BVH found visible.
+    std::vector<std::uint32_t> m_QueryKeys;
+    // Visible items grouped into instanced draws, and the view depth of
+    // each visible item used to order them.
+    InstanceBatcher m_Batcher;
+    std::vector<float> m_VisibleDepths;
+    // Dirty items UpdateObjectConstants writes this frame, sorted by
+    // ObjCBIndex, the start of each job's range in it, and sort scratch.
+    std::vector<std::uint32_t> m_ObjectUpdateItems;
+    std::vector<std::uint32_t> m_ObjectUpdateRanges;
+    std::vector<std::uint64_t> m_ObjectUpdateKeys;
 
     // get the upload pointer ready
     std::vector<D3D12_INPUT_ELEMENT_DESC> m_inputElementDescs;
@@ -117,13 +140,23 @@ private:
 
     // Synchronization objects.
     UINT m_frameIndex;
-    HANDLE m_fenceEvent;
-    ComPtr<ID3D12Fence> m_fence;
-    UINT64 m_fenceValue;
+    // Frames the CPU may run ahead of the GPU, and the pacer keeping it
+    // there on the direct queue's timeline.
+    UINT m_FramesInFlight = gDefaultFramesInFlight;
+    // Layout of the object constants, fixed at startup since the vertex
+    // shader is compiled for it.  Affine3x4 is exact and a quarter smaller
+    // than the full matrix; -objects picks another.
+    ObjectFormat m_ObjectFormat = ObjectFormat::Affine3x4;
+    std::unique_ptr<D3D12GpuTimeline> m_GpuTimeline;
+    std::unique_ptr<FramePacer> m_FramePacer;
     // frames to use
     std::vector<std::unique_ptr<FrameResource>> mFrameResources;
     FrameResource* mCurrFrameResource = nullptr;
-    std::unordered_map<std::string, std::unique_ptr<Material>> m_Materials;
+    // Per-frame constant and instance data, and where this frame's went.
+    std::unique_ptr<UploadRingBuffer> m_UploadRing;
+    D3D12_GPU_VIRTUAL_ADDRESS m_PassCBAddress = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS m_InstanceAddress = 0;
+    MaterialRegistry m_MaterialRegistry;
     int mCurrFrameResourceIndex = 0;
 
     void BuildRootSignature();
@@ -131,20 +164,31 @@ private:
     void CreateDescHeaps();
     void CreateRtvResources();
     void CreateDepthResources();
+    void RecordChunk(std::uint32_t chunk, std::uint32_t begin, std::uint32_t end,
+        RenderCommandStream& stream, CommandRecorder& recorder);
+    HRESULT ReplayChunk(std::uint32_t chunk, const RenderCommandStream& stream);
     void PopulateCommandList();
-    void WaitForPreviousFrame();
+    void LogFramePacing();
+    void SetFramesInFlight(UINT count);
     void DefineInputLayout();
     void CompileShader();
     void BuildPSO();
     void CreateCommandList();
     void UpdateObjectConstants();
     void UpdateMainPass(); 
-    void UpdateMaterialsCB();
+    void UpdateMaterialBuffer();
+    void GrowFrameBuffers();
     void UpdateCamera();
+    void CullRenderItems();
+    void BatchVisibleItems();
+    void Pick(int sx, int sy);
     void InitProjMatrix();
+    void BuildBufferAllocators();
     void BuildCommonGeoMetry();
     void BuildRenderItems();
+    void AttachRenderItem(TransformHandle node, RenderItemHandle item);
+    void UpdateTransforms();
     void BuildFrameResources();
     void BuildMaterials();
-    void RenderGroupItems();
+    void RenderGroupItems(std::uint32_t begin, std::uint32_t end, CommandRecorder& recorder);
 };
@@ -0,0 +1,134 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+FramePacer::FramePacer(GpuTimeline& timeline, std::uint32_t framesInFlight) :
+    mTimeline(timeline),
+    mSlotFences(std::max(framesInFlight, 1u), 0)
+{
+}
+
+std::uint32_t FramePacer::BeginFrame()
+{
+    assert(!mInFrame);
+
+    FrameTelemetry frame;
+    frame.Frame = mFrame;
+
+    const double startMs = mTimeline.NowMs();
+    mTimeline.WaitForPresentLatency();
+    const double latencyMs = mTimeline.NowMs();
+    frame.LatencyWaitMs = latencyMs - startMs;
+
+    const std::uint64_t completed = mTimeline.CompletedValue();
+    for(std::uint64_t fence : mSlotFences)
+    {
+        if(fence > completed)
+            ++frame.FramesQueued;
+    }
+
+    // The slot's previous frame is the oldest one that may still be queued.
+    const std::uint64_t slotFence = mSlotFences[mSlot];
+    if(slotFence > completed)
+    {
+        mTimeline.WaitForValue(slotFence);
+        frame.FenceWaitMs = mTimeline.NowMs() - latencyMs;
+        ++mTelemetry.StalledFrames;
+    }
+
+    const double waitMs = frame.LatencyWaitMs + frame.FenceWaitMs;
+    ++mTelemetry.Frames;
+    mTelemetry.TotalWaitMs += waitMs;
+    mTelemetry.MaxWaitMs = std::max(mTelemetry.MaxWaitMs, waitMs);
+    mTelemetry.TotalLatencyWaitMs += frame.LatencyWaitMs;
+
+    mHistory.push_back(frame);
+    if(mHistory.size() > HistorySize)
+        mHistory.pop_front();
+
+    mInFrame = true;
+    return mSlot;
+}
+
+std::uint64_t FramePacer::EndFrame()
+{
+    assert(mInFrame);
+
+    const std::uint64_t value = Signal();
+    mSlotFences[mSlot] = value;
+    mSlot = (mSlot + 1) % (std::uint32_t)mSlotFences.size();
+    ++mFrame;
+    mInFrame = false;
+    return value;
+}
+
+std::uint64_t FramePacer::Signal()
+{
+    mTimeline.Signal(++mFenceValue);
+    return mFenceValue;
+}
+
+void FramePacer::WaitForIdle()
+{
+    if(mTimeline.CompletedValue() < mFenceValue)
+        mTimeline.WaitForValue(mFenceValue);
+}
+
+void FramePacer::SetFramesInFlight(std::uint32_t framesInFlight)
+{
+    assert(!mInFrame);
+
+    // Every slot is free once the GPU is idle, so the ring can be rebuilt.
+    WaitForIdle();
+    mSlotFences.assign(std::max(framesInFlight, 1u), mFenceValue);
+    mSlot = 0;
+}
+
+SimulatedGpuTimeline::SimulatedGpuTimeline(double gpuFrameMs, double presentIntervalMs) :
+    mGpuFrameMs(gpuFrameMs),
+    mPresentIntervalMs(presentIntervalMs)
+{
+}
+
+void SimulatedGpuTimeline::Signal(std::uint64_t value)
+{
+    assert(mSubmissions.empty() || mSubmissions.back().Value < value);
+
+    double doneMs = std::max(mNowMs, mGpuFreeMs) + mGpuFrameMs;
+    if(mPresentIntervalMs > 0.0)
+        doneMs = std::ceil(doneMs / mPresentIntervalMs) * mPresentIntervalMs;
+    mGpuFreeMs = doneMs;
+
+    Submission submission;
+    submission.Value = value;
+    submission.DoneMs = doneMs;
+    mSubmissions.push_back(submission);
+}
+
+std::uint64_t SimulatedGpuTimeline::CompletedValue()
+{
+    // Submissions complete in order, so the last one done by now wins.
+    auto pending = std::upper_bound(mSubmissions.begin(), mSubmissions.end(), mNowMs,
+        [](double nowMs, const Submission& s) { return nowMs < s.DoneMs; });
+    if(pending == mSubmissions.begin())
+        return 0;
+    return (pending - 1)->Value;
+}
+
+void SimulatedGpuTimeline::WaitForValue(std::uint64_t value)
+{
+    const double doneMs = CompletionTimeMs(value);
+    if(doneMs > mNowMs)
+        mNowMs = doneMs;
+}
+
+double SimulatedGpuTimeline::CompletionTimeMs(std::uint64_t value)const
+{
+    // A value between two signals completes with the later one.
+    auto done = std::lower_bound(mSubmissions.begin(), mSubmissions.end(), value,
+        [](const Submission& s, std::uint64_t v) { return s.Value < v; });
+    if(done == mSubmissions.end())
+        return -1.0;
+    return done->DoneMs;
+}
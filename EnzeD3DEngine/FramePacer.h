@@ -0,0 +1,139 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// The GPU side of frame pacing: a monotonically increasing fence, a way to
+// block on it, and a clock to measure the blocking with.  Nothing here
+// depends on D3D12, so the pacer runs against SimulatedGpuTimeline as well
+// as the real queue.
+class GpuTimeline
+{
+public:
+    virtual ~GpuTimeline() = default;
+
+    // Queues a fence signal of value behind the work submitted so far.
+    virtual void Signal(std::uint64_t value) = 0;
+    virtual std::uint64_t CompletedValue() = 0;
+    // Blocks until CompletedValue() >= value.
+    virtual void WaitForValue(std::uint64_t value) = 0;
+    // Blocks until the presentation engine can take another frame.  Timelines
+    // without a latency waitable swap chain return at once.
+    virtual void WaitForPresentLatency() {}
+    // Milliseconds on a clock of the timeline's choosing; only differences
+    // are used.
+    virtual double NowMs() = 0;
+};
+
+// Keeps at most FramesInFlight() frames queued on the GPU.
+//
+// BeginFrame() waits until the slot the new frame will reuse is done, first
+// on the swap chain's latency object and then on the slot's fence, and
+// returns the slot index; per-frame resources are indexed by it.  EndFrame()
+// signals the fence after the frame's work.  Nothing waits at the end of a
+// frame, so the CPU only stalls when it is FramesInFlight() frames ahead.
+//
+// Work outside frames, such as startup uploads, is fenced with Signal(); the
+// first frames then wait for it like for any earlier frame.
+class FramePacer
+{
+public:
+    struct FrameTelemetry
+    {
+        std::uint64_t Frame = 0;
+        // CPU time spent blocked in BeginFrame().
+        double LatencyWaitMs = 0.0;
+        double FenceWaitMs = 0.0;
+        // Frames still on the GPU when the frame began, itself excluded.
+        std::uint32_t FramesQueued = 0;
+    };
+
+    struct Telemetry
+    {
+        std::uint64_t Frames = 0;
+        // Frames that blocked on a fence, and how long in total and at most.
+        std::uint64_t StalledFrames = 0;
+        double TotalWaitMs = 0.0;
+        double MaxWaitMs = 0.0;
+        double TotalLatencyWaitMs = 0.0;
+    };
+
+    // How many recent frames FrameHistory() keeps.
+    static const size_t HistorySize = 120;
+
+    FramePacer(GpuTimeline& timeline, std::uint32_t framesInFlight);
+
+    std::uint32_t BeginFrame();
+    // Returns the fence value of the frame.
+    std::uint64_t EndFrame();
+
+    // Fences the work submitted so far; returns the value.
+    std::uint64_t Signal();
+    // Blocks until everything signaled has completed, for shutdown.
+    void WaitForIdle();
+
+    // Waits for the GPU to go idle and changes the number of slots.
+    void SetFramesInFlight(std::uint32_t framesInFlight);
+
+    std::uint32_t FramesInFlight()const { return (std::uint32_t)mSlotFences.size(); }
+    std::uint32_t CurrentSlot()const { return mSlot; }
+    std::uint64_t FrameCount()const { return mFrame; }
+    std::uint64_t LastSignaledValue()const { return mFenceValue; }
+    std::uint64_t CompletedValue() { return mTimeline.CompletedValue(); }
+
+    const Telemetry& GetTelemetry()const { return mTelemetry; }
+    void ResetTelemetry() { mTelemetry = Telemetry(); }
+    // Oldest first.
+    const std::deque<FrameTelemetry>& FrameHistory()const { return mHistory; }
+
+private:
+    GpuTimeline& mTimeline;
+    std::uint64_t mFenceValue = 0;
+    std::uint64_t mFrame = 0;
+    std::uint32_t mSlot = 0;
+    bool mInFrame = false;
+    // Fence of the last frame that used each slot.
+    std::vector<std::uint64_t> mSlotFences;
+
+    Telemetry mTelemetry;
+    std::deque<FrameTelemetry> mHistory;
+};
+
+// GpuTimeline on a virtual clock, for measuring pacing without a GPU.
+//
+// The simulated GPU runs signaled frames back to back, each taking
+// GpuFrameMs from when both it was submitted and the previous frame was
+// done.  Waits jump the clock forward to the completion they wait for, and
+// the caller accounts for CPU work with AdvanceCpu().  A present interval
+// models vsync: a frame completes no earlier than the next multiple of it.
+class SimulatedGpuTimeline : public GpuTimeline
+{
+public:
+    explicit SimulatedGpuTimeline(double gpuFrameMs, double presentIntervalMs = 0.0);
+
+    void Signal(std::uint64_t value) override;
+    std::uint64_t CompletedValue() override;
+    void WaitForValue(std::uint64_t value) override;
+    double NowMs() override { return mNowMs; }
+
+    void AdvanceCpu(double ms) { mNowMs += ms; }
+    void SetGpuFrameMs(double ms) { mGpuFrameMs = ms; }
+
+    // When the simulated GPU finishes the work fenced by value, or a negative
+    // number when value was never signaled.
+    double CompletionTimeMs(std::uint64_t value)const;
+
+private:
+    struct Submission
+    {
+        std::uint64_t Value;
+        double DoneMs;
+    };
+
+    double mGpuFrameMs;
+    double mPresentIntervalMs;
+    double mNowMs = 0.0;
+    double mGpuFreeMs = 0.0;
+    std::vector<Submission> mSubmissions;
+};
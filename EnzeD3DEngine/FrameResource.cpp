@@ -1,14 +1,22 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT objectCount, ObjectFormat objectFormat, UINT materialCount, UINT commandListCount)
 {
-     ThrowIfFailed(device->CreateCommandAllocator(
-        D3D12_COMMAND_LIST_TYPE_DIRECT,
-		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
+    CmdListAllocs.resize(commandListCount);
+    CmdLists.resize(commandListCount);
+    for(UINT i = 0; i < commandListCount; ++i)
+    {
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(CmdListAllocs[i].GetAddressOf())));
+        ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+            CmdListAllocs[i].Get(), nullptr, IID_PPV_ARGS(CmdLists[i].GetAddressOf())));
+        ThrowIfFailed(CmdLists[i]->Close());
+    }
 
-    PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
-    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>> (device, materialCount, true);
+    ObjectBuffer = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, false,
+        (UINT)ObjectPacking::ElementByteSize(objectFormat));
+    MaterialBuffer = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, false);
 }
 
 FrameResource::~FrameResource()
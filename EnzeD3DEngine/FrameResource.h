@@ -2,6 +2,8 @@
 #include "stdafx.h"
 #include "MathHelper.h"
 #include "UploadBuffer.h"
+#include "ObjectPacking.h"
+#include "RenderTypes.h"
 // each object has different world matrix
 struct ObjectConstants {
     
@@ -25,20 +27,31 @@ struct PassConstants {
     DirectX::XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
     Light Lights[MaxLights];
 };
-struct Vertex {
-    DirectX::XMFLOAT3 Pos;
-    DirectX::XMFLOAT3 Normal;
-};
 class FrameResource
 {
     public:
-        FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+        FrameResource(ID3D12Device* device, UINT objectCount, ObjectFormat objectFormat, UINT materialCount, UINT commandListCount);
         FrameResource(const FrameResource& rhs) = delete;
         FrameResource& operator=(const FrameResource& rhs) = delete;
         ~FrameResource();
-        Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
-        std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-        std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
-        std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
+        // One allocator and list per recording thread; CmdLists[i] records
+        // with CmdListAllocs[i].  The lists are created closed.
+        std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> CmdListAllocs;
+        std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>> CmdLists;
+        // Object and material constants persist across frames and are only
+        // rewritten when dirty; both grow with UploadBuffer::Resize().  Data
+        // rebuilt every frame (pass constants, instances) comes from the
+        // app's UploadRingBuffer instead.  Object constants are read through
+        // a structured buffer, so elements are packed instead of padded to
+        // 256 bytes; they are ObjectConstants or, with a packed
+        // ObjectFormat, that format's smaller element.
+        std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectBuffer = nullptr;
+        // Material constants are the material table, indexed by material id
+        // and read through a structured buffer as well.
+        std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialBuffer = nullptr;
+        // Generations of the render items and materials the buffers above are
+        // current to; 0 until they have been written once.
+        std::uint64_t ObjectGeneration = 0;
+        std::uint64_t MaterialGeneration = 0;
         UINT64 Fence = 0;
 };
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "FrustumCuller.h"
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE2
+#endif
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX
+#endif
+
+using namespace DirectX;
+
+void AabbSoA::Reserve(size_t count)
+{
+    CenterX.reserve(count);
+    CenterY.reserve(count);
+    CenterZ.reserve(count);
+    ExtentX.reserve(count);
+    ExtentY.reserve(count);
+    ExtentZ.reserve(count);
+}
+
+void AabbSoA::PushBack(const BoundingBox& box)
+{
+    CenterX.push_back(box.Center.x);
+    CenterY.push_back(box.Center.y);
+    CenterZ.push_back(box.Center.z);
+    ExtentX.push_back(box.Extents.x);
+    ExtentY.push_back(box.Extents.y);
+    ExtentZ.push_back(box.Extents.z);
+}
+
+void AabbSoA::PopBack()
+{
+    CenterX.pop_back();
+    CenterY.pop_back();
+    CenterZ.pop_back();
+    ExtentX.pop_back();
+    ExtentY.pop_back();
+    ExtentZ.pop_back();
+}
+
+void AabbSoA::Set(size_t i, const BoundingBox& box)
+{
+    CenterX[i] = box.Center.x;
+    CenterY[i] = box.Center.y;
+    CenterZ[i] = box.Center.z;
+    ExtentX[i] = box.Extents.x;
+    ExtentY[i] = box.Extents.y;
+    ExtentZ[i] = box.Extents.z;
+}
+
+void AabbSoA::Copy(size_t dst, size_t src)
+{
+    CenterX[dst] = CenterX[src];
+    CenterY[dst] = CenterY[src];
+    CenterZ[dst] = CenterZ[src];
+    ExtentX[dst] = ExtentX[src];
+    ExtentY[dst] = ExtentY[src];
+    ExtentZ[dst] = ExtentZ[src];
+}
+
+FrustumCuller::Planes FrustumCuller::ExtractPlanes(FXMMATRIX viewProj)
+{
+    // With clip = v * M, each clip coordinate is v dotted with a column of M,
+    // i.e. a row of the transpose.
+    XMMATRIX t = XMMatrixTranspose(viewProj);
+
+    XMVECTOR planes[6] =
+    {
+        XMVectorAdd(t.r[3], t.r[0]),        // left:   -w <= x
+        XMVectorSubtract(t.r[3], t.r[0]),   // right:   x <= w
+        XMVectorAdd(t.r[3], t.r[1]),        // bottom: -w <= y
+        XMVectorSubtract(t.r[3], t.r[1]),   // top:     y <= w
+        t.r[2],                             // near:    0 <= z
+        XMVectorSubtract(t.r[3], t.r[2])    // far:     z <= w
+    };
+
+    Planes result;
+    for(int i = 0; i < 6; ++i)
+        XMStoreFloat4(&result.Plane[i], XMPlaneNormalize(planes[i]));
+
+    return result;
+}
+
+BoundingBox FrustumCuller::TransformBox(const BoundingBox& box, FXMMATRIX world)
+{
+    XMVECTOR center = XMVector3Transform(XMLoadFloat3(&box.Center), world);
+
+    // Each world-space extent is the local extents projected on the absolute
+    // values of the matching matrix column.
+    XMVECTOR extents = XMLoadFloat3(&box.Extents);
+    XMVECTOR worldExtents = XMVectorMultiply(XMVectorSplatX(extents), XMVectorAbs(world.r[0]));
+    worldExtents = XMVectorMultiplyAdd(XMVectorSplatY(extents), XMVectorAbs(world.r[1]), worldExtents);
+    worldExtents = XMVectorMultiplyAdd(XMVectorSplatZ(extents), XMVectorAbs(world.r[2]), worldExtents);
+
+    BoundingBox result;
+    XMStoreFloat3(&result.Center, center);
+    XMStoreFloat3(&result.Extents, worldExtents);
+    return result;
+}
+
+size_t FrustumCuller::Cull(const Planes& planes, const AabbSoA& boxes, size_t begin, size_t end,
+    std::uint32_t* visible)
+{
+    //
+    // A box is outside a plane when its center's signed distance plus its
+    // projected radius |n.x|*e.x + |n.y|*e.y + |n.z|*e.z is negative.  The
+    // compaction writes every lane and advances by its visibility bit, so it
+    // needs no branches and never writes past the slot of the box it tests.
+    //
+
+    const float* cx = boxes.CenterX.data();
+    const float* cy = boxes.CenterY.data();
+    const float* cz = boxes.CenterZ.data();
+    const float* ex = boxes.ExtentX.data();
+    const float* ey = boxes.ExtentY.data();
+    const float* ez = boxes.ExtentZ.data();
+
+    size_t count = 0;
+    size_t i = begin;
+
+#if defined(FRUSTUM_CULLER_AVX)
+    __m256 pa[6], pb[6], pc[6], pd[6];
+    __m256 absA[6], absB[6], absC[6];
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for(int p = 0; p < 6; ++p)
+    {
+        pa[p] = _mm256_set1_ps(planes.Plane[p].x);
+        pb[p] = _mm256_set1_ps(planes.Plane[p].y);
+        pc[p] = _mm256_set1_ps(planes.Plane[p].z);
+        pd[p] = _mm256_set1_ps(planes.Plane[p].w);
+        absA[p] = _mm256_andnot_ps(signMask, pa[p]);
+        absB[p] = _mm256_andnot_ps(signMask, pb[p]);
+        absC[p] = _mm256_andnot_ps(signMask, pc[p]);
+    }
+
+    for(; i + 8 <= end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(cx + i);
+        __m256 y = _mm256_loadu_ps(cy + i);
+        __m256 z = _mm256_loadu_ps(cz + i);
+        __m256 rx = _mm256_loadu_ps(ex + i);
+        __m256 ry = _mm256_loadu_ps(ey + i);
+        __m256 rz = _mm256_loadu_ps(ez + i);
+
+        __m256 outside = _mm256_setzero_ps();
+        for(int p = 0; p < 6; ++p)
+        {
+            __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pa[p], x), _mm256_mul_ps(pb[p], y)),
+                _mm256_add_ps(_mm256_mul_ps(pc[p], z), pd[p]));
+            __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absA[p], rx), _mm256_mul_ps(absB[p], ry)),
+                _mm256_mul_ps(absC[p], rz));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+
+        unsigned mask = ~(unsigned)_mm256_movemask_ps(outside);
+        for(unsigned k = 0; k < 8; ++k)
+        {
+            visible[count] = (std::uint32_t)(i + k);
+            count += (mask >> k) & 1;
+        }
+    }
+#elif defined(FRUSTUM_CULLER_SSE2)
+    __m128 pa[6], pb[6], pc[6], pd[6];
+    __m128 absA[6], absB[6], absC[6];
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for(int p = 0; p < 6; ++p)
+    {
+        pa[p] = _mm_set1_ps(planes.Plane[p].x);
+        pb[p] = _mm_set1_ps(planes.Plane[p].y);
+        pc[p] = _mm_set1_ps(planes.Plane[p].z);
+        pd[p] = _mm_set1_ps(planes.Plane[p].w);
+        absA[p] = _mm_andnot_ps(signMask, pa[p]);
+        absB[p] = _mm_andnot_ps(signMask, pb[p]);
+        absC[p] = _mm_andnot_ps(signMask, pc[p]);
+    }
+
+    for(; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(cx + i);
+        __m128 y = _mm_loadu_ps(cy + i);
+        __m128 z = _mm_loadu_ps(cz + i);
+        __m128 rx = _mm_loadu_ps(ex + i);
+        __m128 ry = _mm_loadu_ps(ey + i);
+        __m128 rz = _mm_loadu_ps(ez + i);
+
+        __m128 outside = _mm_setzero_ps();
+        for(int p = 0; p < 6; ++p)
+        {
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa[p], x), _mm_mul_ps(pb[p], y)),
+                _mm_add_ps(_mm_mul_ps(pc[p], z), pd[p]));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absA[p], rx), _mm_mul_ps(absB[p], ry)),
+                _mm_mul_ps(absC[p], rz));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+        }
+
+        unsigned mask = ~(unsigned)_mm_movemask_ps(outside);
+        for(unsigned k = 0; k < 4; ++k)
+        {
+            visible[count] = (std::uint32_t)(i + k);
+            count += (mask >> k) & 1;
+        }
+    }
+#endif
+
+    for(; i < end; ++i)
+    {
+        bool outside = false;
+        for(int p = 0; p < 6; ++p)
+        {
+            const XMFLOAT4& n = planes.Plane[p];
+            float dist = n.x*cx[i] + n.y*cy[i] + n.z*cz[i] + n.w;
+            float radius = fabsf(n.x)*ex[i] + fabsf(n.y)*ey[i] + fabsf(n.z)*ez[i];
+            outside = outside || dist + radius < 0.0f;
+        }
+
+        visible[count] = (std::uint32_t)i;
+        count += outside ? 0 : 1;
+    }
+
+    return count;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+// Axis-aligned boxes in structure-of-arrays form, so the culler can load the
+// same component of several boxes with one instruction.
+struct AabbSoA
+{
+    std::vector<float> CenterX, CenterY, CenterZ;
+    std::vector<float> ExtentX, ExtentY, ExtentZ;
+
+    size_t Size()const { return CenterX.size(); }
+    void Reserve(size_t count);
+    void PushBack(const DirectX::BoundingBox& box);
+    void PopBack();
+    void Set(size_t i, const DirectX::BoundingBox& box);
+    void Copy(size_t dst, size_t src);
+};
+
+// Frustum culling of many boxes at once.  Planes are extracted from a
+// view-projection matrix, and each box is kept unless it lies entirely behind
+// one of the six planes (conservative: a few boxes near the frustum corners
+// pass although they are outside).
+class FrustumCuller
+{
+public:
+    // Normalized planes (a, b, c, d) with ax + by + cz + d >= 0 inside.
+    struct Planes
+    {
+        DirectX::XMFLOAT4 Plane[6];
+    };
+
+    // Gribb/Hartmann extraction for the row-vector convention used with
+    // DirectXMath and D3D clip space (0 <= z <= w).  Pass view * proj for
+    // world-space planes.
+    static Planes ExtractPlanes(DirectX::FXMMATRIX viewProj);
+
+    // Box enclosing box after transformation by world (Arvo's method).
+    static DirectX::BoundingBox TransformBox(const DirectX::BoundingBox& box, DirectX::FXMMATRIX world);
+
+    // Writes the index of every box in [begin, end) that may be visible to
+    // visible, in increasing order, and returns how many were written.
+    // visible must have room for end - begin indices.  Tests eight boxes per
+    // iteration with AVX, four with SSE2.
+    static size_t Cull(const Planes& planes, const AabbSoA& boxes, size_t begin, size_t end,
+        std::uint32_t* visible);
+};
@@ -5,6 +5,11 @@
 #include "GeometryGenerator.h"
 #include <algorithm>
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GEOMETRY_GENERATOR_SSE2
+#endif
+
 using namespace DirectX;
 
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
@@ -211,15 +216,60 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
     return meshData;
 }
  
-void GeometryGenerator::Subdivide(MeshData& meshData)
+namespace
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
+	const std::uint64_t EmptyKey = ~0ull;
+
+	// Flat open-addressing table from an undirected edge (vertex index pair) to
+	// the index of its midpoint vertex.  Sized once for the worst case of three
+	// unique edges per triangle, so it never rehashes.
+	class EdgeMidpointCache
+	{
+	public:
+		explicit EdgeMidpointCache(size_t maxEdges)
+		{
+			size_t capacity = 16;
+			while(capacity < maxEdges*2)
+				capacity <<= 1;
+
+			mMask = capacity - 1;
+			mKeys.assign(capacity, EmptyKey);
+			mValues.resize(capacity);
+		}
 
+		// Returns the midpoint index for edge (a, b).  On a miss the edge is
+		// assigned nextIndex and inserted is set.
+		GeometryGenerator::uint32 FindOrInsert(GeometryGenerator::uint32 a, GeometryGenerator::uint32 b,
+			GeometryGenerator::uint32 nextIndex, bool& inserted)
+		{
+			std::uint64_t key = a < b ? ((std::uint64_t)a << 32) | b : ((std::uint64_t)b << 32) | a;
+			size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mMask;
+
+			while(mKeys[slot] != EmptyKey)
+			{
+				if(mKeys[slot] == key)
+				{
+					inserted = false;
+					return mValues[slot];
+				}
+				slot = (slot + 1) & mMask;
+			}
+
+			mKeys[slot] = key;
+			mValues[slot] = nextIndex;
+			inserted = true;
+			return nextIndex;
+		}
 
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
+	private:
+		std::vector<std::uint64_t> mKeys;
+		std::vector<GeometryGenerator::uint32> mValues;
+		size_t mMask = 0;
+	};
+}
 
+void GeometryGenerator::Subdivide(MeshData& meshData)
+{
 	//       v1
 	//       *
 	//      / \
@@ -230,48 +280,77 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
+	// The input vertices are kept in place and each shared edge gets exactly one
+	// midpoint appended after them, so neighbouring triangles weld instead of
+	// each writing six private vertices.
+	uint32 numTris = (uint32)meshData.Indices32.size()/3;
+	uint32 vertexCount = (uint32)meshData.Vertices.size();
+
+	//
+	// First pass: assign a midpoint index to every unique edge.  This gives the
+	// exact final vertex count before any vertex is written.
+	//
+
+	EdgeMidpointCache cache(numTris*3);
+	std::vector<uint32> edgeEnds;
+	edgeEnds.reserve(numTris*3*2);
+	std::vector<uint32> midpoints(numTris*3);
+
+	uint32 nextIndex = vertexCount;
 	for(uint32 i = 0; i < numTris; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
+		uint32 v[3] = { meshData.Indices32[i*3+0], meshData.Indices32[i*3+1], meshData.Indices32[i*3+2] };
 
-		//
-		// Generate the midpoints.
-		//
+		// m0 = (v0, v1), m1 = (v1, v2), m2 = (v0, v2).
+		uint32 edges[3][2] = { { v[0], v[1] }, { v[1], v[2] }, { v[0], v[2] } };
+		for(uint32 e = 0; e < 3; ++e)
+		{
+			bool inserted = false;
+			midpoints[i*3+e] = cache.FindOrInsert(edges[e][0], edges[e][1], nextIndex, inserted);
+			if(inserted)
+			{
+				edgeEnds.push_back(edges[e][0]);
+				edgeEnds.push_back(edges[e][1]);
+				++nextIndex;
+			}
+		}
+	}
 
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
+	//
+	// Generate the midpoints.
+	//
 
-		//
-		// Add new geometry.
-		//
+	meshData.Vertices.resize(nextIndex);
+	for(uint32 i = vertexCount; i < nextIndex; ++i)
+	{
+		uint32 e = (i - vertexCount)*2;
+		meshData.Vertices[i] = MidPoint(meshData.Vertices[edgeEnds[e]], meshData.Vertices[edgeEnds[e+1]]);
+	}
 
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
+	//
+	// Add new geometry.  Triangle order and winding match the unwelded version.
+	//
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+	std::vector<uint32> indices(numTris*12);
+	for(uint32 i = 0; i < numTris; ++i)
+	{
+		uint32 v0 = meshData.Indices32[i*3+0];
+		uint32 v1 = meshData.Indices32[i*3+1];
+		uint32 v2 = meshData.Indices32[i*3+2];
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+		uint32 m0 = midpoints[i*3+0];
+		uint32 m1 = midpoints[i*3+1];
+		uint32 m2 = midpoints[i*3+2];
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+		uint32* tri = &indices[i*12];
+
+		tri[0] = v0; tri[1]  = m0; tri[2]  = m2;
+		tri[3] = m0; tri[4]  = m1; tri[5]  = m2;
+		tri[6] = m2; tri[7]  = m1; tri[8]  = v2;
+		tri[9] = m0; tri[10] = v1; tri[11] = m1;
 	}
+
+	meshData.Indices32.swap(indices);
 }
 
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
@@ -655,3 +734,517 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, floa
 
     return meshData;
 }
+
+namespace
+{
+	using uint32 = GeometryGenerator::uint32;
+
+	// Stores the first count lanes of v to dst.  Whole vectors go out with one
+	// unaligned store; the tail of a ring or row falls back to a lane copy.
+	inline void StoreLanes(float* dst, FXMVECTOR v, uint32 count)
+	{
+		if(count == 4)
+		{
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(dst), v);
+			return;
+		}
+
+		XMFLOAT4A lanes;
+		XMStoreFloat4A(&lanes, v);
+		const float* src = &lanes.x;
+		for(uint32 i = 0; i < count; ++i)
+			dst[i] = src[i];
+	}
+
+	inline void SetVertex(GeometryGenerator::MeshDataSoA& meshData, size_t i,
+		float px, float py, float pz,
+		float nx, float ny, float nz,
+		float tx, float ty, float tz,
+		float u, float v)
+	{
+		meshData.PosX[i] = px; meshData.PosY[i] = py; meshData.PosZ[i] = pz;
+		meshData.NormalX[i] = nx; meshData.NormalY[i] = ny; meshData.NormalZ[i] = nz;
+		meshData.TangentX[i] = tx; meshData.TangentY[i] = ty; meshData.TangentZ[i] = tz;
+		meshData.TexU[i] = u; meshData.TexV[i] = v;
+	}
+
+	// Every ring of a sphere or cylinder uses the same angles, so evaluate
+	// sin/cos once per slice, four at a time.  The tables are padded to a
+	// multiple of four so the ring kernels can always load whole vectors.
+	void BuildRingSinCos(uint32 sliceCount, std::vector<float>& sinTheta, std::vector<float>& cosTheta)
+	{
+		uint32 ringVertexCount = sliceCount + 1;
+		uint32 paddedCount = (ringVertexCount + 3) & ~3u;
+
+		sinTheta.resize(paddedCount);
+		cosTheta.resize(paddedCount);
+
+		XMVECTOR lane = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+		XMVECTOR dTheta = XMVectorReplicate(2.0f*XM_PI/sliceCount);
+		for(uint32 j = 0; j < paddedCount; j += 4)
+		{
+			XMVECTOR theta = XMVectorMultiply(XMVectorAdd(XMVectorReplicate((float)j), lane), dTheta);
+
+			XMVECTOR s, c;
+			XMVectorSinCos(&s, &c, theta);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&sinTheta[j]), s);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&cosTheta[j]), c);
+		}
+	}
+
+	// Writes one horizontal ring (x = r*cos, z = r*sin) whose normal and tangent
+	// are derived per lane from the shared angle tables.
+	void BuildCylinderCapSoA(float radius, float height, float y, float ny, bool topCap, uint32 sliceCount,
+		const std::vector<float>& sinTheta, const std::vector<float>& cosTheta,
+		uint32 baseVertex, uint32* indices, GeometryGenerator::MeshDataSoA& meshData)
+	{
+		uint32 ringVertexCount = sliceCount + 1;
+
+		XMVECTOR r = XMVectorReplicate(radius);
+		XMVECTOR invHeight = XMVectorReplicate(1.0f/height);
+		XMVECTOR half = XMVectorReplicate(0.5f);
+
+		// Duplicate cap ring vertices because the texture coordinates and normals differ.
+		for(uint32 j = 0; j < ringVertexCount; j += 4)
+		{
+			uint32 count = std::min<uint32>(4, ringVertexCount - j);
+			uint32 v = baseVertex + j;
+
+			XMVECTOR x = XMVectorMultiply(r, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&cosTheta[j])));
+			XMVECTOR z = XMVectorMultiply(r, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&sinTheta[j])));
+
+			StoreLanes(&meshData.PosX[v], x, count);
+			StoreLanes(&meshData.PosZ[v], z, count);
+
+			// Scale down by the height to try and make top cap texture coord area
+			// proportional to base.
+			StoreLanes(&meshData.TexU[v], XMVectorMultiplyAdd(x, invHeight, half), count);
+			StoreLanes(&meshData.TexV[v], XMVectorMultiplyAdd(z, invHeight, half), count);
+		}
+
+		std::fill_n(&meshData.PosY[baseVertex], ringVertexCount + 1, y);
+		std::fill_n(&meshData.NormalX[baseVertex], ringVertexCount + 1, 0.0f);
+		std::fill_n(&meshData.NormalY[baseVertex], ringVertexCount + 1, ny);
+		std::fill_n(&meshData.NormalZ[baseVertex], ringVertexCount + 1, 0.0f);
+		std::fill_n(&meshData.TangentX[baseVertex], ringVertexCount + 1, 1.0f);
+		std::fill_n(&meshData.TangentY[baseVertex], ringVertexCount + 1, 0.0f);
+		std::fill_n(&meshData.TangentZ[baseVertex], ringVertexCount + 1, 0.0f);
+
+		// Cap center vertex.
+		uint32 centerIndex = baseVertex + ringVertexCount;
+		SetVertex(meshData, centerIndex, 0.0f, y, 0.0f, 0.0f, ny, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
+
+		for(uint32 i = 0; i < sliceCount; ++i)
+		{
+			indices[i*3+0] = centerIndex;
+			indices[i*3+1] = topCap ? baseVertex + i+1 : baseVertex + i;
+			indices[i*3+2] = topCap ? baseVertex + i : baseVertex + i+1;
+		}
+	}
+}
+
+void GeometryGenerator::MeshDataSoA::ResizeVertices(size_t vertexCount)
+{
+	std::vector<float>* components[] =
+	{
+		&PosX, &PosY, &PosZ,
+		&NormalX, &NormalY, &NormalZ,
+		&TangentX, &TangentY, &TangentZ,
+		&TexU, &TexV
+	};
+
+	for(std::vector<float>* c : components)
+		c->resize(vertexCount);
+}
+
+GeometryGenerator::MeshDataSoA GeometryGenerator::CreateSphereSoA(float radius, uint32 sliceCount, uint32 stackCount)
+{
+    MeshDataSoA meshData;
+
+	AllocateSphereSoA(meshData, sliceCount, stackCount);
+	BuildSphereRowsSoA(meshData, radius, sliceCount, stackCount, 0, stackCount);
+
+    return meshData;
+}
+
+void GeometryGenerator::AllocateSphereSoA(MeshDataSoA& meshData, uint32 sliceCount, uint32 stackCount)
+{
+	meshData.ResizeVertices((stackCount-1)*(sliceCount+1) + 2);
+	meshData.Indices32.resize(sliceCount*6 + (stackCount-2)*sliceCount*6);
+}
+
+void GeometryGenerator::BuildSphereRowsSoA(MeshDataSoA& meshData, float radius, uint32 sliceCount, uint32 stackCount,
+	uint32 rowBegin, uint32 rowEnd)
+{
+	//
+	// Row i is stack i counted from the top pole.  It owns ring i (row 0 owns
+	// the top pole instead) and the triangles of stack i; the last row also
+	// owns the bottom pole.  Vertex and index layout match CreateSphere.
+	//
+
+	uint32 ringVertexCount = sliceCount + 1;
+	uint32 vertexCount = (uint32)meshData.VertexCount();
+	uint32 southPoleIndex = vertexCount-1;
+
+	float phiStep   = XM_PI/stackCount;
+	float thetaStep = 2.0f*XM_PI/sliceCount;
+
+	std::vector<float> sinTheta, cosTheta;
+	BuildRingSinCos(sliceCount, sinTheta, cosTheta);
+
+	XMVECTOR lane = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	XMVECTOR vThetaStep = XMVectorReplicate(thetaStep);
+	XMVECTOR twoPi = XMVectorReplicate(XM_2PI);
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR vRadius = XMVectorReplicate(radius);
+
+	for(uint32 i = rowBegin; i < rowEnd; ++i)
+	{
+		if(i == 0)
+		{
+			// Poles, see CreateSphere for the texture coordinate caveat.
+			SetVertex(meshData, 0, 0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+		}
+		else
+		{
+			float phi = i*phiStep;
+			uint32 base = 1 + (i-1)*ringVertexCount;
+
+			XMVECTOR sinPhi = XMVectorReplicate(sinf(phi));
+			XMVECTOR cosPhi = XMVectorReplicate(cosf(phi));
+			XMVECTOR v = XMVectorReplicate(phi / XM_PI);
+
+			for(uint32 j = 0; j < ringVertexCount; j += 4)
+			{
+				uint32 count = std::min<uint32>(4, ringVertexCount - j);
+				uint32 k = base + j;
+
+				XMVECTOR s = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&sinTheta[j]));
+				XMVECTOR c = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&cosTheta[j]));
+
+				// The unit normal is the spherical direction; the position is that
+				// scaled by the radius.
+				XMVECTOR nx = XMVectorMultiply(sinPhi, c);
+				XMVECTOR nz = XMVectorMultiply(sinPhi, s);
+
+				StoreLanes(&meshData.PosX[k], XMVectorMultiply(vRadius, nx), count);
+				StoreLanes(&meshData.PosY[k], XMVectorMultiply(vRadius, cosPhi), count);
+				StoreLanes(&meshData.PosZ[k], XMVectorMultiply(vRadius, nz), count);
+
+				StoreLanes(&meshData.NormalX[k], nx, count);
+				StoreLanes(&meshData.NormalY[k], cosPhi, count);
+				StoreLanes(&meshData.NormalZ[k], nz, count);
+
+				// Normalized partial derivative of P with respect to theta.
+				StoreLanes(&meshData.TangentX[k], XMVectorNegate(s), count);
+				StoreLanes(&meshData.TangentY[k], zero, count);
+				StoreLanes(&meshData.TangentZ[k], c, count);
+
+				XMVECTOR theta = XMVectorMultiply(XMVectorAdd(XMVectorReplicate((float)j), lane), vThetaStep);
+				StoreLanes(&meshData.TexU[k], XMVectorDivide(theta, twoPi), count);
+				StoreLanes(&meshData.TexV[k], v, count);
+			}
+		}
+
+		if(i == stackCount-1)
+			SetVertex(meshData, southPoleIndex, 0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+
+		//
+		// Indices: the top stack, then the inner stacks, then the bottom stack.
+		//
+
+		if(i == 0)
+		{
+			uint32* indices = meshData.Indices32.data();
+			for(uint32 j = 1; j <= sliceCount; ++j)
+			{
+				*indices++ = 0;
+				*indices++ = j+1;
+				*indices++ = j;
+			}
+		}
+		else if(i == stackCount-1)
+		{
+			uint32* indices = meshData.Indices32.data() + sliceCount*3 + (stackCount-2)*sliceCount*6;
+			uint32 baseIndex = southPoleIndex - ringVertexCount;
+			for(uint32 j = 0; j < sliceCount; ++j)
+			{
+				*indices++ = southPoleIndex;
+				*indices++ = baseIndex+j;
+				*indices++ = baseIndex+j+1;
+			}
+		}
+		else
+		{
+			// Inner stack between rings i and i+1, skipping the top pole vertex.
+			uint32* indices = meshData.Indices32.data() + sliceCount*3 + (i-1)*sliceCount*6;
+			uint32 top = 1 + (i-1)*ringVertexCount;
+			uint32 bottom = top + ringVertexCount;
+			for(uint32 j = 0; j < sliceCount; ++j)
+			{
+				*indices++ = top + j;
+				*indices++ = top + j+1;
+				*indices++ = bottom + j;
+
+				*indices++ = bottom + j;
+				*indices++ = top + j+1;
+				*indices++ = bottom + j+1;
+			}
+		}
+	}
+}
+
+GeometryGenerator::MeshDataSoA GeometryGenerator::CreateCylinderSoA(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
+{
+    MeshDataSoA meshData;
+
+	uint32 ringCount = stackCount+1;
+	uint32 ringVertexCount = sliceCount+1;
+	uint32 sideVertexCount = ringCount*ringVertexCount;
+
+	// Side rings followed by the top and bottom caps, each a ring plus a center.
+	meshData.ResizeVertices(sideVertexCount + 2*(ringVertexCount+1));
+	meshData.Indices32.resize(stackCount*sliceCount*6 + 2*sliceCount*3);
+
+	float stackHeight = height / stackCount;
+	float radiusStep = (topRadius - bottomRadius) / stackCount;
+
+	std::vector<float> sinTheta, cosTheta;
+	BuildRingSinCos(sliceCount, sinTheta, cosTheta);
+
+	// The side normal is normalize(cross(T, B)) with T = (-s, 0, c) and
+	// B = (dr*c, -h, dr*s), see CreateCylinder.  That expands to
+	// (h*c, dr, h*s) / sqrt(h^2 + dr^2), which is the same for every ring.
+	float dr = bottomRadius-topRadius;
+	float invLength = 1.0f / sqrtf(height*height + dr*dr);
+	XMVECTOR nScale = XMVectorReplicate(height*invLength);
+	XMVECTOR ny = XMVectorReplicate(dr*invLength);
+
+	XMVECTOR lane = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	XMVECTOR invSlice = XMVectorReplicate(1.0f/sliceCount);
+	XMVECTOR zero = XMVectorZero();
+
+	// Compute vertices for each stack ring starting at the bottom and moving up.
+	for(uint32 i = 0; i < ringCount; ++i)
+	{
+		uint32 base = i*ringVertexCount;
+
+		XMVECTOR r = XMVectorReplicate(bottomRadius + i*radiusStep);
+		XMVECTOR y = XMVectorReplicate(-0.5f*height + i*stackHeight);
+		XMVECTOR v = XMVectorReplicate(1.0f - (float)i/stackCount);
+
+		for(uint32 j = 0; j < ringVertexCount; j += 4)
+		{
+			uint32 count = std::min<uint32>(4, ringVertexCount - j);
+			uint32 k = base + j;
+
+			XMVECTOR s = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&sinTheta[j]));
+			XMVECTOR c = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&cosTheta[j]));
+
+			StoreLanes(&meshData.PosX[k], XMVectorMultiply(r, c), count);
+			StoreLanes(&meshData.PosY[k], y, count);
+			StoreLanes(&meshData.PosZ[k], XMVectorMultiply(r, s), count);
+
+			StoreLanes(&meshData.NormalX[k], XMVectorMultiply(nScale, c), count);
+			StoreLanes(&meshData.NormalY[k], ny, count);
+			StoreLanes(&meshData.NormalZ[k], XMVectorMultiply(nScale, s), count);
+
+			// This is unit length.
+			StoreLanes(&meshData.TangentX[k], XMVectorNegate(s), count);
+			StoreLanes(&meshData.TangentY[k], zero, count);
+			StoreLanes(&meshData.TangentZ[k], c, count);
+
+			XMVECTOR jj = XMVectorAdd(XMVectorReplicate((float)j), lane);
+			StoreLanes(&meshData.TexU[k], XMVectorMultiply(jj, invSlice), count);
+			StoreLanes(&meshData.TexV[k], v, count);
+		}
+	}
+
+	uint32* indices = meshData.Indices32.data();
+	for(uint32 i = 0; i < stackCount; ++i)
+	{
+		for(uint32 j = 0; j < sliceCount; ++j)
+		{
+			*indices++ = i*ringVertexCount + j;
+			*indices++ = (i+1)*ringVertexCount + j;
+			*indices++ = (i+1)*ringVertexCount + j+1;
+
+			*indices++ = i*ringVertexCount + j;
+			*indices++ = (i+1)*ringVertexCount + j+1;
+			*indices++ = i*ringVertexCount + j+1;
+		}
+	}
+
+	uint32 topBase = sideVertexCount;
+	uint32 bottomBase = topBase + ringVertexCount + 1;
+
+	BuildCylinderCapSoA(topRadius, height, 0.5f*height, 1.0f, true, sliceCount,
+		sinTheta, cosTheta, topBase, indices, meshData);
+	BuildCylinderCapSoA(bottomRadius, height, -0.5f*height, -1.0f, false, sliceCount,
+		sinTheta, cosTheta, bottomBase, indices + sliceCount*3, meshData);
+
+    return meshData;
+}
+
+GeometryGenerator::MeshDataSoA GeometryGenerator::CreateGridSoA(float width, float depth, uint32 m, uint32 n)
+{
+    MeshDataSoA meshData;
+
+	AllocateGridSoA(meshData, m, n);
+	BuildGridRowsSoA(meshData, width, depth, m, n, 0, m);
+
+    return meshData;
+}
+
+void GeometryGenerator::AllocateGridSoA(MeshDataSoA& meshData, uint32 m, uint32 n)
+{
+	meshData.ResizeVertices(m*n);
+	meshData.Indices32.resize((m-1)*(n-1)*2*3); // 3 indices per face
+}
+
+void GeometryGenerator::BuildGridRowsSoA(MeshDataSoA& meshData, float width, float depth, uint32 m, uint32 n,
+	uint32 rowBegin, uint32 rowEnd)
+{
+	float halfWidth = 0.5f*width;
+	float halfDepth = 0.5f*depth;
+
+	float dz = depth / (m-1);
+	float dv = 1.0f / (m-1);
+
+	XMVECTOR lane = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	XMVECTOR dx = XMVectorReplicate(width / (n-1));
+	XMVECTOR du = XMVectorReplicate(1.0f / (n-1));
+	XMVECTOR x0 = XMVectorReplicate(-halfWidth);
+
+	// A grid row only varies in x and u, and those are the same for every row.
+	for(uint32 i = rowBegin; i < rowEnd; ++i)
+	{
+		uint32 base = i*n;
+
+		XMVECTOR z = XMVectorReplicate(halfDepth - i*dz);
+		XMVECTOR v = XMVectorReplicate(i*dv);
+
+		for(uint32 j = 0; j < n; j += 4)
+		{
+			uint32 count = std::min<uint32>(4, n - j);
+			uint32 k = base + j;
+
+			XMVECTOR jj = XMVectorAdd(XMVectorReplicate((float)j), lane);
+
+			StoreLanes(&meshData.PosX[k], XMVectorMultiplyAdd(jj, dx, x0), count);
+			StoreLanes(&meshData.PosZ[k], z, count);
+			StoreLanes(&meshData.TexU[k], XMVectorMultiply(jj, du), count);
+			StoreLanes(&meshData.TexV[k], v, count);
+		}
+	}
+
+	size_t vertexBegin = (size_t)rowBegin*n;
+	size_t vertexEnd = (size_t)rowEnd*n;
+	std::fill(&meshData.PosY[0] + vertexBegin, &meshData.PosY[0] + vertexEnd, 0.0f);
+	std::fill(&meshData.NormalX[0] + vertexBegin, &meshData.NormalX[0] + vertexEnd, 0.0f);
+	std::fill(&meshData.NormalY[0] + vertexBegin, &meshData.NormalY[0] + vertexEnd, 1.0f);
+	std::fill(&meshData.NormalZ[0] + vertexBegin, &meshData.NormalZ[0] + vertexEnd, 0.0f);
+	std::fill(&meshData.TangentX[0] + vertexBegin, &meshData.TangentX[0] + vertexEnd, 1.0f);
+	std::fill(&meshData.TangentY[0] + vertexBegin, &meshData.TangentY[0] + vertexEnd, 0.0f);
+	std::fill(&meshData.TangentZ[0] + vertexBegin, &meshData.TangentZ[0] + vertexEnd, 0.0f);
+
+	// Row i owns the quads between rows i and i+1.
+	uint32 quadRowEnd = std::min(rowEnd, m-1);
+	for(uint32 i = rowBegin; i < quadRowEnd; ++i)
+	{
+		uint32* indices = meshData.Indices32.data() + (size_t)i*(n-1)*6;
+		for(uint32 j = 0; j < n-1; ++j)
+		{
+			*indices++ = i*n+j;
+			*indices++ = i*n+j+1;
+			*indices++ = (i+1)*n+j;
+
+			*indices++ = (i+1)*n+j;
+			*indices++ = i*n+j+1;
+			*indices++ = (i+1)*n+j+1;
+		}
+	}
+}
+
+void GeometryGenerator::InterleavePositionNormal(const MeshDataSoA& meshData, void* dst, size_t stride)
+{
+	size_t vertexCount = meshData.VertexCount();
+	size_t i = 0;
+
+	// Packed {Pos, Normal} vertices: transpose four vertices at a time from
+	// six component vectors into six output vectors (24 contiguous floats).
+	if(stride == 6*sizeof(float))
+	{
+		float* out = static_cast<float*>(dst);
+		for(; i + 4 <= vertexCount; i += 4, out += 24)
+		{
+			XMMATRIX pxyz = XMMatrixTranspose(XMMATRIX(
+				XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&meshData.PosX[i])),
+				XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&meshData.PosY[i])),
+				XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&meshData.PosZ[i])),
+				XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&meshData.NormalX[i]))));
+
+			XMVECTOR ny = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&meshData.NormalY[i]));
+			XMVECTOR nz = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&meshData.NormalZ[i]));
+
+			// (ny0, nz0, ny1, nz1) and (ny2, nz2, ny3, nz3).
+			XMVECTOR n01 = XMVectorMergeXY(ny, nz);
+			XMVECTOR n23 = XMVectorMergeZW(ny, nz);
+
+			XMFLOAT4* o = reinterpret_cast<XMFLOAT4*>(out);
+			XMStoreFloat4(o + 0, pxyz.r[0]);
+			XMStoreFloat4(o + 1, XMVectorPermute<0, 1, 4, 5>(n01, pxyz.r[1]));
+			XMStoreFloat4(o + 2, XMVectorPermute<2, 3, 6, 7>(pxyz.r[1], n01));
+			XMStoreFloat4(o + 3, pxyz.r[2]);
+			XMStoreFloat4(o + 4, XMVectorPermute<0, 1, 4, 5>(n23, pxyz.r[3]));
+			XMStoreFloat4(o + 5, XMVectorPermute<2, 3, 6, 7>(pxyz.r[3], n23));
+		}
+	}
+
+	for(; i < vertexCount; ++i)
+	{
+		float* out = reinterpret_cast<float*>(static_cast<char*>(dst) + i*stride);
+		out[0] = meshData.PosX[i];
+		out[1] = meshData.PosY[i];
+		out[2] = meshData.PosZ[i];
+		out[3] = meshData.NormalX[i];
+		out[4] = meshData.NormalY[i];
+		out[5] = meshData.NormalZ[i];
+	}
+}
+
+bool GeometryGenerator::PackIndices16(const uint32* src, size_t count, uint16* dst)
+{
+	size_t i = 0;
+	uint32 overflow = 0;
+
+#if defined(GEOMETRY_GENERATOR_SSE2)
+	// SSE2 has no unsigned 32->16 saturating pack, so sign-extend the low 16
+	// bits first; packs_epi32 then reproduces them exactly.  The high halves
+	// are OR-ed together to detect indices that did not fit.
+	__m128i high = _mm_setzero_si128();
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+
+		high = _mm_or_si128(high, _mm_or_si128(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16)));
+
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+	}
+
+	high = _mm_or_si128(high, _mm_srli_si128(high, 8));
+	high = _mm_or_si128(high, _mm_srli_si128(high, 4));
+	overflow = (uint32)_mm_cvtsi128_si32(high);
+#endif
+
+	for(; i < count; ++i)
+	{
+		overflow |= src[i] >> 16;
+		dst[i] = static_cast<uint16>(src[i]);
+	}
+
+	return overflow == 0;
+}
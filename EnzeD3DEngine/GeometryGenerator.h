@@ -16,6 +16,7 @@
 
 #include <cstdint>
 #include <DirectXMath.h>
+#include <stdexcept>
 #include <vector>
 
 class GeometryGenerator
@@ -25,6 +26,13 @@ public:
     using uint16 = std::uint16_t;
     using uint32 = std::uint32_t;
 
+	///<summary>
+	/// Narrows count 32-bit indices into dst, eight at a time with SSE2 where
+	/// available.  Returns false if any index is above 0xFFFF; dst is then
+	/// only partially meaningful and must not be used.
+	///</summary>
+    static bool PackIndices16(const uint32* src, size_t count, uint16* dst);
+
 	struct Vertex
 	{
 		Vertex(){}
@@ -58,22 +66,48 @@ public:
 		std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
 
+        // Throws std::overflow_error if an index does not fit in 16 bits.
         std::vector<uint16>& GetIndices16()
         {
 			if(mIndices16.empty())
 			{
 				mIndices16.resize(Indices32.size());
-				for(size_t i = 0; i < Indices32.size(); ++i)
-					mIndices16[i] = static_cast<uint16>(Indices32[i]);
+				if(!PackIndices16(Indices32.data(), Indices32.size(), mIndices16.data()))
+				{
+					mIndices16.clear();
+					throw std::overflow_error("MeshData index does not fit in 16 bits");
+				}
 			}
 
 			return mIndices16;
         }
 
+        // Call after rewriting Indices32 so GetIndices16 narrows them again.
+        void IndicesChanged() { mIndices16.clear(); }
+
 	private:
 		std::vector<uint16> mIndices16;
 	};
 
+	///<summary>
+	/// Structure-of-arrays variant of MeshData.  Every vertex component lives in
+	/// its own array so the batched builders can generate four vertices per
+	/// SIMD store instead of one Vertex per push_back.
+	///</summary>
+	struct MeshDataSoA
+	{
+		std::vector<float> PosX, PosY, PosZ;
+		std::vector<float> NormalX, NormalY, NormalZ;
+		std::vector<float> TangentX, TangentY, TangentZ;
+		std::vector<float> TexU, TexV;
+		std::vector<uint32> Indices32;
+
+		size_t VertexCount()const { return PosX.size(); }
+
+		// Sizes every component array to vertexCount.
+		void ResizeVertices(size_t vertexCount);
+	};
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
@@ -110,6 +144,34 @@ public:
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
 
+	///<summary>
+	/// SIMD counterparts of CreateSphere, CreateCylinder and CreateGrid.  They
+	/// produce the same vertices and indices in structure-of-arrays form.
+	///</summary>
+    MeshDataSoA CreateSphereSoA(float radius, uint32 sliceCount, uint32 stackCount);
+    MeshDataSoA CreateCylinderSoA(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
+    MeshDataSoA CreateGridSoA(float width, float depth, uint32 m, uint32 n);
+
+	///<summary>
+	/// Row-range pieces of CreateSphereSoA and CreateGridSoA so one large mesh
+	/// can be generated by several threads.  Allocate*SoA sizes the mesh, then
+	/// Build*RowsSoA fills rows [rowBegin, rowEnd): a sphere has stackCount rows,
+	/// a grid has m rows.  Disjoint row ranges may be built concurrently.
+	///</summary>
+    static void AllocateSphereSoA(MeshDataSoA& meshData, uint32 sliceCount, uint32 stackCount);
+    static void BuildSphereRowsSoA(MeshDataSoA& meshData, float radius, uint32 sliceCount, uint32 stackCount,
+        uint32 rowBegin, uint32 rowEnd);
+    static void AllocateGridSoA(MeshDataSoA& meshData, uint32 m, uint32 n);
+    static void BuildGridRowsSoA(MeshDataSoA& meshData, float width, float depth, uint32 m, uint32 n,
+        uint32 rowBegin, uint32 rowEnd);
+
+	///<summary>
+	/// Writes the position and normal of every vertex into dst, one vertex
+	/// every stride bytes, with the normal directly following the position.
+	/// A packed {float3 Pos; float3 Normal;} destination takes the SIMD path.
+	///</summary>
+    static void InterleavePositionNormal(const MeshDataSoA& meshData, void* dst, size_t stride);
+
 private:
 	void Subdivide(MeshData& meshData);
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
@@ -0,0 +1,141 @@
+#include "GpuBufferAllocator.h"
+#include <algorithm>
+
+namespace
+{
+    UINT64 NextPowerOfTwo(UINT64 value)
+    {
+        UINT64 result = 1;
+        while(result < value)
+            result <<= 1;
+        return result;
+    }
+}
+
+GpuBufferAllocator::GpuBufferAllocator(ID3D12Device* device, UINT64 pageSize, UINT64 minBlockSize) :
+    mDevice(device),
+    mPageSize(std::max<UINT64>(NextPowerOfTwo(pageSize), D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)),
+    mMinBlockSize(NextPowerOfTwo(minBlockSize))
+{
+}
+
+GpuBufferAllocation GpuBufferAllocator::Allocate(UINT64 byteSize, UINT64 alignment)
+{
+    // Empty buffers still get a distinct range.
+    const UINT64 blockSize = std::max<UINT64>(byteSize, 1);
+
+    Page* page = nullptr;
+    UINT64 offset = BuddyAllocator::InvalidOffset;
+    for(auto& p : mPages)
+    {
+        offset = p->Blocks.Allocate(blockSize, alignment);
+        if(offset != BuddyAllocator::InvalidOffset)
+        {
+            page = p.get();
+            break;
+        }
+    }
+
+    if(page == nullptr)
+    {
+        page = &CreatePage(std::max<UINT64>(mPageSize, NextPowerOfTwo(std::max<UINT64>(blockSize, alignment))));
+        offset = page->Blocks.Allocate(blockSize, alignment);
+    }
+
+    GpuBufferAllocation allocation;
+    allocation.Resource = page->Buffer.Get();
+    allocation.Offset = offset;
+    allocation.Size = byteSize;
+    allocation.GpuAddress = page->Buffer->GetGPUVirtualAddress() + offset;
+    return allocation;
+}
+
+void GpuBufferAllocator::Free(ID3D12Resource* resource, UINT64 offset)
+{
+    Page* page = FindPage(resource);
+    if(page != nullptr)
+        page->Blocks.Free(offset);
+}
+
+void GpuBufferAllocator::ReleaseEmptyPages()
+{
+    if(mPages.size() <= 1)
+        return;
+
+    auto empty = std::remove_if(mPages.begin() + 1, mPages.end(),
+        [](const std::unique_ptr<Page>& page) { return page->Blocks.AllocationCount() == 0; });
+    mPages.erase(empty, mPages.end());
+}
+
+void GpuBufferAllocator::MarkRead(UINT64 readFenceValue)
+{
+    for(auto& page : mPages)
+    {
+        if(page->Blocks.AllocationCount() != 0)
+            page->ReadFence = readFenceValue;
+    }
+}
+
+UINT64 GpuBufferAllocator::ReadFence(ID3D12Resource* resource)const
+{
+    Page* page = FindPage(resource);
+    return page != nullptr ? page->ReadFence : 0;
+}
+
+size_t GpuBufferAllocator::PlanCompaction(ID3D12Resource* resource, size_t maxMoves,
+    std::vector<BuddyAllocator::Move>& moves)
+{
+    Page* page = FindPage(resource);
+    if(page == nullptr)
+        return 0;
+
+    return page->Blocks.PlanCompaction(maxMoves, moves);
+}
+
+UINT64 GpuBufferAllocator::ReservedBytes()const
+{
+    UINT64 bytes = 0;
+    for(const auto& page : mPages)
+        bytes += page->Blocks.Capacity();
+    return bytes;
+}
+
+UINT64 GpuBufferAllocator::AllocatedBytes()const
+{
+    UINT64 bytes = 0;
+    for(const auto& page : mPages)
+        bytes += page->Blocks.AllocatedBytes();
+    return bytes;
+}
+
+GpuBufferAllocator::Page& GpuBufferAllocator::CreatePage(UINT64 size)
+{
+    auto page = std::make_unique<Page>();
+
+    CD3DX12_HEAP_DESC heapDesc(size, D3D12_HEAP_TYPE_DEFAULT,
+        D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS);
+    ThrowIfFailed(mDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&page->Heap)));
+
+    ThrowIfFailed(mDevice->CreatePlacedResource(
+        page->Heap.Get(),
+        0,
+        &CD3DX12_RESOURCE_DESC::Buffer(size),
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&page->Buffer)));
+
+    page->Blocks.Reset(size, mMinBlockSize);
+
+    mPages.push_back(std::move(page));
+    return *mPages.back();
+}
+
+GpuBufferAllocator::Page* GpuBufferAllocator::FindPage(ID3D12Resource* resource)const
+{
+    for(const auto& page : mPages)
+    {
+        if(page->Buffer.Get() == resource)
+            return page.get();
+    }
+    return nullptr;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "d3dUtil.h"
+#include "BuddyAllocator.h"
+
+struct GpuBufferAllocation
+{
+    ID3D12Resource* Resource = nullptr;
+    UINT64 Offset = 0;
+    UINT64 Size = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+};
+
+// Default heap memory for static buffers such as vertex and index data.
+//
+// Memory is reserved in pages, each an ID3D12Heap with a single buffer placed
+// over all of it, and buffer ranges are suballocated from a page with a
+// BuddyAllocator.  Placing a resource per buffer would still round each one
+// up to D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT (64KB), so allocations are
+// byte ranges of the page buffer instead: bind Resource at Offset, or use
+// GpuAddress directly.  A request larger than the page size gets a page of
+// its own.
+//
+// Page buffers are created in D3D12_RESOURCE_STATE_COMMON and rely on buffer
+// state promotion: a copy promotes the buffer to COPY_DEST, a draw to the
+// read states it uses, and it decays back to COMMON when each
+// ExecuteCommandLists completes, so uploads and draws record no barriers.
+// Promotion is per queue, so the copy queue and the direct queue must never
+// use a page at the same time.  UploadManager keeps them apart in two ways:
+//  - A page that no submitted frame reads, such as one created for new
+//    meshes, is written freely; the direct queue waits on the copy fence
+//    before the first frame that may draw from it (MakeQueueWait()).
+//  - A page that frames in flight read has a ReadFence(), and a copy into it
+//    waits on the GPU for that fence, so it starts after the last read.
+//    Call MarkRead() after submitting each frame that draws from the pages.
+//
+// Free() and ReleaseEmptyPages() must only be called once the GPU is done
+// with the memory.
+class GpuBufferAllocator
+{
+public:
+    GpuBufferAllocator(ID3D12Device* device, UINT64 pageSize, UINT64 minBlockSize = 256);
+    GpuBufferAllocator(const GpuBufferAllocator& rhs) = delete;
+    GpuBufferAllocator& operator=(const GpuBufferAllocator& rhs) = delete;
+
+    GpuBufferAllocation Allocate(UINT64 byteSize, UINT64 alignment = 256);
+    // resource and offset are those of an allocation.
+    void Free(ID3D12Resource* resource, UINT64 offset);
+
+    // Releases pages without allocations, keeping the first one.
+    void ReleaseEmptyPages();
+
+    // Records that work signaling readFenceValue on the reading queue's
+    // fence may read every page with allocations.
+    void MarkRead(UINT64 readFenceValue);
+    // The fence value of the last work marked as reading the page holding
+    // resource, 0 when none was.
+    UINT64 ReadFence(ID3D12Resource* resource)const;
+
+    // Defragmentation hook: plans up to maxMoves moves towards the start of
+    // the page holding resource, see BuddyAllocator::PlanCompaction().  The
+    // moves take effect in the allocator immediately; the caller copies the
+    // ranges (through a temporary buffer, since a copy cannot read and write
+    // the same buffer) and repoints whatever used the old offsets.
+    size_t PlanCompaction(ID3D12Resource* resource, size_t maxMoves,
+        std::vector<BuddyAllocator::Move>& moves);
+
+    UINT PageCount()const { return (UINT)mPages.size(); }
+    // Heap memory reserved by all pages, and the part of it allocated.
+    UINT64 ReservedBytes()const;
+    UINT64 AllocatedBytes()const;
+
+private:
+    struct Page
+    {
+        Microsoft::WRL::ComPtr<ID3D12Heap> Heap;
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        BuddyAllocator Blocks;
+        UINT64 ReadFence = 0;
+    };
+
+    Page& CreatePage(UINT64 size);
+    Page* FindPage(ID3D12Resource* resource)const;
+
+    ID3D12Device* mDevice = nullptr;
+    UINT64 mPageSize = 0;
+    UINT64 mMinBlockSize = 0;
+    std::vector<std::unique_ptr<Page>> mPages;
+};
@@ -0,0 +1,86 @@
+#include "InstanceBatcher.h"
+#include "CommandRecorder.h"
+#include <algorithm>
+
+namespace
+{
+    const std::uint32_t NoBatch = ~0u;
+}
+
+void InstanceBatcher::Build(const RenderItemStore& items, const std::uint32_t* visible, size_t visibleCount,
+    const float* visibleDepth)
+{
+    const std::uint32_t* stateIds = items.DrawStateIds().data();
+    const std::uint32_t* objCBIndices = items.ObjCBIndices().data();
+    const std::vector<Material*>& mats = items.Materials();
+
+    mBatches.clear();
+    mBatchOfState.assign(items.DrawStates().size(), NoBatch);
+
+    // Count the instances of every state that is visible this frame.  Batches
+    // are created in order of first appearance.
+    for(size_t i = 0; i < visibleCount; ++i)
+    {
+        std::uint32_t state = stateIds[visible[i]];
+        std::uint32_t& batch = mBatchOfState[state];
+        if(batch == NoBatch)
+        {
+            batch = (std::uint32_t)mBatches.size();
+            InstanceBatch b;
+            b.DrawState = state;
+            if(visibleDepth != nullptr)
+                b.Depth = visibleDepth[i];
+            mBatches.push_back(b);
+        }
+        ++mBatches[batch].InstanceCount;
+        if(visibleDepth != nullptr)
+            mBatches[batch].Depth = std::min<float>(mBatches[batch].Depth, visibleDepth[i]);
+    }
+
+    std::uint32_t offset = 0;
+    size_t largest = 0;
+    for(InstanceBatch& b : mBatches)
+    {
+        b.InstanceOffset = offset;
+        offset += b.InstanceCount;
+        largest = std::max<size_t>(largest, b.InstanceCount);
+    }
+
+    // Scatter; InstanceCount is rebuilt as the write cursor.
+    mInstances.resize(visibleCount);
+    for(InstanceBatch& b : mBatches)
+        b.InstanceCount = 0;
+    for(size_t i = 0; i < visibleCount; ++i)
+    {
+        std::uint32_t item = visible[i];
+        InstanceBatch& b = mBatches[mBatchOfState[stateIds[item]]];
+        InstanceData& instance = mInstances[b.InstanceOffset + b.InstanceCount++];
+        instance.ObjectIndex = objCBIndices[item];
+        instance.MaterialIndex = (std::uint32_t)mats[item]->MatCBIndex;
+    }
+
+    mStats.Items = visibleCount;
+    mStats.Batches = mBatches.size();
+    mStats.LargestBatch = largest;
+}
+
+void InstanceBatcher::SortBatches(const RenderItemStore& items)
+{
+    // The app draws everything with one pipeline state, and materials come
+    // from the material table per instance, so those fields of the key stay
+    // 0.
+    const std::vector<DrawState>& states = items.DrawStates();
+    mSortKeys.resize(mBatches.size());
+    for(size_t i = 0; i < mBatches.size(); ++i)
+    {
+        const DrawState& state = states[mBatches[i].DrawState];
+        mSortKeys[i].first = DrawSortKey::Make(0, state.GeometryId, 0, mBatches[i].Depth);
+        mSortKeys[i].second = (std::uint32_t)i;
+    }
+    std::sort(mSortKeys.begin(), mSortKeys.end());
+
+    mSortedBatches.resize(mBatches.size());
+    for(size_t i = 0; i < mSortKeys.size(); ++i)
+        mSortedBatches[i] = mBatches[mSortKeys[i].second];
+    mBatches.swap(mSortedBatches);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "RenderItemStore.h"
+#include "RenderTypes.h"
+
+// Visible items that share a DrawState, drawn with one DrawIndexedInstanced.
+// Their InstanceData occupies [InstanceOffset, InstanceOffset + InstanceCount)
+// of InstanceBatcher::Instances().
+struct InstanceBatch
+{
+    std::uint32_t DrawState = 0;
+    std::uint32_t InstanceOffset = 0;
+    std::uint32_t InstanceCount = 0;
+    // View depth of the nearest instance, 0 when Build() got no depths.
+    float Depth = 0.0f;
+};
+
+// Groups the visible render items of a frame by DrawState.  Build() is a
+// counting sort on the store's draw state ids, so it is linear in the number
+// of visible items and keeps their relative order inside a batch.  It only
+// touches CPU memory; the caller uploads Instances() for the GPU.
+class InstanceBatcher
+{
+public:
+    struct Stats
+    {
+        size_t Items = 0;
+        size_t Batches = 0;
+        size_t LargestBatch = 0;
+    };
+
+    // visible holds dense indices into items; visibleDepth, if given, the
+    // view depth of each of them.
+    void Build(const RenderItemStore& items, const std::uint32_t* visible, size_t visibleCount,
+        const float* visibleDepth = nullptr);
+
+    // Orders the batches by DrawSortKey so consecutive draws share as much
+    // state as possible.  Instance ranges stay where Build() put them.
+    void SortBatches(const RenderItemStore& items);
+
+    const std::vector<InstanceBatch>& Batches()const { return mBatches; }
+    const std::vector<InstanceData>& Instances()const { return mInstances; }
+    const Stats& GetStats()const { return mStats; }
+
+private:
+    std::vector<InstanceBatch> mBatches;
+    std::vector<InstanceData> mInstances;
+    // Per draw state id: the batch it went to in the last Build, or ~0u.
+    std::vector<std::uint32_t> mBatchOfState;
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> mSortKeys;
+    std::vector<InstanceBatch> mSortedBatches;
+    Stats mStats;
+};
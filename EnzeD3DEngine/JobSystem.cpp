@@ -0,0 +1,433 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+struct JobTask
+{
+    JobSystem::Job Fn;
+    JobCounter* Counter = nullptr;
+};
+
+namespace
+{
+    // Chase-Lev work-stealing deque, with the memory orderings from Le et al.,
+    // "Correct and Efficient Work-Stealing for Weak Memory Models".  Push and
+    // Pop are owner-only; Steal may be called from any thread.  Arrays that
+    // were grown out of are kept until the deque dies because a thief may
+    // still be reading them.
+    class WorkStealingDeque
+    {
+    public:
+        WorkStealingDeque()
+        {
+            mArrays.emplace_back(new Array(InitialCapacity));
+            mArray.store(mArrays.back().get(), std::memory_order_relaxed);
+        }
+
+        void Push(JobTask* task)
+        {
+            std::int64_t b = mBottom.load(std::memory_order_relaxed);
+            std::int64_t t = mTop.load(std::memory_order_acquire);
+            Array* a = mArray.load(std::memory_order_relaxed);
+            if(b - t >= a->Capacity)
+                a = Grow(a, t, b);
+
+            a->Put(b, task);
+            mBottom.store(b + 1, std::memory_order_release);
+        }
+
+        JobTask* Pop()
+        {
+            std::int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+            Array* a = mArray.load(std::memory_order_relaxed);
+            mBottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t t = mTop.load(std::memory_order_relaxed);
+
+            if(t > b)
+            {
+                mBottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            JobTask* task = a->Get(b);
+            if(t == b)
+            {
+                // Last element: race the thieves for it.
+                if(!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    task = nullptr;
+                mBottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        JobTask* Steal()
+        {
+            std::int64_t t = mTop.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t b = mBottom.load(std::memory_order_acquire);
+            if(t >= b)
+                return nullptr;
+
+            Array* a = mArray.load(std::memory_order_acquire);
+            JobTask* task = a->Get(t);
+            if(!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+
+            return task;
+        }
+
+        bool Empty()const
+        {
+            return mTop.load(std::memory_order_acquire) >= mBottom.load(std::memory_order_acquire);
+        }
+
+    private:
+        static const std::int64_t InitialCapacity = 256;
+
+        struct Array
+        {
+            explicit Array(std::int64_t capacity) :
+                Capacity(capacity),
+                Slots(new std::atomic<JobTask*>[capacity])
+            {
+            }
+
+            JobTask* Get(std::int64_t i)const { return Slots[i & (Capacity - 1)].load(std::memory_order_relaxed); }
+            void Put(std::int64_t i, JobTask* task) { Slots[i & (Capacity - 1)].store(task, std::memory_order_relaxed); }
+
+            const std::int64_t Capacity;
+            std::unique_ptr<std::atomic<JobTask*>[]> Slots;
+        };
+
+        Array* Grow(Array* a, std::int64_t top, std::int64_t bottom)
+        {
+            mArrays.emplace_back(new Array(a->Capacity * 2));
+            Array* grown = mArrays.back().get();
+            for(std::int64_t i = top; i < bottom; ++i)
+                grown->Put(i, a->Get(i));
+
+            mArray.store(grown, std::memory_order_release);
+            return grown;
+        }
+
+        std::atomic<std::int64_t> mTop{ 0 };
+        std::atomic<std::int64_t> mBottom{ 0 };
+        std::atomic<Array*> mArray{ nullptr };
+        std::vector<std::unique_ptr<Array>> mArrays;
+    };
+
+    // The slots the current thread owns, one per JobSystem it created or
+    // works for, keyed by the system's id.  Ids are never reused, so an entry
+    // left behind by a system destroyed on another thread cannot match a
+    // later system at the same address.
+    struct OwnedSlot
+    {
+        std::uint64_t System;
+        int Slot;
+    };
+    thread_local std::vector<OwnedSlot> tOwnedSlots;
+
+    std::atomic<std::uint64_t> gNextSystemId{ 1 };
+
+    void ClaimSlot(std::uint64_t system, int slot)
+    {
+        tOwnedSlots.push_back({ system, slot });
+    }
+
+    void ReleaseSlot(std::uint64_t system)
+    {
+        tOwnedSlots.erase(std::remove_if(tOwnedSlots.begin(), tOwnedSlots.end(),
+            [system](const OwnedSlot& s) { return s.System == system; }), tOwnedSlots.end());
+    }
+}
+
+struct JobSystem::WorkerSlot
+{
+    WorkStealingDeque Queue;
+    std::uint32_t RandomState = 0;
+
+    std::atomic<std::uint64_t> TasksExecuted{ 0 };
+    std::atomic<std::uint64_t> StealAttempts{ 0 };
+    std::atomic<std::uint64_t> Steals{ 0 };
+};
+
+JobSystem::JobSystem(unsigned workerCount) :
+    mId(gNextSystemId.fetch_add(1, std::memory_order_relaxed))
+{
+    if(workerCount == 0)
+    {
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    // One slot per worker plus the creating thread, plus one that only holds
+    // the stats of outside threads.
+    mSlots.reserve(workerCount + 2);
+    for(unsigned i = 0; i < workerCount + 2; ++i)
+    {
+        mSlots.emplace_back(new WorkerSlot());
+        mSlots.back()->RandomState = 0x9E3779B9u * (i + 1);
+    }
+
+    ClaimSlot(mId, 0);
+
+    mWorkers.reserve(workerCount);
+    for(unsigned i = 0; i < workerCount; ++i)
+        mWorkers.emplace_back(&JobSystem::WorkerMain, this, (int)i + 1);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepLock);
+        mStopping.store(true);
+        mWorkVersion.fetch_add(1);
+    }
+    mWake.notify_all();
+
+    for(std::thread& worker : mWorkers)
+        worker.join();
+
+    // Jobs queued while the workers were shutting down are dropped.
+    for(std::unique_ptr<WorkerSlot>& s : mSlots)
+    {
+        while(JobTask* task = s->Queue.Steal())
+            delete task;
+    }
+    for(JobTask* task : mInjected)
+        delete task;
+
+    ReleaseSlot(mId);
+}
+
+int JobSystem::CurrentSlot()const
+{
+    // Usually one entry; more only while a thread uses several systems.
+    for(const OwnedSlot& s : tOwnedSlots)
+    {
+        if(s.System == mId)
+            return s.Slot;
+    }
+    return -1;
+}
+
+void JobSystem::Push(JobTask* task)
+{
+    int slot = CurrentSlot();
+    if(slot >= 0)
+    {
+        mSlots[slot]->Queue.Push(task);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(mInjectedLock);
+        mInjected.push_back(task);
+    }
+
+    // Pairs with the version check in WorkerMain: either the worker sees the
+    // new version and stays awake, or we see it sleeping and wake it.
+    mWorkVersion.fetch_add(1);
+    if(mSleeping.load() != 0)
+    {
+        std::lock_guard<std::mutex> lock(mSleepLock);
+        mWake.notify_one();
+    }
+}
+
+void JobSystem::Run(Job job, JobCounter* counter)
+{
+    if(counter != nullptr)
+        counter->Pending.fetch_add(1, std::memory_order_relaxed);
+
+    JobTask* task = new JobTask();
+    task->Fn = std::move(job);
+    task->Counter = counter;
+    Push(task);
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, Job job, JobCounter* counter)
+{
+    if(counter != nullptr)
+        counter->Pending.fetch_add(1, std::memory_order_relaxed);
+
+    JobTask* task = new JobTask();
+    task->Fn = std::move(job);
+    task->Counter = counter;
+
+    {
+        std::lock_guard<std::mutex> lock(dependency.ContinuationLock);
+        if(dependency.Pending.load(std::memory_order_acquire) != 0)
+        {
+            dependency.Continuations.push_back(task);
+            return;
+        }
+    }
+
+    Push(task);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    int slot = CurrentSlot();
+    while(counter.Pending.load(std::memory_order_acquire) != 0)
+    {
+        JobTask* task = FindTask(slot);
+        if(task != nullptr)
+            Execute(task, slot);
+        else
+            std::this_thread::yield();
+    }
+
+    // The job that finished the group may still be releasing continuations;
+    // the counter must not die under it.
+    std::lock_guard<std::mutex> lock(counter.ContinuationLock);
+}
+
+void JobSystem::ParallelFor(std::uint32_t count, std::uint32_t grainSize, const RangeJob& body)
+{
+    grainSize = std::max<std::uint32_t>(grainSize, 1);
+
+    JobCounter counter;
+    for(std::uint32_t begin = 0; begin < count; begin += grainSize)
+    {
+        std::uint32_t end = std::min(count, begin + grainSize);
+        Run([&body, begin, end]() { body(begin, end); }, &counter);
+    }
+
+    Wait(counter);
+}
+
+JobSystem::Stats JobSystem::GetStats()const
+{
+    Stats stats;
+    for(const std::unique_ptr<WorkerSlot>& s : mSlots)
+    {
+        stats.TasksExecuted += s->TasksExecuted.load(std::memory_order_relaxed);
+        stats.StealAttempts += s->StealAttempts.load(std::memory_order_relaxed);
+        stats.Steals += s->Steals.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void JobSystem::ResetStats()
+{
+    for(std::unique_ptr<WorkerSlot>& s : mSlots)
+    {
+        s->TasksExecuted.store(0, std::memory_order_relaxed);
+        s->StealAttempts.store(0, std::memory_order_relaxed);
+        s->Steals.store(0, std::memory_order_relaxed);
+    }
+}
+
+JobTask* JobSystem::FindTask(int slot)
+{
+    if(slot >= 0)
+    {
+        JobTask* task = mSlots[slot]->Queue.Pop();
+        if(task != nullptr)
+            return task;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mInjectedLock);
+        if(!mInjected.empty())
+        {
+            JobTask* task = mInjected.front();
+            mInjected.pop_front();
+            return task;
+        }
+    }
+
+    //
+    // Steal from the other deques, starting at a random victim.  Outside
+    // threads have no random state of their own and start at deque 0.
+    //
+
+    int dequeCount = (int)mSlots.size() - 1;
+    WorkerSlot& self = *mSlots[slot >= 0 ? slot : dequeCount];
+    int start = 0;
+    if(slot >= 0)
+    {
+        std::uint32_t x = self.RandomState;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        self.RandomState = x;
+        start = (int)(x % (std::uint32_t)dequeCount);
+    }
+
+    for(int i = 0; i < dequeCount; ++i)
+    {
+        int victim = (start + i) % dequeCount;
+        if(victim == slot || mSlots[victim]->Queue.Empty())
+            continue;
+
+        self.StealAttempts.fetch_add(1, std::memory_order_relaxed);
+        JobTask* task = mSlots[victim]->Queue.Steal();
+        if(task != nullptr)
+        {
+            self.Steals.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+void JobSystem::Execute(JobTask* task, int slot)
+{
+    task->Fn();
+    if(task->Counter != nullptr)
+        Complete(*task->Counter);
+    delete task;
+
+    WorkerSlot& self = *mSlots[slot >= 0 ? slot : (int)mSlots.size() - 1];
+    self.TasksExecuted.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JobSystem::Complete(JobCounter& counter)
+{
+    // Counts above one drop without the lock.  The step to zero is taken
+    // under the lock so RunAfter sees it atomically with the continuation
+    // list, and so Wait cannot return while the list is being released.
+    std::uint32_t pending = counter.Pending.load(std::memory_order_relaxed);
+    while(pending > 1)
+    {
+        if(counter.Pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+            return;
+    }
+
+    std::vector<JobTask*> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter.ContinuationLock);
+        if(counter.Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter.Continuations);
+    }
+
+    for(JobTask* task : ready)
+        Push(task);
+}
+
+void JobSystem::WorkerMain(int slot)
+{
+    ClaimSlot(mId, slot);
+
+    for(;;)
+    {
+        std::uint64_t version = mWorkVersion.load();
+        JobTask* task = FindTask(slot);
+        if(task != nullptr)
+        {
+            Execute(task, slot);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mSleepLock);
+        if(mStopping.load())
+            return;
+
+        mSleeping.fetch_add(1);
+        mWake.wait(lock, [this, version]() { return mStopping.load() || mWorkVersion.load() != version; });
+        mSleeping.fetch_sub(1);
+    }
+}
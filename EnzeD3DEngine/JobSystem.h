@@ -0,0 +1,111 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobTask;
+
+// Counts the jobs of a group that have not finished yet.  Pass it to
+// JobSystem::Run for every job of the group and JobSystem::Wait on it, or
+// hand it to JobSystem::RunAfter to start other jobs once the group is done.
+struct JobCounter
+{
+    std::atomic<std::uint32_t> Pending{ 0 };
+
+    // Jobs queued by RunAfter, released by the job that brings Pending to zero.
+    std::mutex ContinuationLock;
+    std::vector<JobTask*> Continuations;
+};
+
+// A fixed pool of worker threads with one Chase-Lev deque per thread.  A
+// thread pushes and pops its own jobs at the bottom of its deque; idle threads
+// steal from the top of a random other deque.  The thread that creates the
+// JobSystem owns deque 0; any other outside thread submits through a locked
+// queue.  A thread may create, and work for, any number of JobSystems: its
+// slots are looked up by system, not assumed.  Only the standard library is used so the same code runs on every
+// platform we build for.
+class JobSystem
+{
+public:
+    using Job = std::function<void()>;
+    using RangeJob = std::function<void(std::uint32_t begin, std::uint32_t end)>;
+
+    struct Stats
+    {
+        std::uint64_t TasksExecuted = 0;
+        std::uint64_t StealAttempts = 0;
+        std::uint64_t Steals = 0;
+    };
+
+    // workerCount == 0 starts one worker per hardware thread, minus the caller.
+    explicit JobSystem(unsigned workerCount = 0);
+    JobSystem(const JobSystem& rhs) = delete;
+    JobSystem& operator=(const JobSystem& rhs) = delete;
+    ~JobSystem();
+
+    void Run(Job job, JobCounter* counter = nullptr);
+
+    // Queues job once dependency reaches zero, without blocking the caller.
+    // counter, if given, counts the job from now on, so it can be waited on
+    // or chained again right away.
+    void RunAfter(JobCounter& dependency, Job job, JobCounter* counter = nullptr);
+
+    // Returns once counter reaches zero.  The calling thread executes queued
+    // jobs while it waits, so waiting from inside a job cannot deadlock.
+    void Wait(JobCounter& counter);
+
+    // Splits [0, count) into ranges of at most grainSize elements, runs
+    // body(begin, end) for each range across the workers and waits.
+    void ParallelFor(std::uint32_t count, std::uint32_t grainSize, const RangeJob& body);
+
+    // ParallelFor over an array: body(first + begin, end - begin) per range.
+    template<typename T, typename SpanBody>
+    void ParallelForSpan(T* first, std::uint32_t count, std::uint32_t grainSize, const SpanBody& body)
+    {
+        ParallelFor(count, grainSize, [first, &body](std::uint32_t begin, std::uint32_t end)
+        {
+            body(first + begin, end - begin);
+        });
+    }
+
+    unsigned WorkerCount()const { return (unsigned)mWorkers.size(); }
+
+    // Totals over every thread since construction or the last ResetStats().
+    Stats GetStats()const;
+    void ResetStats();
+
+private:
+    struct WorkerSlot;
+
+    int CurrentSlot()const;
+    void Push(JobTask* task);
+    JobTask* FindTask(int slot);
+    void Execute(JobTask* task, int slot);
+    void Complete(JobCounter& counter);
+    void WorkerMain(int slot);
+
+    // Unique for the life of the process; keys the calling thread's slot.
+    const std::uint64_t mId;
+
+    std::vector<std::thread> mWorkers;
+
+    // [0] creating thread, [1..WorkerCount] workers, last: outside threads.
+    std::vector<std::unique_ptr<WorkerSlot>> mSlots;
+
+    std::deque<JobTask*> mInjected;
+    std::mutex mInjectedLock;
+
+    // Bumped on every push so a worker about to sleep can tell that work
+    // arrived after it last looked.
+    std::atomic<std::uint64_t> mWorkVersion{ 0 };
+    std::atomic<unsigned> mSleeping{ 0 };
+    std::mutex mSleepLock;
+    std::condition_variable mWake;
+    std::atomic<bool> mStopping{ false };
+};
@@ -0,0 +1,155 @@
+#include "MaterialRegistry.h"
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    // Reads exactly count values from the rest of the line.
+    template<typename T>
+    bool ReadValues(std::istringstream& line, T* values, int count)
+    {
+        for(int i = 0; i < count; ++i)
+        {
+            if(!(line >> values[i]))
+                return false;
+        }
+        std::string extra;
+        return !(line >> extra);
+    }
+}
+
+bool MaterialRegistry::Load(std::istream& in, const std::string& sourceName, std::string* error)
+{
+    // Everything is parsed before anything is added, so a bad file leaves
+    // the registry as it was.
+    std::vector<Material> parsed;
+    std::string text;
+    int lineNumber = 0;
+    auto fail = [&](const std::string& message)
+    {
+        if(error != nullptr)
+            *error = sourceName + ":" + std::to_string(lineNumber) + ": " + message;
+        return false;
+    };
+
+    while(std::getline(in, text))
+    {
+        ++lineNumber;
+        size_t comment = text.find('#');
+        if(comment != std::string::npos)
+            text.erase(comment);
+
+        std::istringstream line(text);
+        std::string key;
+        if(!(line >> key))
+            continue;
+
+        if(key == "material")
+        {
+            Material material;
+            if(!ReadValues(line, &material.Name, 1))
+                return fail("expected 'material <name>'");
+            parsed.push_back(material);
+            continue;
+        }
+        if(parsed.empty())
+            return fail("'" + key + "' before the first material");
+
+        Material& material = parsed.back();
+        bool ok;
+        if(key == "DiffuseAlbedo")
+            ok = ReadValues(line, &material.DiffuseAlbedo.x, 4);
+        else if(key == "FresnelR0")
+            ok = ReadValues(line, &material.FresnelR0.x, 3);
+        else if(key == "Roughness")
+            ok = ReadValues(line, &material.Roughness, 1);
+        else if(key == "MatTransform")
+            ok = ReadValues(line, &material.MatTransform._11, 16);
+        else if(key == "DiffuseSrvHeapIndex")
+            ok = ReadValues(line, &material.DiffuseSrvHeapIndex, 1);
+        else if(key == "NormalSrvHeapIndex")
+            ok = ReadValues(line, &material.NormalSrvHeapIndex, 1);
+        else
+            return fail("unknown field '" + key + "'");
+        if(!ok)
+            return fail("bad value for '" + key + "'");
+    }
+
+    for(const Material& material : parsed)
+        Add(material);
+    return true;
+}
+
+bool MaterialRegistry::LoadFile(const std::wstring& path, std::string* error)
+{
+    // Only used for messages, so non-ASCII characters need not survive.
+    std::string name;
+    for(wchar_t c : path)
+        name += c < 128 ? (char)c : '?';
+
+    // Opening by wide name is an MSVC extension; elsewhere, where only the
+    // tests build this, asset paths are ASCII.
+#ifdef _WIN32
+    std::ifstream in(path);
+#else
+    std::ifstream in(name);
+#endif
+    if(!in)
+    {
+        if(error != nullptr)
+            *error = name + ": cannot open";
+        return false;
+    }
+    return Load(in, name, error);
+}
+
+std::uint32_t MaterialRegistry::Add(const Material& material)
+{
+    std::uint32_t id;
+    auto it = mIds.find(material.Name);
+    if(it != mIds.end())
+    {
+        id = it->second;
+        *mMaterials[id] = material;
+    }
+    else
+    {
+        id = (std::uint32_t)mMaterials.size();
+        mMaterials.push_back(std::make_unique<Material>(material));
+        mIds.emplace(material.Name, id);
+        mIsDirty.push_back(0);
+    }
+
+    mMaterials[id]->MatCBIndex = (int)id;
+    MarkChanged(id);
+    return id;
+}
+
+Material* MaterialRegistry::Find(const std::string& name)const
+{
+    auto it = mIds.find(name);
+    return it != mIds.end() ? mMaterials[it->second].get() : nullptr;
+}
+
+void MaterialRegistry::MarkChanged(std::uint32_t id)
+{
+    mMaterials[id]->ChangeGeneration = ++mGeneration;
+    if(!mIsDirty[id])
+    {
+        mIsDirty[id] = 1;
+        mDirty.push_back(id);
+    }
+}
+
+void MaterialRegistry::RetireDirty(std::uint64_t syncedGeneration)
+{
+    size_t kept = 0;
+    for(std::uint32_t id : mDirty)
+    {
+        if(mMaterials[id]->ChangeGeneration <= syncedGeneration)
+            mIsDirty[id] = 0;
+        else
+            mDirty[kept++] = id;
+    }
+    mDirty.resize(kept);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "RenderTypes.h"
+
+// Every material of the app, by name and by dense id.  Ids run from 0 to
+// Count() - 1 in the order materials were first added and never change, so
+// a material's id (kept in Material::MatCBIndex) indexes the material table
+// the shaders read directly; per-instance data carries it, and draws bind
+// the whole table once instead of a constant buffer per material.
+//
+// Edits are tracked like RenderItemStore's: each stamps the material with
+// the next generation, and materials changed since the oldest frame
+// resource was written stay on a dirty list.
+class MaterialRegistry
+{
+public:
+    MaterialRegistry() = default;
+    MaterialRegistry(const MaterialRegistry& rhs) = delete;
+    MaterialRegistry& operator=(const MaterialRegistry& rhs) = delete;
+
+    // Reads material definitions, in the format of materials.txt, and adds
+    // them or updates the materials of the same names.  On malformed input
+    // nothing changes and error, if given, says where; sourceName prefixes
+    // the message.
+    bool Load(std::istream& in, const std::string& sourceName, std::string* error = nullptr);
+    bool LoadFile(const std::wstring& path, std::string* error = nullptr);
+
+    // Adds material, or copies it over the material with the same name.
+    // Either way the result is marked changed.  Returns the id.
+    std::uint32_t Add(const Material& material);
+
+    // Null when no material has the name.
+    Material* Find(const std::string& name)const;
+    Material* Get(std::uint32_t id)const { return mMaterials[id].get(); }
+    size_t Count()const { return mMaterials.size(); }
+
+    // Call after editing a material's constants in place.
+    void MarkChanged(std::uint32_t id);
+
+    // Generation of the latest change; 0 before any material was added.
+    std::uint64_t Generation()const { return mGeneration; }
+
+    // Ids of the materials changed since the last RetireDirty(), which a
+    // frame resource current to a generation g must rewrite if their
+    // ChangeGeneration is above g.  Each id appears once.
+    const std::vector<std::uint32_t>& DirtyMaterials()const { return mDirty; }
+
+    // Drops the materials every frame resource has caught up with; pass the
+    // lowest generation any frame resource is current to.
+    void RetireDirty(std::uint64_t syncedGeneration);
+
+private:
+    std::vector<std::unique_ptr<Material>> mMaterials;
+    std::unordered_map<std::string, std::uint32_t> mIds;
+
+    std::vector<std::uint32_t> mDirty;
+    std::vector<std::uint8_t> mIsDirty;
+    std::uint64_t mGeneration = 0;
+};
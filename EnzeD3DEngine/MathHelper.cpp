@@ -1 +1,181 @@
-#include "MathHelper.h"
\ No newline at end of file
+#include "MathHelper.h"
+#include <cfloat>
+
+using namespace Math;
+
+const float MathHelper::Infinity = FLT_MAX;
+
+#if defined(MATH_HELPER_AVX2)
+namespace
+{
+    // Two rows of a * b, given those two rows of a and each row of b
+    // broadcast to both halves.
+    inline __m256 MultiplyRowPair(__m256 rows, __m256 b0, __m256 b1, __m256 b2, __m256 b3)
+    {
+        __m256 r = _mm256_mul_ps(_mm256_permute_ps(rows, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+        r = _mm256_fmadd_ps(_mm256_permute_ps(rows, _MM_SHUFFLE(1, 1, 1, 1)), b1, r);
+        r = _mm256_fmadd_ps(_mm256_permute_ps(rows, _MM_SHUFFLE(2, 2, 2, 2)), b2, r);
+        return _mm256_fmadd_ps(_mm256_permute_ps(rows, _MM_SHUFFLE(3, 3, 3, 3)), b3, r);
+    }
+}
+#endif
+
+void MathHelper::TransposeMatricesStrided(const Float4x4* src, const std::uint32_t* items, size_t count,
+    const std::uint32_t* dstSlots, void* dst, size_t dstStride, const Float4x4* transform)
+{
+    char* dstBytes = static_cast<char*>(dst);
+
+#if defined(MATH_HELPER_AVX2)
+    // Rows are handled in pairs; after the unpacks each register holds
+    // (r0[i], r2[i], r0[i+1], r2[i+1] | r1[i], r3[i], r1[i+1], r3[i+1]) and
+    // the permute puts two columns in order.
+    const __m256i columnOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256 t0 = _mm256_setzero_ps(), t1 = t0, t2 = t0, t3 = t0;
+    if(transform)
+    {
+        t0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(transform->m[0]));
+        t1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(transform->m[1]));
+        t2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(transform->m[2]));
+        t3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(transform->m[3]));
+    }
+
+    for(size_t k = 0; k < count; ++k)
+    {
+        std::uint32_t item = items ? items[k] : (std::uint32_t)k;
+        __m256 rows01 = _mm256_loadu_ps(src[item].m[0]);
+        __m256 rows23 = _mm256_loadu_ps(src[item].m[2]);
+        if(transform)
+        {
+            rows01 = MultiplyRowPair(rows01, t0, t1, t2, t3);
+            rows23 = MultiplyRowPair(rows23, t0, t1, t2, t3);
+        }
+
+        float* out = reinterpret_cast<float*>(dstBytes + dstSlots[item] * dstStride);
+        _mm256_storeu_ps(out, _mm256_permutevar8x32_ps(_mm256_unpacklo_ps(rows01, rows23), columnOrder));
+        _mm256_storeu_ps(out + 8, _mm256_permutevar8x32_ps(_mm256_unpackhi_ps(rows01, rows23), columnOrder));
+    }
+#else
+    Mat4 t = transform ? Load(*transform) : MatIdentity();
+    for(size_t k = 0; k < count; ++k)
+    {
+        std::uint32_t item = items ? items[k] : (std::uint32_t)k;
+        Mat4 m = Load(src[item]);
+        if(transform)
+            m = MatMultiply(m, t);
+        Store(reinterpret_cast<Float4x4*>(dstBytes + dstSlots[item] * dstStride), MatTranspose(m));
+    }
+#endif
+}
+
+void MathHelper::MultiplyMatrices(const Float4x4* a, const Float4x4* b, Float4x4* dst, size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+#if defined(MATH_HELPER_AVX2)
+        __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b[i].m[0]));
+        __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b[i].m[1]));
+        __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b[i].m[2]));
+        __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b[i].m[3]));
+        __m256 lo = MultiplyRowPair(_mm256_loadu_ps(a[i].m[0]), b0, b1, b2, b3);
+        __m256 hi = MultiplyRowPair(_mm256_loadu_ps(a[i].m[2]), b0, b1, b2, b3);
+        _mm256_storeu_ps(dst[i].m[0], lo);
+        _mm256_storeu_ps(dst[i].m[2], hi);
+#else
+        Store(&dst[i], MatMultiply(Load(a[i]), Load(b[i])));
+#endif
+    }
+}
+
+void MathHelper::MultiplyMatrices(const Float4x4* a, const Float4x4& b, Float4x4* dst, size_t count)
+{
+#if defined(MATH_HELPER_AVX2)
+    __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[0]));
+    __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[1]));
+    __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[2]));
+    __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b.m[3]));
+    for(size_t i = 0; i < count; ++i)
+    {
+        __m256 lo = MultiplyRowPair(_mm256_loadu_ps(a[i].m[0]), b0, b1, b2, b3);
+        __m256 hi = MultiplyRowPair(_mm256_loadu_ps(a[i].m[2]), b0, b1, b2, b3);
+        _mm256_storeu_ps(dst[i].m[0], lo);
+        _mm256_storeu_ps(dst[i].m[2], hi);
+    }
+#else
+    Mat4 mb = Load(b);
+    for(size_t i = 0; i < count; ++i)
+        Store(&dst[i], MatMultiply(Load(a[i]), mb));
+#endif
+}
+
+void MathHelper::TransformPoints(const Float4x4& m, const Float3* src, Float3* dst, size_t count)
+{
+    Mat4 mm = Load(m);
+    size_t i = 0;
+
+    // All but the last point can be loaded with four floats; the fourth
+    // lane is the next point's x and is ignored by VecTransformPoint.
+    for(; i + 1 < count; ++i)
+    {
+        Vec4 p = VecLoad(&src[i].x);
+        VecStore3(&dst[i].x, VecTransformPoint(p, mm));
+    }
+
+    for(; i < count; ++i)
+        VecStore3(&dst[i].x, VecTransformPoint(Load(src[i]), mm));
+}
+
+void MathHelper::TransformPointsSoA(const Float4x4& m, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    size_t i = 0;
+
+#if defined(MATH_HELPER_AVX2)
+    __m256 m8[12];
+    for(int r = 0; r < 4; ++r)
+        for(int c = 0; c < 3; ++c)
+            m8[r * 3 + c] = _mm256_set1_ps(m.m[r][c]);
+
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pz = _mm256_loadu_ps(z + i);
+        for(int c = 0; c < 3; ++c)
+        {
+            __m256 r = _mm256_fmadd_ps(px, m8[c], m8[9 + c]);
+            r = _mm256_fmadd_ps(py, m8[3 + c], r);
+            r = _mm256_fmadd_ps(pz, m8[6 + c], r);
+            _mm256_storeu_ps((c == 0 ? outX : c == 1 ? outY : outZ) + i, r);
+        }
+    }
+#endif
+
+#if !defined(MATH_HELPER_SCALAR)
+    Vec4 m4[12];
+    for(int r = 0; r < 4; ++r)
+        for(int c = 0; c < 3; ++c)
+            m4[r * 3 + c] = VecReplicate(m.m[r][c]);
+
+    for(; i + 4 <= count; i += 4)
+    {
+        Vec4 px = VecLoad(x + i);
+        Vec4 py = VecLoad(y + i);
+        Vec4 pz = VecLoad(z + i);
+        for(int c = 0; c < 3; ++c)
+        {
+            Vec4 r = VecMulAdd(px, m4[c], m4[9 + c]);
+            r = VecMulAdd(py, m4[3 + c], r);
+            r = VecMulAdd(pz, m4[6 + c], r);
+            VecStore((c == 0 ? outX : c == 1 ? outY : outZ) + i, r);
+        }
+    }
+#endif
+
+    for(; i < count; ++i)
+    {
+        float px = x[i], py = y[i], pz = z[i];
+        outX[i] = px * m._11 + py * m._21 + pz * m._31 + m._41;
+        outY[i] = px * m._12 + py * m._22 + pz * m._32 + m._42;
+        outZ[i] = px * m._13 + py * m._23 + pz * m._33 + m._43;
+    }
+}
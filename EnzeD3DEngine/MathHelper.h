@@ -1,10 +1,63 @@
 #pragma once
-#include "stdafx.h"
+#include "MathSimd.h"
+
+// DirectXMath is only needed for the interop below; the rest of MathHelper
+// builds without it.
+#if defined(__has_include)
+#if __has_include(<DirectXMath.h>)
+#include <DirectXMath.h>
+#define MATH_HELPER_DIRECTXMATH
+#endif
+#elif defined(_WIN32)
+#include <DirectXMath.h>
+#define MATH_HELPER_DIRECTXMATH
+#endif
 
 class MathHelper{
     public:
+    static const float Infinity;
+
+    template<typename T>
+	static T Clamp(const T& x, const T& low, const T& high)
+	{
+		return x < low ? low : (x > high ? high : x);
+	}
+
+    // Batched kernels.  Each uses 256-bit registers on AVX2 builds and the
+    // Math::Vec4 backend otherwise.
+
+    // Writes the transpose of src[item] * transform, or of src[item] when
+    // transform is null, to dst + dstSlots[item] * dstStride.  item runs
+    // over items[0, count), or over [0, count) when items is null.  Built
+    // for the object constant upload: dst is the mapped buffer, dstStride
+    // its element size and dstSlots the items' ObjCBIndex.
+    static void TransposeMatricesStrided(const Math::Float4x4* src, const std::uint32_t* items,
+        size_t count, const std::uint32_t* dstSlots, void* dst, size_t dstStride,
+        const Math::Float4x4* transform = nullptr);
+
+    // dst[i] = a[i] * b[i].  dst may alias a or b.
+    static void MultiplyMatrices(const Math::Float4x4* a, const Math::Float4x4* b,
+        Math::Float4x4* dst, size_t count);
+
+    // dst[i] = a[i] * b, e.g. world matrices by a shared view-projection.
+    static void MultiplyMatrices(const Math::Float4x4* a, const Math::Float4x4& b,
+        Math::Float4x4* dst, size_t count);
+
+    // dst[i] = (src[i], 1) * m with the w of the result dropped.  dst may
+    // alias src.
+    static void TransformPoints(const Math::Float4x4& m, const Math::Float3* src,
+        Math::Float3* dst, size_t count);
+
+    // The same for points stored as separate x, y and z arrays, as in
+    // GeometryGenerator::MeshDataSoA and AabbSoA.  Eight points per
+    // iteration with AVX2, four otherwise.
+    static void TransformPointsSoA(const Math::Float4x4& m,
+        const float* x, const float* y, const float* z,
+        float* outX, float* outY, float* outZ, size_t count);
+
+#if defined(MATH_HELPER_DIRECTXMATH)
     static DirectX::XMFLOAT4X4 Identity4X4(){
-    
+
         static DirectX::XMFLOAT4X4 I(
             1.f, 0.f, 0.f, 0.f,
             0.f, 1.f, 0.f, 0.f,
@@ -13,10 +66,34 @@ class MathHelper{
         );
         return I;
     }
-    template<typename T>
-	static T Clamp(const T& x, const T& low, const T& high)
-	{
-		return x < low ? low : (x > high ? high : x); 
-	}
+
+    // The Math storage types have the layout of their DirectXMath
+    // counterparts, so arrays of one can be handed to kernels taking the
+    // other.
+    static const Math::Float4x4* AsFloat4x4(const DirectX::XMFLOAT4X4* m)
+    {
+        return reinterpret_cast<const Math::Float4x4*>(m);
+    }
+    static Math::Float4x4* AsFloat4x4(DirectX::XMFLOAT4X4* m)
+    {
+        return reinterpret_cast<Math::Float4x4*>(m);
+    }
+    static const DirectX::XMFLOAT4X4* AsXMFLOAT4X4(const Math::Float4x4* m)
+    {
+        return reinterpret_cast<const DirectX::XMFLOAT4X4*>(m);
+    }
+#endif
 };
 
+#if defined(MATH_HELPER_DIRECTXMATH)
+namespace Math
+{
+    inline Mat4 Load(const DirectX::XMFLOAT4X4& m) { return Load(*MathHelper::AsFloat4x4(&m)); }
+    inline void Store(DirectX::XMFLOAT4X4* dst, const Mat4& m) { Store(MathHelper::AsFloat4x4(dst), m); }
+}
+
+static_assert(sizeof(Math::Float3) == sizeof(DirectX::XMFLOAT3), "Float3 must match XMFLOAT3");
+static_assert(sizeof(Math::Float4) == sizeof(DirectX::XMFLOAT4), "Float4 must match XMFLOAT4");
+static_assert(sizeof(Math::Float4x4) == sizeof(DirectX::XMFLOAT4X4), "Float4x4 must match XMFLOAT4X4");
+static_assert(offsetof(Math::Float4x4, _43) == offsetof(DirectX::XMFLOAT4X4, _43), "Float4x4 must be row-major like XMFLOAT4X4");
+#endif
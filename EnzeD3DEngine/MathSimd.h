@@ -0,0 +1,776 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Portable vector, matrix and quaternion math.  Nothing here depends on
+// Windows or DirectXMath, so code built on it compiles with GCC and Clang
+// as well as MSVC.  The conventions are DirectXMath's: row vectors
+// (v' = v * M), left-handed view and projection matrices, D3D clip space
+// (0 <= z <= w), and quaternions stored as (x, y, z, w).
+//
+// One backend is chosen at compile time:
+//   SSE2   any x86/x64 target; SSE4.1 instructions are used when the
+//          compiler may emit them (__SSE4_1__, or /arch:AVX and above)
+//   AVX2   (with FMA) SSE4.1 plus 256-bit batched kernels in MathHelper.cpp
+//   NEON   AArch64
+//   scalar everything else, or when MATH_HELPER_FORCE_SCALAR is defined
+// All backends produce the same results up to rounding.
+
+#if defined(MATH_HELPER_FORCE_SCALAR)
+#define MATH_HELPER_SCALAR
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MATH_HELPER_NEON
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MATH_HELPER_SSE2
+#if defined(__SSE4_1__) || defined(__AVX__)
+#include <smmintrin.h>
+#define MATH_HELPER_SSE41
+#endif
+#if defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__))
+#include <immintrin.h>
+#define MATH_HELPER_FMA
+#endif
+#if defined(__AVX2__) && defined(MATH_HELPER_FMA)
+#define MATH_HELPER_AVX2
+#endif
+#else
+#define MATH_HELPER_SCALAR
+#endif
+
+// MathHelper::AsFloat4x4 views XMFLOAT4X4 storage as Float4x4 and back.
+// GCC and Clang assume differently typed structs never overlap, and drop or
+// reorder accesses through such a view unless the type is marked may_alias.
+#if defined(__GNUC__) || defined(__clang__)
+#define MATH_MAY_ALIAS __attribute__((__may_alias__))
+#else
+#define MATH_MAY_ALIAS
+#endif
+
+namespace Math
+{
+    //
+    // Storage types.  Plain floats with the layout of the DirectXMath types
+    // of the same name (XMFLOAT3, XMFLOAT4, XMFLOAT4X4), so they can be
+    // copied to and from constant buffers as they are.
+    //
+
+    struct Float2
+    {
+        float x, y;
+
+        Float2() = default;
+        constexpr Float2(float _x, float _y) : x(_x), y(_y) {}
+    };
+
+    struct Float3
+    {
+        float x, y, z;
+
+        Float3() = default;
+        constexpr Float3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+    };
+
+    struct Float4
+    {
+        float x, y, z, w;
+
+        Float4() = default;
+        constexpr Float4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+    };
+
+    // Row-major: m[row][column], _RC with 1-based row and column.
+    struct MATH_MAY_ALIAS Float4x4
+    {
+        union
+        {
+            struct
+            {
+                float _11, _12, _13, _14;
+                float _21, _22, _23, _24;
+                float _31, _32, _33, _34;
+                float _41, _42, _43, _44;
+            };
+            float m[4][4];
+        };
+
+        Float4x4() = default;
+        constexpr Float4x4(float m00, float m01, float m02, float m03,
+                           float m10, float m11, float m12, float m13,
+                           float m20, float m21, float m22, float m23,
+                           float m30, float m31, float m32, float m33)
+            : _11(m00), _12(m01), _13(m02), _14(m03),
+              _21(m10), _22(m11), _23(m12), _24(m13),
+              _31(m20), _32(m21), _33(m22), _34(m23),
+              _41(m30), _42(m31), _43(m32), _44(m33) {}
+
+        static constexpr Float4x4 Identity()
+        {
+            return Float4x4(
+                1.f, 0.f, 0.f, 0.f,
+                0.f, 1.f, 0.f, 0.f,
+                0.f, 0.f, 1.f, 0.f,
+                0.f, 0.f, 0.f, 1.f);
+        }
+    };
+
+    static_assert(sizeof(Float3) == 12, "Float3 must match XMFLOAT3");
+    static_assert(sizeof(Float4) == 16, "Float4 must match XMFLOAT4");
+    static_assert(sizeof(Float4x4) == 64, "Float4x4 must match XMFLOAT4X4");
+
+    //
+    // Register types.  Vec4 is the backend's native 4-float register and
+    // is passed by value; quaternions are Vec4s too.
+    //
+
+#if defined(MATH_HELPER_SSE2)
+    typedef __m128 Vec4;
+#elif defined(MATH_HELPER_NEON)
+    typedef float32x4_t Vec4;
+#else
+    struct Vec4
+    {
+        float f[4];
+    };
+#endif
+
+    struct Mat4
+    {
+        Vec4 r[4];
+    };
+
+    //
+    // Vec4 primitives.  Everything further down is written in terms of
+    // these, so a new backend only has to provide this block.
+    //
+
+#if defined(MATH_HELPER_SSE2)
+
+    inline Vec4 VecSet(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+    inline Vec4 VecReplicate(float v) { return _mm_set1_ps(v); }
+    inline Vec4 VecZero() { return _mm_setzero_ps(); }
+    inline Vec4 VecLoad(const float* p) { return _mm_loadu_ps(p); }
+    inline void VecStore(float* p, Vec4 v) { _mm_storeu_ps(p, v); }
+
+    inline Vec4 VecLoad3(const float* p, float w)
+    {
+        __m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(p)));
+        __m128 zw = _mm_setr_ps(p[2], w, 0.f, 0.f);
+        return _mm_movelh_ps(xy, zw);
+    }
+
+    inline void VecStore3(float* p, Vec4 v)
+    {
+        _mm_store_sd(reinterpret_cast<double*>(p), _mm_castps_pd(v));
+        _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+    }
+
+    inline Vec4 VecAdd(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+    inline Vec4 VecSub(Vec4 a, Vec4 b) { return _mm_sub_ps(a, b); }
+    inline Vec4 VecMul(Vec4 a, Vec4 b) { return _mm_mul_ps(a, b); }
+    inline Vec4 VecDiv(Vec4 a, Vec4 b) { return _mm_div_ps(a, b); }
+    inline Vec4 VecMin(Vec4 a, Vec4 b) { return _mm_min_ps(a, b); }
+    inline Vec4 VecMax(Vec4 a, Vec4 b) { return _mm_max_ps(a, b); }
+    inline Vec4 VecSqrt(Vec4 v) { return _mm_sqrt_ps(v); }
+    inline Vec4 VecNegate(Vec4 v) { return _mm_xor_ps(v, _mm_set1_ps(-0.f)); }
+    inline Vec4 VecAbs(Vec4 v) { return _mm_andnot_ps(_mm_set1_ps(-0.f), v); }
+
+    // a * b + c
+    inline Vec4 VecMulAdd(Vec4 a, Vec4 b, Vec4 c)
+    {
+#if defined(MATH_HELPER_FMA)
+        return _mm_fmadd_ps(a, b, c);
+#else
+        return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+    }
+
+    // c - a * b
+    inline Vec4 VecNegMulSub(Vec4 a, Vec4 b, Vec4 c)
+    {
+#if defined(MATH_HELPER_FMA)
+        return _mm_fnmadd_ps(a, b, c);
+#else
+        return _mm_sub_ps(c, _mm_mul_ps(a, b));
+#endif
+    }
+
+    // (v[X], v[Y], v[Z], v[W])
+    template<int X, int Y, int Z, int W>
+    inline Vec4 VecSwizzle(Vec4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X)); }
+
+    // (a[X], a[Y], b[Z], b[W])
+    template<int X, int Y, int Z, int W>
+    inline Vec4 VecShuffle(Vec4 a, Vec4 b) { return _mm_shuffle_ps(a, b, _MM_SHUFFLE(W, Z, Y, X)); }
+
+    template<int I>
+    inline float VecGet(Vec4 v) { return _mm_cvtss_f32(VecSwizzle<I, I, I, I>(v)); }
+
+    // (x, y, z, w) with w taken from wSource.
+    inline Vec4 VecSelectW(Vec4 xyz, Vec4 wSource)
+    {
+#if defined(MATH_HELPER_SSE41)
+        return _mm_blend_ps(xyz, wSource, 0x8);
+#else
+        __m128 zw = _mm_shuffle_ps(xyz, wSource, _MM_SHUFFLE(3, 3, 2, 2));
+        return _mm_shuffle_ps(xyz, zw, _MM_SHUFFLE(2, 0, 1, 0));
+#endif
+    }
+
+    // Dot products replicated to all four lanes.
+    inline Vec4 VecDot4(Vec4 a, Vec4 b)
+    {
+#if defined(MATH_HELPER_SSE41)
+        return _mm_dp_ps(a, b, 0xFF);
+#else
+        __m128 m = _mm_mul_ps(a, b);
+        m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+#endif
+    }
+
+    inline Vec4 VecDot3(Vec4 a, Vec4 b)
+    {
+#if defined(MATH_HELPER_SSE41)
+        return _mm_dp_ps(a, b, 0x7F);
+#else
+        __m128 m = _mm_mul_ps(a, b);
+        __m128 sum = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2)));
+        return _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0));
+#endif
+    }
+
+    inline Mat4 MatTranspose(const Mat4& m)
+    {
+        Mat4 t = m;
+        _MM_TRANSPOSE4_PS(t.r[0], t.r[1], t.r[2], t.r[3]);
+        return t;
+    }
+
+#elif defined(MATH_HELPER_NEON)
+
+    inline Vec4 VecSet(float x, float y, float z, float w)
+    {
+        const float v[4] = { x, y, z, w };
+        return vld1q_f32(v);
+    }
+    inline Vec4 VecReplicate(float v) { return vdupq_n_f32(v); }
+    inline Vec4 VecZero() { return vdupq_n_f32(0.f); }
+    inline Vec4 VecLoad(const float* p) { return vld1q_f32(p); }
+    inline void VecStore(float* p, Vec4 v) { vst1q_f32(p, v); }
+
+    inline Vec4 VecLoad3(const float* p, float w)
+    {
+        float32x2_t xy = vld1_f32(p);
+        float32x2_t zw = vset_lane_f32(w, vld1_dup_f32(p + 2), 1);
+        return vcombine_f32(xy, zw);
+    }
+
+    inline void VecStore3(float* p, Vec4 v)
+    {
+        vst1_f32(p, vget_low_f32(v));
+        vst1q_lane_f32(p + 2, v, 2);
+    }
+
+    inline Vec4 VecAdd(Vec4 a, Vec4 b) { return vaddq_f32(a, b); }
+    inline Vec4 VecSub(Vec4 a, Vec4 b) { return vsubq_f32(a, b); }
+    inline Vec4 VecMul(Vec4 a, Vec4 b) { return vmulq_f32(a, b); }
+    inline Vec4 VecDiv(Vec4 a, Vec4 b) { return vdivq_f32(a, b); }
+    inline Vec4 VecMin(Vec4 a, Vec4 b) { return vminq_f32(a, b); }
+    inline Vec4 VecMax(Vec4 a, Vec4 b) { return vmaxq_f32(a, b); }
+    inline Vec4 VecSqrt(Vec4 v) { return vsqrtq_f32(v); }
+    inline Vec4 VecNegate(Vec4 v) { return vnegq_f32(v); }
+    inline Vec4 VecAbs(Vec4 v) { return vabsq_f32(v); }
+    inline Vec4 VecMulAdd(Vec4 a, Vec4 b, Vec4 c) { return vfmaq_f32(c, a, b); }
+    inline Vec4 VecNegMulSub(Vec4 a, Vec4 b, Vec4 c) { return vfmsq_f32(c, a, b); }
+
+    template<int I>
+    inline float VecGet(Vec4 v) { return vgetq_lane_f32(v, I); }
+
+    template<int X, int Y, int Z, int W>
+    inline Vec4 VecShuffle(Vec4 a, Vec4 b)
+    {
+        float32x4_t r = vdupq_n_f32(vgetq_lane_f32(a, X));
+        r = vsetq_lane_f32(vgetq_lane_f32(a, Y), r, 1);
+        r = vsetq_lane_f32(vgetq_lane_f32(b, Z), r, 2);
+        return vsetq_lane_f32(vgetq_lane_f32(b, W), r, 3);
+    }
+
+    template<int X, int Y, int Z, int W>
+    inline Vec4 VecSwizzle(Vec4 v) { return VecShuffle<X, Y, Z, W>(v, v); }
+
+    template<> inline Vec4 VecSwizzle<0, 0, 0, 0>(Vec4 v) { return vdupq_laneq_f32(v, 0); }
+    template<> inline Vec4 VecSwizzle<1, 1, 1, 1>(Vec4 v) { return vdupq_laneq_f32(v, 1); }
+    template<> inline Vec4 VecSwizzle<2, 2, 2, 2>(Vec4 v) { return vdupq_laneq_f32(v, 2); }
+    template<> inline Vec4 VecSwizzle<3, 3, 3, 3>(Vec4 v) { return vdupq_laneq_f32(v, 3); }
+
+    inline Vec4 VecSelectW(Vec4 xyz, Vec4 wSource)
+    {
+        return vsetq_lane_f32(vgetq_lane_f32(wSource, 3), xyz, 3);
+    }
+
+    inline Vec4 VecDot4(Vec4 a, Vec4 b)
+    {
+        return vdupq_n_f32(vaddvq_f32(vmulq_f32(a, b)));
+    }
+
+    inline Vec4 VecDot3(Vec4 a, Vec4 b)
+    {
+        return vdupq_n_f32(vaddvq_f32(vsetq_lane_f32(0.f, vmulq_f32(a, b), 3)));
+    }
+
+    inline Mat4 MatTranspose(const Mat4& m)
+    {
+        float32x4x2_t t0 = vtrnq_f32(m.r[0], m.r[1]);
+        float32x4x2_t t1 = vtrnq_f32(m.r[2], m.r[3]);
+        Mat4 t;
+        t.r[0] = vcombine_f32(vget_low_f32(t0.val[0]), vget_low_f32(t1.val[0]));
+        t.r[1] = vcombine_f32(vget_low_f32(t0.val[1]), vget_low_f32(t1.val[1]));
+        t.r[2] = vcombine_f32(vget_high_f32(t0.val[0]), vget_high_f32(t1.val[0]));
+        t.r[3] = vcombine_f32(vget_high_f32(t0.val[1]), vget_high_f32(t1.val[1]));
+        return t;
+    }
+
+#else
+
+    inline Vec4 VecSet(float x, float y, float z, float w) { return Vec4{ { x, y, z, w } }; }
+    inline Vec4 VecReplicate(float v) { return Vec4{ { v, v, v, v } }; }
+    inline Vec4 VecZero() { return Vec4{ { 0.f, 0.f, 0.f, 0.f } }; }
+    inline Vec4 VecLoad(const float* p) { return Vec4{ { p[0], p[1], p[2], p[3] } }; }
+    inline void VecStore(float* p, Vec4 v) { p[0] = v.f[0]; p[1] = v.f[1]; p[2] = v.f[2]; p[3] = v.f[3]; }
+    inline Vec4 VecLoad3(const float* p, float w) { return Vec4{ { p[0], p[1], p[2], w } }; }
+    inline void VecStore3(float* p, Vec4 v) { p[0] = v.f[0]; p[1] = v.f[1]; p[2] = v.f[2]; }
+
+#define MATH_HELPER_SCALAR_OP(name, expr)                \
+    inline Vec4 name(Vec4 a, Vec4 b)                     \
+    {                                                    \
+        Vec4 r;                                          \
+        for(int i = 0; i < 4; ++i) r.f[i] = (expr);      \
+        return r;                                        \
+    }
+
+    MATH_HELPER_SCALAR_OP(VecAdd, a.f[i] + b.f[i])
+    MATH_HELPER_SCALAR_OP(VecSub, a.f[i] - b.f[i])
+    MATH_HELPER_SCALAR_OP(VecMul, a.f[i] * b.f[i])
+    MATH_HELPER_SCALAR_OP(VecDiv, a.f[i] / b.f[i])
+    MATH_HELPER_SCALAR_OP(VecMin, a.f[i] < b.f[i] ? a.f[i] : b.f[i])
+    MATH_HELPER_SCALAR_OP(VecMax, a.f[i] > b.f[i] ? a.f[i] : b.f[i])
+#undef MATH_HELPER_SCALAR_OP
+
+    inline Vec4 VecSqrt(Vec4 v) { return Vec4{ { std::sqrt(v.f[0]), std::sqrt(v.f[1]), std::sqrt(v.f[2]), std::sqrt(v.f[3]) } }; }
+    inline Vec4 VecNegate(Vec4 v) { return Vec4{ { -v.f[0], -v.f[1], -v.f[2], -v.f[3] } }; }
+    inline Vec4 VecAbs(Vec4 v) { return Vec4{ { std::fabs(v.f[0]), std::fabs(v.f[1]), std::fabs(v.f[2]), std::fabs(v.f[3]) } }; }
+    inline Vec4 VecMulAdd(Vec4 a, Vec4 b, Vec4 c) { return VecAdd(VecMul(a, b), c); }
+    inline Vec4 VecNegMulSub(Vec4 a, Vec4 b, Vec4 c) { return VecSub(c, VecMul(a, b)); }
+
+    template<int I>
+    inline float VecGet(Vec4 v) { return v.f[I]; }
+
+    template<int X, int Y, int Z, int W>
+    inline Vec4 VecShuffle(Vec4 a, Vec4 b) { return Vec4{ { a.f[X], a.f[Y], b.f[Z], b.f[W] } }; }
+
+    template<int X, int Y, int Z, int W>
+    inline Vec4 VecSwizzle(Vec4 v) { return Vec4{ { v.f[X], v.f[Y], v.f[Z], v.f[W] } }; }
+
+    inline Vec4 VecSelectW(Vec4 xyz, Vec4 wSource) { return Vec4{ { xyz.f[0], xyz.f[1], xyz.f[2], wSource.f[3] } }; }
+
+    inline Vec4 VecDot4(Vec4 a, Vec4 b)
+    {
+        return VecReplicate(a.f[0] * b.f[0] + a.f[1] * b.f[1] + a.f[2] * b.f[2] + a.f[3] * b.f[3]);
+    }
+
+    inline Vec4 VecDot3(Vec4 a, Vec4 b)
+    {
+        return VecReplicate(a.f[0] * b.f[0] + a.f[1] * b.f[1] + a.f[2] * b.f[2]);
+    }
+
+    inline Mat4 MatTranspose(const Mat4& m)
+    {
+        Mat4 t;
+        for(int i = 0; i < 4; ++i)
+            t.r[i] = VecSet(m.r[0].f[i], m.r[1].f[i], m.r[2].f[i], m.r[3].f[i]);
+        return t;
+    }
+
+#endif
+
+    //
+    // Vectors.
+    //
+
+    template<int I>
+    inline Vec4 VecSplat(Vec4 v) { return VecSwizzle<I, I, I, I>(v); }
+
+    inline float VecGetX(Vec4 v) { return VecGet<0>(v); }
+    inline float VecGetY(Vec4 v) { return VecGet<1>(v); }
+    inline float VecGetZ(Vec4 v) { return VecGet<2>(v); }
+    inline float VecGetW(Vec4 v) { return VecGet<3>(v); }
+
+    inline Vec4 Load(const Float3& v, float w = 0.f) { return VecLoad3(&v.x, w); }
+    inline Vec4 Load(const Float4& v) { return VecLoad(&v.x); }
+    inline Float3 StoreFloat3(Vec4 v) { Float3 r; VecStore3(&r.x, v); return r; }
+    inline Float4 StoreFloat4(Vec4 v) { Float4 r; VecStore(&r.x, v); return r; }
+
+    inline Vec4 VecLerp(Vec4 a, Vec4 b, float t) { return VecMulAdd(VecSub(b, a), VecReplicate(t), a); }
+
+    // Ignores w; the result's w is 0.
+    inline Vec4 VecCross3(Vec4 a, Vec4 b)
+    {
+        Vec4 r = VecMul(VecSwizzle<1, 2, 0, 3>(a), VecSwizzle<2, 0, 1, 3>(b));
+        return VecNegMulSub(VecSwizzle<2, 0, 1, 3>(a), VecSwizzle<1, 2, 0, 3>(b), r);
+    }
+
+    inline float VecLength3(Vec4 v) { return VecGetX(VecSqrt(VecDot3(v, v))); }
+    inline float VecLength4(Vec4 v) { return VecGetX(VecSqrt(VecDot4(v, v))); }
+
+    // A zero vector stays zero.
+    inline Vec4 VecNormalize3(Vec4 v)
+    {
+        Vec4 length = VecSqrt(VecDot3(v, v));
+        return VecGetX(length) > 0.f ? VecDiv(v, length) : VecZero();
+    }
+
+    inline Vec4 VecNormalize4(Vec4 v)
+    {
+        Vec4 length = VecSqrt(VecDot4(v, v));
+        return VecGetX(length) > 0.f ? VecDiv(v, length) : VecZero();
+    }
+
+    //
+    // Matrices.
+    //
+
+    inline Mat4 Load(const Float4x4& m)
+    {
+        Mat4 r;
+        r.r[0] = VecLoad(m.m[0]);
+        r.r[1] = VecLoad(m.m[1]);
+        r.r[2] = VecLoad(m.m[2]);
+        r.r[3] = VecLoad(m.m[3]);
+        return r;
+    }
+
+    inline void Store(Float4x4* dst, const Mat4& m)
+    {
+        VecStore(dst->m[0], m.r[0]);
+        VecStore(dst->m[1], m.r[1]);
+        VecStore(dst->m[2], m.r[2]);
+        VecStore(dst->m[3], m.r[3]);
+    }
+
+    inline Float4x4 StoreFloat4x4(const Mat4& m) { Float4x4 r; Store(&r, m); return r; }
+
+    inline Mat4 MatIdentity()
+    {
+        Mat4 r;
+        r.r[0] = VecSet(1.f, 0.f, 0.f, 0.f);
+        r.r[1] = VecSet(0.f, 1.f, 0.f, 0.f);
+        r.r[2] = VecSet(0.f, 0.f, 1.f, 0.f);
+        r.r[3] = VecSet(0.f, 0.f, 0.f, 1.f);
+        return r;
+    }
+
+    // v * m for a row vector v with all four components.
+    inline Vec4 VecTransform(Vec4 v, const Mat4& m)
+    {
+        Vec4 r = VecMul(VecSplat<0>(v), m.r[0]);
+        r = VecMulAdd(VecSplat<1>(v), m.r[1], r);
+        r = VecMulAdd(VecSplat<2>(v), m.r[2], r);
+        return VecMulAdd(VecSplat<3>(v), m.r[3], r);
+    }
+
+    // (x, y, z, 1) * m; the result is not divided by w.
+    inline Vec4 VecTransformPoint(Vec4 p, const Mat4& m)
+    {
+        Vec4 r = VecMulAdd(VecSplat<0>(p), m.r[0], m.r[3]);
+        r = VecMulAdd(VecSplat<1>(p), m.r[1], r);
+        return VecMulAdd(VecSplat<2>(p), m.r[2], r);
+    }
+
+    // (x, y, z, 0) * m, for directions.
+    inline Vec4 VecTransformNormal(Vec4 v, const Mat4& m)
+    {
+        Vec4 r = VecMul(VecSplat<0>(v), m.r[0]);
+        r = VecMulAdd(VecSplat<1>(v), m.r[1], r);
+        return VecMulAdd(VecSplat<2>(v), m.r[2], r);
+    }
+
+    // a * b: transforms by a, then by b.
+    inline Mat4 MatMultiply(const Mat4& a, const Mat4& b)
+    {
+        Mat4 r;
+        r.r[0] = VecTransform(a.r[0], b);
+        r.r[1] = VecTransform(a.r[1], b);
+        r.r[2] = VecTransform(a.r[2], b);
+        r.r[3] = VecTransform(a.r[3], b);
+        return r;
+    }
+
+    // 2x2 helpers for the block inverse below.  A Vec4 (a, b, c, d) holds
+    // the 2x2 matrix | a b |
+    //                | c d |
+    namespace Detail
+    {
+        // a * b
+        inline Vec4 Mat2Mul(Vec4 a, Vec4 b)
+        {
+            return VecMulAdd(a, VecSwizzle<0, 3, 0, 3>(b),
+                VecMul(VecSwizzle<1, 0, 3, 2>(a), VecSwizzle<2, 1, 2, 1>(b)));
+        }
+
+        // adj(a) * b
+        inline Vec4 Mat2AdjMul(Vec4 a, Vec4 b)
+        {
+            return VecSub(VecMul(VecSwizzle<3, 3, 0, 0>(a), b),
+                VecMul(VecSwizzle<1, 1, 2, 2>(a), VecSwizzle<2, 3, 0, 1>(b)));
+        }
+
+        // a * adj(b)
+        inline Vec4 Mat2MulAdj(Vec4 a, Vec4 b)
+        {
+            return VecSub(VecMul(a, VecSwizzle<3, 0, 3, 0>(b)),
+                VecMul(VecSwizzle<1, 0, 3, 2>(a), VecSwizzle<2, 1, 2, 1>(b)));
+        }
+    }
+
+    // General inverse by 2x2 blocks.  Writes the determinant to
+    // *determinant when it is not null; a singular matrix gives infinities
+    // and NaNs, as XMMatrixInverse does.  Prefer MatInverseAffine or
+    // MatInverseRigid when the matrix is known to be one of those.
+    inline Mat4 MatInverse(const Mat4& m, float* determinant = nullptr)
+    {
+        using namespace Detail;
+
+        Vec4 A = VecShuffle<0, 1, 0, 1>(m.r[0], m.r[1]);
+        Vec4 B = VecShuffle<2, 3, 2, 3>(m.r[0], m.r[1]);
+        Vec4 C = VecShuffle<0, 1, 0, 1>(m.r[2], m.r[3]);
+        Vec4 D = VecShuffle<2, 3, 2, 3>(m.r[2], m.r[3]);
+
+        // (|A|, |B|, |C|, |D|)
+        Vec4 detSub = VecSub(
+            VecMul(VecShuffle<0, 2, 0, 2>(m.r[0], m.r[2]), VecShuffle<1, 3, 1, 3>(m.r[1], m.r[3])),
+            VecMul(VecShuffle<1, 3, 1, 3>(m.r[0], m.r[2]), VecShuffle<0, 2, 0, 2>(m.r[1], m.r[3])));
+        Vec4 detA = VecSplat<0>(detSub);
+        Vec4 detB = VecSplat<1>(detSub);
+        Vec4 detC = VecSplat<2>(detSub);
+        Vec4 detD = VecSplat<3>(detSub);
+
+        Vec4 D_C = Mat2AdjMul(D, C);
+        Vec4 A_B = Mat2AdjMul(A, B);
+        Vec4 X_ = VecSub(VecMul(detD, A), Mat2Mul(B, D_C));
+        Vec4 W_ = VecSub(VecMul(detA, D), Mat2Mul(C, A_B));
+        Vec4 Y_ = VecSub(VecMul(detB, C), Mat2MulAdj(D, A_B));
+        Vec4 Z_ = VecSub(VecMul(detC, B), Mat2MulAdj(A, D_C));
+
+        // |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+        Vec4 detM = VecMulAdd(detA, detD, VecMul(detB, detC));
+        detM = VecSub(detM, VecDot4(A_B, VecSwizzle<0, 2, 1, 3>(D_C)));
+        if(determinant)
+            *determinant = VecGetX(detM);
+
+        Vec4 rDetM = VecDiv(VecSet(1.f, -1.f, -1.f, 1.f), detM);
+        X_ = VecMul(X_, rDetM);
+        Y_ = VecMul(Y_, rDetM);
+        Z_ = VecMul(Z_, rDetM);
+        W_ = VecMul(W_, rDetM);
+
+        Mat4 r;
+        r.r[0] = VecShuffle<3, 1, 3, 1>(X_, Y_);
+        r.r[1] = VecShuffle<2, 0, 2, 0>(X_, Y_);
+        r.r[2] = VecShuffle<3, 1, 3, 1>(Z_, W_);
+        r.r[3] = VecShuffle<2, 0, 2, 0>(Z_, W_);
+        return r;
+    }
+
+    inline float MatDeterminant(const Mat4& m)
+    {
+        float det;
+        MatInverse(m, &det);
+        return det;
+    }
+
+    // Inverse of an affine matrix: a 3x3 part in the upper left, a
+    // translation in the last row and (0, 0, 0, 1) as the last column.  The
+    // 3x3 part is inverted through the cross products of its rows.
+    inline Mat4 MatInverseAffine(const Mat4& m)
+    {
+        Vec4 c0 = VecCross3(m.r[1], m.r[2]);
+        Vec4 c1 = VecCross3(m.r[2], m.r[0]);
+        Vec4 c2 = VecCross3(m.r[0], m.r[1]);
+        Vec4 rDet = VecDiv(VecReplicate(1.f), VecDot3(m.r[0], c0));
+
+        Mat4 adj = { { c0, c1, c2, VecZero() } };
+        Mat4 r = MatTranspose(adj);
+        r.r[0] = VecMul(r.r[0], rDet);
+        r.r[1] = VecMul(r.r[1], rDet);
+        r.r[2] = VecMul(r.r[2], rDet);
+        r.r[3] = VecSelectW(VecNegate(VecTransformNormal(m.r[3], r)), VecReplicate(1.f));
+        return r;
+    }
+
+    // Inverse of a rotation followed by a translation, such as a view
+    // matrix: the transposed rotation and the translation rotated back.
+    inline Mat4 MatInverseRigid(const Mat4& m)
+    {
+        Mat4 rotation = { { m.r[0], m.r[1], m.r[2], VecZero() } };
+        Mat4 r = MatTranspose(rotation);
+        r.r[3] = VecSelectW(VecNegate(VecTransformNormal(m.r[3], r)), VecReplicate(1.f));
+        return r;
+    }
+
+    // Inverse of a matrix built by MatPerspectiveFovLH or
+    // XMMatrixPerspectiveFovLH, read off its four non-zero terms.
+    inline Mat4 MatInversePerspectiveLH(const Mat4& p)
+    {
+        float width = VecGetX(p.r[0]);
+        float height = VecGetY(p.r[1]);
+        float range = VecGetZ(p.r[2]);
+        float rangeTimesNear = VecGetZ(p.r[3]);
+
+        Mat4 r;
+        r.r[0] = VecSet(1.f / width, 0.f, 0.f, 0.f);
+        r.r[1] = VecSet(0.f, 1.f / height, 0.f, 0.f);
+        r.r[2] = VecSet(0.f, 0.f, 0.f, 1.f / rangeTimesNear);
+        r.r[3] = VecSet(0.f, 0.f, 1.f, -range / rangeTimesNear);
+        return r;
+    }
+
+    //
+    // Transform construction.  All matrices are for row vectors.
+    //
+
+    inline Mat4 MatTranslation(float x, float y, float z)
+    {
+        Mat4 r = MatIdentity();
+        r.r[3] = VecSet(x, y, z, 1.f);
+        return r;
+    }
+
+    inline Mat4 MatScaling(float x, float y, float z)
+    {
+        Mat4 r;
+        r.r[0] = VecSet(x, 0.f, 0.f, 0.f);
+        r.r[1] = VecSet(0.f, y, 0.f, 0.f);
+        r.r[2] = VecSet(0.f, 0.f, z, 0.f);
+        r.r[3] = VecSet(0.f, 0.f, 0.f, 1.f);
+        return r;
+    }
+
+    // Rotation by the unit quaternion q; matches XMMatrixRotationQuaternion.
+    inline Mat4 MatRotationQuaternion(Vec4 q)
+    {
+        Float4 f = StoreFloat4(q);
+        float xx = f.x * f.x, yy = f.y * f.y, zz = f.z * f.z;
+        float xy = f.x * f.y, xz = f.x * f.z, yz = f.y * f.z;
+        float wx = f.w * f.x, wy = f.w * f.y, wz = f.w * f.z;
+
+        Mat4 r;
+        r.r[0] = VecSet(1.f - 2.f * (yy + zz), 2.f * (xy + wz), 2.f * (xz - wy), 0.f);
+        r.r[1] = VecSet(2.f * (xy - wz), 1.f - 2.f * (xx + zz), 2.f * (yz + wx), 0.f);
+        r.r[2] = VecSet(2.f * (xz + wy), 2.f * (yz - wx), 1.f - 2.f * (xx + yy), 0.f);
+        r.r[3] = VecSet(0.f, 0.f, 0.f, 1.f);
+        return r;
+    }
+
+    // Scale, then rotate, then translate.  Only xyz of scale and
+    // translation are used.
+    inline Mat4 MatAffineTransformation(Vec4 scale, Vec4 rotation, Vec4 translation)
+    {
+        Mat4 r = MatRotationQuaternion(rotation);
+        r.r[0] = VecMul(r.r[0], VecSplat<0>(scale));
+        r.r[1] = VecMul(r.r[1], VecSplat<1>(scale));
+        r.r[2] = VecMul(r.r[2], VecSplat<2>(scale));
+        r.r[3] = VecSelectW(translation, VecSet(0.f, 0.f, 0.f, 1.f));
+        return r;
+    }
+
+    // Matches XMMatrixLookAtLH.
+    inline Mat4 MatLookAtLH(Vec4 eye, Vec4 target, Vec4 up)
+    {
+        Vec4 zAxis = VecNormalize3(VecSub(target, eye));
+        Vec4 xAxis = VecNormalize3(VecCross3(up, zAxis));
+        Vec4 yAxis = VecCross3(zAxis, xAxis);
+        Vec4 negEye = VecNegate(eye);
+
+        Mat4 r;
+        r.r[0] = VecSelectW(xAxis, VecDot3(xAxis, negEye));
+        r.r[1] = VecSelectW(yAxis, VecDot3(yAxis, negEye));
+        r.r[2] = VecSelectW(zAxis, VecDot3(zAxis, negEye));
+        r.r[3] = VecSet(0.f, 0.f, 0.f, 1.f);
+        return MatTranspose(r);
+    }
+
+    // Matches XMMatrixPerspectiveFovLH.
+    inline Mat4 MatPerspectiveFovLH(float fovAngleY, float aspectRatio, float nearZ, float farZ)
+    {
+        float height = std::cos(0.5f * fovAngleY) / std::sin(0.5f * fovAngleY);
+        float width = height / aspectRatio;
+        float range = farZ / (farZ - nearZ);
+
+        Mat4 r;
+        r.r[0] = VecSet(width, 0.f, 0.f, 0.f);
+        r.r[1] = VecSet(0.f, height, 0.f, 0.f);
+        r.r[2] = VecSet(0.f, 0.f, range, 1.f);
+        r.r[3] = VecSet(0.f, 0.f, -range * nearZ, 0.f);
+        return r;
+    }
+
+    //
+    // Quaternions.
+    //
+
+    inline Vec4 QuatIdentity() { return VecSet(0.f, 0.f, 0.f, 1.f); }
+    inline Vec4 QuatConjugate(Vec4 q) { return VecMul(q, VecSet(-1.f, -1.f, -1.f, 1.f)); }
+    inline Vec4 QuatNormalize(Vec4 q) { return VecNormalize4(q); }
+
+    // axis must be normalized.
+    inline Vec4 QuatRotationAxis(Vec4 axis, float angle)
+    {
+        float s = std::sin(0.5f * angle);
+        float c = std::cos(0.5f * angle);
+        return VecSelectW(VecMul(axis, VecReplicate(s)), VecReplicate(c));
+    }
+
+    // The rotation q1 followed by q2, i.e. the product q2 * q1; the same
+    // order as XMQuaternionMultiply and matrix multiplication.
+    inline Vec4 QuatMultiply(Vec4 q1, Vec4 q2)
+    {
+        Vec4 r = VecMul(VecSplat<3>(q2), q1);
+        r = VecMulAdd(VecMul(VecSplat<0>(q2), VecSwizzle<3, 2, 1, 0>(q1)), VecSet(1.f, -1.f, 1.f, -1.f), r);
+        r = VecMulAdd(VecMul(VecSplat<1>(q2), VecSwizzle<2, 3, 0, 1>(q1)), VecSet(1.f, 1.f, -1.f, -1.f), r);
+        return VecMulAdd(VecMul(VecSplat<2>(q2), VecSwizzle<1, 0, 3, 2>(q1)), VecSet(-1.f, 1.f, 1.f, -1.f), r);
+    }
+
+    // Rotates the xyz of v by the unit quaternion q; the same as
+    // VecTransformNormal(v, MatRotationQuaternion(q)).
+    inline Vec4 QuatRotate(Vec4 v, Vec4 q)
+    {
+        Vec4 t = VecCross3(q, v);
+        t = VecAdd(t, t);
+        return VecAdd(VecMulAdd(VecSplat<3>(q), t, v), VecCross3(q, t));
+    }
+
+    // Spherical interpolation along the shorter arc; falls back to a
+    // normalized lerp when the quaternions are nearly parallel.
+    inline Vec4 QuatSlerp(Vec4 q0, Vec4 q1, float t)
+    {
+        float cosOmega = VecGetX(VecDot4(q0, q1));
+        if(cosOmega < 0.f)
+        {
+            q1 = VecNegate(q1);
+            cosOmega = -cosOmega;
+        }
+
+        if(cosOmega > 0.9995f)
+            return QuatNormalize(VecLerp(q0, q1, t));
+
+        float omega = std::acos(cosOmega);
+        float sinOmega = std::sin(omega);
+        float s0 = std::sin((1.f - t) * omega) / sinOmega;
+        float s1 = std::sin(t * omega) / sinOmega;
+        return VecMulAdd(q1, VecReplicate(s1), VecMul(q0, VecReplicate(s0)));
+    }
+}
@@ -0,0 +1,306 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    using uint32 = MeshOptimizer::uint32;
+
+    // Scoring parameters from Forsyth's paper.  The score cache is larger than
+    // the simulated hardware cache on purpose; it only ranks candidates.
+    const uint32 ScoreCacheSize = 32;
+    const uint32 MaxValenceScore = 32;
+    const float CacheDecayPower = 1.5f;
+    const float LastTriScore = 0.75f;
+    const float ValenceBoostScale = 2.0f;
+    const float ValenceBoostPower = 0.5f;
+
+    struct ScoreTables
+    {
+        float Cache[ScoreCacheSize];
+        float Valence[MaxValenceScore];
+
+        ScoreTables()
+        {
+            for(uint32 i = 0; i < ScoreCacheSize; ++i)
+            {
+                if(i < 3)
+                {
+                    // The last triangle's vertices get a fixed score so the next
+                    // triangle does not just reuse its two newest vertices.
+                    Cache[i] = LastTriScore;
+                }
+                else
+                {
+                    float scaler = 1.0f / (ScoreCacheSize - 3);
+                    Cache[i] = powf(1.0f - (i - 3)*scaler, CacheDecayPower);
+                }
+            }
+
+            // Vertices with few remaining triangles are boosted so they get
+            // finished off instead of leaving isolated triangles behind.
+            Valence[0] = 0.0f;
+            for(uint32 i = 1; i < MaxValenceScore; ++i)
+                Valence[i] = ValenceBoostScale * powf((float)i, -ValenceBoostPower);
+        }
+    };
+
+    float VertexScore(const ScoreTables& tables, int cachePosition, uint32 remainingValence)
+    {
+        if(remainingValence == 0)
+            return -1.0f;
+
+        float score = cachePosition >= 0 ? tables.Cache[cachePosition] : 0.0f;
+        return score + tables.Valence[std::min(remainingValence, MaxValenceScore - 1)];
+    }
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const uint32* indices, size_t indexCount,
+    size_t vertexCount, uint32 cacheSize)
+{
+    CacheStats stats;
+    if(indexCount == 0)
+        return stats;
+
+    // Each vertex remembers the miss counter value when it entered the cache;
+    // it is still resident if fewer than cacheSize misses happened since.
+    std::vector<size_t> insertedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+
+    size_t misses = 0;
+    size_t uniqueVertices = 0;
+    for(size_t i = 0; i < indexCount; ++i)
+    {
+        uint32 v = indices[i];
+        if(!referenced[v])
+        {
+            referenced[v] = true;
+            ++uniqueVertices;
+        }
+
+        if(insertedAt[v] == 0 || misses - insertedAt[v] >= cacheSize)
+        {
+            ++misses;
+            insertedAt[v] = misses;
+        }
+    }
+
+    stats.ACMR = (float)misses / (float)(indexCount / 3);
+    stats.ATVR = (float)misses / (float)uniqueVertices;
+    return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint32* indices, size_t indexCount, size_t vertexCount)
+{
+    static const ScoreTables tables;
+
+    size_t triCount = indexCount / 3;
+    if(triCount == 0)
+        return;
+
+    //
+    // Vertex -> triangle adjacency in compressed (offset + list) form.
+    //
+
+    std::vector<uint32> valence(vertexCount, 0);
+    for(size_t i = 0; i < indexCount; ++i)
+        ++valence[indices[i]];
+
+    std::vector<uint32> adjacencyOffset(vertexCount + 1, 0);
+    for(size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+
+    std::vector<uint32> adjacency(indexCount);
+    {
+        std::vector<uint32> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for(size_t i = 0; i < indexCount; ++i)
+            adjacency[fill[indices[i]]++] = (uint32)(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = VertexScore(tables, -1, valence[v]);
+
+    std::vector<float> triScore(triCount);
+    std::vector<bool> emitted(triCount, false);
+    for(size_t t = 0; t < triCount; ++t)
+    {
+        triScore[t] = vertexScore[indices[t*3+0]] + vertexScore[indices[t*3+1]] + vertexScore[indices[t*3+2]];
+    }
+
+    std::vector<uint32> output;
+    output.reserve(indexCount);
+
+    // LRU cache, newest first, with room for the three vertices being pushed.
+    uint32 cache[ScoreCacheSize + 3];
+    uint32 cacheCount = 0;
+
+    size_t inputCursor = 0;
+    size_t bestTri = 0;
+    float bestScore = triScore[0];
+    for(size_t t = 1; t < triCount; ++t)
+    {
+        if(triScore[t] > bestScore)
+        {
+            bestScore = triScore[t];
+            bestTri = t;
+        }
+    }
+
+    for(size_t emittedCount = 0; emittedCount < triCount; ++emittedCount)
+    {
+        // Dead end: nothing adjacent to the cache is left, continue in input order.
+        if(bestScore < 0.0f)
+        {
+            while(emitted[inputCursor])
+                ++inputCursor;
+            bestTri = inputCursor;
+        }
+
+        const uint32* tri = &indices[bestTri*3];
+        output.insert(output.end(), tri, tri + 3);
+        emitted[bestTri] = true;
+
+        //
+        // Push the triangle's vertices to the front of the LRU cache.
+        //
+
+        uint32 newCache[ScoreCacheSize + 3];
+        uint32 newCount = 0;
+        for(uint32 k = 0; k < 3; ++k)
+        {
+            newCache[newCount++] = tri[k];
+            --valence[tri[k]];
+        }
+
+        for(uint32 k = 0; k < cacheCount; ++k)
+        {
+            uint32 v = cache[k];
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCount++] = v;
+        }
+
+        // Vertices pushed past the end of the cache lose their cache bonus.
+        for(uint32 k = ScoreCacheSize; k < newCount; ++k)
+        {
+            cachePosition[newCache[k]] = -1;
+            vertexScore[newCache[k]] = VertexScore(tables, -1, valence[newCache[k]]);
+        }
+
+        cacheCount = std::min(newCount, ScoreCacheSize);
+        std::copy(newCache, newCache + cacheCount, cache);
+
+        for(uint32 k = 0; k < cacheCount; ++k)
+        {
+            cachePosition[cache[k]] = (int)k;
+            vertexScore[cache[k]] = VertexScore(tables, (int)k, valence[cache[k]]);
+        }
+
+        //
+        // Rescore the remaining triangles touching the cache and pick the best.
+        //
+
+        bestScore = -1.0f;
+        for(uint32 k = 0; k < newCount; ++k)
+        {
+            uint32 v = newCache[k];
+            for(uint32 a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; ++a)
+            {
+                uint32 t = adjacency[a];
+                if(emitted[t])
+                    continue;
+
+                float score = vertexScore[indices[t*3+0]] + vertexScore[indices[t*3+1]] + vertexScore[indices[t*3+2]];
+                triScore[t] = score;
+                if(score > bestScore)
+                {
+                    bestScore = score;
+                    bestTri = t;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+size_t MeshOptimizer::OptimizeVertexFetchRemap(uint32* indices, size_t indexCount, size_t vertexCount,
+    std::vector<uint32>& remap)
+{
+    remap.assign(vertexCount, ~0u);
+
+    uint32 nextVertex = 0;
+    for(size_t i = 0; i < indexCount; ++i)
+    {
+        uint32& r = remap[indices[i]];
+        if(r == ~0u)
+            r = nextVertex++;
+
+        indices[i] = r;
+    }
+
+    return nextVertex;
+}
+
+MeshOptimizer::OptimizeResult MeshOptimizer::Optimize(GeometryGenerator::MeshData& meshData)
+{
+    OptimizeResult result;
+    uint32* indices = meshData.Indices32.data();
+    size_t indexCount = meshData.Indices32.size();
+    size_t vertexCount = meshData.Vertices.size();
+
+    result.Before = AnalyzeVertexCache(indices, indexCount, vertexCount);
+    OptimizeVertexCache(indices, indexCount, vertexCount);
+
+    std::vector<uint32> remap;
+    size_t usedCount = OptimizeVertexFetchRemap(indices, indexCount, vertexCount, remap);
+    meshData.IndicesChanged();
+
+    std::vector<GeometryGenerator::Vertex> vertices(usedCount);
+    for(size_t v = 0; v < vertexCount; ++v)
+    {
+        if(remap[v] != ~0u)
+            vertices[remap[v]] = meshData.Vertices[v];
+    }
+    meshData.Vertices.swap(vertices);
+
+    result.After = AnalyzeVertexCache(indices, indexCount, usedCount);
+    return result;
+}
+
+MeshOptimizer::OptimizeResult MeshOptimizer::Optimize(GeometryGenerator::MeshDataSoA& meshData)
+{
+    OptimizeResult result;
+    uint32* indices = meshData.Indices32.data();
+    size_t indexCount = meshData.Indices32.size();
+    size_t vertexCount = meshData.VertexCount();
+
+    result.Before = AnalyzeVertexCache(indices, indexCount, vertexCount);
+    OptimizeVertexCache(indices, indexCount, vertexCount);
+
+    std::vector<uint32> remap;
+    size_t usedCount = OptimizeVertexFetchRemap(indices, indexCount, vertexCount, remap);
+
+    std::vector<float>* components[] =
+    {
+        &meshData.PosX, &meshData.PosY, &meshData.PosZ,
+        &meshData.NormalX, &meshData.NormalY, &meshData.NormalZ,
+        &meshData.TangentX, &meshData.TangentY, &meshData.TangentZ,
+        &meshData.TexU, &meshData.TexV
+    };
+
+    std::vector<float> scratch(usedCount);
+    for(std::vector<float>* c : components)
+    {
+        for(size_t v = 0; v < vertexCount; ++v)
+        {
+            if(remap[v] != ~0u)
+                scratch[remap[v]] = (*c)[v];
+        }
+        c->assign(scratch.begin(), scratch.end());
+    }
+
+    result.After = AnalyzeVertexCache(indices, indexCount, usedCount);
+    return result;
+}
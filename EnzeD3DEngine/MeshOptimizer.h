@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+// Index and vertex reordering for GeometryGenerator meshes.  Everything here is
+// plain CPU work on index lists, so the stats can be produced without a device.
+class MeshOptimizer
+{
+public:
+    using uint32 = std::uint32_t;
+
+    // Size of the post-transform cache the optimizer targets and the analysis
+    // simulates.  16-32 entries is typical of current hardware.
+    static const uint32 DefaultCacheSize = 16;
+
+    struct CacheStats
+    {
+        // Average cache miss ratio: transformed vertices per triangle (0.5 is ideal for grids).
+        float ACMR = 0.0f;
+        // Average transform to vertex ratio: transformed vertices per referenced vertex (1.0 is ideal).
+        float ATVR = 0.0f;
+    };
+
+    struct OptimizeResult
+    {
+        CacheStats Before;
+        CacheStats After;
+    };
+
+    // Simulates a FIFO post-transform cache over a triangle list.
+    static CacheStats AnalyzeVertexCache(const uint32* indices, size_t indexCount, size_t vertexCount,
+        uint32 cacheSize = DefaultCacheSize);
+
+    // Reorders the triangles of a triangle list in place for post-transform
+    // cache reuse (Forsyth, "Linear-Speed Vertex Cache Optimisation").
+    static void OptimizeVertexCache(uint32* indices, size_t indexCount, size_t vertexCount);
+
+    // Computes remap[oldVertex] = newVertex so vertices are numbered in the
+    // order the index buffer first references them, and rewrites the indices.
+    // Unreferenced vertices map to ~0u.  Returns the number of used vertices.
+    static size_t OptimizeVertexFetchRemap(uint32* indices, size_t indexCount, size_t vertexCount,
+        std::vector<uint32>& remap);
+
+    // Runs the cache and fetch passes on a mesh and reports the cache stats
+    // before and after.
+    static OptimizeResult Optimize(GeometryGenerator::MeshData& meshData);
+    static OptimizeResult Optimize(GeometryGenerator::MeshDataSoA& meshData);
+};
@@ -0,0 +1,191 @@
+#include "MeshPacker.h"
+#include <algorithm>
+#include <atomic>
+#include "MathHelper.h"
+
+void MeshPacker::Reserve(size_t meshCount)
+{
+    mEntries.reserve(meshCount);
+}
+
+void MeshPacker::Add(const std::string& name, const GeometryGenerator::MeshData& meshData)
+{
+    Entry e;
+    e.Name = name;
+    e.MeshAoS = &meshData;
+    e.Indices = meshData.Indices32.data();
+    e.VertexCount = (std::uint32_t)meshData.Vertices.size();
+    e.Submesh.IndexCount = (std::uint32_t)meshData.Indices32.size();
+    mEntries.push_back(std::move(e));
+}
+
+void MeshPacker::Add(const std::string& name, const GeometryGenerator::MeshDataSoA& meshData)
+{
+    Entry e;
+    e.Name = name;
+    e.MeshSoA = &meshData;
+    e.Indices = meshData.Indices32.data();
+    e.VertexCount = (std::uint32_t)meshData.VertexCount();
+    e.Submesh.IndexCount = (std::uint32_t)meshData.Indices32.size();
+    mEntries.push_back(std::move(e));
+}
+
+void MeshPacker::Pack()
+{
+    bool fitsIndices16 = Layout();
+
+    for(Entry& e : mEntries)
+    {
+        ConvertVertices(e);
+        if(fitsIndices16)
+            fitsIndices16 = NarrowIndices(e);
+    }
+
+    FinishIndices(fitsIndices16);
+}
+
+void MeshPacker::Pack(JobSystem& jobs)
+{
+    bool fitsIndices16 = Layout();
+
+    // Every mesh owns a disjoint slice of the combined arrays, so the meshes
+    // are converted and narrowed independently.
+    std::atomic<bool> narrowed(fitsIndices16);
+    jobs.ParallelFor((std::uint32_t)mEntries.size(), 1, [&](std::uint32_t begin, std::uint32_t end)
+    {
+        for(std::uint32_t i = begin; i < end; ++i)
+        {
+            ConvertVertices(mEntries[i]);
+            if(narrowed.load(std::memory_order_relaxed) && !NarrowIndices(mEntries[i]))
+                narrowed.store(false, std::memory_order_relaxed);
+        }
+    });
+
+    FinishIndices(narrowed.load());
+}
+
+bool MeshPacker::Layout()
+{
+    //
+    // Lay out the combined buffers in one pass.  Indices stay relative to each
+    // submesh's BaseVertexLocation, so 16-bit indices only require every
+    // submesh to address at most 65536 vertices on its own.
+    //
+
+    std::uint32_t vertexCount = 0;
+    std::uint32_t indexCount = 0;
+    bool fitsIndices16 = true;
+    for(Entry& e : mEntries)
+    {
+        e.Submesh.BaseVertexLocation = (std::int32_t)vertexCount;
+        e.Submesh.StartIndexLocation = indexCount;
+        vertexCount += e.VertexCount;
+        indexCount += e.Submesh.IndexCount;
+        fitsIndices16 = fitsIndices16 && e.VertexCount <= 0x10000;
+    }
+
+    mIndexCount = indexCount;
+    mVertices.resize(vertexCount);
+    if(fitsIndices16)
+        mIndices16.resize(indexCount);
+
+    return fitsIndices16;
+}
+
+void MeshPacker::ConvertVertices(Entry& e)
+{
+    using namespace DirectX;
+
+    // The bounds are accumulated from the source positions while the mesh
+    // is in cache anyway.
+    Vertex* dst = mVertices.data() + e.Submesh.BaseVertexLocation;
+    XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
+    XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
+    if(e.MeshSoA != nullptr)
+    {
+        const GeometryGenerator::MeshDataSoA& mesh = *e.MeshSoA;
+        GeometryGenerator::InterleavePositionNormal(mesh, dst, sizeof(Vertex));
+
+        if(e.VertexCount > 0)
+        {
+            auto x = std::minmax_element(mesh.PosX.begin(), mesh.PosX.end());
+            auto y = std::minmax_element(mesh.PosY.begin(), mesh.PosY.end());
+            auto z = std::minmax_element(mesh.PosZ.begin(), mesh.PosZ.end());
+            vMinf3 = XMFLOAT3(*x.first, *y.first, *z.first);
+            vMaxf3 = XMFLOAT3(*x.second, *y.second, *z.second);
+        }
+    }
+    else
+    {
+        XMVECTOR vMin = XMLoadFloat3(&vMinf3);
+        XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+        const GeometryGenerator::Vertex* src = e.MeshAoS->Vertices.data();
+        for(std::uint32_t i = 0; i < e.VertexCount; ++i)
+        {
+            dst[i].Pos = src[i].Position;
+            dst[i].Normal = src[i].Normal;
+
+            XMVECTOR p = XMLoadFloat3(&src[i].Position);
+            vMin = XMVectorMin(vMin, p);
+            vMax = XMVectorMax(vMax, p);
+        }
+        XMStoreFloat3(&vMinf3, vMin);
+        XMStoreFloat3(&vMaxf3, vMax);
+    }
+
+    if(e.VertexCount > 0)
+    {
+        BoundingBox::CreateFromPoints(e.Submesh.Bounds, XMLoadFloat3(&vMinf3), XMLoadFloat3(&vMaxf3));
+    }
+}
+
+bool MeshPacker::NarrowIndices(const Entry& e)
+{
+    // The pack kernel still checks every index in case a mesh references
+    // vertices it does not own.
+    return GeometryGenerator::PackIndices16(e.Indices, e.Submesh.IndexCount,
+        mIndices16.data() + e.Submesh.StartIndexLocation);
+}
+
+void MeshPacker::FinishIndices(bool fitsIndices16)
+{
+    if(fitsIndices16)
+    {
+        mIndices32.clear();
+        mIndexStride = sizeof(std::uint16_t);
+    }
+    else
+    {
+        mIndices16.clear();
+        mIndices32.resize(mIndexCount);
+        for(const Entry& e : mEntries)
+        {
+            std::copy(e.Indices, e.Indices + e.Submesh.IndexCount,
+                mIndices32.data() + e.Submesh.StartIndexLocation);
+        }
+        mIndexStride = sizeof(std::uint32_t);
+    }
+}
+
+void MeshPacker::Clear()
+{
+    mEntries.clear();
+    mVertices.clear();
+    mIndices16.clear();
+    mIndices32.clear();
+    mIndexCount = 0;
+    mIndexStride = sizeof(std::uint16_t);
+}
+
+const void* MeshPacker::IndexData()const
+{
+    if(mIndexStride == sizeof(std::uint16_t))
+        return mIndices16.data();
+
+    return mIndices32.data();
+}
+
+std::uint32_t MeshPacker::IndexByteSize()const
+{
+    return mIndexCount * mIndexStride;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "GeometryGenerator.h"
+#include "JobSystem.h"
+#include "RenderTypes.h"
+
+struct MeshGeometry;
+class GpuBufferAllocator;
+class UploadManager;
+
+// Concatenates any number of named GeometryGenerator meshes into one vertex
+// buffer and one index buffer, and fills MeshGeometry::DrawArgs for them.
+// Offsets are computed in a single pass and the combined arrays are sized
+// once, so packing is linear in the total vertex/index count.
+//
+// Packing is plain CPU work; only CreateGeometry touches D3D12, and it lives
+// in D3D12MeshPacker.cpp so the rest builds without Windows.
+class MeshPacker
+{
+public:
+    MeshPacker() = default;
+    MeshPacker(const MeshPacker& rhs) = delete;
+    MeshPacker& operator=(const MeshPacker& rhs) = delete;
+
+    void Reserve(size_t meshCount);
+
+    // Meshes are referenced, not copied, and must stay alive until Pack().
+    void Add(const std::string& name, const GeometryGenerator::MeshData& meshData);
+    void Add(const std::string& name, const GeometryGenerator::MeshDataSoA& meshData);
+
+    // Lays out every added mesh, converts the vertices to the packed Vertex
+    // format, computes each submesh's Bounds and narrows indices to 16 bits
+    // when every submesh allows it.
+    void Pack();
+
+    // Same as Pack(), with the per-mesh conversion spread across the job system.
+    void Pack(JobSystem& jobs);
+
+    // Allocates the vertex and index buffers from buffers, queues the packed
+    // data for upload into them and returns the geometry with its DrawArgs
+    // filled in.  The geometry can be drawn by a queue once the upload batch
+    // has been submitted and the queue made to wait for it.
+    std::unique_ptr<MeshGeometry> CreateGeometry(GpuBufferAllocator& buffers,
+        UploadManager& uploads, const std::string& name)const;
+
+    // Forgets all meshes but keeps the allocated storage for the next batch.
+    void Clear();
+
+    const std::vector<Vertex>& Vertices()const { return mVertices; }
+    const void* IndexData()const;
+    std::uint32_t IndexCount()const { return mIndexCount; }
+    std::uint32_t IndexByteSize()const;
+    // Bytes per index: 2 when every submesh fits 16-bit indices, else 4.
+    std::uint32_t IndexStride()const { return mIndexStride; }
+    size_t SubmeshCount()const { return mEntries.size(); }
+    const std::string& SubmeshName(size_t i)const { return mEntries[i].Name; }
+    const SubmeshGeometry& Submesh(size_t i)const { return mEntries[i].Submesh; }
+
+private:
+    struct Entry
+    {
+        std::string Name;
+        const GeometryGenerator::MeshData* MeshAoS = nullptr;
+        const GeometryGenerator::MeshDataSoA* MeshSoA = nullptr;
+        const std::uint32_t* Indices = nullptr;
+        std::uint32_t VertexCount = 0;
+        SubmeshGeometry Submesh;
+    };
+
+    bool Layout();
+    void ConvertVertices(Entry& e);
+    bool NarrowIndices(const Entry& e);
+    void FinishIndices(bool fitsIndices16);
+
+    std::vector<Entry> mEntries;
+    std::vector<Vertex> mVertices;
+    std::vector<std::uint16_t> mIndices16;
+    std::vector<std::uint32_t> mIndices32;
+    std::uint32_t mIndexCount = 0;
+    std::uint32_t mIndexStride = sizeof(std::uint16_t);
+};
@@ -0,0 +1,379 @@
+#include "ObjectPacking.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// F16C converts four or eight floats to halves per instruction; every AVX2
+// CPU has it, but GCC and Clang only enable it with -mf16c or -march.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(MATH_HELPER_AVX2))
+#define OBJECT_PACKING_F16C
+#include <immintrin.h>
+#endif
+
+using namespace Math;
+
+namespace
+{
+    const float Snorm16Scale = 32767.f;
+    const size_t CacheLineSize = 64;
+    // SortIntoRanges sorts slots this many bits a pass, and shorter lists
+    // with std::sort.
+    const std::uint32_t RadixBits = 11;
+    const std::uint64_t RadixMask = (1u << RadixBits) - 1;
+    const size_t RadixSortThreshold = 256;
+
+    // dst[i] = the halves of values 2i and 2i + 1, for count values.
+    void PackHalves(const float* values, size_t count, std::uint32_t* dst)
+    {
+#if defined(OBJECT_PACKING_F16C)
+        for(; count >= 4; count -= 4, values += 4, dst += 2)
+        {
+            __m128i halves = _mm_cvtps_ph(_mm_loadu_ps(values), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), halves);
+        }
+#endif
+        for(; count >= 2; count -= 2, values += 2, ++dst)
+            *dst = ObjectPacking::FloatToHalf(values[0]) | ((std::uint32_t)ObjectPacking::FloatToHalf(values[1]) << 16);
+        if(count)
+            *dst = ObjectPacking::FloatToHalf(values[0]);
+    }
+
+    std::uint32_t PackSnorm16(float lo, float hi)
+    {
+        auto quantize = [](float v)
+        {
+            return (std::uint32_t)(std::int32_t)std::lround(std::min(std::max(v, -1.f), 1.f) * Snorm16Scale) & 0xffffu;
+        };
+        return quantize(lo) | (quantize(hi) << 16);
+    }
+
+    float UnpackSnorm16(std::uint32_t v)
+    {
+        return std::max((float)(std::int16_t)(v & 0xffffu) / Snorm16Scale, -1.f);
+    }
+
+    // Unit quaternion of a rotation matrix in the row-vector convention of
+    // MatRotationQuaternion, taken from the largest of w, x, y and z.
+    Float4 QuaternionFromRotation(const float r[3][3])
+    {
+        Float4 q;
+        float trace = r[0][0] + r[1][1] + r[2][2];
+        if(trace > 0.f)
+        {
+            float s = 2.f * std::sqrt(trace + 1.f), inv = 1.f / s;
+            q = { (r[1][2] - r[2][1]) * inv, (r[2][0] - r[0][2]) * inv, (r[0][1] - r[1][0]) * inv, 0.25f * s };
+        }
+        else if(r[0][0] >= r[1][1] && r[0][0] >= r[2][2])
+        {
+            float s = 2.f * std::sqrt(1.f + r[0][0] - r[1][1] - r[2][2]), inv = 1.f / s;
+            q = { 0.25f * s, (r[0][1] + r[1][0]) * inv, (r[2][0] + r[0][2]) * inv, (r[1][2] - r[2][1]) * inv };
+        }
+        else if(r[1][1] >= r[2][2])
+        {
+            float s = 2.f * std::sqrt(1.f + r[1][1] - r[0][0] - r[2][2]), inv = 1.f / s;
+            q = { (r[0][1] + r[1][0]) * inv, 0.25f * s, (r[1][2] + r[2][1]) * inv, (r[2][0] - r[0][2]) * inv };
+        }
+        else
+        {
+            float s = 2.f * std::sqrt(1.f + r[2][2] - r[0][0] - r[1][1]), inv = 1.f / s;
+            q = { (r[2][0] + r[0][2]) * inv, (r[1][2] + r[2][1]) * inv, 0.25f * s, (r[0][1] - r[1][0]) * inv };
+        }
+        return q;
+    }
+
+    void PackAffine3x4(const Float4x4& world, void* dst)
+    {
+        Mat4 columns = MatTranspose(Load(world));
+        float* out = static_cast<float*>(dst);
+        VecStore(out, columns.r[0]);
+        VecStore(out + 4, columns.r[1]);
+        VecStore(out + 8, columns.r[2]);
+    }
+
+    void PackAffine3x4Half(const Float4x4& world, void* dst)
+    {
+        PackedAffine3x4Half packed;
+        packed.Translation = { world._41, world._42, world._43 };
+        const float linear[9] = {
+            world._11, world._12, world._13,
+            world._21, world._22, world._23,
+            world._31, world._32, world._33 };
+        PackHalves(linear, 9, packed.Linear);
+        std::memcpy(dst, &packed, sizeof(packed));
+    }
+
+    // World = scale * rotation * translation: the rows of the 3x3 part are
+    // the rotation's rows times the scale factors.  A mirroring world gets
+    // a negative x scale so that the rotation is proper.
+    void PackQuatTranslationScale(const Float4x4& world, void* dst)
+    {
+        float r[3][3];
+        // The fourth scale keeps the half conversion four wide.
+        float scale[4] = { 0.f, 0.f, 0.f, 0.f };
+        for(int i = 0; i < 3; ++i)
+        {
+            scale[i] = std::sqrt(world.m[i][0] * world.m[i][0] + world.m[i][1] * world.m[i][1] + world.m[i][2] * world.m[i][2]);
+            float inv = scale[i] > 0.f ? 1.f / scale[i] : 0.f;
+            for(int j = 0; j < 3; ++j)
+                r[i][j] = world.m[i][j] * inv;
+        }
+        float det = r[0][0] * (r[1][1] * r[2][2] - r[1][2] * r[2][1]) -
+            r[0][1] * (r[1][0] * r[2][2] - r[1][2] * r[2][0]) +
+            r[0][2] * (r[1][0] * r[2][1] - r[1][1] * r[2][0]);
+        if(det < 0.f)
+        {
+            scale[0] = -scale[0];
+            for(int j = 0; j < 3; ++j)
+                r[0][j] = -r[0][j];
+        }
+
+        Float4 q = QuaternionFromRotation(r);
+        float invLength = 1.f / std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+
+        PackedQuatTranslationScale packed;
+        packed.Translation = { world._41, world._42, world._43 };
+        packed.Rotation[0] = PackSnorm16(q.x * invLength, q.y * invLength);
+        packed.Rotation[1] = PackSnorm16(q.z * invLength, q.w * invLength);
+        PackHalves(scale, 4, packed.Scale);
+        std::memcpy(dst, &packed, sizeof(packed));
+    }
+}
+
+size_t ObjectPacking::ElementByteSize(ObjectFormat format)
+{
+    switch(format)
+    {
+    case ObjectFormat::Affine3x4: return sizeof(PackedAffine3x4);
+    case ObjectFormat::Affine3x4Half: return sizeof(PackedAffine3x4Half);
+    case ObjectFormat::QuatTranslationScale: return sizeof(PackedQuatTranslationScale);
+    default: return sizeof(Float4x4);
+    }
+}
+
+const char* ObjectPacking::Name(ObjectFormat format)
+{
+    switch(format)
+    {
+    case ObjectFormat::Affine3x4: return "affine 3x4";
+    case ObjectFormat::Affine3x4Half: return "affine 3x4, half";
+    case ObjectFormat::QuatTranslationScale: return "quaternion, translation, scale";
+    default: return "matrix 4x4";
+    }
+}
+
+void ObjectPacking::PackObjects(ObjectFormat format, const Float4x4* src, const std::uint32_t* items,
+    size_t count, const std::uint32_t* dstSlots, void* dst, size_t dstStride)
+{
+    void (*pack)(const Float4x4&, void*);
+    switch(format)
+    {
+    case ObjectFormat::Affine3x4: pack = PackAffine3x4; break;
+    case ObjectFormat::Affine3x4Half: pack = PackAffine3x4Half; break;
+    case ObjectFormat::QuatTranslationScale: pack = PackQuatTranslationScale; break;
+    default:
+        MathHelper::TransposeMatricesStrided(src, items, count, dstSlots, dst, dstStride);
+        return;
+    }
+
+    char* dstBytes = static_cast<char*>(dst);
+    for(size_t i = 0; i < count; ++i)
+    {
+        std::uint32_t item = items ? items[i] : (std::uint32_t)i;
+        pack(src[item], dstBytes + (size_t)dstSlots[item] * dstStride);
+    }
+}
+
+void ObjectPacking::SortIntoRanges(std::vector<std::uint32_t>& items, const std::uint32_t* dstSlots,
+    size_t dstStride, size_t grainSize, std::vector<std::uint32_t>& rangeBegins,
+    std::vector<std::uint64_t>& sortKeys)
+{
+    // Slot in the high half and item in the low one, so plain integer order
+    // is slot order.  A list already in order, as after a full update, is
+    // kept; long ones are radix sorted on the slot bits alone, ping-ponging
+    // between the two halves of sortKeys, which takes a fraction of
+    // std::sort's time at 100k items.
+    const size_t count = items.size();
+    sortKeys.resize(2 * count);
+    std::uint64_t* keys = sortKeys.data();
+    std::uint32_t maxSlot = 0;
+    bool ordered = true;
+    for(size_t i = 0; i < count; ++i)
+    {
+        keys[i] = ((std::uint64_t)dstSlots[items[i]] << 32) | items[i];
+        maxSlot = std::max(maxSlot, dstSlots[items[i]]);
+        ordered &= i == 0 || keys[i] > keys[i - 1];
+    }
+
+    if(!ordered && count <= RadixSortThreshold)
+    {
+        std::sort(keys, keys + count);
+    }
+    else if(!ordered)
+    {
+        std::uint64_t* other = keys + count;
+        for(std::uint32_t shift = 32; shift < 64 && (maxSlot >> (shift - 32)) != 0; shift += RadixBits)
+        {
+            std::uint32_t offsets[1u << RadixBits] = {};
+            for(size_t i = 0; i < count; ++i)
+                ++offsets[(keys[i] >> shift) & RadixMask];
+            std::uint32_t sum = 0;
+            for(std::uint32_t& offset : offsets)
+            {
+                std::uint32_t digitCount = offset;
+                offset = sum;
+                sum += digitCount;
+            }
+            for(size_t i = 0; i < count; ++i)
+                other[offsets[(keys[i] >> shift) & RadixMask]++] = keys[i];
+            std::swap(keys, other);
+        }
+    }
+    if(!ordered)
+    {
+        for(size_t i = 0; i < count; ++i)
+            items[i] = (std::uint32_t)keys[i];
+    }
+
+    // Move each boundary forward past elements sharing a line with the
+    // element before them; with elements of at most 64 bytes that is at most
+    // a few items.
+    grainSize = std::max<size_t>(grainSize, 1);
+    rangeBegins.clear();
+    rangeBegins.push_back(0);
+    for(size_t begin = grainSize; begin < items.size();)
+    {
+        size_t previousEnd = (size_t)dstSlots[items[begin - 1]] * dstStride + dstStride - 1;
+        if((size_t)dstSlots[items[begin]] * dstStride / CacheLineSize > previousEnd / CacheLineSize)
+        {
+            rangeBegins.push_back((std::uint32_t)begin);
+            begin += grainSize;
+        }
+        else
+        {
+            ++begin;
+        }
+    }
+    rangeBegins.push_back((std::uint32_t)items.size());
+}
+
+Float4x4 ObjectPacking::UnpackObject(ObjectFormat format, const void* element)
+{
+    Float4x4 world = Float4x4::Identity();
+    switch(format)
+    {
+    case ObjectFormat::Affine3x4:
+    {
+        PackedAffine3x4 packed;
+        std::memcpy(&packed, element, sizeof(packed));
+        Mat4 columns;
+        columns.r[0] = Load(packed.Columns[0]);
+        columns.r[1] = Load(packed.Columns[1]);
+        columns.r[2] = Load(packed.Columns[2]);
+        columns.r[3] = VecSet(0.f, 0.f, 0.f, 1.f);
+        Store(&world, MatTranspose(columns));
+        break;
+    }
+    case ObjectFormat::Affine3x4Half:
+    {
+        PackedAffine3x4Half packed;
+        std::memcpy(&packed, element, sizeof(packed));
+        for(int k = 0; k < 9; ++k)
+            world.m[k / 3][k % 3] = HalfToFloat((std::uint16_t)(packed.Linear[k / 2] >> (16 * (k % 2))));
+        world._41 = packed.Translation.x;
+        world._42 = packed.Translation.y;
+        world._43 = packed.Translation.z;
+        break;
+    }
+    case ObjectFormat::QuatTranslationScale:
+    {
+        PackedQuatTranslationScale packed;
+        std::memcpy(&packed, element, sizeof(packed));
+        float x = UnpackSnorm16(packed.Rotation[0]), y = UnpackSnorm16(packed.Rotation[0] >> 16);
+        float z = UnpackSnorm16(packed.Rotation[1]), w = UnpackSnorm16(packed.Rotation[1] >> 16);
+        float length = std::sqrt(x * x + y * y + z * z + w * w);
+        x /= length; y /= length; z /= length; w /= length;
+        const float scale[3] = {
+            HalfToFloat((std::uint16_t)packed.Scale[0]),
+            HalfToFloat((std::uint16_t)(packed.Scale[0] >> 16)),
+            HalfToFloat((std::uint16_t)packed.Scale[1]) };
+        const float r[3][3] = {
+            { 1.f - 2.f * (y * y + z * z), 2.f * (x * y + z * w), 2.f * (x * z - y * w) },
+            { 2.f * (x * y - z * w), 1.f - 2.f * (x * x + z * z), 2.f * (y * z + x * w) },
+            { 2.f * (x * z + y * w), 2.f * (y * z - x * w), 1.f - 2.f * (x * x + y * y) } };
+        for(int i = 0; i < 3; ++i)
+            for(int j = 0; j < 3; ++j)
+                world.m[i][j] = scale[i] * r[i][j];
+        world._41 = packed.Translation.x;
+        world._42 = packed.Translation.y;
+        world._43 = packed.Translation.z;
+        break;
+    }
+    default:
+        std::memcpy(&world, element, sizeof(world));
+        Store(&world, MatTranspose(Load(world)));
+        break;
+    }
+    return world;
+}
+
+std::uint16_t ObjectPacking::FloatToHalf(float value)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    std::uint32_t sign = (bits >> 16) & 0x8000u;
+    std::uint32_t magnitude = bits & 0x7fffffffu;
+
+    // NaN stays NaN, infinity and anything that rounds past 65504 becomes
+    // infinity.
+    if(magnitude >= 0x7f800000u)
+        return (std::uint16_t)(sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u));
+    if(magnitude >= 0x477ff000u)
+        return (std::uint16_t)(sign | 0x7c00u);
+
+    std::uint32_t half, remainder, halfway;
+    if(magnitude < 0x38800000u)
+    {
+        // Below the smallest normal half: denormal or zero.
+        std::uint32_t exponent = magnitude >> 23;
+        if(exponent < 102)
+            return (std::uint16_t)sign;
+        std::uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+        std::uint32_t shift = 126 - exponent;
+        half = mantissa >> shift;
+        remainder = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        // Rebias the exponent from 127 to 15.  A carry out of the mantissa
+        // correctly bumps the exponent.
+        half = (magnitude - 0x38000000u) >> 13;
+        remainder = magnitude & 0x1fffu;
+        halfway = 0x1000u;
+    }
+    if(remainder > halfway || (remainder == halfway && (half & 1)))
+        ++half;
+    return (std::uint16_t)(sign | half);
+}
+
+float ObjectPacking::HalfToFloat(std::uint16_t value)
+{
+    std::uint32_t sign = (std::uint32_t)(value & 0x8000u) << 16;
+    std::uint32_t exponent = (value >> 10) & 0x1fu;
+    std::uint32_t mantissa = value & 0x3ffu;
+
+    std::uint32_t bits;
+    if(exponent == 0)
+    {
+        float magnitude = std::ldexp((float)mantissa, -24);
+        return sign ? -magnitude : magnitude;
+    }
+    if(exponent == 31)
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    else
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
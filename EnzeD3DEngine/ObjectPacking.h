@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "MathHelper.h"
+
+// Layouts of the per-object elements of FrameResource::ObjectBuffer.  The
+// vertex shader is compiled with OBJECT_FORMAT set to the value in use and
+// decodes its element with the matching branch of shaders.hlsl.
+enum class ObjectFormat : std::uint32_t
+{
+    // ObjectConstants: the transposed world matrix.  64 bytes.
+    Matrix4x4 = 0,
+    // The first three columns of the world matrix, the fourth being
+    // (0, 0, 0, 1) for any affine transform.  48 bytes, exact.
+    Affine3x4 = 1,
+    // The 3x3 rotation and scale part in half precision and the translation
+    // in full.  32 bytes.
+    Affine3x4Half = 2,
+    // Translation, rotation quaternion and per-axis scale.  28 bytes.  Only
+    // represents worlds without shear, i.e. hierarchies whose non-uniformly
+    // scaled nodes have no rotated children.  The slowest to encode, so best
+    // suited to scenes where few objects move per frame.
+    QuatTranslationScale = 3,
+
+    Count
+};
+
+struct PackedAffine3x4
+{
+    // Columns[c] is column c of the world matrix.
+    Math::Float4 Columns[3];
+};
+
+struct PackedAffine3x4Half
+{
+    Math::Float3 Translation;
+    // Rows 0-2 of the world matrix, 9 halves in row-major order; half k is
+    // in the low 16 bits of Linear[k / 2] when k is even, the high ones
+    // otherwise.
+    std::uint32_t Linear[5];
+};
+
+struct PackedQuatTranslationScale
+{
+    Math::Float3 Translation;
+    // Unit quaternion (x, y, z, w) as snorm16, x and z in the low bits.
+    std::uint32_t Rotation[2];
+    // Scale (x, y, z) as halves, x in the low bits of Scale[0].
+    std::uint32_t Scale[2];
+};
+
+static_assert(sizeof(PackedAffine3x4) == 48, "PackedAffine3x4 must match ObjectData in shaders.hlsl");
+static_assert(sizeof(PackedAffine3x4Half) == 32, "PackedAffine3x4Half must match ObjectData in shaders.hlsl");
+static_assert(sizeof(PackedQuatTranslationScale) == 28, "PackedQuatTranslationScale must match ObjectData in shaders.hlsl");
+
+// Encodes world matrices into ObjectFormat elements.  The decoders mirror
+// the shader's, so the precision of a format can be checked without a
+// device (see Benchmarks/ObjectPackingBenchmarks.cpp).
+class ObjectPacking
+{
+public:
+    static size_t ElementByteSize(ObjectFormat format);
+    static const char* Name(ObjectFormat format);
+
+    // Writes src[item] in format to dst + dstSlots[item] * dstStride, for
+    // item in items[0, count), or in [0, count) when items is null.  Takes
+    // the same arguments as MathHelper::TransposeMatricesStrided, which it
+    // uses for Matrix4x4.
+    static void PackObjects(ObjectFormat format, const Math::Float4x4* src, const std::uint32_t* items,
+        size_t count, const std::uint32_t* dstSlots, void* dst, size_t dstStride);
+
+    // Splits a scattered list of items to pack into ranges for one job each.
+    // Sorts items by dstSlots[item], so every job writes its part of the
+    // mapped buffer front to back, then sets rangeBegins to the first index
+    // into items of each range, followed by items.size().  Ranges hold about
+    // grainSize items and each starts on an element beginning a new 64-byte
+    // line of dst, taken to be line aligned, so no two jobs write the same
+    // line of write-combined memory.  Slots must be unique; sortKeys is
+    // scratch the caller keeps so its storage is reused from frame to frame.
+    static void SortIntoRanges(std::vector<std::uint32_t>& items, const std::uint32_t* dstSlots,
+        size_t dstStride, size_t grainSize, std::vector<std::uint32_t>& rangeBegins,
+        std::vector<std::uint64_t>& sortKeys);
+
+    // The world matrix the shader decodes from one element.
+    static Math::Float4x4 UnpackObject(ObjectFormat format, const void* element);
+
+    // IEEE half precision.  FloatToHalf rounds to nearest even; HalfToFloat
+    // is exact, like the shader's f16tof32.
+    static std::uint16_t FloatToHalf(float value);
+    static float HalfToFloat(std::uint16_t value);
+};
@@ -0,0 +1,48 @@
+#include "ParallelCommandRecorder.h"
+#include <algorithm>
+
+std::uint32_t ParallelCommandRecorder::Record(JobSystem& jobs, std::uint32_t itemCount,
+    std::uint32_t maxChunks, std::uint32_t minItemsPerChunk, const ChunkJob& record)
+{
+    minItemsPerChunk = std::max(minItemsPerChunk, 1u);
+    std::uint32_t chunkCount = (itemCount + minItemsPerChunk - 1) / minItemsPerChunk;
+    chunkCount = std::max(1u, std::min(chunkCount, std::max(maxChunks, 1u)));
+
+    while(mChunks.size() < chunkCount)
+        mChunks.push_back(std::make_unique<Chunk>());
+    mChunkCount = chunkCount;
+
+    // Chunk sizes differ by at most one item.
+    const std::uint32_t baseSize = itemCount / chunkCount;
+    const std::uint32_t remainder = itemCount % chunkCount;
+    jobs.ParallelFor(chunkCount, 1, [&](std::uint32_t first, std::uint32_t last)
+    {
+        for(std::uint32_t chunk = first; chunk < last; ++chunk)
+        {
+            std::uint32_t begin = chunk * baseSize + std::min(chunk, remainder);
+            std::uint32_t end = begin + baseSize + (chunk < remainder ? 1 : 0);
+
+            Chunk& c = *mChunks[chunk];
+            c.Stream.Clear();
+            c.Recorder.Reset(&c.Stream);
+            c.Recorder.ResetStats();
+            record(chunk, begin, end, c.Stream, c.Recorder);
+        }
+    });
+
+    return chunkCount;
+}
+
+CommandRecorder::Stats ParallelCommandRecorder::GetStats()const
+{
+    CommandRecorder::Stats total;
+    for(std::uint32_t i = 0; i < mChunkCount; ++i)
+    {
+        const CommandRecorder::Stats& s = mChunks[i]->Recorder.GetStats();
+        total.Calls += s.Calls;
+        total.RedundantCalls += s.RedundantCalls;
+        total.Draws += s.Draws;
+        total.Instances += s.Instances;
+    }
+    return total;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "CommandRecorder.h"
+#include "JobSystem.h"
+
+// Records one frame as several RenderCommandStreams at once.  The items to
+// draw are split into contiguous chunks, each recorded by a job into its own
+// stream through its own CommandRecorder, so submitting the streams in chunk
+// order reproduces the single-threaded frame.  Every chunk starts with no
+// bound state: a chunk must bind everything it relies on, just as every D3D12
+// command list has to.
+class ParallelCommandRecorder
+{
+public:
+    // Records items [begin, end) of chunk into stream through recorder.
+    typedef std::function<void(std::uint32_t chunk, std::uint32_t begin, std::uint32_t end,
+        RenderCommandStream& stream, CommandRecorder& recorder)> ChunkJob;
+
+    ParallelCommandRecorder() = default;
+    ParallelCommandRecorder(const ParallelCommandRecorder& rhs) = delete;
+    ParallelCommandRecorder& operator=(const ParallelCommandRecorder& rhs) = delete;
+
+    // Splits [0, itemCount) into at most maxChunks chunks of at least
+    // minItemsPerChunk items, runs record once per chunk across jobs and
+    // waits.  There is always at least one chunk, even for no items, so a
+    // frame always has a first and a last stream.  Returns the chunk count.
+    std::uint32_t Record(JobSystem& jobs, std::uint32_t itemCount, std::uint32_t maxChunks,
+        std::uint32_t minItemsPerChunk, const ChunkJob& record);
+
+    // Valid from the start of Record() until the next Record().
+    std::uint32_t ChunkCount()const { return mChunkCount; }
+    const RenderCommandStream& Stream(std::uint32_t chunk)const { return mChunks[chunk]->Stream; }
+
+    // Recorder statistics summed over all chunks of the last Record().
+    CommandRecorder::Stats GetStats()const;
+
+private:
+    struct Chunk
+    {
+        RenderCommandStream Stream;
+        CommandRecorder Recorder;
+    };
+
+    // Chunks are held by pointer so a recorder's stream never moves.
+    std::vector<std::unique_ptr<Chunk>> mChunks;
+    std::uint32_t mChunkCount = 0;
+};
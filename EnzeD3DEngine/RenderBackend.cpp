@@ -0,0 +1,23 @@
+#include "RenderBackend.h"
+
+NullRenderBackend::NullRenderBackend(bool keepLastStream) :
+    mKeepLastStream(keepLastStream)
+{
+}
+
+void NullRenderBackend::Submit(const RenderCommandStream& stream)
+{
+    ++mStats.Submits;
+    mStats.Bytes += stream.ByteSize();
+
+    for(auto c = stream.Begin(); c != stream.End(); c = RenderCommandStream::Next(c))
+    {
+        ++mStats.Commands;
+        ++mStats.CommandsOfType[(size_t)c->Type];
+        if(c->Type == RenderCommandType::DrawIndexedInstanced)
+            mStats.Instances += reinterpret_cast<const RenderCommand::DrawIndexedInstanced*>(c)->InstanceCount;
+    }
+
+    if(mKeepLastStream)
+        mLastStream = stream;
+}
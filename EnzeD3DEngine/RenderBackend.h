@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include "RenderCommandStream.h"
+
+// Executes recorded RenderCommandStreams.
+class RenderBackend
+{
+public:
+    virtual ~RenderBackend() = default;
+
+    virtual void Submit(const RenderCommandStream& stream) = 0;
+};
+
+// Backend that executes nothing.  It walks every submitted stream and counts
+// what it sees, so the CPU side of a frame can run and be measured without a
+// GPU; with keepLastStream it also keeps a copy of the last stream for
+// inspection.
+class NullRenderBackend : public RenderBackend
+{
+public:
+    struct Stats
+    {
+        std::uint64_t Submits = 0;
+        std::uint64_t Commands = 0;
+        std::uint64_t Bytes = 0;
+        std::uint64_t Instances = 0;
+        std::uint64_t CommandsOfType[(size_t)RenderCommandType::Count] = {};
+    };
+
+    explicit NullRenderBackend(bool keepLastStream = false);
+
+    void Submit(const RenderCommandStream& stream) override;
+
+    const Stats& GetStats()const { return mStats; }
+    void ResetStats() { mStats = Stats(); }
+    const RenderCommandStream& LastStream()const { return mLastStream; }
+
+private:
+    bool mKeepLastStream = false;
+    RenderCommandStream mLastStream;
+    Stats mStats;
+};
@@ -0,0 +1,136 @@
+#include "RenderCommandStream.h"
+#include <cstring>
+#include <new>
+
+void RenderCommandStream::Clear()
+{
+    mWords.clear();
+    mCommandCount = 0;
+}
+
+void RenderCommandStream::Reserve(size_t byteCount)
+{
+    mWords.reserve((byteCount + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+}
+
+template<typename T>
+T& RenderCommandStream::Push(RenderCommandType type)
+{
+    const size_t wordCount = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+    const size_t offset = mWords.size();
+    mWords.resize(offset + wordCount);
+    ++mCommandCount;
+
+    T* command = new(&mWords[offset]) T;
+    command->Header.Type = type;
+    command->Header.Size = (std::uint16_t)(wordCount * sizeof(std::uint64_t));
+    return *command;
+}
+
+void RenderCommandStream::SetPipelineState(void* pipelineState)
+{
+    Push<RenderCommand::SetPipelineState>(RenderCommandType::SetPipelineState).PipelineState = pipelineState;
+}
+
+void RenderCommandStream::SetGraphicsRootSignature(void* rootSignature)
+{
+    Push<RenderCommand::SetRootSignature>(RenderCommandType::SetRootSignature).RootSignature = rootSignature;
+}
+
+void RenderCommandStream::SetViewport(const RenderViewport& viewport)
+{
+    Push<RenderCommand::SetViewport>(RenderCommandType::SetViewport).Viewport = viewport;
+}
+
+void RenderCommandStream::SetScissorRect(const RenderRect& rect)
+{
+    Push<RenderCommand::SetScissorRect>(RenderCommandType::SetScissorRect).Rect = rect;
+}
+
+void RenderCommandStream::SetRenderTargets(RenderDescriptor renderTarget, RenderDescriptor depthStencil)
+{
+    auto& c = Push<RenderCommand::SetRenderTargets>(RenderCommandType::SetRenderTargets);
+    c.RenderTarget = renderTarget;
+    c.DepthStencil = depthStencil;
+}
+
+void RenderCommandStream::ClearRenderTarget(RenderDescriptor renderTarget, const float color[4])
+{
+    auto& c = Push<RenderCommand::ClearRenderTarget>(RenderCommandType::ClearRenderTarget);
+    std::memcpy(c.Color, color, sizeof(c.Color));
+    c.RenderTarget = renderTarget;
+}
+
+void RenderCommandStream::ClearDepthStencil(RenderDescriptor depthStencil, float depth, std::uint8_t stencil)
+{
+    auto& c = Push<RenderCommand::ClearDepthStencil>(RenderCommandType::ClearDepthStencil);
+    c.Depth = depth;
+    c.DepthStencil = depthStencil;
+    c.Stencil = stencil;
+}
+
+void RenderCommandStream::ResourceBarrier(void* resource, RenderResourceState before, RenderResourceState after)
+{
+    auto& c = Push<RenderCommand::ResourceBarrier>(RenderCommandType::ResourceBarrier);
+    c.Before = before;
+    c.Resource = resource;
+    c.After = after;
+}
+
+void RenderCommandStream::SetVertexBuffer(const RenderVertexBufferView& view)
+{
+    Push<RenderCommand::SetVertexBuffer>(RenderCommandType::SetVertexBuffer).View = view;
+}
+
+void RenderCommandStream::SetIndexBuffer(const RenderIndexBufferView& view)
+{
+    Push<RenderCommand::SetIndexBuffer>(RenderCommandType::SetIndexBuffer).View = view;
+}
+
+void RenderCommandStream::SetPrimitiveTopology(std::uint32_t topology)
+{
+    Push<RenderCommand::SetPrimitiveTopology>(RenderCommandType::SetPrimitiveTopology).Topology = topology;
+}
+
+void RenderCommandStream::SetGraphicsRootConstantBufferView(std::uint32_t rootParameter, RenderGpuAddress address)
+{
+    auto& c = Push<RenderCommand::SetRootView>(RenderCommandType::SetRootConstantBufferView);
+    c.RootParameter = rootParameter;
+    c.Address = address;
+}
+
+void RenderCommandStream::SetGraphicsRootShaderResourceView(std::uint32_t rootParameter, RenderGpuAddress address)
+{
+    auto& c = Push<RenderCommand::SetRootView>(RenderCommandType::SetRootShaderResourceView);
+    c.RootParameter = rootParameter;
+    c.Address = address;
+}
+
+void RenderCommandStream::SetGraphicsRoot32BitConstant(std::uint32_t rootParameter, std::uint32_t value, std::uint32_t destOffset)
+{
+    auto& c = Push<RenderCommand::SetRoot32BitConstant>(RenderCommandType::SetRoot32BitConstant);
+    c.RootParameter = rootParameter;
+    c.Value = value;
+    c.DestOffset = destOffset;
+}
+
+void RenderCommandStream::DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+    std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation)
+{
+    auto& c = Push<RenderCommand::DrawIndexedInstanced>(RenderCommandType::DrawIndexedInstanced);
+    c.IndexCountPerInstance = indexCountPerInstance;
+    c.InstanceCount = instanceCount;
+    c.StartIndexLocation = startIndexLocation;
+    c.BaseVertexLocation = baseVertexLocation;
+    c.StartInstanceLocation = startInstanceLocation;
+}
+
+const RenderCommandHeader* RenderCommandStream::Begin()const
+{
+    return reinterpret_cast<const RenderCommandHeader*>(mWords.data());
+}
+
+const RenderCommandHeader* RenderCommandStream::End()const
+{
+    return reinterpret_cast<const RenderCommandHeader*>(mWords.data() + mWords.size());
+}
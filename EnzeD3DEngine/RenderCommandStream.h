@@ -0,0 +1,240 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Backend-agnostic description of one frame's rendering work.
+//
+// Commands are POD structs packed back to back into a word array, each
+// starting with a RenderCommandHeader and padded to 8 bytes, so recording is
+// a bump of the write position and a stream can be copied or replayed by
+// any RenderBackend.  Nothing here depends on D3D12: pipeline states, root
+// signatures and resources are opaque backend pointers, and topology values
+// are passed through untouched.
+
+typedef std::uint64_t RenderGpuAddress;
+// CPU descriptor handle of a render target or depth stencil view.
+typedef std::uint64_t RenderDescriptor;
+
+struct RenderVertexBufferView
+{
+    RenderGpuAddress BufferLocation = 0;
+    std::uint32_t SizeInBytes = 0;
+    std::uint32_t StrideInBytes = 0;
+};
+
+struct RenderIndexBufferView
+{
+    RenderGpuAddress BufferLocation = 0;
+    std::uint32_t SizeInBytes = 0;
+    // Backend index format, DXGI_FORMAT for D3D12.
+    std::uint32_t Format = 0;
+};
+
+struct RenderViewport
+{
+    float TopLeftX = 0.0f;
+    float TopLeftY = 0.0f;
+    float Width = 0.0f;
+    float Height = 0.0f;
+    float MinDepth = 0.0f;
+    float MaxDepth = 1.0f;
+};
+
+struct RenderRect
+{
+    std::int32_t Left = 0;
+    std::int32_t Top = 0;
+    std::int32_t Right = 0;
+    std::int32_t Bottom = 0;
+};
+
+enum class RenderResourceState : std::uint32_t
+{
+    Present,
+    RenderTarget,
+    DepthWrite,
+    CopyDest,
+    GenericRead
+};
+
+enum class RenderCommandType : std::uint16_t
+{
+    SetPipelineState,
+    SetRootSignature,
+    SetViewport,
+    SetScissorRect,
+    SetRenderTargets,
+    ClearRenderTarget,
+    ClearDepthStencil,
+    ResourceBarrier,
+    SetVertexBuffer,
+    SetIndexBuffer,
+    SetPrimitiveTopology,
+    SetRootConstantBufferView,
+    SetRootShaderResourceView,
+    SetRoot32BitConstant,
+    DrawIndexedInstanced,
+    Count
+};
+
+struct RenderCommandHeader
+{
+    RenderCommandType Type;
+    // Bytes from this header to the next one.
+    std::uint16_t Size;
+};
+
+namespace RenderCommand
+{
+    struct SetPipelineState
+    {
+        RenderCommandHeader Header;
+        void* PipelineState;
+    };
+
+    struct SetRootSignature
+    {
+        RenderCommandHeader Header;
+        void* RootSignature;
+    };
+
+    struct SetViewport
+    {
+        RenderCommandHeader Header;
+        RenderViewport Viewport;
+    };
+
+    struct SetScissorRect
+    {
+        RenderCommandHeader Header;
+        RenderRect Rect;
+    };
+
+    struct SetRenderTargets
+    {
+        RenderCommandHeader Header;
+        RenderDescriptor RenderTarget;
+        // 0 when no depth stencil is bound.
+        RenderDescriptor DepthStencil;
+    };
+
+    struct ClearRenderTarget
+    {
+        RenderCommandHeader Header;
+        float Color[4];
+        RenderDescriptor RenderTarget;
+    };
+
+    struct ClearDepthStencil
+    {
+        RenderCommandHeader Header;
+        float Depth;
+        RenderDescriptor DepthStencil;
+        std::uint8_t Stencil;
+    };
+
+    struct ResourceBarrier
+    {
+        RenderCommandHeader Header;
+        RenderResourceState Before;
+        void* Resource;
+        RenderResourceState After;
+    };
+
+    struct SetVertexBuffer
+    {
+        RenderCommandHeader Header;
+        RenderVertexBufferView View;
+    };
+
+    struct SetIndexBuffer
+    {
+        RenderCommandHeader Header;
+        RenderIndexBufferView View;
+    };
+
+    struct SetPrimitiveTopology
+    {
+        RenderCommandHeader Header;
+        std::uint32_t Topology;
+    };
+
+    // Root CBVs and SRVs.
+    struct SetRootView
+    {
+        RenderCommandHeader Header;
+        std::uint32_t RootParameter;
+        RenderGpuAddress Address;
+    };
+
+    struct SetRoot32BitConstant
+    {
+        RenderCommandHeader Header;
+        std::uint32_t RootParameter;
+        std::uint32_t Value;
+        std::uint32_t DestOffset;
+    };
+
+    struct DrawIndexedInstanced
+    {
+        RenderCommandHeader Header;
+        std::uint32_t IndexCountPerInstance;
+        std::uint32_t InstanceCount;
+        std::uint32_t StartIndexLocation;
+        std::int32_t BaseVertexLocation;
+        std::uint32_t StartInstanceLocation;
+    };
+}
+
+class RenderCommandStream
+{
+public:
+    RenderCommandStream() = default;
+    RenderCommandStream(const RenderCommandStream& rhs) = default;
+    RenderCommandStream& operator=(const RenderCommandStream& rhs) = default;
+
+    // Drops all commands but keeps the storage for the next frame.
+    void Clear();
+    void Reserve(size_t byteCount);
+
+    // Recording.  The names of the state calls match BasicCommandRecorder so
+    // a recorder can filter what goes into a stream.
+    void SetPipelineState(void* pipelineState);
+    void SetGraphicsRootSignature(void* rootSignature);
+    void SetViewport(const RenderViewport& viewport);
+    void SetScissorRect(const RenderRect& rect);
+    void SetRenderTargets(RenderDescriptor renderTarget, RenderDescriptor depthStencil);
+    void ClearRenderTarget(RenderDescriptor renderTarget, const float color[4]);
+    void ClearDepthStencil(RenderDescriptor depthStencil, float depth, std::uint8_t stencil);
+    void ResourceBarrier(void* resource, RenderResourceState before, RenderResourceState after);
+    void SetVertexBuffer(const RenderVertexBufferView& view);
+    void SetIndexBuffer(const RenderIndexBufferView& view);
+    void SetPrimitiveTopology(std::uint32_t topology);
+    void SetGraphicsRootConstantBufferView(std::uint32_t rootParameter, RenderGpuAddress address);
+    void SetGraphicsRootShaderResourceView(std::uint32_t rootParameter, RenderGpuAddress address);
+    void SetGraphicsRoot32BitConstant(std::uint32_t rootParameter, std::uint32_t value, std::uint32_t destOffset);
+    void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+        std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation);
+
+    // Iteration: for(auto c = s.Begin(); c != s.End(); c = RenderCommandStream::Next(c)),
+    // then cast c to the RenderCommand struct matching c->Type.
+    const RenderCommandHeader* Begin()const;
+    const RenderCommandHeader* End()const;
+    static const RenderCommandHeader* Next(const RenderCommandHeader* command)
+    {
+        return reinterpret_cast<const RenderCommandHeader*>(
+            reinterpret_cast<const std::uint8_t*>(command) + command->Size);
+    }
+
+    size_t CommandCount()const { return mCommandCount; }
+    size_t ByteSize()const { return mWords.size() * sizeof(std::uint64_t); }
+
+private:
+    template<typename T>
+    T& Push(RenderCommandType type);
+
+    // Words rather than bytes so every command starts 8-byte aligned.
+    std::vector<std::uint64_t> mWords;
+    size_t mCommandCount = 0;
+};
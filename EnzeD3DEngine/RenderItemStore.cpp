@@ -0,0 +1,233 @@
+#include "RenderItemStore.h"
+
+namespace
+{
+    // Unused slot, or item not on the dirty list.
+    const std::uint32_t Invalid = ~0u;
+
+    void HashCombine(size_t& seed, size_t value)
+    {
+        seed ^= value + 0x9E3779B9u + (seed << 6) + (seed >> 2);
+    }
+}
+
+size_t DrawStateHash::operator()(const DrawState& state)const
+{
+    size_t seed = std::hash<const void*>()(state.Geo);
+    HashCombine(seed, (size_t)state.PrimitiveType);
+    HashCombine(seed, state.IndexCount);
+    HashCombine(seed, state.StartIndexLocation);
+    HashCombine(seed, (size_t)state.BaseVertexLocation);
+    return seed;
+}
+
+void RenderItemStore::Reserve(size_t itemCount)
+{
+    mWorld.reserve(itemCount);
+    mObjCBIndex.reserve(itemCount);
+    mGeo.reserve(itemCount);
+    mMat.reserve(itemCount);
+    mPrimitiveType.reserve(itemCount);
+    mDrawArgs.reserve(itemCount);
+    mDrawStateId.reserve(itemCount);
+    mWorldBounds.Reserve(itemCount);
+    mChangeGeneration.reserve(itemCount);
+    mDirtyPosition.reserve(itemCount);
+    mDenseToSlot.reserve(itemCount);
+    mSlots.reserve(itemCount);
+    mDirty.reserve(itemCount);
+}
+
+RenderItemHandle RenderItemStore::Add(const RenderItemDesc& desc)
+{
+    std::uint32_t slot;
+    if(!mFreeSlots.empty())
+    {
+        slot = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    else
+    {
+        slot = (std::uint32_t)mSlots.size();
+        mSlots.emplace_back();
+    }
+
+    std::uint32_t objCBIndex;
+    if(!mFreeObjCBIndices.empty())
+    {
+        objCBIndex = mFreeObjCBIndices.back();
+        mFreeObjCBIndices.pop_back();
+    }
+    else
+    {
+        objCBIndex = mNextObjCBIndex++;
+    }
+
+    std::uint32_t dense = (std::uint32_t)mWorld.size();
+    mWorld.push_back(desc.World);
+    mObjCBIndex.push_back(objCBIndex);
+    mGeo.push_back(desc.Geo);
+    mMat.push_back(desc.Mat);
+    mPrimitiveType.push_back(desc.PrimitiveType);
+    mDrawArgs.push_back(desc.DrawArgs);
+
+    DrawState state;
+    state.Geo = desc.Geo;
+    state.PrimitiveType = desc.PrimitiveType;
+    state.IndexCount = desc.DrawArgs.IndexCount;
+    state.StartIndexLocation = desc.DrawArgs.StartIndexLocation;
+    state.BaseVertexLocation = desc.DrawArgs.BaseVertexLocation;
+    mDrawStateId.push_back(InternDrawState(state));
+
+    DirectX::BoundingBox bounds = FrustumCuller::TransformBox(desc.DrawArgs.Bounds, DirectX::XMLoadFloat4x4(&desc.World));
+    mWorldBounds.PushBack(bounds);
+    mBvh.Insert(slot, bounds);
+    mChangeGeneration.push_back(0);
+    mDirtyPosition.push_back(Invalid);
+    mDenseToSlot.push_back(slot);
+    mSlots[slot].Dense = dense;
+
+    PushDirty(dense);
+
+    RenderItemHandle handle;
+    handle.Slot = slot;
+    handle.Generation = mSlots[slot].Generation;
+    return handle;
+}
+
+void RenderItemStore::Remove(RenderItemHandle handle)
+{
+    if(!IsAlive(handle))
+        return;
+
+    std::uint32_t dense = mSlots[handle.Slot].Dense;
+    std::uint32_t last = (std::uint32_t)mWorld.size() - 1;
+    if(mDirtyPosition[dense] != Invalid)
+        EraseDirty(dense);
+
+    mFreeObjCBIndices.push_back(mObjCBIndex[dense]);
+
+    // Move the last item into the hole so the arrays stay dense.
+    if(dense != last)
+    {
+        mWorld[dense] = mWorld[last];
+        mObjCBIndex[dense] = mObjCBIndex[last];
+        mGeo[dense] = mGeo[last];
+        mMat[dense] = mMat[last];
+        mPrimitiveType[dense] = mPrimitiveType[last];
+        mDrawArgs[dense] = mDrawArgs[last];
+        mDrawStateId[dense] = mDrawStateId[last];
+        mWorldBounds.Copy(dense, last);
+        mChangeGeneration[dense] = mChangeGeneration[last];
+        mDirtyPosition[dense] = mDirtyPosition[last];
+        mDenseToSlot[dense] = mDenseToSlot[last];
+
+        mSlots[mDenseToSlot[dense]].Dense = dense;
+        if(mDirtyPosition[dense] != Invalid)
+            mDirty[mDirtyPosition[dense]] = dense;
+    }
+
+    mWorld.pop_back();
+    mObjCBIndex.pop_back();
+    mGeo.pop_back();
+    mMat.pop_back();
+    mPrimitiveType.pop_back();
+    mDrawArgs.pop_back();
+    mDrawStateId.pop_back();
+    mWorldBounds.PopBack();
+    mChangeGeneration.pop_back();
+    mDirtyPosition.pop_back();
+    mDenseToSlot.pop_back();
+
+    mBvh.Remove(handle.Slot);
+
+    Slot& slot = mSlots[handle.Slot];
+    slot.Dense = Invalid;
+    ++slot.Generation;
+    mFreeSlots.push_back(handle.Slot);
+}
+
+bool RenderItemStore::IsAlive(RenderItemHandle handle)const
+{
+    return handle.Slot < mSlots.size() &&
+        mSlots[handle.Slot].Generation == handle.Generation &&
+        mSlots[handle.Slot].Dense != Invalid;
+}
+
+std::uint32_t RenderItemStore::DenseIndex(RenderItemHandle handle)const
+{
+    return mSlots[handle.Slot].Dense;
+}
+
+const DirectX::XMFLOAT4X4& RenderItemStore::World(RenderItemHandle handle)const
+{
+    return mWorld[DenseIndex(handle)];
+}
+
+void RenderItemStore::SetWorld(RenderItemHandle handle, const DirectX::XMFLOAT4X4& world)
+{
+    std::uint32_t dense = DenseIndex(handle);
+    mWorld[dense] = world;
+    DirectX::BoundingBox bounds = FrustumCuller::TransformBox(mDrawArgs[dense].Bounds, DirectX::XMLoadFloat4x4(&world));
+    mWorldBounds.Set(dense, bounds);
+    mBvh.Update(handle.Slot, bounds);
+    PushDirty(dense);
+}
+
+void RenderItemStore::MarkDirty(RenderItemHandle handle)
+{
+    PushDirty(DenseIndex(handle));
+}
+
+void RenderItemStore::CollectChangedSince(std::uint64_t syncedGeneration, std::vector<std::uint32_t>& items)const
+{
+    for(std::uint32_t dense : mDirty)
+    {
+        if(mChangeGeneration[dense] > syncedGeneration)
+            items.push_back(dense);
+    }
+}
+
+void RenderItemStore::RetireDirty(std::uint64_t syncedGeneration)
+{
+    // Walk backwards so EraseDirty's swap only moves entries already visited.
+    for(size_t i = mDirty.size(); i-- > 0;)
+    {
+        std::uint32_t dense = mDirty[i];
+        if(mChangeGeneration[dense] <= syncedGeneration)
+            EraseDirty(dense);
+    }
+}
+
+std::uint32_t RenderItemStore::InternDrawState(const DrawState& state)
+{
+    auto it = mDrawStateIds.find(state);
+    if(it != mDrawStateIds.end())
+        return it->second;
+
+    std::uint32_t id = (std::uint32_t)mDrawStates.size();
+    mDrawStates.push_back(state);
+    mDrawStates.back().GeometryId = mGeometryIds.emplace(state.Geo, (std::uint32_t)mGeometryIds.size()).first->second;
+    mDrawStateIds.emplace(state, id);
+    return id;
+}
+
+void RenderItemStore::PushDirty(std::uint32_t dense)
+{
+    mChangeGeneration[dense] = ++mGeneration;
+    if(mDirtyPosition[dense] == Invalid)
+    {
+        mDirtyPosition[dense] = (std::uint32_t)mDirty.size();
+        mDirty.push_back(dense);
+    }
+}
+
+void RenderItemStore::EraseDirty(std::uint32_t dense)
+{
+    std::uint32_t position = mDirtyPosition[dense];
+    std::uint32_t moved = mDirty.back();
+    mDirty[position] = moved;
+    mDirtyPosition[moved] = position;
+    mDirty.pop_back();
+    mDirtyPosition[dense] = Invalid;
+}
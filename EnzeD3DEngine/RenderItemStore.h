@@ -0,0 +1,188 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "BoundingVolumeHierarchy.h"
+#include "FrustumCuller.h"
+#include "MathHelper.h"
+#include "RenderTypes.h"
+
+// Only stored, never looked into, so the store builds without D3D12.
+struct MeshGeometry;
+
+// Refers to one item of a RenderItemStore.  The generation makes a handle to
+// a removed item invalid even after its slot is reused.
+struct RenderItemHandle
+{
+    std::uint32_t Slot = ~0u;
+    std::uint32_t Generation = 0;
+};
+
+// Everything needed to create a render item.  The store assigns ObjCBIndex.
+struct RenderItemDesc
+{
+    // World matrix of the shape that describes the object's local space
+    // relative to the world space, which defines the position, orientation,
+    // and scale of the object in the world.
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4X4();
+
+    MeshGeometry* Geo = nullptr;
+    Material* Mat = nullptr;
+    // A D3D_PRIMITIVE_TOPOLOGY value.
+    std::uint32_t PrimitiveType = PrimitiveTopologyTriangleList;
+
+    // DrawIndexedInstanced parameters and model-space bounds.
+    SubmeshGeometry DrawArgs;
+};
+
+// The part of a render item that decides which draw call it can share.  Items
+// with equal DrawStates differ only in their object constants and material,
+// both of which the shaders look up per instance, so they can be drawn as
+// instances of one DrawIndexedInstanced.
+struct DrawState
+{
+    MeshGeometry* Geo = nullptr;
+    // A D3D_PRIMITIVE_TOPOLOGY value.
+    std::uint32_t PrimitiveType = PrimitiveTopologyTriangleList;
+    std::uint32_t IndexCount = 0;
+    std::uint32_t StartIndexLocation = 0;
+    std::int32_t BaseVertexLocation = 0;
+    // Small id of Geo, assigned by the store.  Derived from Geo, so it takes
+    // no part in comparisons.
+    std::uint32_t GeometryId = 0;
+
+    bool operator==(const DrawState& rhs)const
+    {
+        return Geo == rhs.Geo && PrimitiveType == rhs.PrimitiveType &&
+            IndexCount == rhs.IndexCount && StartIndexLocation == rhs.StartIndexLocation &&
+            BaseVertexLocation == rhs.BaseVertexLocation;
+    }
+};
+
+struct DrawStateHash
+{
+    size_t operator()(const DrawState& state)const;
+};
+
+// Structure-of-arrays storage for render items.  Live items are packed in
+// dense arrays (removal swaps the last item in), so per-frame loops walk
+// memory linearly.  Handles map to dense indices through a slot table.
+//
+// Every change to an item's object constants stamps it with the next value
+// of a store-wide generation counter.  Each frame resource remembers the
+// generation its copy of the constants is current to and rewrites the items
+// stamped later, so the ring of frame resources can be any size, or change
+// size, without the items having to know.  Items changed since the oldest
+// frame resource was written are kept in a dirty list of dense indices, so
+// the per-frame update costs O(changed items) rather than O(all items).
+class RenderItemStore
+{
+public:
+    RenderItemStore() = default;
+    RenderItemStore(const RenderItemStore& rhs) = delete;
+    RenderItemStore& operator=(const RenderItemStore& rhs) = delete;
+
+    void Reserve(size_t itemCount);
+
+    // New items start dirty so every frame resource receives their constants.
+    RenderItemHandle Add(const RenderItemDesc& desc);
+    void Remove(RenderItemHandle handle);
+    bool IsAlive(RenderItemHandle handle)const;
+
+    // Dense index of a live item; valid until the next Remove.
+    std::uint32_t DenseIndex(RenderItemHandle handle)const;
+    std::uint32_t DenseIndexOfSlot(std::uint32_t slot)const { return mSlots[slot].Dense; }
+
+    const DirectX::XMFLOAT4X4& World(RenderItemHandle handle)const;
+    void SetWorld(RenderItemHandle handle, const DirectX::XMFLOAT4X4& world);
+    void MarkDirty(RenderItemHandle handle);
+
+    size_t Size()const { return mWorld.size(); }
+
+    // Number of object constant buffer slots the items may use: one past the
+    // highest ObjCBIndex ever handed out.
+    std::uint32_t ObjectCBCapacity()const { return mNextObjCBIndex; }
+
+    // Dense arrays, all Size() long.
+    const std::vector<DirectX::XMFLOAT4X4>& Worlds()const { return mWorld; }
+    const std::vector<std::uint32_t>& ObjCBIndices()const { return mObjCBIndex; }
+    const std::vector<MeshGeometry*>& Geos()const { return mGeo; }
+    const std::vector<Material*>& Materials()const { return mMat; }
+    const std::vector<std::uint32_t>& PrimitiveTypes()const { return mPrimitiveType; }
+    const std::vector<SubmeshGeometry>& DrawArgs()const { return mDrawArgs; }
+
+    // Every distinct DrawState gets a small id when the first item using it
+    // is added; ids are never reused.  DrawStateIds() is a dense array and
+    // DrawStates()[id] the state behind an id.
+    const std::vector<std::uint32_t>& DrawStateIds()const { return mDrawStateId; }
+    const std::vector<DrawState>& DrawStates()const { return mDrawStates; }
+
+    // World-space boxes around DrawArgs().Bounds, kept current by SetWorld.
+    const AabbSoA& WorldBounds()const { return mWorldBounds; }
+
+    // Handle slot of every dense item.  Slots stay put when items move in the
+    // dense arrays, so spatial structures use them as keys.
+    const std::vector<std::uint32_t>& DenseSlots()const { return mDenseToSlot; }
+
+    // Hierarchy over WorldBounds() keyed by slot, which Add, Remove and
+    // SetWorld keep in step.  Moves reach the queries only after RefitBvh(),
+    // so call it once the frame's SetWorlds are done.
+    const BoundingVolumeHierarchy& Bvh()const { return mBvh; }
+    void RefitBvh() { mBvh.Refit(); }
+
+    // Generation of the latest change; 0 before any item was added.
+    std::uint64_t Generation()const { return mGeneration; }
+    // Dense array of the generation each item last changed in.
+    const std::vector<std::uint64_t>& ChangeGenerations()const { return mChangeGeneration; }
+
+    // Dense indices of the items changed since the last RetireDirty(), which
+    // a frame resource current to a generation g must rewrite if their
+    // ChangeGenerations() is above g.  Each index appears once.
+    const std::vector<std::uint32_t>& DirtyItems()const { return mDirty; }
+
+    // Appends the dense indices of the items a frame resource current to
+    // syncedGeneration lacks, in DirtyItems() order.  syncedGeneration must
+    // not be below the last one passed to RetireDirty().
+    void CollectChangedSince(std::uint64_t syncedGeneration, std::vector<std::uint32_t>& items)const;
+
+    // Drops the items every frame resource has caught up with; pass the
+    // lowest generation any frame resource is current to.
+    void RetireDirty(std::uint64_t syncedGeneration);
+
+private:
+    std::uint32_t InternDrawState(const DrawState& state);
+    void PushDirty(std::uint32_t dense);
+    void EraseDirty(std::uint32_t dense);
+
+    struct Slot
+    {
+        std::uint32_t Dense = ~0u;
+        std::uint32_t Generation = 0;
+    };
+
+    // Dense arrays.
+    std::vector<DirectX::XMFLOAT4X4> mWorld;
+    std::vector<std::uint32_t> mObjCBIndex;
+    std::vector<MeshGeometry*> mGeo;
+    std::vector<Material*> mMat;
+    std::vector<std::uint32_t> mPrimitiveType;
+    std::vector<SubmeshGeometry> mDrawArgs;
+    std::vector<std::uint32_t> mDrawStateId;
+    AabbSoA mWorldBounds;
+    BoundingVolumeHierarchy mBvh;
+    std::vector<std::uint64_t> mChangeGeneration;
+    std::vector<std::uint32_t> mDirtyPosition;
+    std::vector<std::uint32_t> mDenseToSlot;
+
+    std::vector<DrawState> mDrawStates;
+    std::unordered_map<DrawState, std::uint32_t, DrawStateHash> mDrawStateIds;
+    std::unordered_map<const MeshGeometry*, std::uint32_t> mGeometryIds;
+
+    std::vector<Slot> mSlots;
+    std::vector<std::uint32_t> mFreeSlots;
+    std::vector<std::uint32_t> mFreeObjCBIndices;
+    std::uint32_t mNextObjCBIndex = 0;
+
+    std::vector<std::uint32_t> mDirty;
+    std::uint64_t mGeneration = 0;
+};
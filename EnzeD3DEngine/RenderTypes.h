@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "MathHelper.h"
+
+// Plain data shared by the D3D12 code and the modules that only do CPU work
+// on it.  Nothing here needs Windows, so those modules build, and are tested,
+// anywhere DirectXMath does (see Benchmarks/).
+
+struct Vertex {
+    DirectX::XMFLOAT3 Pos;
+    DirectX::XMFLOAT3 Normal;
+};
+
+struct SubmeshGeometry
+{
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	std::int32_t BaseVertexLocation = 0;
+
+	// Bounding box of the geometry defined by this submesh, in model space.
+	DirectX::BoundingBox Bounds;
+};
+
+// One element of the per-frame instance data.  A batch's instances are
+// contiguous; the vertex shader fetches its element with the batch's first
+// instance plus SV_InstanceID.
+struct InstanceData {
+    std::uint32_t ObjectIndex = 0;
+    std::uint32_t MaterialIndex = 0;
+};
+
+// Simple struct to represent a material for our demos.  A production 3D engine
+// would likely create a class hierarchy of Materials.
+struct Material
+{
+	// Unique material name for lookup.
+	std::string Name;
+
+	// Id from MaterialRegistry: the material's index in the material table.
+	int MatCBIndex = -1;
+
+	// Index into SRV heap for diffuse texture.
+	int DiffuseSrvHeapIndex = -1;
+
+	// Index into SRV heap for normal texture.
+	int NormalSrvHeapIndex = -1;
+
+	// Generation the material constants last changed in.  Because we have a material
+	// table for each FrameResource, each one remembers the generation it is current
+	// to and rewrites the materials that changed later.  MaterialRegistry::MarkChanged
+	// stamps a modified material with the next value of the registry's generation.
+	std::uint64_t ChangeGeneration = 1;
+
+	// Material constant buffer data used for shading.
+	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
+	float Roughness = .25f;
+	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4X4();
+};
+
+// D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, for code that stores topologies as
+// plain integers.
+const std::uint32_t PrimitiveTopologyTriangleList = 4;
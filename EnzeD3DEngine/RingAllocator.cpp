@@ -0,0 +1,94 @@
+#include "RingAllocator.h"
+
+namespace
+{
+    std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+RingAllocator::RingAllocator(std::uint64_t capacity)
+{
+    Reset(capacity);
+}
+
+void RingAllocator::Reset(std::uint64_t capacity)
+{
+    mCapacity = capacity;
+    mHead = 0;
+    mTail = 0;
+    mUsed = 0;
+    mFrameSize = 0;
+    mFrames.clear();
+}
+
+std::uint64_t RingAllocator::Allocate(std::uint64_t size, std::uint64_t alignment)
+{
+    if(size == 0 || size > mCapacity || mUsed == mCapacity)
+        return InvalidOffset;
+
+    if(mUsed == 0)
+    {
+        // Nothing is live, so restart at the front and let a large request
+        // use the whole ring.  Frames still waiting to retire are empty.
+        mHead = 0;
+        mTail = 0;
+        for(FrameMarker& frame : mFrames)
+            frame.Head = 0;
+    }
+
+    std::uint64_t offset = AlignUp(mHead, alignment);
+    std::uint64_t taken = 0;
+    if(mHead >= mTail)
+    {
+        // Free space is [head, capacity) followed by [0, tail).
+        if(offset + size <= mCapacity)
+        {
+            taken = offset + size - mHead;
+        }
+        else if(size <= mTail)
+        {
+            // Skip the rest of the ring; the skipped bytes stay with this
+            // frame until it retires.
+            offset = 0;
+            taken = mCapacity - mHead + size;
+        }
+        else
+        {
+            return InvalidOffset;
+        }
+    }
+    else
+    {
+        // Free space is [head, tail).
+        if(offset + size > mTail)
+            return InvalidOffset;
+        taken = offset + size - mHead;
+    }
+
+    mHead = offset + size;
+    mUsed += taken;
+    mFrameSize += taken;
+    return offset;
+}
+
+void RingAllocator::FinishFrame(std::uint64_t fenceValue)
+{
+    FrameMarker marker;
+    marker.FenceValue = fenceValue;
+    marker.Head = mHead;
+    marker.Size = mFrameSize;
+    mFrames.push_back(marker);
+    mFrameSize = 0;
+}
+
+void RingAllocator::Retire(std::uint64_t completedFenceValue)
+{
+    while(!mFrames.empty() && mFrames.front().FenceValue <= completedFenceValue)
+    {
+        mTail = mFrames.front().Head;
+        mUsed -= mFrames.front().Size;
+        mFrames.pop_front();
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+
+// Offset bookkeeping for a ring of bytes shared by the frames in flight.
+// Allocations are bump-allocated at the head; FinishFrame() tags everything
+// allocated since the previous call with a fence value, and Retire() hands
+// the bytes of frames whose fence has completed back to the ring.  Nothing
+// is ever freed individually.  It only deals in offsets, so the same policy
+// serves any mapped buffer.
+class RingAllocator
+{
+public:
+    static const std::uint64_t InvalidOffset = ~0ull;
+
+    explicit RingAllocator(std::uint64_t capacity = 0);
+
+    // Forgets every allocation and frame and starts over with capacity bytes.
+    void Reset(std::uint64_t capacity);
+
+    // Returns the offset of size bytes aligned to alignment (a power of two),
+    // or InvalidOffset when they do not fit in front of the oldest live frame
+    // or size is 0.  An allocation never straddles the end of the ring.
+    std::uint64_t Allocate(std::uint64_t size, std::uint64_t alignment);
+
+    void FinishFrame(std::uint64_t fenceValue);
+    // Releases every finished frame whose fence value is <= completedFenceValue.
+    void Retire(std::uint64_t completedFenceValue);
+
+    std::uint64_t Capacity()const { return mCapacity; }
+    // Bytes held by live frames, alignment padding and skipped ring ends included.
+    std::uint64_t UsedBytes()const { return mUsed; }
+
+private:
+    struct FrameMarker
+    {
+        std::uint64_t FenceValue;
+        std::uint64_t Head;
+        std::uint64_t Size;
+    };
+
+    std::uint64_t mCapacity = 0;
+    std::uint64_t mHead = 0;
+    std::uint64_t mTail = 0;
+    std::uint64_t mUsed = 0;
+    // Bytes taken since the last FinishFrame().
+    std::uint64_t mFrameSize = 0;
+    std::deque<FrameMarker> mFrames;
+};
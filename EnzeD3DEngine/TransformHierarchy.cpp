@@ -0,0 +1,339 @@
+#include "TransformHierarchy.h"
+#include <algorithm>
+#include <type_traits>
+#include "JobSystem.h"
+
+using namespace Math;
+
+namespace
+{
+    // Unused slot, removed node, or no parent.
+    const std::uint32_t Invalid = ~0u;
+    // Changed nodes per job when a level is evaluated in parallel; smaller
+    // levels are evaluated on the calling thread.
+    const std::uint32_t EvaluateGrainSize = 1024;
+}
+
+void TransformHierarchy::Reserve(size_t nodeCount)
+{
+    mLocal.reserve(nodeCount);
+    mWorld.reserve(nodeCount);
+    mParentSlot.reserve(nodeCount);
+    mDenseToSlot.reserve(nodeCount);
+    mLocalDirty.reserve(nodeCount);
+    mChangedFlag.reserve(nodeCount);
+    mParent.reserve(nodeCount);
+    mFirstChild.reserve(nodeCount);
+    mChildCount.reserve(nodeCount);
+    mSlots.reserve(nodeCount);
+    mDirty.reserve(nodeCount);
+    mChanged.reserve(nodeCount);
+}
+
+TransformHandle TransformHierarchy::Add(const LocalTransform& local, TransformHandle parent)
+{
+    std::uint32_t parentSlot = IsAlive(parent) ? parent.Slot : Invalid;
+
+    std::uint32_t slot;
+    if(!mFreeSlots.empty())
+    {
+        slot = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    else
+    {
+        slot = (std::uint32_t)mSlots.size();
+        mSlots.emplace_back();
+    }
+
+    // Appended out of breadth-first order; RebuildLayout() puts it in place.
+    std::uint32_t dense = (std::uint32_t)mLocal.size();
+    mLocal.push_back(local);
+    mWorld.push_back(Float4x4::Identity());
+    mParentSlot.push_back(parentSlot);
+    mDenseToSlot.push_back(slot);
+    mLocalDirty.push_back(0);
+    mChangedFlag.push_back(0);
+    mSlots[slot].Dense = dense;
+    ++mLiveCount;
+    mLayoutDirty = true;
+
+    MarkDirty(dense);
+
+    TransformHandle handle;
+    handle.Slot = slot;
+    handle.Generation = mSlots[slot].Generation;
+    return handle;
+}
+
+void TransformHierarchy::Remove(TransformHandle handle)
+{
+    if(!IsAlive(handle))
+        return;
+
+    // The subtree is found through the child ranges, which need a current
+    // layout.
+    if(mLayoutDirty)
+        RebuildLayout();
+
+    // The subtree in breadth-first order; pending grows while it is read.
+    std::vector<std::uint32_t> pending(1, mSlots[handle.Slot].Dense);
+    for(size_t i = 0; i < pending.size(); ++i)
+    {
+        std::uint32_t dense = pending[i];
+        for(std::uint32_t c = 0; c < mChildCount[dense]; ++c)
+            pending.push_back(mFirstChild[dense] + c);
+
+        Slot& slot = mSlots[mDenseToSlot[dense]];
+        slot.Dense = Invalid;
+        ++slot.Generation;
+        mFreeSlots.push_back(mDenseToSlot[dense]);
+        mDenseToSlot[dense] = Invalid;
+    }
+
+    mLiveCount -= pending.size();
+    mLayoutDirty = true;
+}
+
+bool TransformHierarchy::IsAlive(TransformHandle handle)const
+{
+    return handle.Slot < mSlots.size() &&
+        mSlots[handle.Slot].Generation == handle.Generation &&
+        mSlots[handle.Slot].Dense != Invalid;
+}
+
+bool TransformHierarchy::SetParent(TransformHandle handle, TransformHandle parent)
+{
+    if(!IsAlive(handle))
+        return false;
+
+    std::uint32_t parentSlot = IsAlive(parent) ? parent.Slot : Invalid;
+
+    // Refuse to create a cycle.
+    for(std::uint32_t ancestor = parentSlot; ancestor != Invalid; ancestor = mParentSlot[mSlots[ancestor].Dense])
+    {
+        if(ancestor == handle.Slot)
+            return false;
+    }
+
+    std::uint32_t dense = mSlots[handle.Slot].Dense;
+    if(mParentSlot[dense] != parentSlot)
+    {
+        mParentSlot[dense] = parentSlot;
+        mLayoutDirty = true;
+        MarkDirty(dense);
+    }
+    return true;
+}
+
+const LocalTransform& TransformHierarchy::Local(TransformHandle handle)const
+{
+    return mLocal[mSlots[handle.Slot].Dense];
+}
+
+void TransformHierarchy::SetLocal(TransformHandle handle, const LocalTransform& local)
+{
+    std::uint32_t dense = mSlots[handle.Slot].Dense;
+    mLocal[dense] = local;
+    MarkDirty(dense);
+}
+
+void TransformHierarchy::SetTranslation(TransformHandle handle, const Float3& translation)
+{
+    std::uint32_t dense = mSlots[handle.Slot].Dense;
+    mLocal[dense].Translation = translation;
+    MarkDirty(dense);
+}
+
+void TransformHierarchy::SetRotation(TransformHandle handle, const Float4& rotation)
+{
+    std::uint32_t dense = mSlots[handle.Slot].Dense;
+    mLocal[dense].Rotation = rotation;
+    MarkDirty(dense);
+}
+
+void TransformHierarchy::SetScale(TransformHandle handle, const Float3& scale)
+{
+    std::uint32_t dense = mSlots[handle.Slot].Dense;
+    mLocal[dense].Scale = scale;
+    MarkDirty(dense);
+}
+
+const Float4x4& TransformHierarchy::World(TransformHandle handle)const
+{
+    return mWorld[mSlots[handle.Slot].Dense];
+}
+
+void TransformHierarchy::Update(JobSystem* jobSystem)
+{
+    if(mLayoutDirty)
+        RebuildLayout();
+
+    mChanged.clear();
+
+    // Dense order is level order, so the flagged nodes of each level can be
+    // taken from the front of the sorted list.
+    std::sort(mDirty.begin(), mDirty.end());
+    size_t dirtyPos = 0;
+
+    // The nodes recomputed on the previous level, as a range of mChanged.
+    size_t parentsBegin = 0, parentsEnd = 0;
+
+    for(size_t level = 0; level + 1 < mLevelStart.size(); ++level)
+    {
+        if(parentsBegin == parentsEnd)
+        {
+            if(dirtyPos == mDirty.size())
+                break;
+            // Nothing propagates into this level; skip to the next flagged node.
+            level = std::upper_bound(mLevelStart.begin(), mLevelStart.end(), mDirty[dirtyPos]) - mLevelStart.begin() - 1;
+        }
+
+        size_t levelBegin = mChanged.size();
+        for(size_t i = parentsBegin; i < parentsEnd; ++i)
+        {
+            std::uint32_t parent = mChanged[i];
+            std::uint32_t childEnd = mFirstChild[parent] + mChildCount[parent];
+            for(std::uint32_t child = mFirstChild[parent]; child < childEnd; ++child)
+            {
+                mChanged.push_back(child);
+                mChangedFlag[child] = 1;
+            }
+        }
+
+        std::uint32_t levelEnd = mLevelStart[level + 1];
+        for(; dirtyPos < mDirty.size() && mDirty[dirtyPos] < levelEnd; ++dirtyPos)
+        {
+            std::uint32_t dense = mDirty[dirtyPos];
+            if(!mChangedFlag[dense])
+            {
+                mChanged.push_back(dense);
+                mChangedFlag[dense] = 1;
+            }
+        }
+
+        std::uint32_t count = (std::uint32_t)(mChanged.size() - levelBegin);
+        if(jobSystem && count > EvaluateGrainSize)
+        {
+            jobSystem->ParallelForSpan(mChanged.data() + levelBegin, count, EvaluateGrainSize,
+                [this](const std::uint32_t* nodes, std::uint32_t nodeCount)
+            {
+                EvaluateNodes(nodes, nodeCount);
+            });
+        }
+        else
+        {
+            EvaluateNodes(mChanged.data() + levelBegin, count);
+        }
+
+        parentsBegin = levelBegin;
+        parentsEnd = mChanged.size();
+    }
+
+    for(std::uint32_t dense : mChanged)
+        mChangedFlag[dense] = 0;
+    for(std::uint32_t dense : mDirty)
+        mLocalDirty[dense] = 0;
+    mDirty.clear();
+}
+
+void TransformHierarchy::MarkDirty(std::uint32_t dense)
+{
+    if(!mLocalDirty[dense])
+    {
+        mLocalDirty[dense] = 1;
+        mDirty.push_back(dense);
+    }
+}
+
+// Puts the live nodes in breadth-first order: roots first, in their current
+// order, then the children of each node of a level in the order of their
+// parents.  Removed nodes are dropped.
+void TransformHierarchy::RebuildLayout()
+{
+    const std::uint32_t oldCount = (std::uint32_t)mDenseToSlot.size();
+
+    // Children of every current dense index, grouped by parent.
+    std::vector<std::uint32_t> childStart(oldCount + 1, 0);
+    std::vector<std::uint32_t> roots;
+    for(std::uint32_t dense = 0; dense < oldCount; ++dense)
+    {
+        if(mDenseToSlot[dense] == Invalid)
+            continue;
+        if(mParentSlot[dense] == Invalid)
+            roots.push_back(dense);
+        else
+            ++childStart[mSlots[mParentSlot[dense]].Dense + 1];
+    }
+    for(std::uint32_t dense = 0; dense < oldCount; ++dense)
+        childStart[dense + 1] += childStart[dense];
+
+    std::vector<std::uint32_t> children(childStart[oldCount]);
+    std::vector<std::uint32_t> cursor(childStart.begin(), childStart.end() - 1);
+    for(std::uint32_t dense = 0; dense < oldCount; ++dense)
+    {
+        if(mDenseToSlot[dense] != Invalid && mParentSlot[dense] != Invalid)
+            children[cursor[mSlots[mParentSlot[dense]].Dense]++] = dense;
+    }
+
+    // Breadth-first walk; order[i] is the old dense index of new index i.
+    std::vector<std::uint32_t> order(roots);
+    order.reserve(mLiveCount);
+    mFirstChild.assign(mLiveCount, 0);
+    mChildCount.assign(mLiveCount, 0);
+    mLevelStart.assign(1, 0);
+    for(size_t levelBegin = 0; levelBegin < order.size();)
+    {
+        size_t levelEnd = order.size();
+        mLevelStart.push_back((std::uint32_t)levelEnd);
+        for(size_t i = levelBegin; i < levelEnd; ++i)
+        {
+            std::uint32_t old = order[i];
+            mFirstChild[i] = (std::uint32_t)order.size();
+            mChildCount[i] = childStart[old + 1] - childStart[old];
+            order.insert(order.end(), children.begin() + childStart[old], children.begin() + childStart[old + 1]);
+        }
+        levelBegin = levelEnd;
+    }
+
+    auto permute = [&order](auto& values)
+    {
+        typename std::decay<decltype(values)>::type permuted;
+        permuted.reserve(order.size());
+        for(std::uint32_t old : order)
+            permuted.push_back(values[old]);
+        values.swap(permuted);
+    };
+    permute(mLocal);
+    permute(mWorld);
+    permute(mParentSlot);
+    permute(mDenseToSlot);
+    permute(mLocalDirty);
+    mChangedFlag.assign(order.size(), 0);
+
+    mParent.resize(order.size());
+    mDirty.clear();
+    for(std::uint32_t dense = 0; dense < (std::uint32_t)order.size(); ++dense)
+    {
+        mSlots[mDenseToSlot[dense]].Dense = dense;
+        if(mLocalDirty[dense])
+            mDirty.push_back(dense);
+    }
+    for(std::uint32_t dense = 0; dense < (std::uint32_t)order.size(); ++dense)
+        mParent[dense] = mParentSlot[dense] == Invalid ? Invalid : mSlots[mParentSlot[dense]].Dense;
+
+    mLayoutDirty = false;
+}
+
+void TransformHierarchy::EvaluateNodes(const std::uint32_t* nodes, std::uint32_t count)
+{
+    for(std::uint32_t i = 0; i < count; ++i)
+    {
+        std::uint32_t dense = nodes[i];
+        const LocalTransform& local = mLocal[dense];
+        Mat4 world = MatAffineTransformation(Load(local.Scale), Load(local.Rotation), Load(local.Translation));
+        if(mParent[dense] != Invalid)
+            world = MatMultiply(world, Load(mWorld[mParent[dense]]));
+        Store(&mWorld[dense], world);
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "MathHelper.h"
+
+class JobSystem;
+
+// Refers to one node of a TransformHierarchy.  The generation makes a handle
+// to a removed node invalid even after its slot is reused.
+struct TransformHandle
+{
+    std::uint32_t Slot = ~0u;
+    std::uint32_t Generation = 0;
+};
+
+// A node's transform relative to its parent: scale, then rotate by the unit
+// quaternion, then translate.
+struct LocalTransform
+{
+    Math::Float3 Translation = { 0.f, 0.f, 0.f };
+    Math::Float4 Rotation = { 0.f, 0.f, 0.f, 1.f };
+    Math::Float3 Scale = { 1.f, 1.f, 1.f };
+};
+
+// Parent/child transforms stored breadth-first in dense arrays: every level
+// of the tree is one contiguous range, and the children of a node are a
+// contiguous range of the next level.  A node's world matrix is its local
+// transform times its parent's world matrix.
+//
+// Changing a local transform only flags the node.  Update() then walks the
+// levels top-down and recomputes the flagged nodes and the children of
+// every node recomputed on the level above, so the cost is O(nodes in
+// changed subtrees) and untouched parts of the tree are never visited.
+// The nodes of one level do not depend on each other, so a level with many
+// changed nodes is split across the job system.
+//
+// Adding, removing and reparenting nodes only records the change; the
+// breadth-first order is rebuilt, in O(nodes), by the next Update().  Dense
+// indices are therefore only stable from one Update() to the next
+// structural change.
+//
+// Only the standard library and MathHelper are used, so the hierarchy can
+// be built and benchmarked without a device.
+class TransformHierarchy
+{
+public:
+    TransformHierarchy() = default;
+    TransformHierarchy(const TransformHierarchy& rhs) = delete;
+    TransformHierarchy& operator=(const TransformHierarchy& rhs) = delete;
+
+    void Reserve(size_t nodeCount);
+
+    // Adds a node under parent, or a root when parent is a default handle.
+    // New nodes are computed by the next Update().
+    TransformHandle Add(const LocalTransform& local, TransformHandle parent = TransformHandle());
+    // Removes the node and its whole subtree.
+    void Remove(TransformHandle handle);
+    bool IsAlive(TransformHandle handle)const;
+
+    // Moves the node, with its subtree, under parent, or makes it a root.
+    // Returns false and changes nothing if parent is the node itself or one
+    // of its descendants.
+    bool SetParent(TransformHandle handle, TransformHandle parent = TransformHandle());
+
+    const LocalTransform& Local(TransformHandle handle)const;
+    void SetLocal(TransformHandle handle, const LocalTransform& local);
+    void SetTranslation(TransformHandle handle, const Math::Float3& translation);
+    void SetRotation(TransformHandle handle, const Math::Float4& rotation);
+    void SetScale(TransformHandle handle, const Math::Float3& scale);
+
+    // World matrix as of the last Update().
+    const Math::Float4x4& World(TransformHandle handle)const;
+
+    // Brings the world matrices up to date.  jobSystem may be null to
+    // evaluate on the calling thread only.
+    void Update(JobSystem* jobSystem = nullptr);
+
+    size_t Size()const { return mLiveCount; }
+    size_t LevelCount()const { return mLevelStart.empty() ? 0 : mLevelStart.size() - 1; }
+
+    // Dense indices of the nodes whose world matrix the last Update()
+    // recomputed, parents before their children.
+    const std::vector<std::uint32_t>& ChangedNodes()const { return mChanged; }
+
+    // Dense arrays, indexed like ChangedNodes().
+    const std::vector<Math::Float4x4>& Worlds()const { return mWorld; }
+    const std::vector<std::uint32_t>& DenseSlots()const { return mDenseToSlot; }
+
+private:
+    void MarkDirty(std::uint32_t dense);
+    void RebuildLayout();
+    void EvaluateNodes(const std::uint32_t* nodes, std::uint32_t count);
+
+    struct Slot
+    {
+        std::uint32_t Dense = ~0u;
+        std::uint32_t Generation = 0;
+    };
+
+    // Dense arrays, breadth-first once the layout is rebuilt.  Removed nodes
+    // stay as holes (mDenseToSlot of ~0u) until then.
+    std::vector<LocalTransform> mLocal;
+    std::vector<Math::Float4x4> mWorld;
+    std::vector<std::uint32_t> mParentSlot;
+    std::vector<std::uint32_t> mDenseToSlot;
+    // Set for nodes whose local transform changed since the last Update(),
+    // and, during Update(), for the nodes recomputed.
+    std::vector<std::uint8_t> mLocalDirty;
+    std::vector<std::uint8_t> mChangedFlag;
+
+    // Valid while mLayoutDirty is false.
+    std::vector<std::uint32_t> mParent;
+    std::vector<std::uint32_t> mFirstChild;
+    std::vector<std::uint32_t> mChildCount;
+    // Level l is [mLevelStart[l], mLevelStart[l + 1]).
+    std::vector<std::uint32_t> mLevelStart;
+    bool mLayoutDirty = false;
+
+    std::vector<Slot> mSlots;
+    std::vector<std::uint32_t> mFreeSlots;
+    size_t mLiveCount = 0;
+
+    std::vector<std::uint32_t> mDirty;
+    std::vector<std::uint32_t> mChanged;
+};
@@ -1,15 +1,19 @@
 #pragma once
 
 #include "d3dUtil.h"
+#include <algorithm>
 
 template<typename T>
 class UploadBuffer
 {
 public:
-    UploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer) : 
+    // elementByteSize overrides sizeof(T) for structured buffers whose
+    // element layout is chosen at runtime; those are written through
+    // MappedElement() rather than CopyData().
+    UploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer, UINT elementByteSize = sizeof(T)) : 
         mIsConstantBuffer(isConstantBuffer)
     {
-        mElementByteSize = sizeof(T);
+        mElementByteSize = elementByteSize;
 
         // Constant buffer elements need to be multiples of 256 bytes.
         // This is because the hardware can only view constant data 
@@ -19,20 +23,9 @@ public:
         // UINT   SizeInBytes;   // multiple of 256
         // } D3D12_CONSTANT_BUFFER_VIEW_DESC;
         if(isConstantBuffer)
-            mElementByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(T));
+            mElementByteSize = d3dUtil::CalcConstantBufferByteSize(elementByteSize);
 
-        ThrowIfFailed(device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(mElementByteSize*elementCount),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&mUploadBuffer)));
-
-        ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
-
-        // We do not need to unmap until we are done with the resource.  However, we must not write to
-        // the resource while it is in use by the GPU (so we must use synchronization techniques).
+        CreateBuffer(device, elementCount);
     }
 
     UploadBuffer(const UploadBuffer& rhs) = delete;
@@ -45,6 +38,29 @@ public:
         mMappedData = nullptr;
     }
 
+    // Replaces the buffer with one of elementCount elements, keeping the
+    // contents of the elements both have.  The GPU must be done with the old
+    // buffer, which is released right away.  Resizing to the current count
+    // keeps the buffer.
+    void Resize(ID3D12Device* device, UINT elementCount)
+    {
+        if(elementCount == mElementCount)
+            return;
+
+        Microsoft::WRL::ComPtr<ID3D12Resource> oldBuffer = mUploadBuffer;
+        BYTE* oldMappedData = mMappedData;
+        UINT oldElementCount = mElementCount;
+
+        CreateBuffer(device, elementCount);
+        memcpy(mMappedData, oldMappedData, (size_t)mElementByteSize * std::min<UINT>(oldElementCount, elementCount));
+        oldBuffer->Unmap(0, nullptr);
+    }
+
+    UINT ElementCount()const
+    {
+        return mElementCount;
+    }
+
     ID3D12Resource* Resource()const
     {
         return mUploadBuffer.Get();
@@ -55,10 +71,42 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Start of element elementIndex in the mapped memory, for writers that
+    // fill elements in place instead of going through CopyData.
+    BYTE* MappedElement(int elementIndex)const
+    {
+        return &mMappedData[elementIndex*mElementByteSize];
+    }
+
+    UINT ElementByteSize()const
+    {
+        return mElementByteSize;
+    }
+
 private:
+    void CreateBuffer(ID3D12Device* device, UINT elementCount)
+    {
+        // D3D12 rejects empty buffers, so an empty UploadBuffer still backs
+        // one element; ElementCount() reports the requested count.
+        ThrowIfFailed(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer((UINT64)mElementByteSize*std::max<UINT>(elementCount, 1)),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(&mUploadBuffer)));
+
+        ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+        mElementCount = elementCount;
+
+        // We do not need to unmap until we are done with the resource.  However, we must not write to
+        // the resource while it is in use by the GPU (so we must use synchronization techniques).
+    }
+
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
 
+    UINT mElementCount = 0;
     UINT mElementByteSize = 0;
     bool mIsConstantBuffer = false;
 };
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "UploadManager.h"
+#include <algorithm>
+
+UploadManager::UploadManager(ID3D12Device* device, UINT64 stagingSize, ID3D12Fence* readerFence) :
+    mDevice(device),
+    mReaderFence(readerFence),
+    mStaging(device, stagingSize)
+{
+    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    ThrowIfFailed(mDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mQueue)));
+
+    ThrowIfFailed(mDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+    mFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if(mFenceEvent == nullptr)
+        ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+}
+
+UploadManager::~UploadManager()
+{
+    WaitForIdle();
+    CloseHandle(mFenceEvent);
+}
+
+void UploadManager::CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* data, UINT64 byteSize,
+    UINT64 readFenceValue)
+{
+    if(byteSize == 0)
+        return;
+
+    if(!mRecordingOpen)
+        BeginBatch();
+
+    UploadAllocation staging = mStaging.Allocate(byteSize, sizeof(UINT));
+    memcpy(staging.CpuAddress, data, (size_t)byteSize);
+    mCmdList->CopyBufferRegion(dest, destOffset, staging.Resource, staging.Offset, byteSize);
+    mPendingBytes += byteSize;
+    mBatchReadFenceValue = std::max(mBatchReadFenceValue, readFenceValue);
+}
+
+GpuBufferAllocation UploadManager::UploadToBuffer(GpuBufferAllocator& buffers, const void* data, UINT64 byteSize,
+    UINT64 alignment)
+{
+    GpuBufferAllocation allocation = buffers.Allocate(byteSize, alignment);
+    CopyBuffer(allocation.Resource, allocation.Offset, data, byteSize, buffers.ReadFence(allocation.Resource));
+    return allocation;
+}
+
+UINT64 UploadManager::Submit()
+{
+    if(!mRecordingOpen)
+        return mFenceValue;
+
+    ThrowIfFailed(mCmdList->Close());
+
+    // The batch writes pages that earlier frames may still be reading.
+    if(mBatchReadFenceValue != 0)
+    {
+        ThrowIfFailed(mQueue->Wait(mReaderFence, mBatchReadFenceValue));
+        mBatchReadFenceValue = 0;
+    }
+
+    ID3D12CommandList* cmdsLists[] = { mCmdList.Get() };
+    mQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+    ++mFenceValue;
+    ThrowIfFailed(mQueue->Signal(mFence.Get(), mFenceValue));
+    mStaging.FinishFrame(mFenceValue);
+
+    mRecording.FenceValue = mFenceValue;
+    mAllocators.push_back(mRecording);
+    mRecording = Allocator();
+    mRecordingOpen = false;
+    mPendingBytes = 0;
+
+    return mFenceValue;
+}
+
+void UploadManager::MakeQueueWait(ID3D12CommandQueue* queue)
+{
+    if(mWaitedFenceValue == mFenceValue)
+        return;
+
+    ThrowIfFailed(queue->Wait(mFence.Get(), mFenceValue));
+    mWaitedFenceValue = mFenceValue;
+}
+
+bool UploadManager::IsComplete(UINT64 fenceValue)const
+{
+    return mFence->GetCompletedValue() >= fenceValue;
+}
+
+void UploadManager::WaitForIdle()
+{
+    if(!IsComplete(mFenceValue))
+    {
+        ThrowIfFailed(mFence->SetEventOnCompletion(mFenceValue, mFenceEvent));
+        WaitForSingleObject(mFenceEvent, INFINITE);
+    }
+    Recycle();
+}
+
+void UploadManager::BeginBatch()
+{
+    // Reuse the oldest allocator once its batch is done, so a steady stream
+    // of uploads cycles through a handful of allocators.
+    Recycle();
+    if(!mAllocators.empty() && IsComplete(mAllocators.front().FenceValue))
+    {
+        mRecording = mAllocators.front();
+        mAllocators.pop_front();
+        ThrowIfFailed(mRecording.CmdListAlloc->Reset());
+    }
+    else
+    {
+        ThrowIfFailed(mDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+            IID_PPV_ARGS(mRecording.CmdListAlloc.GetAddressOf())));
+    }
+
+    if(mCmdList == nullptr)
+    {
+        ThrowIfFailed(mDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+            mRecording.CmdListAlloc.Get(), nullptr, IID_PPV_ARGS(mCmdList.GetAddressOf())));
+    }
+    else
+    {
+        ThrowIfFailed(mCmdList->Reset(mRecording.CmdListAlloc.Get(), nullptr));
+    }
+
+    mRecordingOpen = true;
+}
+
+void UploadManager::Recycle()
+{
+    mStaging.Retire(mFence->GetCompletedValue());
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "d3dUtil.h"
+#include "GpuBufferAllocator.h"
+#include "UploadRingBuffer.h"
+#include <deque>
+
+// Uploads static data to default heap buffers on a dedicated copy queue.
+//
+// Copies are staged through one upload ring and recorded into a single copy
+// command list until Submit(), so any number of meshes go out as one batch.
+// Each batch signals the manager's own fence; the staging memory and command
+// allocator of a batch are recycled as soon as that fence completes, so
+// nothing has to be disposed by hand and the staging memory is bounded by the
+// uploads in flight rather than by everything ever loaded.
+//
+// Destination buffers must be in D3D12_RESOURCE_STATE_COMMON, as the page
+// buffers of GpuBufferAllocator are: the copy queue promotes them to
+// COPY_DEST and they decay back once the batch completes.  The copy queue
+// and the reading queue must not use a buffer at the same time, see
+// GpuBufferAllocator:
+//  - Data the reading queue has not read yet: that queue waits for the
+//    batch with MakeQueueWait() before its first read.
+//  - A buffer the reading queue reads in work still in flight: the batch
+//    waits on readerFence for the value passed to CopyBuffer() before it
+//    starts writing.
+// Both are GPU side waits and do not stall the CPU.
+//
+// Not thread safe; record and submit from one thread.
+class UploadManager
+{
+public:
+    // readerFence is signaled by the queue that reads the uploaded data.
+    UploadManager(ID3D12Device* device, UINT64 stagingSize, ID3D12Fence* readerFence);
+    UploadManager(const UploadManager& rhs) = delete;
+    UploadManager& operator=(const UploadManager& rhs) = delete;
+    // Waits for the outstanding copies.
+    ~UploadManager();
+
+    // Stages byteSize bytes of data and records a copy of them into dest at
+    // destOffset.  readFenceValue is the readerFence value after which no
+    // submitted work reads dest, 0 when none does.
+    void CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* data, UINT64 byteSize,
+        UINT64 readFenceValue = 0);
+
+    // Allocates a range from buffers and uploads data into it, after the
+    // reads of its page in flight.
+    GpuBufferAllocation UploadToBuffer(GpuBufferAllocator& buffers, const void* data, UINT64 byteSize,
+        UINT64 alignment = 256);
+
+    // Executes the copies recorded since the last Submit() on the copy queue.
+    // Returns the fence value signaled when they complete, or the value of
+    // the last batch when nothing was recorded.
+    UINT64 Submit();
+
+    // Makes queue wait on the GPU for every batch submitted so far.  Batches
+    // it already waited for are skipped, so this is cheap to call once per
+    // frame before queue executes anything.
+    void MakeQueueWait(ID3D12CommandQueue* queue);
+
+    bool IsComplete(UINT64 fenceValue)const;
+    // Blocks the CPU until every submitted batch has completed.
+    void WaitForIdle();
+
+    ID3D12CommandQueue* Queue()const { return mQueue.Get(); }
+    UINT64 StagingCapacity()const { return mStaging.Capacity(); }
+    UINT64 StagingUsedBytes()const { return mStaging.UsedBytes(); }
+    UINT64 PendingBytes()const { return mPendingBytes; }
+
+private:
+    struct Allocator
+    {
+        Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+        // Fence of the batch recorded with the allocator.
+        UINT64 FenceValue = 0;
+    };
+
+    void BeginBatch();
+    void Recycle();
+
+    ID3D12Device* mDevice = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> mQueue;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCmdList;
+    Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+    HANDLE mFenceEvent = nullptr;
+    UINT64 mFenceValue = 0;
+    UINT64 mWaitedFenceValue = 0;
+    ID3D12Fence* mReaderFence = nullptr;
+    // readerFence value the recording batch must wait for, 0 for none.
+    UINT64 mBatchReadFenceValue = 0;
+
+    UploadRingBuffer mStaging;
+    // Allocators of submitted batches, oldest first, and the one recording.
+    std::deque<Allocator> mAllocators;
+    Allocator mRecording;
+    bool mRecordingOpen = false;
+    UINT64 mPendingBytes = 0;
+};
@@ -0,0 +1,90 @@
+#include "UploadRingBuffer.h"
+#include <algorithm>
+
+UploadRingBuffer::UploadRingBuffer(ID3D12Device* device, UINT64 capacity) :
+    mDevice(device)
+{
+    // D3D12 rejects empty buffers.
+    CreateBuffer(std::max<UINT64>(capacity, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
+}
+
+UploadRingBuffer::~UploadRingBuffer()
+{
+    Release(mBuffer);
+    for(Buffer& buffer : mRetiredBuffers)
+        Release(buffer);
+}
+
+UploadAllocation UploadRingBuffer::Allocate(UINT64 byteSize, UINT64 alignment)
+{
+    // The ring hands out no empty ranges.
+    byteSize = std::max<UINT64>(byteSize, 1);
+    UINT64 offset = mRing.Allocate(byteSize, alignment);
+    if(offset == RingAllocator::InvalidOffset)
+    {
+        // Frames in flight may still read the current buffer, so it is kept
+        // until they complete and the ring restarts in a new, larger one.
+        mRetiredBuffers.push_back(mBuffer);
+        CreateBuffer(std::max<UINT64>(mRing.Capacity() * 2, byteSize + alignment));
+        offset = mRing.Allocate(byteSize, alignment);
+    }
+
+    UploadAllocation allocation;
+    allocation.CpuAddress = mBuffer.MappedData + offset;
+    allocation.GpuAddress = mBuffer.Resource->GetGPUVirtualAddress() + offset;
+    allocation.Resource = mBuffer.Resource.Get();
+    allocation.Offset = offset;
+    return allocation;
+}
+
+void UploadRingBuffer::FinishFrame(UINT64 fenceValue)
+{
+    mRing.FinishFrame(fenceValue);
+    for(Buffer& buffer : mRetiredBuffers)
+    {
+        if(buffer.FenceValue == 0)
+            buffer.FenceValue = fenceValue;
+    }
+}
+
+void UploadRingBuffer::Retire(UINT64 completedFenceValue)
+{
+    mRing.Retire(completedFenceValue);
+
+    auto done = std::remove_if(mRetiredBuffers.begin(), mRetiredBuffers.end(),
+        [completedFenceValue](Buffer& buffer)
+    {
+        if(buffer.FenceValue == 0 || buffer.FenceValue > completedFenceValue)
+            return false;
+        Release(buffer);
+        return true;
+    });
+    mRetiredBuffers.erase(done, mRetiredBuffers.end());
+}
+
+void UploadRingBuffer::CreateBuffer(UINT64 capacity)
+{
+    Buffer buffer;
+    ThrowIfFailed(mDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(capacity),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&buffer.Resource)));
+
+    // Upload heap memory stays mapped for the lifetime of the buffer.
+    ThrowIfFailed(buffer.Resource->Map(0, nullptr, reinterpret_cast<void**>(&buffer.MappedData)));
+
+    mBuffer = buffer;
+    mRing.Reset(capacity);
+}
+
+void UploadRingBuffer::Release(Buffer& buffer)
+{
+    if(buffer.Resource != nullptr)
+        buffer.Resource->Unmap(0, nullptr);
+
+    buffer.Resource = nullptr;
+    buffer.MappedData = nullptr;
+}
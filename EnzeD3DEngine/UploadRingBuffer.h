@@ -0,0 +1,70 @@
+#pragma once
+#include "d3dUtil.h"
+#include "RingAllocator.h"
+
+struct UploadAllocation
+{
+    BYTE* CpuAddress = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+    // Buffer and offset of the allocation, for copies out of it.
+    ID3D12Resource* Resource = nullptr;
+    UINT64 Offset = 0;
+};
+
+// One persistently mapped upload heap buffer that per-frame constant and
+// structured data is suballocated from.  Suballocations are 256-byte aligned
+// by default so any of them can back a root CBV, and are valid until the GPU
+// has finished the frame they were made for: call FinishFrame() with the
+// fence value signaled after the frame's work, and Retire() with the
+// completed fence value before allocating for a new frame.
+//
+// When the ring is full the buffer grows to twice its size (or more, for a
+// large request).  The old buffer is released once the frames that used it
+// have completed, so addresses handed out earlier stay valid.
+class UploadRingBuffer
+{
+public:
+    UploadRingBuffer(ID3D12Device* device, UINT64 capacity);
+    UploadRingBuffer(const UploadRingBuffer& rhs) = delete;
+    UploadRingBuffer& operator=(const UploadRingBuffer& rhs) = delete;
+    ~UploadRingBuffer();
+
+    // A zero-byte request still gets an aligned address inside the buffer,
+    // so it can be bound like any other.
+    UploadAllocation Allocate(UINT64 byteSize,
+        UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+
+    // Allocates and copies count elements; returns their GPU address.
+    template<typename T>
+    D3D12_GPU_VIRTUAL_ADDRESS Upload(const T* data, size_t count)
+    {
+        UploadAllocation allocation = Allocate(sizeof(T) * count);
+        if(count != 0)
+            memcpy(allocation.CpuAddress, data, sizeof(T) * count);
+        return allocation.GpuAddress;
+    }
+
+    void FinishFrame(UINT64 fenceValue);
+    void Retire(UINT64 completedFenceValue);
+
+    UINT64 Capacity()const { return mRing.Capacity(); }
+    UINT64 UsedBytes()const { return mRing.UsedBytes(); }
+
+private:
+    struct Buffer
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+        BYTE* MappedData = nullptr;
+        // Fence of the last frame that used the buffer, 0 while that frame
+        // is still being recorded.
+        UINT64 FenceValue = 0;
+    };
+
+    void CreateBuffer(UINT64 capacity);
+    static void Release(Buffer& buffer);
+
+    ID3D12Device* mDevice = nullptr;
+    Buffer mBuffer;
+    RingAllocator mRing;
+    std::vector<Buffer> mRetiredBuffers;
+};
@@ -2,15 +2,16 @@
 #include "stdafx.h"
 #include "DXSampleHelper.h"
 #include "MathHelper.h"
+#include "RenderTypes.h"
 
-const int gNumFrameResources = 3;
+// Frames the CPU may work ahead of the GPU, unless -frames N asks for
+// another count between 1 and gMaxFramesInFlight.  The swap chain has
+// gMaxFramesInFlight back buffers, so every frame in flight can hold one.
+const UINT gDefaultFramesInFlight = 3;
+const UINT gMaxFramesInFlight = 4;
 
-struct SubmeshGeometry
-{
-	UINT IndexCount = 0;
-	UINT StartIndexLocation = 0;
-	INT BaseVertexLocation = 0;
-};
+static_assert(PrimitiveTopologyTriangleList == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+    "PrimitiveTopologyTriangleList must match D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST");
 
 struct MeshGeometry
 {
@@ -25,8 +26,10 @@ struct MeshGeometry
 	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferGPU = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferGPU = nullptr;
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
-	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
+	// Where the data starts in the GPU buffers, which may be ranges of a
+	// larger buffer shared with other geometry.
+	UINT64 VertexBufferOffset = 0;
+	UINT64 IndexBufferOffset = 0;
 
     // Data about the buffers.
 	UINT VertexByteStride = 0;
@@ -42,7 +45,7 @@ struct MeshGeometry
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
 	{
 		D3D12_VERTEX_BUFFER_VIEW vbv;
-		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress();
+		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress() + VertexBufferOffset;
 		vbv.StrideInBytes = VertexByteStride;
 		vbv.SizeInBytes = VertexBufferByteSize;
 
@@ -52,19 +55,12 @@ struct MeshGeometry
 	D3D12_INDEX_BUFFER_VIEW IndexBufferView()const
 	{
         D3D12_INDEX_BUFFER_VIEW ibv;
-		ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress();
+		ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress() + IndexBufferOffset;
 		ibv.Format = IndexFormat;
 		ibv.SizeInBytes = IndexBufferByteSize;
 
 		return ibv;
 	}
-
-	// We can free this memory after we finish upload to the GPU.
-	void DisposeUploaders()
-	{
-		VertexBufferUploader = nullptr;
-		IndexBufferUploader = nullptr;
-	}
 };
 struct Light
 {
@@ -89,34 +85,6 @@ struct MaterialConstants
 	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4X4();
 };
 
-// Simple struct to represent a material for our demos.  A production 3D engine
-// would likely create a class hierarchy of Materials.
-struct Material
-{
-	// Unique material name for lookup.
-	std::string Name;
-
-	// Index into constant buffer corresponding to this material.
-	int MatCBIndex = -1;
-
-	// Index into SRV heap for diffuse texture.
-	int DiffuseSrvHeapIndex = -1;
-
-	// Index into SRV heap for normal texture.
-	int NormalSrvHeapIndex = -1;
-
-	// Dirty flag indicating the material has changed and we need to update the constant buffer.
-	// Because we have a material constant buffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify a material we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
-	// Material constant buffer data used for shading.
-	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
-	DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
-	float Roughness = .25f;
-	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4X4();
-};
 class d3dUtil
 {
     public:
@@ -29,11 +29,100 @@ struct Material
     float Shininess;
 
 };
-cbuffer cbPerObject : register(b0)
+// First element of the current batch in gInstances.
+cbuffer cbPerDraw : register(b0)
 {
-	float4x4 WorldMatrix; 
+    uint gInstanceOffset;
 };
 
+// Layout of gObjects, one of ObjectFormat in ObjectPacking.h.  EnzeApp
+// defines it when compiling.
+#ifndef OBJECT_FORMAT
+    #define OBJECT_FORMAT 0
+#endif
+
+#if OBJECT_FORMAT == 1
+// The first three columns of the world matrix.
+struct ObjectData
+{
+    float4 Columns[3];
+};
+
+float4x4 DecodeWorld(ObjectData o)
+{
+    return transpose(float4x4(o.Columns[0], o.Columns[1], o.Columns[2], float4(0.f, 0.f, 0.f, 1.f)));
+}
+#elif OBJECT_FORMAT == 2
+// Rows 0-2 as 9 halves in row-major order, and the translation.
+struct ObjectData
+{
+    float3 Translation;
+    uint Linear[5];
+};
+
+float HalfAt(ObjectData o, uint k)
+{
+    return f16tof32(o.Linear[k / 2] >> (16 * (k % 2)));
+}
+
+float4x4 DecodeWorld(ObjectData o)
+{
+    return float4x4(
+        HalfAt(o, 0), HalfAt(o, 1), HalfAt(o, 2), 0.f,
+        HalfAt(o, 3), HalfAt(o, 4), HalfAt(o, 5), 0.f,
+        HalfAt(o, 6), HalfAt(o, 7), HalfAt(o, 8), 0.f,
+        o.Translation, 1.f);
+}
+#elif OBJECT_FORMAT == 3
+// Translation, snorm16 rotation quaternion and half scale.
+struct ObjectData
+{
+    float3 Translation;
+    uint2 Rotation;
+    uint2 Scale;
+};
+
+float4x4 DecodeWorld(ObjectData o)
+{
+    // Sign-extend the 16-bit halves.
+    int2 low = int2(o.Rotation << 16) >> 16;
+    int2 high = int2(o.Rotation) >> 16;
+    float4 q = normalize(max(float4(low.x, high.x, low.y, high.y) / 32767.f, -1.f));
+    float3 s = f16tof32(uint3(o.Scale.x, o.Scale.x >> 16, o.Scale.y));
+
+    // Scale, then rotate: the rows of the quaternion's rotation matrix
+    // times the scale factors.
+    float3 r0 = float3(1.f - 2.f * (q.y * q.y + q.z * q.z), 2.f * (q.x * q.y + q.z * q.w), 2.f * (q.x * q.z - q.y * q.w));
+    float3 r1 = float3(2.f * (q.x * q.y - q.z * q.w), 1.f - 2.f * (q.x * q.x + q.z * q.z), 2.f * (q.y * q.z + q.x * q.w));
+    float3 r2 = float3(2.f * (q.x * q.z + q.y * q.w), 2.f * (q.y * q.z - q.x * q.w), 1.f - 2.f * (q.x * q.x + q.y * q.y));
+    return float4x4(
+        float4(s.x * r0, 0.f),
+        float4(s.y * r1, 0.f),
+        float4(s.z * r2, 0.f),
+        float4(o.Translation, 1.f));
+}
+#else
+// The transposed world matrix.
+struct ObjectData
+{
+    float4x4 WorldMatrix;
+};
+
+float4x4 DecodeWorld(ObjectData o)
+{
+    return o.WorldMatrix;
+}
+#endif
+
+struct InstanceData
+{
+    uint ObjectIndex;
+    uint MaterialIndex;
+};
+
+StructuredBuffer<ObjectData> gObjects : register(t0);
+StructuredBuffer<InstanceData> gInstances : register(t1);
+
 cbuffer cbPerPass : register(b1)
 {
         float4x4 ViewMatrix;
@@ -53,7 +142,8 @@ cbuffer cbPerPass : register(b1)
         Light Lights[MAXLIGHTNUM];
 };
 
-cbuffer cbPerMaterial: register(b2)
+// The material table, indexed by InstanceData::MaterialIndex.
+struct MaterialData
 {
     float4 DiffuseAlbedo;
     float3 FresnelR0;
@@ -61,23 +151,28 @@ cbuffer cbPerMaterial: register(b2)
     float4x4 MatTransform;
 };
 
+StructuredBuffer<MaterialData> gMaterials : register(t2);
+
 struct PSInput
 {
     float4 position : SV_POSITION;
     float3 normal : NORMAL;
     float3 positionWorld: POSITION;
-    
+    nointerpolation uint materialIndex : MATERIAL;
 };
 
 // 由于HLSL 是列向量乘法，所以vector都是在前的。同时也是为什么要先乘世界矩阵
 // 再处理投影矩阵的原因
-PSInput VSMain(float3 position : POSITION, float3 normal : NORMAL)
+PSInput VSMain(float3 position : POSITION, float3 normal : NORMAL, uint instanceID : SV_InstanceID)
 {
     PSInput result;
+    InstanceData instance = gInstances[gInstanceOffset + instanceID];
+    float4x4 WorldMatrix = DecodeWorld(gObjects[instance.ObjectIndex]);
     float4 tempPosition = mul(float4(position, 1.0f), WorldMatrix);
     result.position = mul(tempPosition, ViewProj);
     result.normal = normal;
     result.positionWorld = tempPosition.xyz;
+    result.materialIndex = instance.MaterialIndex;
     return result;
 }
 
@@ -126,6 +221,8 @@ float3 reflectionCalculation(Light L[MAXLIGHTNUM], Material mat, float3 toEye, f
 
 float4 PSMain(PSInput input) : SV_TARGET
 {
+    MaterialData material = gMaterials[input.materialIndex];
+    float4 DiffuseAlbedo = material.DiffuseAlbedo;
     //线性插值可能让其大于1
     float3 NormalW = normalize(input.normal);
     float3 toEye = normalize(EyePosW - input.positionWorld);
@@ -135,8 +232,8 @@ float4 PSMain(PSInput input) : SV_TARGET
     float4 ambient = AmbientLight * DiffuseAlbedo;
     // 下面来计算diffusion
     float4 diffusion = diffusionCalCulation(Lights, DiffuseAlbedo, NormalW);
-    float Shininess = 1.f - Roughness;
-    Material current = { DiffuseAlbedo, FresnelR0, Shininess };
+    float Shininess = 1.f - material.Roughness;
+    Material current = { DiffuseAlbedo, material.FresnelR0, Shininess };
     float3 reflection = reflectionCalculation(Lights, current, toEye, NormalW);
     float3 result = ambient.xyz + diffusion.xyz + reflection;
     // 下面就是开始计算 反射光，包含微表面模型了